@@ -0,0 +1,592 @@
+#include <benchmark/benchmark.h>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <nlohmann/json.hpp>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <memory>
+
+#include "../include/psdik.h"
+#include "psdik_client.h"
+
+using json = nlohmann::json;
+
+// Бенчмарки горячих путей сервера: обновление кэша, сериализация,
+// копирование истории, рассылка подписчикам и разбор запросов.
+// Запуск с машиночитаемым выводом: make bench (см. bench/CMakeLists.txt)
+
+namespace {
+
+// Общий кэш для многопоточных бенчмарков
+std::unique_ptr<DataCache> sharedCache;
+
+void fillCache(DataCache& cache, int64_t tagCount, int historyDepth = 1) {
+    for (int h = 0; h < historyDepth; ++h) {
+        for (int64_t id = 1; id <= tagCount; ++id) {
+            cache.updateValue(id, "Var" + std::to_string(id), static_cast<double>(id + h), "good");
+        }
+    }
+}
+
+void setupSharedCache(const benchmark::State& state) {
+    Logger::getInstance().setLevel(Logger::ERROR);
+    sharedCache = std::make_unique<DataCache>();
+    fillCache(*sharedCache, state.range(0));
+}
+
+void teardownSharedCache(const benchmark::State&) {
+    sharedCache.reset();
+}
+
+// Конфигурация с заданным количеством переменных Modbus
+json makeConfig(int64_t tagCount) {
+    json variables = json::object();
+    for (int64_t i = 1; i <= tagCount; ++i) {
+        variables["var" + std::to_string(i)] = {
+            {"id", i},
+            {"name", "Var" + std::to_string(i)},
+            {"address", i},
+            {"type", "float32"}
+        };
+    }
+    return {
+        {"modbus_tcp", {
+            {"connection_parameters", {
+                {"primary", {{"host", "localhost"}, {"port", 502}}}
+            }},
+            {"variables", variables},
+            {"polling_interval_ms", 100}
+        }}
+    };
+}
+
+// Самоподписанный сертификат ECDSA P-256 для TLS-порта
+void writeSelfSignedCertificate(const std::string& certFile, const std::string& keyFile) {
+    EVP_PKEY* key = EVP_PKEY_Q_keygen(nullptr, nullptr, "EC", "P-256");
+    X509* certificate = X509_new();
+    X509_set_version(certificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 86400);
+    X509_set_pubkey(certificate, key);
+    X509_NAME* name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(certificate, name);
+    X509_sign(certificate, key, EVP_sha256());
+
+    FILE* file = std::fopen(certFile.c_str(), "w");
+    PEM_write_X509(file, certificate);
+    std::fclose(file);
+    file = std::fopen(keyFile.c_str(), "w");
+    PEM_write_PrivateKey(file, key, nullptr, nullptr, 0, nullptr, nullptr);
+    std::fclose(file);
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+}
+
+// TCP-сервер с выбранным сетевым циклом для сравнения asio и io_uring
+std::unique_ptr<DataServer> tcpServer;
+std::thread tcpServerThread;
+const std::string tcpConfigFile = "bench_network_config.json";
+const std::string tlsCertFile = "bench_tls.pem";
+const std::string tlsKeyFile = "bench_tls.key";
+
+void startTcpServer(const std::string& backend, bool tls = false) {
+    Logger::getInstance().setLevel(Logger::ERROR);
+    json settings = {{"tcp_port", 0}, {"network", {{"backend", backend}}}};
+    if (tls) {
+        writeSelfSignedCertificate(tlsCertFile, tlsKeyFile);
+        settings["tls"] = {{"enabled", true}, {"port", 0}, {"cert_file", tlsCertFile}, {"key_file", tlsKeyFile}};
+    }
+    {
+        std::ofstream f(tcpConfigFile);
+        f << json({{"server_settings", settings}}).dump();
+    }
+    tcpServer = std::make_unique<DataServer>();
+    tcpServer->loadConfig(tcpConfigFile);
+    tcpServer->startPolling();
+    tcpServerThread = std::thread([]() { tcpServer->startTcpServer(); });
+    while (tcpServer->tcpPort() == 0 || (tls && tcpServer->tlsPort() == 0)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void setupTcpServer(const benchmark::State& state) {
+    startTcpServer(state.range(0) == 1 ? "io_uring" : "asio");
+}
+
+void setupClientServer(const benchmark::State&) {
+    startTcpServer("asio");
+}
+
+void setupTlsServer(const benchmark::State&) {
+    startTcpServer("asio", true);
+}
+
+void teardownTcpServer(const benchmark::State&) {
+    tcpServer->stop();
+    tcpServerThread.join();
+    tcpServer.reset();
+    std::remove(tcpConfigFile.c_str());
+    std::remove(tlsCertFile.c_str());
+    std::remove(tlsKeyFile.c_str());
+}
+
+} // namespace
+
+// Обновление значений: количество тегов x количество потоков-опросчиков
+static void BM_DataCacheUpdate(benchmark::State& state) {
+    const int64_t tagCount = state.range(0);
+    int64_t id = 1 + state.thread_index();
+    double value = 0.0;
+    const std::string name = "Var";
+
+    for (auto _ : state) {
+        sharedCache->updateValue(id, name, value, "good");
+        id = (id % tagCount) + 1;
+        value += 1.0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DataCacheUpdate)
+    ->ArgName("tags")
+    ->Arg(100)->Arg(10000)->Arg(100000)
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Setup(setupSharedCache)
+    ->Teardown(teardownSharedCache);
+
+// Запись опросчиками собственных переменных с закреплением потоков по узлам NUMA
+// (pinned:1) и без него (pinned:0)
+static void BM_DataCacheUpdatePinned(benchmark::State& state) {
+    const int64_t tagsPerThread = state.range(0) / state.threads();
+    const bool pinned = state.range(1) != 0;
+    if (pinned) {
+        auto nodes = ThreadPlacement::numaNodes();
+        ThreadPlacement::pinCurrentThread(nodes[static_cast<size_t>(state.thread_index()) % nodes.size()]);
+    }
+    
+    const int64_t firstId = 1 + state.thread_index() * tagsPerThread;
+    int64_t offset = 0;
+    double value = 0.0;
+    const std::string name = "Var";
+    for (auto _ : state) {
+        sharedCache->updateValue(firstId + offset, name, value, "good");
+        offset = (offset + 1) % tagsPerThread;
+        value += 1.0;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(pinned ? "pinned" : "unpinned");
+    
+    if (pinned) {
+        std::vector<int> all(std::thread::hardware_concurrency());
+        std::iota(all.begin(), all.end(), 0);
+        ThreadPlacement::pinCurrentThread(all);
+    }
+}
+BENCHMARK(BM_DataCacheUpdatePinned)
+    ->ArgNames({"tags", "pinned"})
+    ->ArgsProduct({{10000}, {0, 1}})
+    ->ThreadRange(2, 8)
+    ->UseRealTime()
+    ->Setup(setupSharedCache)
+    ->Teardown(teardownSharedCache);
+
+// Снимок всех текущих значений и его сериализация (GET_ALL)
+static void BM_GetAllCurrentValues(benchmark::State& state) {
+    Logger::getInstance().setLevel(Logger::ERROR);
+    DataCache cache;
+    fillCache(cache, state.range(0));
+
+    size_t bytes = 0;
+    for (auto _ : state) {
+        std::string response = cache.getAllCurrentValues().dump() + "\n";
+        bytes += response.size();
+        benchmark::DoNotOptimize(response.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GetAllCurrentValues)
+    ->ArgName("tags")
+    ->Arg(100)->Arg(10000)->Arg(100000)
+    ->Unit(benchmark::kMicrosecond);
+
+// Чтение GET_ALL под нагрузкой записи: конкуренция читателей за мьютекс кэша
+static void BM_GetAllUnderContention(benchmark::State& state) {
+    const int64_t tagCount = state.range(0);
+    if (state.thread_index() == 0) {
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(sharedCache->getAllCurrentValues());
+        }
+    } else {
+        int64_t id = 1;
+        for (auto _ : state) {
+            sharedCache->updateValue(id, "Var", 1.0, "good");
+            id = (id % tagCount) + 1;
+        }
+    }
+}
+BENCHMARK(BM_GetAllUnderContention)
+    ->ArgName("tags")
+    ->Arg(1000)->Arg(10000)
+    ->ThreadRange(2, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond)
+    ->Setup(setupSharedCache)
+    ->Teardown(teardownSharedCache);
+
+// Копирование истории одной переменной (GET_HISTORY)
+static void BM_GetHistory(benchmark::State& state) {
+    Logger::getInstance().setLevel(Logger::ERROR);
+    DataCache cache;
+    fillCache(cache, 10, 100);
+    const auto count = static_cast<size_t>(state.range(0));
+
+    for (auto _ : state) {
+        auto history = cache.getHistory(5, count);
+        benchmark::DoNotOptimize(history.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GetHistory)
+    ->ArgName("count")
+    ->Arg(10)->Arg(100);
+
+// Публикация обновления в кольцо рассылки: количество клиентов на одну переменную
+// (запись в сокеты выполняют потоки сессий подписчиков)
+static void BM_NotifySubscribers(benchmark::State& state) {
+    using boost::asio::ip::tcp;
+    Logger::getInstance().setLevel(Logger::ERROR);
+
+    const int clientCount = static_cast<int>(state.range(0));
+    const int64_t varId = 1;
+
+    // io_context объявлен первым: сокеты подписчиков должны разрушаться раньше него
+    boost::asio::io_context io;
+    DataCache cache;
+    cache.updateValue(varId, "Var1", 0.0, "good");
+    SubscriptionManager manager(cache);
+
+    tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+    // Клиенты вычитывают данные, чтобы не заполнялись буферы сокетов
+    std::vector<std::unique_ptr<tcp::socket>> clients;
+    std::vector<std::thread> drainers;
+    for (int i = 0; i < clientCount; ++i) {
+        auto client = std::make_unique<tcp::socket>(io);
+        client->connect(acceptor.local_endpoint());
+        tcp::socket serverSide(io);
+        acceptor.accept(serverSide);
+        manager.addSubscriber(varId, std::move(serverSide));
+
+        drainers.emplace_back([sock = client.get()]() {
+            char buf[65536];
+            boost::system::error_code ec;
+            while (!ec) {
+                sock->read_some(boost::asio::buffer(buf), ec);
+            }
+        });
+        clients.push_back(std::move(client));
+    }
+
+    json value = 42.5;
+    for (auto _ : state) {
+        manager.notifySubscribers(varId, value);
+    }
+    state.SetItemsProcessed(state.iterations() * clientCount);
+
+    for (auto& client : clients) {
+        boost::system::error_code ec;
+        client->shutdown(tcp::socket::shutdown_both, ec);
+    }
+    for (auto& t : drainers) t.join();
+}
+BENCHMARK(BM_NotifySubscribers)
+    ->ArgName("clients")
+    ->Arg(1)->Arg(10)->Arg(100)
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+// Агрегация ряда по интервалам и прореживание LTTB: количество точек ряда
+static void BM_HistoryAggregation(benchmark::State& state) {
+    HistorySeries series;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        series.timestamps.push_back(i * 100);
+        series.values.push_back(static_cast<double>(i % 97));
+    }
+    const bool downsample = state.range(1) != 0;
+
+    for (auto _ : state) {
+        if (downsample) {
+            benchmark::DoNotOptimize(HistoryAggregator::downsample(series, 300));
+        } else {
+            benchmark::DoNotOptimize(HistoryAggregator::aggregate(series, 60000));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetLabel(downsample ? "lttb" : "buckets");
+}
+BENCHMARK(BM_HistoryAggregation)
+    ->ArgNames({"points", "lttb"})
+    ->ArgsProduct({{1000, 100000}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+// Вычисление скомпилированного выражения вычисляемой переменной: количество входов
+static void BM_ExpressionEvaluate(benchmark::State& state) {
+    std::string text = "($1";
+    for (int64_t i = 2; i <= state.range(0); ++i) text += " + $" + std::to_string(i);
+    text += ") / " + std::to_string(state.range(0)) + " > 50 && max($1, $2) < 100";
+    auto expression = Expression::compile(text);
+    
+    std::vector<double> values(expression.inputs().size(), 42.0);
+    std::vector<double> stack;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(expression.evaluate(values.data(), stack));
+        values[0] += 1.0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ExpressionEvaluate)
+    ->ArgName("inputs")
+    ->Arg(2)->Arg(16);
+
+// Разбор JSON-запроса и его обработка в handleJsonRequest
+static void BM_HandleJsonRequest(benchmark::State& state) {
+    Logger::getInstance().setLevel(Logger::ERROR);
+    const std::string configFile = "bench_config.json";
+    {
+        std::ofstream f(configFile);
+        f << makeConfig(state.range(0)).dump(4);
+    }
+
+    DataServer server;
+    server.loadConfig(configFile);
+
+    const std::string requests[] = {
+        R"({"action": "get_all"})",
+        R"({"action": "get_history", "variable_id": 1, "count": 10})",
+        R"({"action": "get_id_map"})",
+        R"({"action": "get_values", "names": ["Var1*"]})"
+    };
+    const std::string& request = requests[state.range(1)];
+
+    for (auto _ : state) {
+        json response = server.handleJsonRequest(json::parse(request));
+        std::string responseStr = response.dump() + "\n";
+        benchmark::DoNotOptimize(responseStr.data());
+    }
+    state.SetLabel(request);
+
+    std::remove(configFile.c_str());
+}
+BENCHMARK(BM_HandleJsonRequest)
+    ->ArgNames({"tags", "request"})
+    ->ArgsProduct({{100, 10000}, {0, 1, 2, 3}})
+    ->Unit(benchmark::kMicrosecond);
+
+// Старт сервера: загрузка конфигурации с количеством тегов, с кэшем базы тегов и без него
+static void BM_LoadConfig(benchmark::State& state) {
+    Logger::getInstance().setLevel(Logger::ERROR);
+    const std::string configFile = "bench_load_config.json";
+    const std::string cacheFile = configFile + ".tagdb";
+    const bool useCache = state.range(1) != 0;
+    {
+        std::ofstream f(configFile);
+        f << makeConfig(state.range(0)).dump(4);
+    }
+    std::remove(cacheFile.c_str());
+    if (useCache) {
+        // Первый запуск компилирует базу тегов
+        DataServer server;
+        server.setTagCacheFile(cacheFile);
+        server.loadConfig(configFile);
+    }
+
+    for (auto _ : state) {
+        DataServer server;
+        if (useCache) server.setTagCacheFile(cacheFile);
+        server.loadConfig(configFile);
+        benchmark::DoNotOptimize(server.loadedFromTagCache());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+
+    std::remove(configFile.c_str());
+    std::remove(cacheFile.c_str());
+}
+BENCHMARK(BM_LoadConfig)
+    ->ArgNames({"tags", "cache"})
+    ->ArgsProduct({{10000, 200000}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// Полный путь текстовой команды через handleTcpClient: разбор, выборка, ответ
+static void BM_HandleTcpClient(benchmark::State& state) {
+    using boost::asio::ip::tcp;
+    Logger::getInstance().setLevel(Logger::ERROR);
+
+    DataServer server;
+    boost::asio::io_context io;
+    tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+    const std::string requests[] = {
+        "GET_HISTORY 4611686018427387904 100\n",
+        "GET_ALL\n"
+    };
+    const std::string& request = requests[state.range(0)];
+
+    boost::asio::streambuf response;
+    for (auto _ : state) {
+        tcp::socket client(io);
+        client.connect(acceptor.local_endpoint());
+        boost::asio::write(client, boost::asio::buffer(request));
+
+        tcp::socket serverSide(io);
+        acceptor.accept(serverSide);
+        server.handleTcpClient(std::move(serverSide));
+
+        boost::asio::read_until(client, response, '\n');
+        response.consume(response.size());
+    }
+    state.SetLabel(request.substr(0, request.size() - 1));
+}
+BENCHMARK(BM_HandleTcpClient)
+    ->ArgName("request")
+    ->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+
+// Запрос-ответ через TCP-сервер целиком: соединение, JSON-запрос, ответ, закрытие.
+// backend:0 - потоки asio на соединение, backend:1 - кольцо io_uring (ENABLE_IO_URING)
+static void BM_TcpServerRequest(benchmark::State& state) {
+    using boost::asio::ip::tcp;
+    const std::string backend = state.range(0) == 1 ? "io_uring" : "asio";
+    if (tcpServer->handleJsonRequest({{"action", "get_network_metrics"}})["backend"] != backend) {
+        state.SkipWithError("io_uring backend is not available");
+        return;
+    }
+
+    boost::asio::io_context io;
+    const tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), tcpServer->tcpPort());
+    const std::string request = "{\"action\": \"get_alarms\"}\n";
+    boost::asio::streambuf response;
+    for (auto _ : state) {
+        tcp::socket client(io);
+        client.connect(endpoint);
+        boost::asio::write(client, boost::asio::buffer(request));
+        boost::asio::read_until(client, response, '\n');
+        response.consume(response.size());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(backend);
+}
+BENCHMARK(BM_TcpServerRequest)
+    ->ArgName("backend")
+    ->Arg(0)->Arg(1)
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Setup(setupTcpServer)
+    ->Teardown(teardownTcpServer)
+    ->Unit(benchmark::kMicrosecond);
+
+// Запросы клиентской библиотеки: encoding:0 - JSON-строка по соединению на запрос,
+// encoding:1 - кадры MessagePack по постоянному соединению; depth - запросов без ожидания ответа
+static void BM_ClientRequest(benchmark::State& state) {
+    DataClient::Settings settings;
+    settings.port = tcpServer->tcpPort();
+    settings.poolSize = 1;
+    settings.binary = state.range(0) == 1;
+    DataClient client(settings);
+    const json request = {{"action", "get_alarms"}};
+    const auto depth = static_cast<size_t>(state.range(1));
+
+    std::vector<std::future<json>> responses;
+    for (auto _ : state) {
+        for (size_t i = 0; i < depth; ++i) responses.push_back(client.requestAsync(request));
+        for (auto& response : responses) benchmark::DoNotOptimize(response.get());
+        responses.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    state.SetLabel(client.metrics()["encoding"].get<std::string>());
+}
+BENCHMARK(BM_ClientRequest)
+    ->ArgNames({"encoding", "depth"})
+    ->ArgsProduct({{0, 1}, {1, 16}})
+    ->Setup(setupClientServer)
+    ->Teardown(teardownTcpServer)
+    ->Unit(benchmark::kMicrosecond);
+
+// Кадры MessagePack по постоянному соединению: transport:0 - открытый порт, transport:1 - TLS;
+// depth - запросов без ожидания ответа
+static void BM_ClientTransport(benchmark::State& state) {
+    DataClient::Settings settings;
+    settings.poolSize = 1;
+    settings.tls = state.range(0) == 1;
+    settings.port = settings.tls ? tcpServer->tlsPort() : tcpServer->tcpPort();
+    settings.caFile = tlsCertFile;
+    settings.serverName = "localhost";
+    DataClient client(settings);
+    const json request = {{"action", "get_alarms"}};
+    const auto depth = static_cast<size_t>(state.range(1));
+
+    std::vector<std::future<json>> responses;
+    for (auto _ : state) {
+        for (size_t i = 0; i < depth; ++i) responses.push_back(client.requestAsync(request));
+        for (auto& response : responses) benchmark::DoNotOptimize(response.get());
+        responses.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    state.SetLabel(settings.tls ? "tls" : "plaintext");
+}
+BENCHMARK(BM_ClientTransport)
+    ->ArgNames({"transport", "depth"})
+    ->ArgsProduct({{0, 1}, {1, 16}})
+    ->UseRealTime()
+    ->Setup(setupTlsServer)
+    ->Teardown(teardownTcpServer)
+    ->Unit(benchmark::kMicrosecond);
+
+// Новое соединение TLS с одним запросом и закрытием: resume:0 - полное рукопожатие,
+// resume:1 - возобновление по билету первого соединения
+static void BM_TlsHandshake(benchmark::State& state) {
+    namespace ssl = boost::asio::ssl;
+    ssl::context context(ssl::context::tls_client);
+    context.load_verify_file(tlsCertFile);
+    context.set_verify_mode(ssl::verify_peer);
+    SSL_CTX_set_session_cache_mode(context.native_handle(), SSL_SESS_CACHE_CLIENT);
+    io_context io;
+    const ip::tcp::endpoint endpoint(ip::address_v4::loopback(), tcpServer->tlsPort());
+    const std::string request = "{\"action\": \"get_alarms\"}\n";
+    SSL_SESSION* session = nullptr;
+    int64_t resumed = 0;
+    for (auto _ : state) {
+        ssl::stream<ip::tcp::socket> stream(io, context);
+        stream.next_layer().connect(endpoint);
+        stream.next_layer().set_option(ip::tcp::no_delay(true));
+        if (session) SSL_set_session(stream.native_handle(), session);
+        stream.handshake(ssl::stream_base::client);
+        write(stream, boost::asio::buffer(request));
+        std::string response;
+        read_until(stream, boost::asio::dynamic_buffer(response), '\n');
+        resumed += SSL_session_reused(stream.native_handle());
+        // Билет TLS 1.3 получен вместе с ответом; как и клиент, используется последний
+        if (state.range(0) == 1) {
+            if (session) SSL_SESSION_free(session);
+            session = SSL_get1_session(stream.native_handle());
+        }
+        // close_notify: сессия закрытого соединения остается возобновляемой
+        boost::system::error_code ignored;
+        stream.shutdown(ignored);
+    }
+    if (session) SSL_SESSION_free(session);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["resumed"] = benchmark::Counter(static_cast<double>(resumed), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_TlsHandshake)
+    ->ArgName("resume")
+    ->DenseRange(0, 1)
+    ->UseRealTime()
+    ->Setup(setupTlsServer)
+    ->Teardown(teardownTcpServer)
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <nlohmann/json.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using json = nlohmann::json;
+
+// Клиент data_server: пул постоянных соединений с кадрами MessagePack (команда BINARY),
+// конвейер асинхронных запросов, подписки с автоматическим восстановлением
+// и локальный кэш карты ID -> имя (get_id_map).
+// Сервер без поддержки кадров обслуживается JSON-строками, по соединению на запрос.
+// Через TLS-порт сервера запросы передаются так же конвейером,
+// новые соединения возобновляют сессию TLS предыдущих.
+class DataClient {
+public:
+    struct Settings {
+        std::string host = "127.0.0.1";
+        unsigned short port = 8080;
+        size_t poolSize = 4;                                // Постоянных соединений для запросов
+        bool binary = true;                                 // false - только JSON-строки
+        std::chrono::milliseconds reconnectDelay{500};      // Пауза перед восстановлением подписки
+        std::chrono::milliseconds idMapTtl{60000};          // Время жизни кэша get_id_map
+        // TLS-порт сервера (server_settings.tls)
+        bool tls = false;
+        std::string caFile;                                 // Сертификаты для проверки сервера
+        std::string certFile;                               // Сертификат и ключ клиента (mTLS)
+        std::string keyFile;
+        std::string serverName;                             // SNI и проверка имени; пусто - проверяется адрес host
+        std::string token;                                  // Токен записи (команда AUTH)
+        
+        // host, port, pool_size, encoding ("msgpack" | "json"), reconnect_delay_ms, id_map_ttl_ms,
+        // tls: {enabled, ca_file, cert_file, key_file, server_name, token}
+        static Settings fromJson(const json& settings);
+    };
+    
+    using IdMap = std::unordered_map<int64_t, std::string>;
+    using UpdateHandler = std::function<void(int64_t id, const std::string& name, const json& value,
+                                             int64_t timestampMs)>;
+    
+    explicit DataClient(Settings settings);
+    ~DataClient();
+    DataClient(const DataClient&) = delete;
+    DataClient& operator=(const DataClient&) = delete;
+    
+    // Запрос через соединение пула; ответы соединения приходят в порядке отправки,
+    // поэтому несколько запросов передаются без ожидания ответов
+    std::future<json> requestAsync(const json& request);
+    json request(const json& request) { return requestAsync(request).get(); }
+    json getValues(const std::vector<int64_t>& ids);
+    
+    // Карта ID -> имя; повторный запрос к серверу - по истечении idMapTtl или при refresh
+    std::shared_ptr<const IdMap> idMap(bool refresh = false);
+    // ID по имени из кэша карты
+    std::optional<int64_t> findId(const std::string& name);
+    
+    // Подписка на обновления ID в собственном потоке; после обрыва соединения
+    // подписка восстанавливается через reconnectDelay. Возвращает ключ для unsubscribe
+    uint64_t subscribe(int64_t id, UpdateHandler handler);
+    void unsubscribe(uint64_t token);
+    
+    // Кодировка запросов, число запросов, переподключений и восстановленных подписок,
+    // рукопожатия TLS (всего и возобновленных)
+    json metrics() const;
+
+private:
+    using TlsStream = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+    
+    // Постоянное соединение пула: запись кадров и очередь ожидающих ответов - под mutex,
+    // ответы читает собственный поток
+    struct Connection {
+        std::mutex mutex;
+        std::unique_ptr<boost::asio::ip::tcp::socket> socket;
+        std::deque<std::promise<json>> pending;
+        std::thread reader;
+        bool connected = false;
+        // Соединение TLS: поток TLS не допускает одновременных операций из разных потоков,
+        // поэтому чтение и запись выполняются асинхронно в потоке reader (tlsIo).
+        // Буферы ниже используются только этим потоком
+        boost::asio::io_context tlsIo;
+        std::unique_ptr<TlsStream> tls;
+        std::vector<uint8_t> outgoing;      // Кадры, ожидающие записи
+        std::vector<uint8_t> sending;       // Кадры текущей записи
+        std::vector<uint8_t> received;
+    };
+    
+    struct Subscriber {
+        int64_t id;
+        UpdateHandler handler;
+        std::atomic<bool> active{true};
+        std::mutex mutex;
+        std::condition_variable wake;
+        boost::asio::ip::tcp::socket* socket = nullptr; // Текущее соединение для остановки
+        std::thread thread;
+    };
+    
+    struct IdCache {
+        IdMap names;
+        std::unordered_map<std::string, int64_t> ids;
+    };
+    
+    Settings settings;
+    boost::asio::io_context io;
+    boost::asio::ip::tcp::endpoint endpoint;
+    std::vector<std::unique_ptr<Connection>> connections;
+    std::atomic<size_t> nextConnection{0};
+    // Сервер ответил на BINARY подтверждением кадров; false - запросы JSON-строками
+    std::atomic<bool> binaryAvailable;
+    
+    std::unique_ptr<boost::asio::ssl::context> tlsContext;
+    // Последняя полученная сессия (билет) для возобновления рукопожатий
+    std::mutex tlsSessionMutex;
+    std::shared_ptr<SSL_SESSION> tlsSession;
+    
+    std::mutex subscribersMutex;
+    std::unordered_map<uint64_t, std::unique_ptr<Subscriber>> subscribers;
+    uint64_t nextToken = 1;
+    
+    std::mutex idCacheMutex;
+    std::shared_ptr<const IdCache> idCache;
+    std::chrono::steady_clock::time_point idCacheTime;
+    
+    std::atomic<uint64_t> requestCount{0};
+    std::atomic<uint64_t> reconnectCount{0};
+    std::atomic<uint64_t> resubscribeCount{0};
+    std::atomic<uint64_t> handlerErrors{0};
+    std::atomic<uint64_t> tlsHandshakes{0};
+    std::atomic<uint64_t> tlsResumed{0};
+    
+    // Подключение и согласование кадров; вызывается под mutex соединения
+    bool connect(Connection& connection);
+    void readResponses(Connection& connection);
+    // Ответ на первый ожидающий запрос; вызывается потоком чтения
+    void completeRequest(Connection& connection, json response);
+    // Отклоняет ожидающие запросы и закрывает соединение; следующий запрос подключится заново
+    void failPending(Connection& connection, const std::string& error);
+    json requestLine(const json& request);
+    // Подключение сокета потока и рукопожатие с сохраненной сессией
+    void handshake(TlsStream& stream);
+    // Подключение TLS, токен и согласование кадров; вызывается под mutex соединения
+    void connectTls(Connection& connection);
+    void readTls(Connection& connection);
+    void writeTls(Connection& connection);
+    static int onNewSession(SSL* ssl, SSL_SESSION* session);
+    void runSubscriber(Subscriber& subscriber);
+    template <typename Stream>
+    void readUpdates(Stream& stream, Subscriber& subscriber);
+    std::shared_ptr<const IdCache> idCacheEntry(bool refresh);
+};
@@ -0,0 +1,503 @@
+#include "../include/psdik_client.h"
+
+#include <stdexcept>
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+// Кадр протокола BINARY: длина полезной нагрузки (4 байта, big-endian) и MessagePack
+std::vector<uint8_t> encodeFrame(const json& message) {
+    std::vector<uint8_t> frame(4);
+    json::to_msgpack(message, frame);
+    const auto size = static_cast<uint32_t>(frame.size() - 4);
+    frame[0] = static_cast<uint8_t>(size >> 24);
+    frame[1] = static_cast<uint8_t>(size >> 16);
+    frame[2] = static_cast<uint8_t>(size >> 8);
+    frame[3] = static_cast<uint8_t>(size);
+    return frame;
+}
+
+template <typename Stream>
+std::string readLine(Stream& stream, boost::asio::streambuf& buffer) {
+    boost::asio::read_until(stream, buffer, '\n');
+    std::istream is(&buffer);
+    std::string line;
+    std::getline(is, line);
+    return line;
+}
+
+// Индекс данных соединения SSL для указателя на клиента: индекс 0 занимает asio
+int clientDataIndex() {
+    static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+template <typename Stream>
+json readFrame(Stream& stream, std::vector<uint8_t>& payload) {
+    uint8_t header[4];
+    boost::asio::read(stream, boost::asio::buffer(header));
+    const size_t length = (size_t{header[0]} << 24) | (size_t{header[1]} << 16) |
+                          (size_t{header[2]} << 8) | size_t{header[3]};
+    payload.resize(length);
+    boost::asio::read(stream, boost::asio::buffer(payload));
+    return json::from_msgpack(payload);
+}
+    
+} // namespace
+
+DataClient::Settings DataClient::Settings::fromJson(const json& settings) {
+    Settings result;
+    if (!settings.is_object()) return result;
+    result.host = settings.value("host", result.host);
+    result.port = settings.value("port", result.port);
+    result.poolSize = std::max<size_t>(1, settings.value("pool_size", result.poolSize));
+    result.binary = settings.value("encoding", "msgpack") != "json";
+    result.reconnectDelay = std::chrono::milliseconds(
+        settings.value("reconnect_delay_ms", static_cast<int64_t>(result.reconnectDelay.count())));
+    result.idMapTtl = std::chrono::milliseconds(
+        settings.value("id_map_ttl_ms", static_cast<int64_t>(result.idMapTtl.count())));
+    if (settings.contains("tls") && settings["tls"].is_object()) {
+        const json& tls = settings["tls"];
+        result.tls = tls.value("enabled", true);
+        result.caFile = tls.value("ca_file", "");
+        result.certFile = tls.value("cert_file", "");
+        result.keyFile = tls.value("key_file", "");
+        result.serverName = tls.value("server_name", "");
+        result.token = tls.value("token", "");
+    }
+    return result;
+}
+
+DataClient::DataClient(Settings settings)
+    : settings(std::move(settings)), binaryAvailable(this->settings.binary) {
+    endpoint = tcp::endpoint(boost::asio::ip::make_address(this->settings.host), this->settings.port);
+    for (size_t i = 0; i < std::max<size_t>(1, this->settings.poolSize); ++i) {
+        connections.push_back(std::make_unique<Connection>());
+    }
+    
+    if (this->settings.tls) {
+        // Только TLS 1.3; полученные сессии сохраняет onNewSession, а не внутренний кэш
+        namespace ssl = boost::asio::ssl;
+        tlsContext = std::make_unique<ssl::context>(ssl::context::tls_client);
+        SSL_CTX* ctx = tlsContext->native_handle();
+        SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+        SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, &DataClient::onNewSession);
+        if (this->settings.caFile.empty()) {
+            tlsContext->set_default_verify_paths();
+        } else {
+            tlsContext->load_verify_file(this->settings.caFile);
+        }
+        tlsContext->set_verify_mode(ssl::verify_peer);
+        if (!this->settings.certFile.empty()) {
+            tlsContext->use_certificate_chain_file(this->settings.certFile);
+            tlsContext->use_private_key_file(this->settings.keyFile, ssl::context::pem);
+        }
+    }
+}
+
+DataClient::~DataClient() {
+    std::vector<uint64_t> tokens;
+    {
+        std::lock_guard<std::mutex> lock(subscribersMutex);
+        for (const auto& entry : subscribers) tokens.push_back(entry.first);
+    }
+    for (uint64_t token : tokens) unsubscribe(token);
+    
+    // Потоки чтения завершаются после закрытия соединений и отклоняют ожидающие запросы
+    for (auto& connection : connections) {
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            boost::system::error_code ignored;
+            if (connection->socket) connection->socket->shutdown(tcp::socket::shutdown_both, ignored);
+            if (connection->tls) connection->tls->lowest_layer().shutdown(tcp::socket::shutdown_both, ignored);
+        }
+        if (connection->reader.joinable()) connection->reader.join();
+    }
+}
+
+bool DataClient::connect(Connection& connection) {
+    // Предыдущий поток чтения уже завершился: connected сбрасывается его последним действием
+    if (connection.reader.joinable()) {
+        connection.reader.join();
+        ++reconnectCount;
+    }
+    
+    auto socket = std::make_unique<tcp::socket>(io);
+    socket->connect(endpoint);
+    socket->set_option(tcp::no_delay(true));
+    boost::asio::write(*socket, boost::asio::buffer("BINARY\n", 7));
+    
+    // До ответа на BINARY сервер не отправляет кадров, поэтому буфер строки пуст после нее
+    boost::asio::streambuf buffer;
+    std::string line;
+    try {
+        line = readLine(*socket, buffer);
+    } catch (const boost::system::system_error&) {
+        line.clear();
+    }
+    json ack = json::parse(line, nullptr, false);
+    if (ack.is_discarded() || !ack.is_object() || ack.value("encoding", "") != "msgpack") {
+        // Сервер без кадров закрывает соединение на неизвестной команде
+        binaryAvailable = false;
+        return false;
+    }
+    
+    connection.socket = std::move(socket);
+    connection.connected = true;
+    connection.reader = std::thread([this, &connection]() { readResponses(connection); });
+    return true;
+}
+
+void DataClient::readResponses(Connection& connection) {
+    std::string error = "Connection closed";
+    try {
+        std::vector<uint8_t> payload;
+        while (true) {
+            completeRequest(connection, readFrame(*connection.socket, payload));
+        }
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    failPending(connection, error);
+}
+
+void DataClient::completeRequest(Connection& connection, json response) {
+    std::promise<json> promise;
+    {
+        std::lock_guard<std::mutex> lock(connection.mutex);
+        if (connection.pending.empty()) throw std::runtime_error("Unexpected response frame");
+        promise = std::move(connection.pending.front());
+        connection.pending.pop_front();
+    }
+    promise.set_value(std::move(response));
+}
+
+void DataClient::failPending(Connection& connection, const std::string& error) {
+    // Запросы без ответа отклоняются; следующий запрос откроет соединение заново
+    std::lock_guard<std::mutex> lock(connection.mutex);
+    for (auto& promise : connection.pending) {
+        promise.set_exception(std::make_exception_ptr(std::runtime_error("Data server connection lost: " + error)));
+    }
+    connection.pending.clear();
+    boost::system::error_code ignored;
+    if (connection.socket) connection.socket->close(ignored);
+    if (connection.tls) connection.tls->lowest_layer().close(ignored);
+    connection.connected = false;
+}
+
+std::future<json> DataClient::requestAsync(const json& request) {
+    ++requestCount;
+    std::promise<json> promise;
+    try {
+        if (tlsContext) {
+            // Кадр передается потоку соединения в порядке очереди ожидающих ответов
+            std::vector<uint8_t> frame = encodeFrame(request);
+            Connection& connection = *connections[nextConnection++ % connections.size()];
+            std::lock_guard<std::mutex> lock(connection.mutex);
+            if (!connection.connected) connectTls(connection);
+            connection.pending.emplace_back();
+            std::future<json> response = connection.pending.back().get_future();
+            boost::asio::post(connection.tlsIo, [this, &connection, frame = std::move(frame)]() {
+                const bool idle = connection.sending.empty();
+                connection.outgoing.insert(connection.outgoing.end(), frame.begin(), frame.end());
+                if (idle) writeTls(connection);
+            });
+            return response;
+        }
+        if (binaryAvailable) {
+            Connection& connection = *connections[nextConnection++ % connections.size()];
+            std::lock_guard<std::mutex> lock(connection.mutex);
+            if (connection.connected || connect(connection)) {
+                connection.pending.emplace_back();
+                std::future<json> response = connection.pending.back().get_future();
+                boost::system::error_code error;
+                boost::asio::write(*connection.socket, boost::asio::buffer(encodeFrame(request)), error);
+                if (error) {
+                    // Ожидающие запросы, включая этот, отклонит поток чтения
+                    connection.socket->shutdown(tcp::socket::shutdown_both, error);
+                }
+                return response;
+            }
+        }
+    
+        // JSON-строка по отдельному соединению
+        promise.set_value(requestLine(request));
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+    return promise.get_future();
+}
+
+json DataClient::requestLine(const json& request) {
+    tcp::socket socket(io);
+    socket.connect(endpoint);
+    std::string line = request.dump() + "\n";
+    boost::asio::write(socket, boost::asio::buffer(line));
+    boost::asio::streambuf buffer;
+    return json::parse(readLine(socket, buffer));
+}
+
+void DataClient::handshake(TlsStream& stream) {
+    stream.next_layer().connect(endpoint);
+    stream.next_layer().set_option(tcp::no_delay(true));
+    SSL* ssl = stream.native_handle();
+    SSL_set_ex_data(ssl, clientDataIndex(), this);
+    // Сертификат сервера проверяется всегда: по server_name или по адресу подключения
+    const std::string& expectedName = settings.serverName.empty() ? settings.host : settings.serverName;
+    boost::system::error_code notAddress;
+    boost::asio::ip::make_address(expectedName, notAddress);
+    if (notAddress) {
+        // SNI - только для DNS-имени; SSL_set_tlsext_host_name без приведения в стиле C
+        SSL_ctrl(ssl, SSL_CTRL_SET_TLSEXT_HOSTNAME, TLSEXT_NAMETYPE_host_name,
+                 const_cast<char*>(expectedName.c_str()));
+    }
+    stream.set_verify_callback(boost::asio::ssl::host_name_verification(expectedName));
+    {
+        std::lock_guard<std::mutex> lock(tlsSessionMutex);
+        if (tlsSession) SSL_set_session(ssl, tlsSession.get());
+    }
+    stream.handshake(TlsStream::client);
+    ++tlsHandshakes;
+    if (SSL_session_reused(ssl)) ++tlsResumed;
+}
+
+int DataClient::onNewSession(SSL* ssl, SSL_SESSION* session) {
+    // Билет TLS 1.3 приходит после рукопожатия, при первом чтении ответа. Сохраняется копия:
+    // сессию соединения, закрытого без close_notify, OpenSSL помечает невозобновляемой
+    auto* client = static_cast<DataClient*>(SSL_get_ex_data(ssl, clientDataIndex()));
+    SSL_SESSION* copy = client ? SSL_SESSION_dup(session) : nullptr;
+    if (!copy) return 0;
+    std::lock_guard<std::mutex> lock(client->tlsSessionMutex);
+    client->tlsSession.reset(copy, SSL_SESSION_free);
+    return 0;
+}
+
+void DataClient::connectTls(Connection& connection) {
+    // Предыдущий поток соединения уже завершился: connected сбрасывается в failPending,
+    // после чего tlsIo выполняет только оставшиеся обработчики старого соединения
+    if (connection.reader.joinable()) {
+        connection.reader.join();
+        ++reconnectCount;
+    }
+    connection.tls.reset();
+    connection.outgoing.clear();
+    connection.sending.clear();
+    connection.received.clear();
+    
+    // Рукопожатие и согласование - синхронно: поток соединения еще не запущен
+    auto stream = std::make_unique<TlsStream>(connection.tlsIo, *tlsContext);
+    handshake(*stream);
+    boost::asio::streambuf buffer;
+    if (!settings.token.empty()) {
+        boost::asio::write(*stream, boost::asio::buffer("AUTH " + settings.token + "\n"));
+        json reply = json::parse(readLine(*stream, buffer), nullptr, false);
+        if (reply.is_discarded() || !reply.is_object() || reply.value("status", "") != "success") {
+            throw std::runtime_error("Data server rejected the access token");
+        }
+    }
+    boost::asio::write(*stream, boost::asio::buffer("BINARY\n", 7));
+    json ack = json::parse(readLine(*stream, buffer), nullptr, false);
+    if (ack.is_discarded() || !ack.is_object() || ack.value("encoding", "") != "msgpack") {
+        throw std::runtime_error("Data server does not support binary frames over TLS");
+    }
+    
+    connection.tls = std::move(stream);
+    connection.connected = true;
+    connection.tlsIo.restart();
+    readTls(connection);
+    connection.reader = std::thread([&connection]() { connection.tlsIo.run(); });
+}
+
+void DataClient::readTls(Connection& connection) {
+    constexpr size_t chunk = 65536;
+    const size_t size = connection.received.size();
+    connection.received.resize(size + chunk);
+    connection.tls->async_read_some(boost::asio::buffer(connection.received.data() + size, chunk),
+        [this, &connection, size](const boost::system::error_code& error, size_t n) {
+            std::vector<uint8_t>& received = connection.received;
+            received.resize(size + n);
+            try {
+                if (error) throw boost::system::system_error(error);
+                // Все полные кадры буфера; неполный остается до следующего чтения
+                size_t offset = 0;
+                while (received.size() - offset >= 4) {
+                    const uint8_t* header = received.data() + offset;
+                    const size_t length = (size_t{header[0]} << 24) | (size_t{header[1]} << 16) |
+                                          (size_t{header[2]} << 8) | size_t{header[3]};
+                    if (received.size() - offset - 4 < length) break;
+                    completeRequest(connection, json::from_msgpack(header + 4, header + 4 + length));
+                    offset += 4 + length;
+                }
+                received.erase(received.begin(), received.begin() + static_cast<std::ptrdiff_t>(offset));
+            } catch (const std::exception& e) {
+                failPending(connection, e.what());
+                return;
+            }
+            readTls(connection);
+        });
+}
+
+void DataClient::writeTls(Connection& connection) {
+    // Кадры, накопленные за время предыдущей записи, отправляются одной записью
+    connection.sending.swap(connection.outgoing);
+    boost::asio::async_write(*connection.tls, boost::asio::buffer(connection.sending),
+        [this, &connection](const boost::system::error_code& error, size_t) {
+            connection.sending.clear();
+            if (error) {
+                // Ожидающие запросы, включая неотправленные, отклонит чтение
+                connection.outgoing.clear();
+                boost::system::error_code ignored;
+                connection.tls->lowest_layer().shutdown(tcp::socket::shutdown_both, ignored);
+                return;
+            }
+            if (!connection.outgoing.empty()) writeTls(connection);
+        });
+}
+
+json DataClient::getValues(const std::vector<int64_t>& ids) {
+    return request({{"action", "get_values"}, {"variable_ids", ids}});
+}
+
+std::shared_ptr<const DataClient::IdCache> DataClient::idCacheEntry(bool refresh) {
+    {
+        std::lock_guard<std::mutex> lock(idCacheMutex);
+        if (!refresh && idCache && std::chrono::steady_clock::now() - idCacheTime < settings.idMapTtl) {
+            return idCache;
+        }
+    }
+    
+    json response = request({{"action", "get_id_map"}});
+    auto entry = std::make_shared<IdCache>();
+    for (const auto& [key, value] : response.items()) {
+        if (!value.is_string()) continue;
+        const int64_t id = std::stoll(key);
+        entry->names.emplace(id, value.get<std::string>());
+        entry->ids.emplace(value.get<std::string>(), id);
+    }
+    
+    std::lock_guard<std::mutex> lock(idCacheMutex);
+    idCache = entry;
+    idCacheTime = std::chrono::steady_clock::now();
+    return idCache;
+}
+
+std::shared_ptr<const DataClient::IdMap> DataClient::idMap(bool refresh) {
+    auto entry = idCacheEntry(refresh);
+    return std::shared_ptr<const IdMap>(entry, &entry->names);
+}
+
+std::optional<int64_t> DataClient::findId(const std::string& name) {
+    auto entry = idCacheEntry(false);
+    auto it = entry->ids.find(name);
+    if (it == entry->ids.end()) return std::nullopt;
+    return it->second;
+}
+
+uint64_t DataClient::subscribe(int64_t id, UpdateHandler handler) {
+    auto subscriber = std::make_unique<Subscriber>();
+    subscriber->id = id;
+    subscriber->handler = std::move(handler);
+    Subscriber& ref = *subscriber;
+    
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    const uint64_t token = nextToken++;
+    subscribers.emplace(token, std::move(subscriber));
+    ref.thread = std::thread([this, &ref]() { runSubscriber(ref); });
+    return token;
+}
+
+void DataClient::unsubscribe(uint64_t token) {
+    std::unique_ptr<Subscriber> subscriber;
+    {
+        std::lock_guard<std::mutex> lock(subscribersMutex);
+        auto it = subscribers.find(token);
+        if (it == subscribers.end()) return;
+        subscriber = std::move(it->second);
+        subscribers.erase(it);
+    }
+    
+    subscriber->active = false;
+    {
+        std::lock_guard<std::mutex> lock(subscriber->mutex);
+        boost::system::error_code ignored;
+        if (subscriber->socket) subscriber->socket->shutdown(tcp::socket::shutdown_both, ignored);
+    }
+    subscriber->wake.notify_all();
+    if (subscriber->thread.joinable()) subscriber->thread.join();
+}
+
+void DataClient::runSubscriber(Subscriber& subscriber) {
+    bool resubscribe = false;
+    while (subscriber.active) {
+        tcp::socket plain(io);
+        std::optional<TlsStream> tls;
+        if (tlsContext) tls.emplace(io, *tlsContext);
+        tcp::socket& socket = tls ? tls->next_layer() : plain;
+        try {
+            {
+                std::lock_guard<std::mutex> lock(subscriber.mutex);
+                if (!subscriber.active) break;
+                subscriber.socket = &socket;
+            }
+            if (tls) {
+                handshake(*tls);
+            } else {
+                socket.connect(endpoint);
+            }
+            if (resubscribe) ++resubscribeCount;
+            if (tls) {
+                readUpdates(*tls, subscriber);
+            } else {
+                readUpdates(socket, subscriber);
+            }
+        } catch (const std::exception&) {
+            // Обрыв соединения или неизвестный ID: повтор после паузы
+        }
+        
+        std::unique_lock<std::mutex> lock(subscriber.mutex);
+        subscriber.socket = nullptr;
+        resubscribe = true;
+        subscriber.wake.wait_for(lock, settings.reconnectDelay, [&subscriber]() { return !subscriber.active; });
+    }
+}
+
+template <typename Stream>
+void DataClient::readUpdates(Stream& stream, Subscriber& subscriber) {
+    std::string command = "SUBSCRIBE " + std::to_string(subscriber.id) + "\n";
+    boost::asio::write(stream, boost::asio::buffer(command));
+    
+    // Обновления приходят JSON-строками: {"i":..,"n":..,"t":..,"type":"data_update","v":..}
+    boost::asio::streambuf buffer;
+    while (subscriber.active) {
+        json update = json::parse(readLine(stream, buffer), nullptr, false);
+        if (update.is_discarded() || !update.is_object()) continue;
+        if (update.contains("error")) {
+            throw std::runtime_error(update["error"].get<std::string>());
+        }
+        if (update.value("type", "") != "data_update") continue;
+        try {
+            subscriber.handler(update.value("i", subscriber.id), update.value("n", ""),
+                               update.contains("v") ? update["v"] : json(),
+                               update.value("t", int64_t{0}));
+        } catch (const std::exception&) {
+            ++handlerErrors;
+        }
+    }
+}
+
+json DataClient::metrics() const {
+    return {
+        {"encoding", binaryAvailable ? "msgpack" : "json"},
+        {"tls", tlsContext != nullptr},
+        {"tls_handshakes", tlsHandshakes.load()},
+        {"tls_resumed", tlsResumed.load()},
+        {"pool_size", connections.size()},
+        {"requests", requestCount.load()},
+        {"reconnects", reconnectCount.load()},
+        {"resubscribes", resubscribeCount.load()},
+        {"handler_errors", handlerErrors.load()}
+    };
+}
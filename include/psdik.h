@@ -9,14 +9,54 @@
 #include <mutex>
 #include <atomic>
 #include <deque>
+#include <condition_variable>
+#include <filesystem>
+#include <set>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <future>
+#include <queue>
+#include <numeric>
+#include <array>
+#include <limits>
+#include <cctype>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#endif
+#include <pthread.h>
+#include <sched.h>
 #include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/zlib.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
 #include <boost/signals2.hpp>
 #include <nlohmann/json.hpp>
 #include <csignal>
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <cmath>
+#include <optional>
+#include <memory_resource>
 #include <random>
 #include <iomanip>
 #include <sstream>
@@ -58,6 +98,45 @@ private:
     Level currentLevel = INFO;
 };
 
+// Размещение потоков по ядрам (server_settings.affinity): опросчики не мигрируют между ядрами
+// и узлами NUMA, потоки клиентов не вытесняют их с выделенных ядер. Закрепляются только потоки:
+// память (кэш данных, буферы обработчиков) общая, по узлам не разделяется и не переносится.
+class ThreadPlacement {
+public:
+    enum class Role { Poller, Io };
+    
+    struct Settings {
+        bool enabled = false;
+        // Наборы ядер опросчиков, опросчик закрепляется за следующим набором по кругу:
+        // "numa" - по набору на узел NUMA, список "0-3,8" - по набору из одного ядра
+        std::vector<std::vector<int>> pollerSets;
+        // Общий набор ядер потоков TCP-клиентов и подписчиков
+        std::vector<int> ioCpus;
+        
+        static Settings fromJson(const json& settings);
+    };
+    
+    static ThreadPlacement& getInstance();
+    
+    void configure(const Settings& settings);
+    // Закрепление текущего потока по его роли; false - размещение отключено или не удалось
+    bool place(Role role);
+    
+    static bool pinCurrentThread(const std::vector<int>& cpus);
+    // "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}; элементы вне [0, CPU_SETSIZE) пропускаются
+    static std::vector<int> parseCpuList(std::string_view list);
+    // Ядра узлов NUMA из /sys/devices/system/node; без NUMA - один узел со всеми ядрами
+    static std::vector<std::vector<int>> numaNodes();
+    
+private:
+    ThreadPlacement() = default;
+    
+    std::mutex mutex;
+    Settings current;
+    std::atomic<bool> enabled{false};
+    size_t nextPollerSet = 0;
+};
+
 // Хеш-функция для int64_t
 struct Int64Hash {
     std::size_t operator()(int64_t key) const {
@@ -72,11 +151,193 @@ struct HistoricalValue {
     std::string quality; // "good", "bad", "uncertain"
 };
 
+// Числовой ряд истории: непрерывные массивы времени и значений для агрегации
+struct HistorySeries {
+    std::vector<int64_t> timestamps; // мс с начала эпохи
+    std::vector<double> values;
+    
+    size_t size() const { return values.size(); }
+};
+
+// Агрегаты по временным интервалам, столбцы одинаковой длины
+struct HistoryBuckets {
+    std::vector<int64_t> start;
+    std::vector<uint32_t> count;
+    std::vector<double> min;
+    std::vector<double> max;
+    std::vector<double> avg;
+    std::vector<double> first;
+    std::vector<double> last;
+    
+    size_t size() const { return start.size(); }
+};
+
+// Текущее значение переменной вместе с именем для пакетных запросов
+struct NamedValue {
+    int64_t id;
+    std::string name;
+    HistoricalValue value;
+};
+
+// Ограниченный пул буферов фиксированного размера для потоковых ответов.
+// Память под ответы не превышает bufferSize * maxBuffers независимо от размера ответов.
+class BufferPool {
+public:
+    // Буфер, возвращаемый в пул при разрушении
+    class Lease {
+    public:
+        Lease(BufferPool& pool, std::unique_ptr<char[]> data) : pool(&pool), buffer(std::move(data)) {}
+        Lease(Lease&& other) noexcept = default;
+        Lease& operator=(Lease&&) = delete;
+        ~Lease();
+        
+        char* data() const { return buffer.get(); }
+        size_t size() const { return pool->bufferSize; }
+        
+    private:
+        BufferPool* pool;
+        std::unique_ptr<char[]> buffer;
+    };
+    
+    BufferPool(size_t bufferSize = 64 * 1024, size_t maxBuffers = 64);
+    
+    // Ожидает освобождения буфера не дольше timeout, если выданы все maxBuffers;
+    // по истечении ожидания - std::runtime_error
+    Lease acquire(std::chrono::milliseconds timeout = std::chrono::milliseconds(5000));
+    size_t available();
+    
+private:
+    const size_t bufferSize;
+    const size_t maxBuffers;
+    size_t allocated = 0;
+    std::vector<std::unique_ptr<char[]>> freeBuffers;
+    std::mutex mutex;
+    std::condition_variable released;
+    
+    void release(std::unique_ptr<char[]> buffer);
+};
+
+// Потоковая запись JSON-ответа: сериализация прямо в буфер фиксированного размера,
+// заполненный буфер передается приемнику (обычно блокирующая запись в сокет)
+class JsonChunkWriter {
+public:
+    using Sink = std::function<void(std::string_view)>;
+    
+    explicit JsonChunkWriter(Sink sink, size_t chunkSize = 64 * 1024);
+    JsonChunkWriter(Sink sink, BufferPool& pool);
+    
+    JsonChunkWriter& raw(std::string_view text);
+    JsonChunkWriter& number(int64_t value);
+    JsonChunkWriter& string(std::string_view value);
+    JsonChunkWriter& value(const json& value, int indent = -1);
+    // Запись накопленного буфера в приемник
+    void flush();
+    
+private:
+    // Адаптер вывода nlohmann::json, пишущий в буфер без промежуточных строк
+    class Output : public nlohmann::detail::output_adapter_protocol<char> {
+    public:
+        explicit Output(JsonChunkWriter& writer) : writer(writer) {}
+        void write_character(char c) override { writer.put(c); }
+        void write_characters(const char* s, std::size_t length) override { writer.append(s, length); }
+        
+    private:
+        JsonChunkWriter& writer;
+    };
+    
+    Sink sink;
+    std::unique_ptr<char[]> ownBuffer;
+    std::optional<BufferPool::Lease> lease;
+    char* buffer;
+    size_t capacity;
+    size_t used = 0;
+    // Создается только для объектов и массивов: конструктор сериализатора выделяет память
+    std::optional<nlohmann::detail::serializer<json>> serializer;
+    
+    void put(char c) {
+        if (used == capacity) flush();
+        buffer[used++] = c;
+    }
+    void append(const char* data, size_t length);
+};
+
+// Отправка готовых сообщений подписчику: накопленные сообщения передаются одним
+// вызовом writev (sendmsg) без копирования в общий буфер. Сообщения разделяются между
+// сессиями; при MSG_ZEROCOPY они удерживаются до уведомления ядра о завершении передачи.
+class GatherWriter {
+public:
+    using Message = std::shared_ptr<const std::string>;
+    
+    struct Options {
+        bool zeroCopy = false;              // MSG_ZEROCOPY (Linux 4.14+), иначе обычный writev
+        size_t zeroCopyMinBytes = 16 * 1024; // Меньшие пакеты дешевле скопировать
+        
+        static Options fromJson(const json& settings);
+    };
+    
+    // Счетчики отправки, общие для всех сессий
+    struct Stats {
+        std::atomic<uint64_t> messages{0};
+        std::atomic<uint64_t> writes{0};
+        std::atomic<uint64_t> zeroCopyWrites{0};
+        std::atomic<uint64_t> zeroCopyCopied{0};  // Ядро скопировало данные (например, loopback)
+    };
+    
+    GatherWriter(ip::tcp::socket& socket, Options options, Stats* stats = nullptr);
+    ~GatherWriter();
+    GatherWriter(const GatherWriter&) = delete;
+    GatherWriter& operator=(const GatherWriter&) = delete;
+    
+    void add(Message message);
+    void flush();
+    size_t pendingBytes() const { return batchBytes; }
+    
+private:
+    ip::tcp::socket& socket;
+    Options options;
+    Stats* stats;
+    bool zeroCopyEnabled = false;
+    std::vector<Message> batch;
+    size_t batchBytes = 0;
+    // Пакеты, переданные с MSG_ZEROCOPY: номер последнего вызова sendmsg и сообщения
+    std::deque<std::pair<uint32_t, std::vector<Message>>> inFlight;
+    uint32_t nextNotification = 0;
+    
+    void sendZeroCopy();
+    void reapCompletions(int timeoutMs);
+};
+
+// Текстовая команда протокола TCP, разобранная без выделения памяти
+struct TextCommand {
+    enum class Type { Subscribe, GetAll, GetHistory, GetConfig, SaveConfig, Binary };
+    
+    Type type = Type::GetAll;
+    int64_t variableId = 0;
+    size_t count = 0;
+    std::string_view argument;      // Имя файла SAVE_CONFIG
+    const char* error = nullptr;    // Готовый ответ об ошибке формата аргументов
+    
+    // false - строка не является текстовой командой
+    static bool parse(std::string_view line, TextCommand& command);
+};
+
+// Агрегация и прореживание истории на стороне сервера
+class HistoryAggregator {
+public:
+    // min/max/avg/first/last по интервалам bucketMs, выровненным по эпохе; пустые интервалы пропускаются
+    static HistoryBuckets aggregate(const HistorySeries& series, int64_t bucketMs);
+    // Прореживание Largest-Triangle-Three-Buckets до points точек
+    static HistorySeries downsample(const HistorySeries& series, size_t points);
+};
+
 #define LOG_DEBUG(msg) Logger::getInstance().log(Logger::DEBUG, msg)
 #define LOG_INFO(msg) Logger::getInstance().log(Logger::INFO, msg)
 #define LOG_WARNING(msg) Logger::getInstance().log(Logger::WARNING, msg)
 #define LOG_ERROR(msg) Logger::getInstance().log(Logger::ERROR, msg)
 
+class UpdateRing;
+class AlarmEngine;
+
 // Кэш данных с историей
 class DataCache {
 private:
@@ -86,6 +347,22 @@ private:
     std::unordered_map<int64_t, std::string, Int64Hash> idToName; // Маппинг ID -> имя
     size_t maxHistorySize = 100;
     
+    // Снимок для теплого старта: ID, измененные после последней записи,
+    // и закодированные записи неизмененных ID (защищены snapshotMutex)
+    std::unordered_set<int64_t, Int64Hash> dirtyIds;
+    std::mutex snapshotMutex;
+    std::unordered_map<int64_t, std::string, Int64Hash> encodedEntries;
+    
+    // Кольцо рассылки, в которое публикуется каждое обновление (устанавливает SubscriptionManager)
+    std::atomic<UpdateRing*> updateRing{nullptr};
+    // Правила тревог, проверяемые при записи значения (устанавливает DataServer)
+    std::atomic<AlarmEngine*> alarmEngine{nullptr};
+    // Номер последней записи значения: порядок проверки тревог вне блокировки кэша
+    uint64_t writeSequence = 0;
+    
+    bool store(int64_t id, const std::string* name, const HistoricalValue& value, bool onlyNewer);
+    void storeLocked(int64_t id, const std::string* name, const HistoricalValue& value);
+    
 public:
     virtual void updateValue(int64_t id, const std::string& name, const json& value, const std::string& quality = "good");
     virtual std::vector<HistoricalValue> getHistory(int64_t id, size_t count);
@@ -93,6 +370,72 @@ public:
     virtual json getAllCurrentValues();
     virtual std::string getNameById(int64_t id);
     virtual bool idExists(int64_t id);
+    virtual void removeValue(int64_t id);
+    // Замена качества текущих значений под одной блокировкой; возвращает количество измененных
+    size_t setQuality(const std::vector<int64_t>& ids, const std::string& quality);
+    // Применение значения, полученного от другого сервера, с его временем и качеством.
+    // Значения не новее текущего пропускаются; пустое имя не изменяет известное имя переменной
+    bool applyValue(int64_t id, const std::string& name, const HistoricalValue& value);
+    void setUpdateRing(UpdateRing* ring) { updateRing.store(ring, std::memory_order_release); }
+    void setAlarmEngine(AlarmEngine* engine) { alarmEngine.store(engine, std::memory_order_release); }
+    // Пакетное чтение под одной блокировкой; отсутствующие ID пропускаются
+    std::vector<NamedValue> getValues(const std::vector<int64_t>& ids);
+    std::vector<int64_t> getIds();
+    // Копирование последних count значений истории в переданный вектор (например, на арене запроса);
+    // строковые значения длиннее SSO и объекты json копируются в куче
+    void copyHistory(int64_t id, size_t count, std::pmr::vector<HistoricalValue>& out);
+    std::vector<std::pair<int64_t, std::vector<HistoricalValue>>> getHistories(const std::vector<int64_t>& ids, size_t count);
+    // Числовые значения истории за интервал [fromMs, toMs]; значения с качеством "bad" пропускаются
+    HistorySeries getNumericHistory(int64_t id, int64_t fromMs = INT64_MIN, int64_t toMs = INT64_MAX);
+    
+    // Запись снимка текущих значений и последних historyDepth значений истории.
+    // Перекодируются только измененные ID; файл заменяется атомарно.
+    // Возвращает false, если изменений не было и файл не перезаписывался.
+    bool saveSnapshot(const std::string& path, size_t historyDepth);
+    // Загрузка снимка; восстановленные текущие значения получают качество "uncertain"
+    size_t loadSnapshot(const std::string& path, const std::function<bool(int64_t)>& filter = nullptr);
+};
+
+// Управление подключением к устройству: ограниченная экспоненциальная задержка
+// со случайным разбросом, параллельное подключение ко всем адресам (happy eyeballs)
+// и фоновая проверка основного адреса при работе через резервный
+class ConnectionManager {
+public:
+    struct Settings {
+        std::chrono::milliseconds backoffInitial{500};
+        std::chrono::milliseconds backoffMax{30000};
+        double jitter = 0.2;                            // Доля случайного уменьшения задержки
+        std::chrono::milliseconds stagger{250};         // Запуск следующего адреса, пока предыдущий не ответил
+        std::chrono::milliseconds probeInterval{30000}; // Проверка основного адреса
+        
+        static Settings fromJson(const json& connectionParams);
+    };
+    
+    Settings settings;
+    
+    // Задержка перед попыткой после failures неудачных подряд
+    std::chrono::milliseconds backoffDelay(int failures);
+    bool attemptDue() const { return std::chrono::steady_clock::now() >= nextAttempt; }
+    int failureCount() const { return failures; }
+    // Возвращает задержку до следующей попытки
+    std::chrono::milliseconds recordFailure();
+    void recordSuccess();
+    
+    // Подключение ко всем адресам {host, port}; адрес i запускается через i * stagger
+    // или сразу после ошибки предыдущего. Возвращает индекс первого подключившегося адреса.
+    static std::optional<size_t> race(ip::tcp::socket& socket, const std::vector<json>& endpoints,
+                                      std::chrono::milliseconds timeout, std::chrono::milliseconds stagger);
+    
+    // Фоновая проверка доступности адреса; результат забирается без ожидания
+    bool probeDue() const { return !probe.valid() && std::chrono::steady_clock::now() >= nextProbe; }
+    void startProbe(const json& endpoint, std::chrono::milliseconds timeout);
+    bool probeSucceeded();
+    
+private:
+    int failures = 0;
+    std::chrono::steady_clock::time_point nextAttempt{};
+    std::chrono::steady_clock::time_point nextProbe{};
+    std::future<bool> probe;
 };
 
 // Базовый класс для протоколов с улучшенной обработкой ошибок
@@ -100,10 +443,13 @@ class ProtocolHandler {
 protected:
     std::string name;
     std::atomic<bool> connected{false};
-    std::atomic<int> connectionAttempts{0};
-    std::chrono::steady_clock::time_point lastConnectionAttempt;
+    ConnectionManager connectionManager;
+    std::atomic<uint64_t> goodReads{0};
+    std::atomic<uint64_t> badReads{0};
     std::vector<json> connectionParams; // Основной + резервные
     size_t currentConnectionIndex = 0;
+    // Переход на основной адрес: переподключение без событий потери и восстановления связи
+    bool switchingEndpoint = false;
     DataCache& dataCache;
     
 public:
@@ -114,7 +460,19 @@ public:
     virtual bool connect();
     virtual void disconnect();
     virtual json readData(const json& variables) = 0;
+    // false - readData ожидает полный список переменных устройства при каждом вызове:
+    // опросчик не делит его на полосы классов обслуживания и части
+    virtual bool supportsPartialReads() const { return true; }
     bool isConnected() const;
+    const std::string& getName() const { return name; }
+    // Вызывается опросчиком между циклами: при работе через резервный адрес проверяет основной
+    void checkHealth();
+    // Количество успешных и ошибочных (качество "bad") чтений с начала работы
+    uint64_t goodReadCount() const { return goodReads; }
+    uint64_t badReadCount() const { return badReads; }
+    // Массовая установка качества тегов устройства
+    size_t markQuality(const std::vector<int64_t>& ids, const std::string& quality);
+    size_t activeEndpoint() const { return currentConnectionIndex; }
     
     // Callback система
     boost::signals2::signal<void(int64_t, const std::string&, const json&)> onDataReceived;
@@ -122,76 +480,1410 @@ public:
 
 protected:
     virtual bool trySpecificConnect(const json& connectionParams) = 0;
+    // Протоколы поверх TCP: новый контекст соединения (сокет для подключения)
+    // и настройка после подключения к адресу endpoint
+    virtual bool usesTcp() const { return false; }
+    virtual ip::tcp::socket* createTcpContext() { return nullptr; }
+    virtual bool onTcpConnected([[maybe_unused]] const json& endpoint) { return true; }
+    std::optional<size_t> connectTcp(const std::vector<json>& endpoints);
+    std::chrono::milliseconds connectTimeout() const;
     void updateData(int64_t id, const std::string& varName, const json& value, const std::string& quality = "good");
 };
 
 // Modbus handler
 class ModbusTcpHandler : public ProtocolHandler {
 private:
-    // Заглушки для Modbus структур
+    // Контекст соединения Modbus TCP
     struct ModbusContext {
         std::string host;
         int port;
-        // ... реальная реализация будет использовать libmodbus
+        uint8_t unitId = 1;
+        uint16_t transactionId = 0;
+        std::chrono::milliseconds timeout{5000};
+        io_context io;
+        ip::tcp::socket socket{io};
     };
     
     std::unique_ptr<ModbusContext> context;
     
+    // Выполнение запроса Modbus (PDU) с таймаутом, возвращает PDU ответа
+    std::vector<uint8_t> transact(const std::vector<uint8_t>& pdu);
+    std::vector<uint16_t> readRegisters(uint8_t function, uint16_t address, uint16_t count);
+    std::vector<bool> readBits(uint8_t function, uint16_t address, uint16_t count);
+    json readVariable(const json& var);
+    
 public:
-    ModbusTcpHandler(DataCache& cache) : ProtocolHandler("modbus_tcp", cache) {}
+    ModbusTcpHandler(DataCache& cache, const std::string& deviceName = "modbus_tcp")
+        : ProtocolHandler(deviceName, cache) {}
     
 protected:
     bool trySpecificConnect(const json& connectionParams) override ;
+    bool usesTcp() const override { return true; }
+    ip::tcp::socket* createTcpContext() override;
+    bool onTcpConnected(const json& endpoint) override;
     
 public:
     json readData(const json& variables) override ;
+    void disconnect() override ;
+};
+
+// Классы обслуживания переменных (поле переменной "priority"): критичные теги
+// блокировок опрашиваются и рассылаются раньше обычных и массовых
+struct QosClass {
+    enum Value : uint8_t { Critical, Normal, Bulk, Count };
+    
+    // Неизвестное имя - обычный класс
+    static Value fromString(std::string_view name);
+    static const char* name(Value value);
+    // Индекс полосы в массивах размера Count
+    static constexpr size_t index(Value value) { return static_cast<size_t>(value); }
+};
+
+// Политика классов обслуживания (server_settings.qos, уточняется секцией устройства "qos")
+struct QosPolicy {
+    std::array<int, QosClass::Count> intervalMs{};                 // 0 - интервал опроса устройства
+    std::array<double, QosClass::Count> sloMs{100.0, 1000.0, 10000.0};
+    size_t bulkChunk = 16;                                         // Массовых переменных за одно чтение
+    
+    static QosPolicy fromJson(const json& settings);
+};
+
+// Задержка класса обслуживания относительно целевого значения (SLO)
+class LatencySlo {
+private:
+    mutable std::mutex mutex;
+    double targetMs = 0.0;
+    double averageMs = 0.0;   // Скользящее среднее
+    double maxMs = 0.0;
+    uint64_t samples = 0;
+    uint64_t violations = 0;
+
+public:
+    void setTarget(double ms);
+    void record(double ms);
+    json toJson() const;
 };
 
 // Система подписки
+// Типизированное обновление значения для кольца рассылки
+struct ValueUpdate {
+    enum class Kind : uint8_t { Null, Bool, Integer, Unsigned, Float, Other };
+    enum class Quality : uint8_t { Good, Bad, Uncertain };
+    
+    int64_t id = 0;
+    int64_t timestampMs = 0;
+    Kind kind = Kind::Null;
+    Quality quality = Quality::Good;
+    uint64_t bits = 0;      // Значение скалярного типа; Other - номер значения в кольце (0 - нет значения)
+    
+    static ValueUpdate fromJson(int64_t id, const json& value, int64_t timestampMs);
+    json toJson() const;
+    static Quality qualityFromString(std::string_view quality);
+    static const char* qualityName(Quality quality);
+};
+
+// Кольцо широковещательной рассылки: опросчики записывают обновление один раз,
+// каждый подписчик читает со своего курсора. Запись без блокировок и не зависит
+// от числа подписчиков; отставший более чем на емкость кольца читатель получает Lagged.
+class UpdateRing {
+public:
+    enum class ReadStatus { Ready, Empty, Lagged };
+    
+    explicit UpdateRing(size_t capacity = 65536);
+    
+    void publish(const ValueUpdate& update);
+    // Публикация вместе со значением: нескалярное значение (строка, массив, объект)
+    // сохраняется в кольце значений той же емкости, bits обновления - его номер
+    void publish(ValueUpdate update, const json& value);
+    ReadStatus read(uint64_t cursor, ValueUpdate& update) const;
+    // Нескалярное значение обновления; nullptr - значение уже перезаписано (читатель отстал)
+    std::shared_ptr<const json> payload(const ValueUpdate& update) const;
+    // Позиция следующей записи: курсор нового читателя
+    uint64_t head() const { return next.load(std::memory_order_acquire); }
+    size_t capacity() const { return mask + 1; }
+    // Ожидание публикации по курсору (или таймаута)
+    void waitFor(uint64_t cursor, std::chrono::milliseconds timeout);
+    void wakeAll();
+    
+private:
+    // Слот с версией (seqlock): нечетная - идет запись, 2 * номер + 2 - запись завершена
+    struct Slot {
+        std::atomic<uint64_t> stamp{0};
+        std::atomic<int64_t> id{0};
+        std::atomic<int64_t> timestampMs{0};
+        std::atomic<uint64_t> bits{0};
+        std::atomic<uint8_t> kind{0};
+        std::atomic<uint8_t> quality{0};
+    };
+    
+    // Значение с номером публикации: слот проверяется по номеру при чтении
+    struct Payload {
+        uint64_t sequence;
+        json value;
+    };
+    
+    std::unique_ptr<Slot[]> slots;
+    std::unique_ptr<std::shared_ptr<const Payload>[]> payloads;
+    size_t mask;
+    alignas(64) std::atomic<uint64_t> next{0};
+    std::atomic<uint64_t> nextPayload{1};
+    alignas(64) std::atomic<int> waiters{0};
+    std::mutex waitMutex;
+    std::condition_variable dataReady;
+    
+    bool published(uint64_t cursor) const;
+};
+
+// Подписка на обновления: курсор в кольце рассылки и набор ID.
+// Используется из одного потока сессии (TCP или WebSocket).
+class Subscription {
+public:
+    enum class PollResult { Updates, Idle, Resync };
+    using Visitor = std::function<void(const ValueUpdate& update, const std::string& name)>;
+    
+    Subscription(UpdateRing& ring, DataCache& cache) : ring(ring), dataCache(cache), cursor(ring.head()) {}
+    
+    void add(int64_t id);
+    void remove(int64_t id);
+    // Подписка на все ID (репликация); имя в обработчик не передается
+    void addAll() { allIds = true; }
+    bool contains(int64_t id) const { return allIds || names.count(id) != 0; }
+    std::vector<int64_t> ids() const;
+    
+    // Чтение до limit обновлений подписанных ID. Resync - подписка отстала,
+    // курсор перенесен в голову кольца, текущие значения нужно отправить заново.
+    PollResult poll(const Visitor& visitor, size_t limit = 4096);
+    void wait(std::chrono::milliseconds timeout) { ring.waitFor(cursor, timeout); }
+    // Позиция в кольце: все обновления до нее прочитаны
+    uint64_t position() const { return cursor; }
+    // Продолжение чтения с ранее переданной позиции, если она еще в кольце
+    bool seek(uint64_t position);
+    // Значение обновления; нескалярное - опубликованное вместе с ним,
+    // а если оно уже перезаписано в кольце значений - текущее из кэша
+    json value(const ValueUpdate& update) const;
+    
+private:
+    UpdateRing& ring;
+    DataCache& dataCache;
+    uint64_t cursor;
+    bool allIds = false;
+    std::unordered_map<int64_t, std::string, Int64Hash> names; // Подписанные ID -> имя
+};
+
 class SubscriptionManager {
 private:
+    // Сессия подписчика TCP: собственный поток читает кольцо в своем темпе
+    struct Session {
+        ip::tcp::socket socket;
+        Subscription subscription;
+        std::atomic<bool> active{true};
+        std::thread thread;
+        
+        Session(ip::tcp::socket s, UpdateRing& ring, DataCache& cache)
+            : socket(std::move(s)), subscription(ring, cache) {}
+    };
+    
     std::mutex mutex;
     DataCache& dataCache;
-    std::unordered_map<int64_t, std::vector<ip::tcp::socket>, Int64Hash> subscribers;
+    UpdateRing ring;
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::atomic<bool> stopping{false};
+
+public:
+    using QosClasses = std::unordered_map<int64_t, QosClass::Value, Int64Hash>;
+    
+private:
+    // Закодированные сообщения по позициям кольца: обновление кодируется один раз,
+    // сессии подписчиков одного ID отправляют общий неизменяемый буфер
+    struct EncodedSlot {
+        std::mutex mutex;
+        uint64_t position = std::numeric_limits<uint64_t>::max();
+        GatherWriter::Message message;
+    };
+    static constexpr size_t ENCODED_SLOTS = 4096;
+    std::unique_ptr<EncodedSlot[]> encoded{new EncodedSlot[ENCODED_SLOTS]};
+    std::atomic<uint64_t> encodedMessages{0};
+    GatherWriter::Options sendOptions;
+    GatherWriter::Stats sendStats;
+    
+    GatherWriter::Message encodeUpdate(uint64_t position, const ValueUpdate& update, const std::string& name,
+                                       const Subscription& subscription);
     
+    
+    // Классы обслуживания ID (обычные не хранятся) и задержка доставки по классам
+    std::shared_ptr<const QosClasses> qosClasses = std::make_shared<const QosClasses>();
+    std::array<LatencySlo, QosClass::Count> pushLatency;
+    
+    void runSession(Session& session);
+    void resync(Session& session, JsonChunkWriter& writer);
+
 public:
-    SubscriptionManager(DataCache& cache) : dataCache(cache) {}
+    // Кэш публикует в кольцо каждое обновление значения
+    SubscriptionManager(DataCache& cache, size_t ringCapacity = 65536) : dataCache(cache), ring(ringCapacity) {
+        dataCache.setUpdateRing(&ring);
+    }
+    ~SubscriptionManager();
     
     void addSubscriber(int64_t variableId, ip::tcp::socket socket) ;
+    // Новая подписка без ID для сессий с собственным транспортом (WebSocket)
+    std::unique_ptr<Subscription> createSubscription() { return std::make_unique<Subscription>(ring, dataCache); }
     
-    void notifySubscribers(int64_t variableId, const std::string& variableName, const json& value) ;
+    // Публикация обновления, не записанного в кэш; рассылку выполняют потоки сессий
+    void notifySubscribers(int64_t variableId, const json& value) ;
     
     void removeDisconnected() ;
+    size_t subscriberCount() ;
+    
+    // Классы обслуживания подписанных ID и целевые задержки доставки
+    void setQos(QosClasses classes, const QosPolicy& policy);
+    std::shared_ptr<const QosClasses> qosTable() const { return std::atomic_load(&qosClasses); }
+    // Учет задержки доставки обновления с меткой времени timestampMs
+    void recordPush(QosClass::Value lane, int64_t timestampMs);
+    // Параметры отправки для новых сессий (server_settings.subscribers)
+    void setSendOptions(const GatherWriter::Options& options);
+    // Закодированные и отправленные сообщения, вызовы writev и MSG_ZEROCOPY
+    json sendMetrics() const;
+    // Задержка от метки времени значения до записи в сокет по классам
+    json qosMetrics() const;
+};
+
+// Заголовок скомпилированной базы тегов (файл *.tagdb)
+struct TagDbHeader {
+    char magic[8];           // "PSDTAGDB"
+    uint32_t version;
+    uint32_t generatedIds;   // Количество ID, отсутствующих в файле и сгенерированных сервером
+    uint64_t configHash;     // FNV-1a содержимого config.json
+    uint64_t configSize;
+    uint64_t tagCount;
+    uint64_t recordsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    int64_t maxId;
+};
+
+// Запись тега; строки хранятся в общем пуле, записи отсортированы по ID
+struct TagRecord {
+    int64_t id;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t sectionOffset;
+    uint32_t sectionLength;
+    uint32_t keyOffset;
+    uint32_t keyLength;
+};
+
+// Таблица тегов времени выполнения: строится за один проход по конфигурации
+// или отображается в память из файла базы тегов
+class TagTable {
+public:
+    struct Entry {
+        int64_t id;
+        std::string name;
+        std::string section;
+        std::string key;
+    };
+    
+private:
+    std::vector<char> storage; // Данные построенной таблицы (формат совпадает с файлом)
+    void* mapping = nullptr;   // Данные, отображенные из файла
+    size_t mappingSize = 0;
+    const char* base = nullptr;
+    
+    const TagDbHeader& header() const;
+    std::string_view str(uint32_t offset, uint32_t length) const;
+    
+public:
+    TagTable() = default;
+    TagTable(const TagTable&) = delete;
+    TagTable& operator=(const TagTable&) = delete;
+    ~TagTable();
+    
+    static uint64_t hashContent(std::string_view content);
+    
+    void build(std::vector<Entry> entries, int64_t maxId, uint64_t configHash, uint64_t configSize,
+               uint32_t generatedIds = 0);
+    // Загрузка базы тегов, если она соответствует хешу и размеру конфигурации
+    bool loadFromFile(const std::string& path, uint64_t configHash, uint64_t configSize);
+    bool saveToFile(const std::string& path) const;
+    
+    size_t size() const;
+    const TagRecord& record(size_t index) const;
+    const TagRecord* find(int64_t id) const;
+    std::string_view name(const TagRecord& rec) const;
+    std::string_view section(const TagRecord& rec) const;
+    std::string_view key(const TagRecord& rec) const;
+    int64_t maxId() const;
+    uint32_t generatedIds() const;
+};
+
+// Индекс имен тегов: отсортированный по имени массив для точного поиска, поиска по префиксу
+// и шаблону. Обновляется по разнице таблиц тегов при изменении конфигурации
+class TagNameIndex {
+public:
+    struct Entry {
+        std::string name;
+        int64_t id;
+        
+        bool operator<(const Entry& other) const {
+            return name != other.name ? name < other.name : id < other.id;
+        }
+        bool operator==(const Entry& other) const { return id == other.id && name == other.name; }
+    };
+    
+    void build(const TagTable& table);
+    // Удаление и вставка только тегов с измененным именем, удаленных и новых ID
+    void update(const TagTable& oldTable, const TagTable& newTable);
+    
+    size_t size() const { return entries.size(); }
+    // Наименьший ID тега с именем name (имя может повторяться в разных секциях)
+    std::optional<int64_t> find(std::string_view name) const;
+    // Теги в порядке имен; limit 0 - без ограничения. Указатели действительны до обновления
+    std::vector<const Entry*> prefix(std::string_view prefix, size_t limit = 0) const;
+    // Шаблон с * и ?: просматривается только диапазон литерального начала шаблона
+    std::vector<const Entry*> match(std::string_view pattern, size_t limit = 0) const;
+    
+private:
+    std::vector<Entry> entries;
+    
+    std::vector<Entry>::const_iterator lowerBound(std::string_view name) const;
+};
+
+// Политика опроса при деградации устройства (секция устройства "circuit_breaker")
+struct PollingPolicy {
+    double errorRateThreshold = 0.5;                // Доля ошибочных чтений для размыкания цепи
+    int failureThreshold = 5;                       // Неудачных циклов подряд для размыкания цепи
+    std::chrono::milliseconds openDuration{10000};  // Пауза опроса в разомкнутом состоянии
+    std::chrono::milliseconds slowResponse{0};      // Медленный цикл опроса (0 - половина интервала)
+    int maxStretch = 8;                             // Максимальное растяжение интервала опроса
+    std::string openQuality = "bad";                // Качество тегов при размыкании цепи
+    
+    static PollingPolicy fromJson(const json& settings);
+};
+
+// Опрос одного устройства (секции конфигурации) в отдельном потоке.
+// Задержка и доля ошибок отслеживаются по циклам опроса: при перегрузке интервал
+// растягивается, при устойчивых ошибках цепь размыкается и опрос приостанавливается.
+// Переменные разных классов обслуживания опрашиваются отдельными полосами со своими
+// сроками; наступивший срок критичной полосы прерывает чтение массовой между частями.
+// Цикл политики - полный проход одной полосы (все ее части), а не чтение одной части.
+// Обработчики без частичного чтения опрашиваются одной полосой целиком.
+class DevicePoller {
+public:
+    enum class BreakerState { Closed, Open, HalfOpen };
+    
+private:
+    std::unique_ptr<ProtocolHandler> handler;
+    std::shared_ptr<const json> variables;
+    std::atomic<int> pollingInterval;
+    std::atomic<bool> running{false};
+    std::mutex waitMutex;
+    std::condition_variable waitCondition;
+    std::thread thread;
+    
+    // Состояние политики опроса (защищено statsMutex)
+    mutable std::mutex statsMutex;
+    PollingPolicy policy;
+    BreakerState breakerState = BreakerState::Closed;
+    std::chrono::steady_clock::time_point openedAt;
+    int stretch = 1;
+    int consecutiveFailures = 0;
+    double latencyMs = 0.0;   // Скользящее среднее длительности цикла
+    double errorRate = 0.0;   // Скользящее среднее доли ошибочных чтений
+    uint64_t cycles = 0;
+    uint64_t failedCycles = 0;
+    uint64_t breakerOpens = 0;
+    QosPolicy qos;
+    std::array<LatencySlo, QosClass::Count> laneLatency;   // От наступления срока полосы до конца ее чтения
+    
+    // Полоса опроса класса обслуживания; массовые переменные читаются частями.
+    // Итоги частей накапливаются до конца прохода полосы
+    struct Lane {
+        std::vector<json> chunks;
+        size_t next = 0;
+        std::chrono::steady_clock::time_point due;
+        std::chrono::steady_clock::duration busy{};
+        uint64_t goodReads = 0;
+        uint64_t badReads = 0;
+    };
+    
+    void run();
+    bool pollAllowed();
+    // Чтение очередной части полосы; false - соединение потеряно во время чтения
+    bool pollChunk(Lane& lane);
+    void finishCycle(Lane& lane, bool connectionLost);
+    void splitLanes(const json& vars, std::array<Lane, QosClass::Count>& lanes) const;
+    void recordCycle(std::chrono::steady_clock::duration latency, double cycleErrorRate);
+    std::chrono::milliseconds effectiveInterval() const;
+    std::chrono::milliseconds laneInterval(QosClass::Value lane) const;
+    
+public:
+    DevicePoller(std::unique_ptr<ProtocolHandler> protocolHandler, json vars, int intervalMs,
+                 const json& policySettings = json(), const json& qosSettings = json());
+    ~DevicePoller();
+    
+    void start();
+    void stop();
+    // Замена списка переменных без разрыва соединения с устройством
+    void updateVariables(json vars, int intervalMs);
+    void updatePolicy(const json& policySettings);
+    void updateQos(const json& qosSettings);
+    ProtocolHandler& getHandler();
+    BreakerState state() const;
+    // Метрики политики: состояние цепи, интервалы, задержка и доля ошибок, полосы опроса
+    json metrics() const;
+};
+
+// Репликация: основной сервер передает резервным журнал обновлений кэша в двоичном виде.
+// Кадр: [тип u8][длина u32][данные], целые числа - big-endian; после подключения передаются все текущие
+// значения с именами (SyncBegin ... SyncEnd), затем поток обновлений из кольца рассылки и Heartbeat при простое.
+// Подключения не аутентифицируются: порт слушает loopback, пока не задан bind_address доверенной сети.
+class ReplicationPublisher {
+public:
+    // secret - общий ключ получателей (пусто - без проверки); приветствие получателя
+    // ожидается не дольше handshakeTimeout
+    ReplicationPublisher(DataCache& cache, SubscriptionManager& manager, unsigned short port,
+                         std::chrono::milliseconds heartbeatInterval,
+                         const std::string& bindAddress = "127.0.0.1", std::string secret = {},
+                         std::chrono::milliseconds handshakeTimeout = std::chrono::milliseconds(5000));
+    ~ReplicationPublisher();
+    
+    void start();
+    void stop();
+    // Фактический порт (при port = 0 выбирается системой)
+    unsigned short port() const;
+    size_t peerCount();
+    
+private:
+    struct Peer {
+        ip::tcp::socket socket;
+        std::unique_ptr<Subscription> subscription;
+        std::atomic<bool> active{true};
+        std::thread thread;
+        
+        Peer(ip::tcp::socket s, std::unique_ptr<Subscription> sub)
+            : socket(std::move(s)), subscription(std::move(sub)) {}
+    };
+    
+    DataCache& dataCache;
+    SubscriptionManager& subscriptionManager;
+    std::chrono::milliseconds heartbeatInterval;
+    std::string secret;
+    std::chrono::milliseconds handshakeTimeout;
+    uint64_t epoch = 0; // Случайный идентификатор кольца: позиции другого экземпляра недействительны
+    io_context io;
+    ip::tcp::acceptor acceptor;
+    std::thread acceptThread;
+    std::atomic<bool> running{false};
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Peer>> peers;
+    
+    void doAccept();
+    void runPeer(Peer& peer);
+    void removeInactive();
+};
+
+// Прием журнала репликации на резервном сервере. Если основной сервер молчит дольше
+// failoverTimeout, вызывается onStateChanged(false) - резервный начинает опрос сам;
+// после повторной полной синхронизации вызывается onStateChanged(true).
+class ReplicationReceiver {
+public:
+    using StateHandler = std::function<void(bool primaryAlive)>;
+    
+    ReplicationReceiver(DataCache& cache, std::string host, unsigned short port,
+                        std::chrono::milliseconds failoverTimeout, StateHandler onStateChanged,
+                        std::string secret = {});
+    ~ReplicationReceiver();
+    
+    void start();
+    void stop();
+    bool primaryAlive() const { return alive; }
+    uint64_t appliedUpdates() const { return applied; }
+    
+private:
+    DataCache& dataCache;
+    std::string host;
+    unsigned short port;
+    std::chrono::milliseconds failoverTimeout;
+    StateHandler onStateChanged;
+    std::string secret;
+    io_context io;
+    std::atomic<bool> running{false};
+    std::atomic<bool> alive{false};
+    std::atomic<uint64_t> applied{0};
+    // Используются только потоком приема
+    std::chrono::steady_clock::time_point lastContact;  // Последний кадр основного сервера
+    std::chrono::steady_clock::time_point lastActivity; // Последний кадр или подключение
+    bool pollingTakenOver = false;
+    uint64_t epoch = 0;    // Эпоха и позиция журнала для продолжения после переподключения
+    uint64_t position = 0;
+    std::mutex waitMutex;
+    std::condition_variable waitCondition;
+    std::thread thread;
+    
+    void run();
+    void receive();
+    // Чтение доступных байтов; исключение при разрыве, остановке или молчании до deadline
+    size_t readSome(ip::tcp::socket& socket, char* data, size_t size);
+    // Разбор кадров из буфера; возвращает количество обработанных байтов
+    size_t applyFrames(const char* data, size_t size);
+};
+
+// Подключение к нижестоящему серверу данных (иерархия шлюзов): журнал репликации принимается
+// как подписчик, значения записываются в локальный кэш под локальными ID. Переменные секции
+// задают соответствие: {"id", "name", "remote_id"} или {"id", "name", "remote_name"};
+// import_all {"id_offset", "name_prefix"} принимает и остальные переменные со сдвигом ID;
+// переменные, ID которых переполняется или занят локальной переменной, отбрасываются.
+// Кадры накапливаются в сокете между опросами и применяются пакетом; после переподключения
+// передача продолжается с последней принятой позиции без полной синхронизации.
+// Ключ источника - параметр подключения secret.
+class DataServerHandler : public ProtocolHandler {
+private:
+    struct LinkContext {
+        io_context io;
+        ip::tcp::socket socket{io};
+        std::chrono::milliseconds timeout{5000};
+        std::chrono::steady_clock::time_point lastFrame;
+        std::vector<char> buffer = std::vector<char>(256 * 1024);
+        size_t filled = 0;
+    };
+    
+    struct LocalTag {
+        int64_t id;
+        std::string name;
+    };
+    
+    std::unique_ptr<LinkContext> context;
+    uint64_t epoch = 0;
+    uint64_t position = 0;
+    std::atomic<uint64_t> fullSyncs{0};
+    bool importAll = false;
+    int64_t idOffset = 0;
+    std::string namePrefix;
+    
+    // Соответствие удаленных ID локальным; remote_name разрешается по именам из синхронизации
+    json mappedVariables;
+    std::unordered_map<int64_t, LocalTag, Int64Hash> idMap;
+    std::unordered_map<std::string, LocalTag> nameMap;
+    std::unordered_map<int64_t, std::string, Int64Hash> remoteNames;
+    // import_all: принятые удаленные ID -> локальные, отброшенные удаленные ID
+    std::unordered_map<int64_t, int64_t, Int64Hash> importedIds;
+    std::unordered_set<int64_t, Int64Hash> rejectedIds;
+    std::unordered_set<int64_t, Int64Hash> mappedLocalIds;
+    
+    bool updateMapping(const json& variables);
+    // Локальный ID переменной import_all; false - значение отбрасывается
+    bool importedId(int64_t remoteId, const std::string& localName, int64_t& localId);
+    size_t applyFrames(const char* data, size_t size);
+    
+public:
+    DataServerHandler(DataCache& cache, const std::string& deviceName = "data_server",
+                      const json& importSettings = json());
+    
+    json readData(const json& variables) override;
+    // Другой объект переменных - новое соответствие ID и полная синхронизация
+    bool supportsPartialReads() const override { return false; }
+    void disconnect() override;
+    uint64_t resumePosition() const { return position; }
+    uint64_t fullSyncCount() const { return fullSyncs; }
+    
+protected:
+    bool trySpecificConnect(const json& connectionParams) override;
+    bool usesTcp() const override { return true; }
+    ip::tcp::socket* createTcpContext() override;
+    bool onTcpConnected(const json& endpoint) override;
+};
+
+// Вычисляемые переменные
+// Выражение над значениями других переменных: $<id>, числа, true/false, + - * / %,
+// сравнения, && || !, условие ?: и функции abs, sqrt, round, pow, min, max, sum, avg.
+// Компилируется один раз в байт-код стековой машины; входы - слоты в порядке inputs().
+class Expression {
+public:
+    // Синтаксическая ошибка - std::invalid_argument с позицией в тексте
+    static Expression compile(std::string_view text);
+    
+    const std::vector<int64_t>& inputs() const { return inputIds; }
+    // Результат логический (сравнение, &&, ||, !) - публикуется как bool
+    bool isBoolean() const { return boolean; }
+    // values[i] - значение входа inputs()[i]; stack - рабочий буфер вызывающего
+    double evaluate(const double* values, std::vector<double>& stack) const;
+    
+private:
+    enum class Op : uint8_t {
+        Const, Input, Neg, Not, Add, Sub, Mul, Div, Mod,
+        Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual, And, Or, Select,
+        Abs, Sqrt, Round, Pow, Min, Max, Sum, Avg
+    };
+    
+    struct Instruction {
+        Op op;
+        uint32_t arg = 0;      // Слот входа или количество аргументов функции
+        double value = 0.0;    // Константа
+    };
+    
+    class Parser;
+    
+    std::vector<Instruction> code;
+    std::vector<int64_t> inputIds;
+    size_t maxDepth = 0;
+    bool boolean = false;
+};
+
+// Движок вычисляемых переменных: переменная пересчитывается только при изменении одного
+// из ее входов. Изменения читаются из кольца рассылки пакетами, результат записывается в кэш
+// как обычная переменная. Вычисляемые переменные могут ссылаться друг на друга: порядок
+// вычисления топологический, циклы отклоняются. Качество результата - худшее из качеств входов.
+class DerivedTagEngine {
+public:
+    struct Definition {
+        int64_t id;
+        std::string name;
+        std::string expression;
+    };
+    
+    DerivedTagEngine(DataCache& cache, SubscriptionManager& manager);
+    ~DerivedTagEngine();
+    
+    // Определения из секции {"variables": {<ключ>: {"id", "name", "expression"}}}
+    static std::vector<Definition> definitionsFromJson(const json& section);
+    
+    // Компиляция при остановленном движке; ошибочные выражения и циклы пропускаются
+    void configure(const std::vector<Definition>& definitions);
+    void start();
+    void stop();
+    size_t tagCount() const { return tags.size(); }
+    // Ошибки последней компиляции: имя переменной -> описание
+    const std::map<std::string, std::string>& errors() const { return compileErrors; }
+    uint64_t evaluationCount() const { return evaluations; }
+    
+private:
+    struct Input {
+        double value = 0.0;
+        ValueUpdate::Quality quality = ValueUpdate::Quality::Bad;
+        bool known = false;
+        std::vector<size_t> dependents; // Индексы в tags
+    };
+    
+    struct Tag {
+        int64_t id;
+        std::string name;
+        Expression expression;
+        std::vector<const Input*> sources;
+        bool published = false;
+        double lastValue = 0.0;
+        ValueUpdate::Quality lastQuality = ValueUpdate::Quality::Good;
+    };
+    
+    DataCache& dataCache;
+    SubscriptionManager& subscriptionManager;
+    std::vector<Tag> tags; // В топологическом порядке: входы раньше зависимых
+    std::unordered_map<int64_t, Input, Int64Hash> inputs;
+    std::map<std::string, std::string> compileErrors;
+    // Очередь пересчета по возрастанию индекса сохраняет топологический порядок
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> pending;
+    std::vector<char> queued;
+    std::vector<double> values;
+    std::vector<double> stack;
+    std::atomic<uint64_t> evaluations{0};
+    std::atomic<bool> running{false};
+    std::thread thread;
+    
+    void run();
+    void loadInputs();
+    void setInput(Input& input, double value, ValueUpdate::Quality quality);
+    void evaluatePending();
+    void evaluate(size_t index);
+};
+
+// Тревоги и события
+struct AlarmEvent {
+    enum class Type : uint8_t { Raised, Cleared, Acknowledged };
+    
+    uint64_t sequence = 0;
+    int64_t timestampMs = 0;
+    Type type = Type::Raised;
+    std::string rule;
+    int64_t tagId = 0;
+    double value = 0.0;
+    int severity = 0;
+    std::string message;
+    
+    json toJson() const;
+    static AlarmEvent fromJson(const json& event);
+};
+
+// Движок тревог в пути записи значений: верхняя и нижняя уставки, скорость изменения,
+// гистерезис (deadband) и квитирование. Правила проиндексированы по ID переменной -
+// запись значения проверяет только ссылающиеся на нее правила. События нумеруются,
+// хранятся в ограниченной очереди для подписчиков и в журнале на диске (JSON-строки;
+// при заполнении файл переносится в <файл>.1, на диске не более 2 * max_events событий).
+class AlarmEngine {
+public:
+    enum class RuleType : uint8_t { High, Low, Rate };
+    
+    AlarmEngine() = default;
+    
+    // Секция alarms: {"journal": {"file", "max_events"}, "rules": {<имя>: {"tag", "type",
+    // "limit", "deadband", "severity", "message"}}}; состояние неизмененных правил сохраняется
+    void configure(const json& section);
+    // Вызывается кэшем после записи значения; sequence - номер записи в кэше. Записи одной
+    // переменной из разных потоков могут прийти не по порядку: значение старше уже проверенного
+    // пропускается, состояние тревог соответствует последней записи
+    void evaluate(int64_t id, const HistoricalValue& value, uint64_t sequence);
+    // false - правило не найдено или тревога уже квитирована
+    bool acknowledge(const std::string& rule);
+    // Активные и неквитированные тревоги
+    json activeAlarms();
+    // События с номером больше since; при их отсутствии ожидание до timeout
+    std::vector<AlarmEvent> eventsSince(uint64_t since, size_t limit,
+                                        std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    uint64_t lastSequence();
+    size_t ruleCount();
+    
+    // Уведомление о каждом событии (вызывается вне блокировки движка)
+    boost::signals2::signal<void(const AlarmEvent&)> onEvent;
+    
+private:
+    struct Rule {
+        std::string name;
+        int64_t tagId = 0;
+        RuleType type = RuleType::High;
+        double limit = 0.0;
+        double deadband = 0.0;
+        int severity = 0;
+        std::string message;
+        // Состояние
+        bool active = false;
+        bool acknowledged = true;
+        bool hasValue = false;
+        double lastValue = 0.0;
+        int64_t lastTimestampMs = 0;
+        int64_t raisedAtMs = 0;
+        uint64_t lastSequence = 0;
+    };
+    
+    // Фильтр ID с правилами: запись значения без правил не берет блокировку движка
+    static constexpr size_t kFilterBits = 4096;
+    std::array<std::atomic<uint64_t>, kFilterBits / 64> tagFilter{};
+    
+    std::mutex mutex;
+    std::vector<Rule> rules;
+    std::unordered_map<int64_t, std::vector<size_t>, Int64Hash> rulesByTag;
+    std::deque<AlarmEvent> events;
+    size_t maxEvents = 1000;
+    uint64_t nextSequence = 1;
+    std::condition_variable eventAdded;
+    
+    std::mutex journalMutex;
+    std::string journalFile;
+    std::ofstream journal;
+    size_t journalLines = 0;
+    
+    static size_t filterBit(int64_t id) { return Int64Hash{}(id) % kFilterBits; }
+    void record(Rule& rule, AlarmEvent::Type type, int64_t timestampMs, std::vector<AlarmEvent>& emitted);
+    void publish(const std::vector<AlarmEvent>& emitted);
+    void openJournal(const std::string& file);
+};
+
+// Экспорт в вышестоящий архив (store-and-forward)
+// Дисковая очередь из файлов-сегментов, отображенных в память. Записи добавляются в конец
+// последнего сегмента; номер последней подтвержденной записи хранится в отображенном файле
+// cursor и переживает перезапуск. Подтвержденные сегменты удаляются; при превышении
+// maxSegments удаляется самый старый сегмент - добавление никогда не блокируется.
+// Добавленная запись и новая позиция cursor сбрасываются на диск (msync) до возврата,
+// поэтому переживают и сбой питания. Один писатель и один читатель.
+class DiskQueue {
+public:
+    struct Record {
+        uint64_t sequence = 0;
+        std::string data;
+    };
+    
+    DiskQueue(const std::string& directory, size_t segmentSize = 4 * 1024 * 1024, size_t maxSegments = 64);
+    ~DiskQueue();
+    DiskQueue(const DiskQueue&) = delete;
+    DiskQueue& operator=(const DiskQueue&) = delete;
+    
+    uint64_t append(std::string_view data);
+    // Первая неподтвержденная запись; false - очередь пуста
+    bool front(Record& record);
+    // Подтверждение записей до sequence включительно
+    void acknowledge(uint64_t sequence);
+    uint64_t backlog();
+    // Записи, удаленные без подтверждения при переполнении
+    uint64_t dropped();
+    size_t segmentCount();
+    
+private:
+    struct Segment {
+        uint64_t index = 0;
+        std::string path;
+        char* data = nullptr;
+        size_t size = 0;
+        size_t writeOffset = 0;
+        uint64_t firstSequence = 0; // 0 - в сегменте нет записей
+        uint64_t lastSequence = 0;
+    };
+    
+    std::mutex mutex;
+    std::string directory;
+    size_t segmentSize;
+    size_t maxSegments;
+    std::deque<Segment> segments;
+    uint64_t* acked = nullptr;
+    uint64_t nextSequence = 1;
+    size_t readOffset = 0; // Позиция чтения в первом сегменте
+    uint64_t droppedRecords = 0;
+    
+    Segment mapSegment(uint64_t index, size_t size);
+    void unmapSegment(Segment& segment, bool remove);
+    void dropFront();
+    void syncCursor();
+};
+
+// Получатель экспортируемых пакетов (архив); реализации подключаются через createTarget
+class HistorianTarget {
+public:
+    virtual ~HistorianTarget() = default;
+    virtual bool connect() = 0;
+    // true - получатель подтвердил прием пакета
+    virtual bool send(uint64_t sequence, std::string_view batch) = 0;
+    virtual void disconnect() = 0;
+    virtual std::string describe() const = 0;
+};
+
+// Архив по TCP: кадр [u32 длина][u64 номер][пакет], подтверждение - [u64 номер];
+// целые числа - big-endian
+class TcpHistorianTarget : public HistorianTarget {
+public:
+    TcpHistorianTarget(const std::string& host, unsigned short port, std::chrono::milliseconds timeout);
+    
+    bool connect() override;
+    bool send(uint64_t sequence, std::string_view batch) override;
+    void disconnect() override;
+    std::string describe() const override;
+    
+private:
+    io_context io;
+    ip::tcp::socket socket{io};
+    std::string host;
+    unsigned short port;
+    std::chrono::milliseconds timeout;
+};
+
+// Экспорт обновлений кэша: сборщик читает кольцо рассылки, формирует сжатые пакеты
+// и записывает их в дисковую очередь; отправитель передает пакеты получателю и удаляет
+// подтвержденные. Накопленное за время обрыва передается с ограниченной скоростью.
+// Опрос устройств не блокируется: сборщик читает кольцо со своего курсора.
+class HistorianExporter {
+public:
+    struct Settings {
+        std::string directory = "export_queue";
+        size_t segmentSize = 4 * 1024 * 1024;
+        size_t maxSegments = 64;
+        size_t batchSize = 1000;
+        std::chrono::milliseconds batchInterval{1000};
+        double replayRate = 20.0; // Пакетов в секунду при передаче накопленного
+        std::chrono::milliseconds retryInterval{2000};
+        
+        static Settings fromJson(const json& settings);
+    };
+    
+    HistorianExporter(DataCache& cache, SubscriptionManager& manager,
+                      std::unique_ptr<HistorianTarget> target, const Settings& settings);
+    ~HistorianExporter();
+    
+    // Получатель по секции target: {"type": "tcp", "host", "port", "timeout_ms"}
+    static std::unique_ptr<HistorianTarget> createTarget(const json& settings);
+    // Пакет: [u32 размер JSON][deflate JSON [[id, t, q, v], ...]]
+    static std::string encodeBatch(const json& updates);
+    static json decodeBatch(std::string_view batch);
+    
+    void start();
+    void stop();
+    json metrics();
+    
+private:
+    DataCache& dataCache;
+    SubscriptionManager& subscriptionManager;
+    std::unique_ptr<HistorianTarget> target;
+    Settings settings;
+    DiskQueue queue;
+    std::atomic<bool> running{false};
+    std::atomic<bool> connected{false};
+    std::atomic<uint64_t> sentBatches{0};
+    std::thread collector;
+    std::thread sender;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    
+    void collect();
+    void forward();
+    void flush(json& batch);
+    // Пауза, прерываемая остановкой; false - экспорт остановлен
+    bool pause(std::chrono::steady_clock::time_point until);
+};
+
+#ifdef HAVE_IO_URING
+// Сетевой цикл TCP-сервера на io_uring (сборка с ENABLE_IO_URING, ядро 6.0+), без liburing.
+// Прием соединений и чтение запросов - многоразовые операции (multishot accept/recv)
+// с кольцом предоставленных буферов; короткие ответы отправляются из зарегистрированных
+// буферов (SEND_ZC с IORING_RECVSEND_FIXED_BUF). Подготовленные за итерацию операции
+// передаются ядру одним вызовом io_uring_enter. Запросы обрабатываются пулом потоков, готовые ответы
+// возвращаются в цикл через eventfd.
+class IoUringServer {
+public:
+    struct Settings {
+        unsigned entries = 1024;            // Размер очереди отправки
+        unsigned recvBuffers = 1024;        // Буферов приема, степень двойки
+        size_t recvBufferSize = 4096;
+        unsigned sendBuffers = 256;         // Зарегистрированных буферов ответа
+        size_t sendBufferSize = 16 * 1024;
+        size_t workers = 2;
+        size_t maxRequestLine = 64 * 1024 * 1024; // Строка запроса длиннее - соединение закрывается
+        
+        static Settings fromJson(const json& settings);
+    };
+    
+    // Обработка запроса: received - принятые байты, первая строка - запрос.
+    // true - ответ response отправляется циклом и соединение закрывается;
+    // false - обработчик забрал дескриптор (потоковые ответы, подписки, WebSocket)
+    using Handler = std::function<bool(int fd, std::string& received, std::string& response)>;
+    
+    IoUringServer(Settings settings, Handler handler);
+    ~IoUringServer();
+    IoUringServer(const IoUringServer&) = delete;
+    IoUringServer& operator=(const IoUringServer&) = delete;
+    
+    // Ядро поддерживает многоразовые accept и recv и кольца буферов
+    static bool supported();
+    // Слушающий сокет; port = 0 - выбирается системой, возвращается фактический порт
+    unsigned short listen(unsigned short port);
+    // Цикл обработки до stop()
+    void run();
+    void stop();
+    unsigned short port() const { return listenPort; }
+    // Соединения, запросы, вызовы io_uring_enter и переданные ядру операции
+    json metrics() const;
+    
+private:
+    enum class Op : uint8_t { Accept, Recv, Cancel, Send, Close, Wake };
+    enum class State : uint8_t { Reading, Cancelling, Processing, Sending, Closing };
+    
+    struct Connection {
+        State state = State::Reading;
+        bool recvArmed = false;
+        std::string received;
+        std::string response;
+        size_t sent = 0;
+        int sendBuffer = -1;        // Индекс зарегистрированного буфера или -1
+        unsigned notifications = 0; // Ожидаемые уведомления SEND_ZC об освобождении буфера
+        bool sendDone = false;
+        uint64_t generation = 0;    // Номер соединения: дескриптор переиспользуется после закрытия
+    };
+    
+    struct Job {
+        int fd;
+        uint64_t generation;
+        std::string received;
+    };
+    
+    struct Completion {
+        int fd;
+        uint64_t generation;
+        bool handled;
+        std::string response;
+    };
+    
+    Settings settings;
+    Handler handler;
+    int ringFd = -1;
+    int listenFd = -1;
+    int wakeFd = -1;
+    std::atomic<bool> stopping{false};
+    std::atomic<unsigned short> listenPort{0};
+    
+    // Отображения колец отправки и завершения
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned pendingSqes = 0;
+    // Завершения, снятые с кольца до обработки: освобождают место при переполнении
+    std::deque<io_uring_cqe> reaped;
+    
+    // Кольцо предоставленных буферов приема и зарегистрированные буферы ответов
+    io_uring_buf_ring* recvRing = nullptr;
+    size_t recvRingSize = 0;
+    std::unique_ptr<char[]> recvMemory;
+    std::unique_ptr<char[]> sendMemory;
+    std::vector<int> freeSendBuffers;
+    uint64_t wakeValue = 0;
+    
+    std::unordered_map<int, Connection> connections;
+    uint64_t nextGeneration = 0;
+    
+    // Пул обработчиков запросов
+    std::mutex jobsMutex;
+    std::condition_variable jobsCondition;
+    std::deque<Job> jobs;
+    std::vector<std::thread> workers;
+    std::mutex completionsMutex;
+    std::vector<Completion> completions;
+    
+    std::atomic<uint64_t> acceptedCount{0};
+    std::atomic<uint64_t> requestCount{0};
+    std::atomic<uint64_t> enterCount{0};
+    std::atomic<uint64_t> sqeCount{0};
+    
+    void setupRing();
+    void teardown();
+    io_uring_sqe* nextSqe();
+    unsigned submit(unsigned waitFor);
+    void reapCompletions();
+    static uint64_t userData(Op op, int fd) { return (static_cast<uint64_t>(op) << 32) | static_cast<uint32_t>(fd); }
+    
+    void armAccept();
+    void armRecv(int fd);
+    void armWake();
+    void recycleRecvBuffer(unsigned short bufferId);
+    void handleCqe(const io_uring_cqe& cqe);
+    void onRecv(int fd, const io_uring_cqe& cqe);
+    void dispatch(int fd);
+    void startSend(int fd);
+    void submitSend(int fd, Connection& connection);
+    void continueSend(int fd, const io_uring_cqe& cqe);
+    void closeConnection(int fd);
+    void drainCompletions();
+    void workerLoop();
+};
+#endif
+
+// Права соединения TCP-сервера на изменяющие действия (update_config, save_config,
+// ack_alarm, SAVE_CONFIG)
+struct ClientAuth {
+    bool write = false;
+    bool encrypted = false; // Соединение через TLS-порт: принимаются токены
+    std::string client;     // CN сертификата клиента или имя токена
+};
+
+// TLS-порт TCP-сервера (server_settings.tls). Соединения постоянные: по одному соединению
+// передается любое число JSON-строк, текстовых команд или кадров BINARY, поэтому полное
+// рукопожатие выполняется один раз на клиента. Только TLS 1.3 (1-RTT, группы X25519/P-256);
+// переподключение возобновляет сессию по билету без обмена сертификатами.
+// Запись разрешена клиенту с сертификатом, подписанным ca_file (mTLS), или
+// предъявившему токен из tokens (команда AUTH или поле "token" запроса).
+class TlsServer {
+public:
+    struct Settings {
+        unsigned short port = 8443;                 // 0 - выбирается системой
+        std::string certFile;
+        std::string keyFile;
+        std::string caFile;                         // Корневые сертификаты клиентов; пусто - без mTLS
+        bool requireClientCert = false;
+        std::vector<std::string> writeClients;      // CN с правом записи; пусто - любой проверенный
+        std::vector<std::pair<std::string, std::string>> tokens; // Имя клиента и токен
+        bool sessionTickets = true;                 // false - возобновление по кэшу сессий сервера
+        size_t sessionCacheSize = 1024;
+        std::chrono::seconds sessionTimeout{3600};
+        bool allowPlaintextWrites = false;          // Запись и через открытый порт tcp_port
+        std::chrono::milliseconds handshakeTimeout{10000};
+        std::chrono::milliseconds idleTimeout{300000}; // Ожидание запроса; 0 - без ограничения
+        
+        static Settings fromJson(const json& settings);
+    };
+    
+    using Stream = ssl::stream<ip::tcp::socket>;
+    
+    // Срок ожидания данных клиента. Синхронное чтение не ограничено по времени, поэтому
+    // соединение с истекшим сроком закрывает поток приема
+    class Deadline {
+    public:
+        // Срок через timeout от текущего момента; 0 - без срока
+        void expireAfter(std::chrono::milliseconds timeout);
+        void cancel() { at.store(0, std::memory_order_relaxed); }
+        bool expired(std::chrono::steady_clock::time_point now) const;
+        
+    private:
+        std::atomic<std::chrono::steady_clock::rep> at{0};
+    };
+    
+    // Обработка соединения после рукопожатия до закрытия клиентом; idle взводится
+    // обработчиком на время ожидания очередного запроса
+    using Handler = std::function<void(Stream& stream, ClientAuth& auth, Deadline& idle)>;
+    
+    TlsServer(Settings settings, Handler handler);
+    ~TlsServer();
+    TlsServer(const TlsServer&) = delete;
+    TlsServer& operator=(const TlsServer&) = delete;
+    
+    // Прием соединений в собственном потоке
+    void start();
+    // Закрывает соединения и ожидает завершения их обработчиков
+    void stop();
+    bool isRunning() const { return running; }
+    unsigned short port() const { return listenPort; }
+    std::chrono::milliseconds idleTimeout() const { return settings.idleTimeout; }
+    // Право записи по токену; false - токен неизвестен
+    bool authorize(std::string_view token, ClientAuth& auth) const;
+    void recordDenied() { ++deniedCount; }
+    // Полные и возобновленные рукопожатия, ошибки, отказы в записи, открытые и закрытые
+    // по сроку соединения
+    json metrics() const;
+    
+private:
+    Settings settings;
+    Handler handler;
+    ssl::context context;
+    io_context io;
+    ip::tcp::acceptor acceptor;
+    std::thread acceptThread;
+    std::atomic<bool> running{false};
+    std::atomic<unsigned short> listenPort{0};
+    
+    struct Session {
+        Stream stream;
+        Deadline deadline;
+        std::atomic<bool> active{true};
+        std::thread thread;
+        
+        Session(ip::tcp::socket socket, ssl::context& context) : stream(std::move(socket), context) {}
+    };
+    
+    // Открытые соединения: закрываются и ожидаются при остановке
+    std::mutex sessionsMutex;
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::atomic<size_t> openSessions{0};
+    
+    std::atomic<uint64_t> fullHandshakes{0};
+    std::atomic<uint64_t> resumedHandshakes{0};
+    std::atomic<uint64_t> failedHandshakes{0};
+    std::atomic<uint64_t> deniedCount{0};
+    std::atomic<uint64_t> timedOutSessions{0};
+    
+    void configureContext();
+    void acceptLoop();
+    void runSession(Session& session);
+    void removeInactive();
+    // Закрывает соединения с истекшим сроком рукопожатия или ожидания запроса
+    void closeExpired();
+    // Право записи по проверенному сертификату клиента
+    void identify(SSL* ssl, ClientAuth& auth) const;
 };
 
 // Главный класс сервера
 class DataServer {
 private:
-    std::map<std::string, std::unique_ptr<ProtocolHandler>> protocols;
+    std::map<std::string, std::unique_ptr<DevicePoller>> protocols;
     json config;
+    // Неизменяемая копия config для get_config: заменяется при загрузке и изменении
+    // конфигурации, запросы отправляют ее без копирования. Секреты в ней заменены
+    // отметкой "<redacted>", update_config восстанавливает их из текущей конфигурации
+    std::shared_ptr<const json> configSnapshot = std::make_shared<const json>();
+    std::mutex configMutex; // Защищает config, configSnapshot и protocols
+    // Запуск и остановка опросчиков по очереди; захватывается до configMutex
+    std::mutex pollersMutex;
     DataCache dataCache;
     SubscriptionManager subscriptionManager;
     std::atomic<bool> running{false};
     std::vector<std::thread> pollingThreads;
     std::string configFile;
     std::chrono::steady_clock::time_point lastConfigCheck;
+    // Отпечаток файла конфигурации для дешевой проверки изменений
+    std::filesystem::file_time_type configMtime{};
+    std::uintmax_t configSize = 0;
+    uint64_t configHash = 0;
+    // Таблица тегов и необязательный файл ее кэша
+    std::unique_ptr<TagTable> tagTable;
+    // Индекс имен текущей таблицы тегов (под configMutex)
+    TagNameIndex nameIndex;
+    std::string tagCacheFile;
+    bool tagCacheHit = false;
+    // Буферы потоковых ответов TCP-клиентам и арены текстовых команд
+    BufferPool responseBuffers;
+    BufferPool requestArenas{16 * 1024, 128};
+    // Снимок кэша для теплого старта (server_settings.snapshot)
+    std::string snapshotFile;
+    std::chrono::milliseconds snapshotInterval{5000};
+    size_t snapshotHistoryDepth = 10;
+    // Репликация (server_settings.replication): основной сервер или резервный;
+    // на резервном опрос устройств включается только при отказе основного
+    std::unique_ptr<ReplicationPublisher> replicationPublisher;
+    std::unique_ptr<ReplicationReceiver> replicationReceiver;
+    std::atomic<bool> pollingActive{false};
+    // Смена состояния основного сервера передается отдельному потоку: прием репликации
+    // и обнаружение отказа не ждут остановки опросчиков
+    std::mutex pollingSwitchMutex;
+    std::condition_variable pollingSwitchCondition;
+    std::optional<bool> pollingSwitch;
+    // Вычисляемые переменные (секция derived)
+    std::unique_ptr<DerivedTagEngine> derivedTags;
+    // Тревоги (секция alarms)
+    AlarmEngine alarmEngine;
+    // Экспорт в архив (server_settings.export)
+    std::unique_ptr<HistorianExporter> exporter;
+    // Фактический порт TCP-сервера (0 - сервер не запущен)
+    std::atomic<unsigned short> tcpListenPort{0};
+    // Предельное время передачи клиенту (server_settings.network.write_timeout_ms)
+    std::atomic<int> writeTimeoutMs{10000};
+    // Сокеты соединений TCP-сервера; живет дольше цикла приема, пока сервер существует
+    io_service tcpService;
+#ifdef HAVE_IO_URING
+    // Сетевой цикл io_uring (server_settings.network.backend = "io_uring")
+    std::unique_ptr<IoUringServer> uringServer;
+    std::mutex uringMutex;
+#endif
+    // TLS-порт (server_settings.tls). Запись через открытый порт запрещается только при
+    // включенном TLS без allow_plaintext_writes; без TLS она разрешена любому клиенту сети
+    std::unique_ptr<TlsServer> tlsServer;
+    std::mutex tlsMutex;
+    std::atomic<bool> plaintextWrites{true};
+    // Предельная длина строки текстового запроса; соединение с более длинной строкой закрывается
+    static constexpr size_t MAX_REQUEST_LINE = 64 * 1024 * 1024;
+    
+    // Цикл приема соединений на блокирующих вызовах asio (epoll)
+    void runAsioServer(unsigned short port);
+    // Короткий JSON-запрос, ответ на который формируется целиком; false - нужен поток соединения
+    bool respondInline(std::string_view request, std::string& response);
+    void startTlsServer(const json& section);
+    ClientAuth plaintextAuth() const { return ClientAuth{plaintextWrites, false, ""}; }
+    bool isWriteRequest(const json& request) const;
+    // Ответ на запрос клиента сети: изменяющие действия - только при праве записи
+    json handleClientRequest(const json& request, ClientAuth& auth);
+    std::unique_ptr<ProtocolHandler> createHandler(const std::string& proto, const json& protoConfig);
+    void writeConfigFile(const std::string& filename);
+    void updateConfigFingerprint(const std::string& content);
+    void rebuildTagTable(uint64_t contentHash = 0, uint64_t contentSize = 0, uint32_t generatedIds = 0);
+    void installTagTable(std::vector<TagTable::Entry> entries, int64_t maxId,
+                         uint64_t contentHash, uint64_t contentSize, uint32_t generatedIds = 0);
+    // Замена таблицы тегов с обновлением индекса имен; вызывается под configMutex
+    void setTagTable(std::unique_ptr<TagTable> table);
+    // Замена configSnapshot; вызывается под configMutex
+    void publishConfigSnapshot();
+    std::shared_ptr<const json> configView();
+    void restoreSnapshot();
+    void writeSnapshot();
+    void startReplication();
+    void setPollingActive(bool active);
+    // Перекомпиляция и запуск движка вычисляемых переменных; вызывается под configMutex
+    void startDerivedTags(const json& section);
+    void startExport();
+    // Политика классов обслуживания секции: server_settings.qos, уточненная полем "qos" секции
+    json qosSettings(const json& section) const;
+    // Классы обслуживания переменных для рассылки подписчикам; вызывается под configMutex
+    void updateQosClasses();
+    // ID из variable_id, variable_ids и шаблонов имен names (* и ?) без повторов
+    std::vector<int64_t> resolveRequestIds(const json& request);
+    bool isBatchRequest(const json& request) const;
+    bool isStreamedRequest(const json& request) const;
+    void writeStreamedResponse(const json& request, JsonChunkWriter& writer);
+    void writeAllValues(JsonChunkWriter& writer);
+    void writeHistory(const HistoricalValue* samples, size_t count, JsonChunkWriter& writer);
+    void handleTextCommand(const TextCommand& command, ip::tcp::socket& socket, std::pmr::memory_resource& arena);
+    // Ответ на GET_ALL, GET_HISTORY и GET_CONFIG
+    void writeTextResponse(const TextCommand& command, JsonChunkWriter& writer, std::pmr::memory_resource& arena);
+    // Ответ на JSON-запрос: большие ответы передаются частями по мере сериализации
+    template <typename Stream>
+    void writeJsonResponse(Stream& stream, const json& request, ClientAuth& auth);
+    // Подключение WebSocket на том же порту: received - уже прочитанные байты HTTP-запроса
+    void handleWebSocket(ip::tcp::socket socket, std::string_view received);
+    // Постоянное соединение с кадрами MessagePack после команды BINARY: received - байты,
+    // прочитанные после команды; запросы конвейера обрабатываются по порядку
+    void handleBinarySession(ip::tcp::socket socket, std::string received);
+    template <typename Stream>
+    void runBinarySession(Stream& stream, std::string received, ClientAuth& auth,
+                          TlsServer::Deadline* idle = nullptr);
+    // Постоянное TLS-соединение: запросы обрабатываются по одному до закрытия клиентом
+    // или истечения срока ожидания запроса
+    void handleTlsClient(TlsServer::Stream& stream, ClientAuth& auth, TlsServer::Deadline& idle);
+    // SUBSCRIBE через TLS: обновления записывает поток соединения
+    void streamTlsSubscription(TlsServer::Stream& stream, int64_t variableId);
+    bool websocketEnabled();
+    // Блокирующая запись клиенту, не принимающему данные дольше writeTimeoutMs, завершается ошибкой:
+    // медленный клиент не удерживает буфер пула ответов
+    void setWriteDeadline(ip::tcp::socket& socket);
+    friend class WebSocketSession;
     
 public:
     DataServer() : subscriptionManager(dataCache) {}
+    ~DataServer();
+    // Файл скомпилированной базы тегов для быстрого старта (пустая строка - отключено)
+    void setTagCacheFile(const std::string& filename) ;
+    bool loadedFromTagCache() const ;
     void loadConfig(const std::string& filename) ;
     void restoreIdCounter() ;    
-    void generateMissingIds() ;    
+    size_t generateMissingIds() ;    
     void saveConfig(const std::string& filename = "") ;    
     void initializeProtocols() ;    
+    // Инкрементальное применение новой конфигурации: затрагиваются только измененные устройства
+    void applyConfigChanges(json newConfig) ;
     void startPolling() ;    
     void checkConfigUpdate() ;    
     void startTcpServer() ;    
-    void handleTcpClient(ip::tcp::socket socket) ;    
+    // received - байты запроса, уже прочитанные сетевым циклом
+    void handleTcpClient(ip::tcp::socket socket, std::string_view received = {}) ;    
+    unsigned short tcpPort() const { return tcpListenPort; }
+    // Порт TLS-сервера (0 - не запущен)
+    unsigned short tlsPort();
     json handleJsonRequest(const json& request) ;    
+    ProtocolHandler* getProtocolHandler(const std::string& proto) ;
+    // Опрашивает ли сервер устройства сам (на резервном - только после отказа основного)
+    bool isPolling() const { return pollingActive; }
+    // Порт журнала репликации основного сервера (0 - репликация не запущена)
+    unsigned short replicationPort() const;
     void stop() ;
 };
 
 
+// Сессия WebSocket для веб-HMI: подписка и отписка, пакетные кадры обновлений,
+// необязательное сжатие permessage-deflate. Обновления берутся из общего кольца рассылки;
+// все операции выполняются асинхронно в собственном io_context потока соединения.
+class WebSocketSession {
+public:
+    struct Settings {
+        bool permessageDeflate = true;
+        std::chrono::milliseconds batchInterval{50};
+        size_t maxQueuedFrames = 64; // При переполнении очереди чтение кольца приостанавливается
+    };
+    
+    // Дескриптор принятого соединения переносится вместе с его протоколом (IPv4 или IPv6)
+    WebSocketSession(DataServer& server, ip::tcp::socket::native_handle_type handle,
+                     const ip::tcp::socket::protocol_type& protocol, Settings settings);
+    
+    // Рукопожатие по уже прочитанным байтам запроса и обработка до закрытия соединения
+    void run(std::string_view received);
+    
+private:
+    DataServer& server;
+    Settings settings;
+    io_context io;
+    boost::beast::websocket::stream<ip::tcp::socket> ws;
+    steady_timer timer;
+    boost::beast::flat_buffer readBuffer;
+    std::unique_ptr<Subscription> subscription;
+    std::deque<std::string> outbox;
+    bool writing = false;
+    size_t urgentFrames = 0;   // Кадры критичных обновлений в начале очереди, еще не начатые
+    
+    void doRead();
+    void handleMessage(const std::string& text);
+    void scheduleTick();
+    void publishUpdates();
+    void sendValues(const char* type, const std::vector<int64_t>& ids);
+    void send(std::string frame);
+    void doWrite();
+};
+
 // Обработчик сигналов для graceful shutdown
 std::atomic<bool> shutdownRequested{false};
 
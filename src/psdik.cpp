@@ -51,23 +51,181 @@ void Logger::log(Level level, const std::string& message) {
                 << " [" << levelStr << "] " << message << std::endl;
 };
 
+// Размещение потоков
+ThreadPlacement& ThreadPlacement::getInstance() {
+    static ThreadPlacement instance;
+    return instance;
+}
+
+ThreadPlacement::Settings ThreadPlacement::Settings::fromJson(const json& settings) {
+    Settings result;
+    if (!settings.is_object()) return result;
+    result.enabled = settings.value("enabled", false);
+    
+    auto cpuList = [](const json& value) {
+        if (value.is_string()) return parseCpuList(value.get<std::string>());
+        std::vector<int> cpus;
+        if (value.is_array()) {
+            for (const auto& cpu : value) {
+                if (cpu.is_number_integer() && cpu.get<int64_t>() >= 0 && cpu.get<int64_t>() < CPU_SETSIZE) {
+                    cpus.push_back(cpu.get<int>());
+                }
+            }
+        }
+        return cpus;
+    };
+    
+    const json pollers = settings.value("pollers", json("numa"));
+    if (pollers == "numa") {
+        result.pollerSets = numaNodes();
+    } else {
+        for (int cpu : cpuList(pollers)) result.pollerSets.push_back({cpu});
+    }
+    result.ioCpus = cpuList(settings.value("io", json()));
+    return result;
+}
+
+void ThreadPlacement::configure(const Settings& settings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    current = settings;
+    nextPollerSet = 0;
+    enabled = settings.enabled;
+}
+
+bool ThreadPlacement::place(Role role) {
+    if (!enabled) return false;
+    
+    std::vector<int> cpus;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (role == Role::Poller) {
+            if (current.pollerSets.empty()) return false;
+            cpus = current.pollerSets[nextPollerSet++ % current.pollerSets.size()];
+        } else {
+            cpus = current.ioCpus;
+        }
+    }
+    return !cpus.empty() && pinCurrentThread(cpus);
+}
+
+bool ThreadPlacement::pinCurrentThread(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(static_cast<size_t>(cpu), &set);
+    }
+    if (CPU_COUNT(&set) == 0) return false;
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+std::vector<int> ThreadPlacement::parseCpuList(std::string_view list) {
+    std::vector<int> cpus;
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+        
+        while (!item.empty() && std::isspace(static_cast<unsigned char>(item.front()))) item.remove_prefix(1);
+        while (!item.empty() && std::isspace(static_cast<unsigned char>(item.back()))) item.remove_suffix(1);
+        int first = 0;
+        int last = 0;
+        auto parsed = std::from_chars(item.data(), item.data() + item.size(), first);
+        if (parsed.ec != std::errc()) continue;
+        last = first;
+        if (parsed.ptr < item.data() + item.size() && *parsed.ptr == '-') {
+            auto range = std::from_chars(parsed.ptr + 1, item.data() + item.size(), last);
+            if (range.ec != std::errc()) continue;
+        }
+        // Номер вне маски cpu_set_t - ошибка конфигурации, а не диапазон для перебора
+        if (first < 0 || last < first || last >= CPU_SETSIZE) continue;
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<std::vector<int>> ThreadPlacement::numaNodes() {
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0;; ++node) {
+        std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!f.is_open()) break;
+        std::string list;
+        std::getline(f, list);
+        auto cpus = parseCpuList(list);
+        if (!cpus.empty()) nodes.push_back(std::move(cpus));
+    }
+    if (nodes.empty()) {
+        std::vector<int> all(std::max(1u, std::thread::hardware_concurrency()));
+        std::iota(all.begin(), all.end(), 0);
+        nodes.push_back(std::move(all));
+    }
+    return nodes;
+}
+
 
 
 // Кэш данных с историей
 
 void DataCache::updateValue(int64_t id, const std::string& name, const json& value, const std::string& quality = "good") {
-    std::lock_guard<std::mutex> lock(mutex);
-    HistoricalValue hv{value, std::chrono::system_clock::now(), quality};
+    store(id, &name, HistoricalValue{value, std::chrono::system_clock::now(), quality}, false);
+    
+    LOG_DEBUG("Updated value for " + name + " (ID: " + std::to_string(id) + "): " + value.dump());
+}
+
+bool DataCache::applyValue(int64_t id, const std::string& name, const HistoricalValue& value) {
+    return store(id, name.empty() ? nullptr : &name, value, true);
+}
+
+bool DataCache::store(int64_t id, const std::string* name, const HistoricalValue& hv, bool onlyNewer) {
+    std::unique_lock<std::mutex> lock(mutex);
     
+    if (onlyNewer) {
+        auto it = currentValues.find(id);
+        if (it != currentValues.end() && it->second.timestamp >= hv.timestamp) {
+            return false;
+        }
+    }
+    storeLocked(id, name, hv);
+    const uint64_t sequence = ++writeSequence;
+    lock.unlock();
+    
+    // Тревоги проверяются в пути записи, но вне блокировки кэша; порядок восстанавливается по номеру записи
+    if (AlarmEngine* alarms = alarmEngine.load(std::memory_order_acquire)) {
+        alarms->evaluate(id, hv, sequence);
+    }
+    return true;
+}
+
+size_t DataCache::setQuality(const std::vector<int64_t>& ids, const std::string& quality) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto now = std::chrono::system_clock::now();
+    size_t changed = 0;
+    for (int64_t id : ids) {
+        auto it = currentValues.find(id);
+        if (it == currentValues.end() || it->second.quality == quality) continue;
+        storeLocked(id, nullptr, HistoricalValue{it->second.value, now, quality});
+        ++changed;
+    }
+    return changed;
+}
+
+void DataCache::storeLocked(int64_t id, const std::string* name, const HistoricalValue& hv) {
     currentValues[id] = hv;
-    idToName[id] = name;
-    history[id].push_back(hv);
+    if (name) idToName[id] = *name;
+    auto& samples = history[id];
+    samples.push_back(hv);
     
-    if (history[id].size() > maxHistorySize) {
-        history[id].pop_front();
+    if (samples.size() > maxHistorySize) {
+        samples.pop_front();
     }
+    dirtyIds.insert(id);
     
-    LOG_DEBUG("Updated value for " + name + " (ID: " + std::to_string(id) + "): " + value.dump());
+    // Публикация под блокировкой: порядок обновлений в кольце совпадает с порядком в кэше
+    if (UpdateRing* ring = updateRing.load(std::memory_order_acquire)) {
+        ValueUpdate update = ValueUpdate::fromJson(id, hv.value,
+            std::chrono::duration_cast<std::chrono::milliseconds>(hv.timestamp.time_since_epoch()).count());
+        update.quality = ValueUpdate::qualityFromString(hv.quality);
+        ring->publish(update, hv.value);
+    }
 }
 
 std::vector<HistoricalValue> DataCache::getHistory(int64_t id, size_t count) {
@@ -120,468 +278,6627 @@ bool DataCache::idExists(int64_t id) {
     return idToName.find(id) != idToName.end();
 }
 
+void DataCache::removeValue(int64_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    currentValues.erase(id);
+    history.erase(id);
+    idToName.erase(id);
+    dirtyIds.insert(id);
+}
 
-// Базовый класс для протоколов с улучшенной обработкой ошибок
-
-ProtocolHandler::ProtocolHandler(const std::string& protoName, DataCache& cache) 
-    : name(protoName), dataCache(cache) {}
+HistorySeries DataCache::getNumericHistory(int64_t id, int64_t fromMs, int64_t toMs) {
+    HistorySeries series;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = history.find(id);
+    if (it == history.end()) return series;
     
+    series.timestamps.reserve(it->second.size());
+    series.values.reserve(it->second.size());
+    for (const auto& item : it->second) {
+        if (item.quality == "bad") continue;
+        
+        double value;
+        if (item.value.is_number()) {
+            value = item.value.get<double>();
+        } else if (item.value.is_boolean()) {
+            value = item.value.get<bool>() ? 1.0 : 0.0;
+        } else {
+            continue;
+        }
+        
+        int64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+            item.timestamp.time_since_epoch()).count();
+        if (timestamp < fromMs || timestamp > toMs) continue;
+        
+        series.timestamps.push_back(timestamp);
+        series.values.push_back(value);
+    }
+    return series;
+}
 
+std::vector<NamedValue> DataCache::getValues(const std::vector<int64_t>& ids) {
+    std::vector<NamedValue> result;
+    result.reserve(ids.size());
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int64_t id : ids) {
+        auto it = currentValues.find(id);
+        if (it == currentValues.end()) continue;
+        auto nameIt = idToName.find(id);
+        result.push_back({id, nameIt != idToName.end() ? nameIt->second : "Unknown", it->second});
+    }
+    return result;
+}
 
-void ProtocolHandler::setConnectionParameters(const json& config) {
-    connectionParams.clear();
-    connectionParams.push_back(config["primary"]);
-    
-    if (config.contains("secondary")) {
-        for (const auto& secondary : config["secondary"]) {
-            connectionParams.push_back(secondary);
-        }
+std::vector<std::pair<int64_t, std::vector<HistoricalValue>>> DataCache::getHistories(
+    const std::vector<int64_t>& ids, size_t count) {
+    std::vector<std::pair<int64_t, std::vector<HistoricalValue>>> result;
+    result.reserve(ids.size());
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int64_t id : ids) {
+        auto it = history.find(id);
+        if (it == history.end()) continue;
+        size_t n = std::min(count, it->second.size());
+        result.emplace_back(id, std::vector<HistoricalValue>(
+            it->second.end() - static_cast<std::ptrdiff_t>(n), it->second.end()));
     }
+    return result;
 }
 
-bool ProtocolHandler::connect() {
-    if (connectionParams.empty()) {
-        LOG_ERROR("No connection parameters for " + name);
-        return false;
+std::vector<int64_t> DataCache::getIds() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<int64_t> ids;
+    ids.reserve(currentValues.size());
+    for (const auto& [id, value] : currentValues) {
+        ids.push_back(id);
     }
+    return ids;
+}
+
+void DataCache::copyHistory(int64_t id, size_t count, std::pmr::vector<HistoricalValue>& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    out.clear();
+    auto it = history.find(id);
+    if (it == history.end()) return;
     
-    auto now = std::chrono::steady_clock::now();
-    if (connectionAttempts > 0) {
-        auto timeSinceLastAttempt = std::chrono::duration_cast<std::chrono::seconds>(
-            now - lastConnectionAttempt);
-        if (timeSinceLastAttempt.count() < (1 << connectionAttempts)) {
-            return false; // Экспоненциальная задержка
-        }
+    count = std::min(count, it->second.size());
+    out.assign(it->second.end() - static_cast<std::ptrdiff_t>(count), it->second.end());
+}
+
+// Пул буферов ответов
+BufferPool::BufferPool(size_t bufferSize, size_t maxBuffers)
+    : bufferSize(bufferSize), maxBuffers(std::max<size_t>(maxBuffers, 1)) {
+    freeBuffers.reserve(this->maxBuffers);
+}
+
+BufferPool::Lease::~Lease() {
+    if (buffer) pool->release(std::move(buffer));
+}
+
+BufferPool::Lease BufferPool::acquire(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!released.wait_for(lock, timeout, [this]() { return !freeBuffers.empty() || allocated < maxBuffers; })) {
+        throw std::runtime_error("Buffer pool exhausted");
     }
     
-    lastConnectionAttempt = now;
-    
-    for (size_t i = 0; i < connectionParams.size(); ++i) {
-        size_t idx = (currentConnectionIndex + i) % connectionParams.size();
-        LOG_INFO("Attempting to connect to " + name + " via " + 
-                    connectionParams[idx]["host"].get<std::string>());
-        
-        if (trySpecificConnect(connectionParams[idx])) {
-            connected = true;
-            connectionAttempts = 0;
-            currentConnectionIndex = idx;
-            LOG_INFO("Successfully connected to " + name);
-            return true;
-        }
+    if (!freeBuffers.empty()) {
+        auto buffer = std::move(freeBuffers.back());
+        freeBuffers.pop_back();
+        return Lease(*this, std::move(buffer));
     }
-    
-    connectionAttempts++;
-    connected = false;
-    LOG_ERROR("All connection attempts failed for " + name);
-    return false;
+    ++allocated;
+    return Lease(*this, std::make_unique<char[]>(bufferSize));
 }
 
-void ProtocolHandler::disconnect() {
-    connected = false;
-    LOG_INFO("Disconnected from " + name);
+size_t BufferPool::available() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return freeBuffers.size() + (maxBuffers - allocated);
 }
 
-bool ProtocolHandler::isConnected() const { return connected; }
+void BufferPool::release(std::unique_ptr<char[]> buffer) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeBuffers.push_back(std::move(buffer));
+    }
+    released.notify_one();
+}
 
-void ProtocolHandler::updateData(int64_t id, const std::string& varName, const json& value, const std::string& quality = "good") {
-    dataCache.updateValue(id, varName, value, quality);
-    onDataReceived(id, varName, value);
+// Потоковая запись JSON
+JsonChunkWriter::JsonChunkWriter(Sink sink, size_t chunkSize)
+    : sink(std::move(sink)), ownBuffer(std::make_unique<char[]>(std::max<size_t>(chunkSize, 1))),
+      buffer(ownBuffer.get()), capacity(std::max<size_t>(chunkSize, 1)) {}
+
+JsonChunkWriter::JsonChunkWriter(Sink sink, BufferPool& pool)
+    : sink(std::move(sink)), lease(pool.acquire()),
+      buffer(lease->data()), capacity(lease->size()) {}
+
+void JsonChunkWriter::append(const char* data, size_t length) {
+    while (length > 0) {
+        if (used == capacity) flush();
+        size_t n = std::min(length, capacity - used);
+        std::memcpy(buffer + used, data, n);
+        used += n;
+        data += n;
+        length -= n;
+    }
+}
+
+JsonChunkWriter& JsonChunkWriter::raw(std::string_view text) {
+    append(text.data(), text.size());
+    return *this;
 }
 
+JsonChunkWriter& JsonChunkWriter::number(int64_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    append(digits, static_cast<size_t>(result.ptr - digits));
+    return *this;
+}
 
-// Modbus handler
-bool ModbusTcpHandler::trySpecificConnect(const json& connectionParams) {
-    try {
-        // Здесь будет реальная реализация подключения Modbus
-        context = std::make_unique<ModbusContext>();
-        context->host = connectionParams["host"];
-        context->port = connectionParams["port"];
-        
-        // Имитация подключения
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        bool success = (rand() % 4 != 0); // 75% успешных подключений для демо
-        
-        if (success) {
-            LOG_INFO("Modbus connected to " + context->host + ":" + 
-                        std::to_string(context->port));
-            return true;
+JsonChunkWriter& JsonChunkWriter::string(std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    put('"');
+    for (char c : value) {
+        auto code = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            put('\\');
+            put(c);
+        } else if (code < 0x20) {
+            const char escaped[] = {'\\', 'u', '0', '0', hex[code >> 4], hex[code & 0x0f]};
+            append(escaped, sizeof(escaped));
+        } else {
+            put(c);
         }
-    } catch (const std::exception& e) {
-        LOG_ERROR("Modbus connection error: " + std::string(e.what()));
     }
-    return false;
+    put('"');
+    return *this;
 }
 
-json ModbusTcpHandler::readData(const json& variables) {
-    if (!connected) {
-        if (!connect()) {
-            return json::object();
+JsonChunkWriter& JsonChunkWriter::value(const json& value, int indent) {
+    // Скалярные значения записываются напрямую в формате nlohmann::json
+    switch (value.type()) {
+        case json::value_t::null:
+            return raw("null");
+        case json::value_t::boolean:
+            return raw(value.get<bool>() ? "true" : "false");
+        case json::value_t::number_integer:
+            return number(value.get<int64_t>());
+        case json::value_t::number_unsigned: {
+            char digits[24];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value.get<uint64_t>());
+            append(digits, static_cast<size_t>(result.ptr - digits));
+            return *this;
         }
-    }
-    
-    json result;
-    try {
-        for (const auto& [key, var] : variables.items()) {
-            try {
-                // Имитация чтения данных
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                
-                // Генерация тестовых данных
-                json value;
-                std::string type = var["type"];
-                if (type == "float32") {
-                    value = static_cast<float>(rand() % 1000) / 10.0f;
-                } else if (type == "uint16") {
-                    value = rand() % 65535;
-                } else if (type == "bool") {
-                    value = (rand() % 2) == 1;
-                } else if (type == "string") {
-                    value = "test_string_" + std::to_string(rand() % 100);
-                } else {
-                    value = "unknown_type";
-                }
-                
-                int64_t varId = var["id"];
-                std::string varName = var["name"];
-                
-                result[std::to_string(varId)] = {
-                    {"n", varName}, // Сокращенные ключи для экономии места
-                    {"v", value},
-                    {"t", type}
-                };
-                
-                updateData(varId, varName, value);
-                
-            } catch (const std::exception& e) {
-                LOG_ERROR("Error reading variable " + var["name"].get<std::string>() + 
-                            ": " + e.what());
-                updateData(var["id"], var["name"], json(), "bad");
-            }
+        case json::value_t::number_float: {
+            double x = value.get<double>();
+            if (!std::isfinite(x)) return raw("null");
+            char digits[64];
+            char* end = nlohmann::detail::to_chars(digits, digits + sizeof(digits), x);
+            append(digits, static_cast<size_t>(end - digits));
+            return *this;
         }
-    } catch (const std::exception& e) {
-        LOG_ERROR("Modbus read error: " + std::string(e.what()));
-        disconnect();
+        case json::value_t::string:
+            return string(value.get_ref<const std::string&>());
+        default:
+            break;
     }
     
-    return result;
+    if (!serializer) {
+        serializer.emplace(std::make_shared<Output>(*this), ' ');
+    }
+    serializer->dump(value, indent >= 0, false, static_cast<unsigned int>(std::max(indent, 0)));
+    return *this;
 }
 
-// Система подписки
-void SubscriptionManager::addSubscriber(int64_t variableId, ip::tcp::socket socket) {
-    std::lock_guard<std::mutex> lock(mutex);
-    subscribers[variableId].push_back(std::move(socket));
-    LOG_INFO("New subscription for variable ID: " + std::to_string(variableId));
+void JsonChunkWriter::flush() {
+    if (used > 0) {
+        sink(std::string_view(buffer, used));
+        used = 0;
+    }
 }
 
-void SubscriptionManager::notifySubscribers(int64_t variableId, const std::string& variableName, const json& value) {
-    std::lock_guard<std::mutex> lock(mutex);
-    auto it = subscribers.find(variableId);
-    if (it == subscribers.end()) return;
-    
-    // Компактный формат для экономии трафика
-    json message = {
-        {"i", variableId}, // "i" вместо "id"
-        {"n", variableName}, // "n" вместо "name"
-        {"v", value}, // "v" вместо "value"
-        {"t", std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()).count()}, // "t" вместо "timestamp"
-        {"type", "data_update"}
-    };
-    
-    std::string messageStr = message.dump() + "\n";
-    
-    auto& sockets = it->second;
-    for (auto itSocket = sockets.begin(); itSocket != sockets.end(); ) {
-        try {
-            write(*itSocket, buffer(messageStr));
-            ++itSocket;
-        } catch (const std::exception& e) {
-            LOG_WARNING("Subscriber disconnected: " + std::string(e.what()));
-            itSocket = sockets.erase(itSocket);
+// Отправка сообщений подписчикам
+GatherWriter::Options GatherWriter::Options::fromJson(const json& settings) {
+    Options options;
+    if (!settings.is_object()) return options;
+    options.zeroCopy = settings.value("zero_copy", false);
+    options.zeroCopyMinBytes = settings.value("zero_copy_min_bytes", options.zeroCopyMinBytes);
+    return options;
+}
+
+GatherWriter::GatherWriter(ip::tcp::socket& socket, Options options, Stats* stats)
+    : socket(socket), options(options), stats(stats) {
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    if (options.zeroCopy) {
+        int one = 1;
+        zeroCopyEnabled = ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+        if (!zeroCopyEnabled) {
+            LOG_WARNING("MSG_ZEROCOPY is not supported, subscriber updates are sent with writev");
         }
     }
+#endif
 }
 
-void SubscriptionManager::removeDisconnected() {
-    std::lock_guard<std::mutex> lock(mutex);
-    for (auto& [variable, sockets] : subscribers) {
-        sockets.erase(
-            std::remove_if(sockets.begin(), sockets.end(),
-                [](const ip::tcp::socket& socket) {
-                    return !socket.is_open();
-                }),
-            sockets.end()
-        );
+GatherWriter::~GatherWriter() {
+    // Сообщения освобождаются после уведомления ядра; при закрытии сокета ожидание ограничено
+    for (int attempt = 0; attempt < 10 && !inFlight.empty(); ++attempt) {
+        reapCompletions(100);
     }
 }
 
-
-// Главный класс сервера
-DataServer::DataServer() : subscriptionManager(dataCache) {
-    lastConfigCheck = std::chrono::steady_clock::now();
+void GatherWriter::add(Message message) {
+    batchBytes += message->size();
+    batch.push_back(std::move(message));
 }
 
-void DataServer::loadConfig(const std::string& filename) {
-    configFile = filename;
-    std::ifstream f(filename);
-    if (!f.is_open()) {
-        throw std::runtime_error("Cannot open config file: " + filename);
+void GatherWriter::flush() {
+    if (batch.empty()) return;
+    if (stats) {
+        stats->messages += batch.size();
+        ++stats->writes;
     }
     
-    config = json::parse(f);
-    LOG_INFO("Configuration loaded from " + filename);
-    
-    // Восстановление счетчика ID из конфига
-    restoreIdCounter();
-    
-    // Генерация ID для переменных, если их нет
-    generateMissingIds();
-    
-    // Инициализация обработчиков протоколов
-    initializeProtocols();
+    if (zeroCopyEnabled && batchBytes >= options.zeroCopyMinBytes) {
+        sendZeroCopy();
+    } else {
+        // Один вызов sendmsg на пакет; asio продолжает запись при частичной отправке
+        std::vector<boost::asio::const_buffer> buffers;
+        buffers.reserve(batch.size());
+        for (const auto& message : batch) buffers.emplace_back(message->data(), message->size());
+        write(socket, buffers);
+        if (!inFlight.empty()) reapCompletions(0);
+    }
+    batch.clear();
+    batchBytes = 0;
 }
 
-void DataServer::restoreIdCounter() {
-    int64_t maxId = 0;
-    for (auto& [proto, proto_config] : config.items()) {
-        if (proto_config.contains("variables")) {
-            for (auto& [key, var] : proto_config["variables"].items()) {
-                if (var.contains("id") && var["id"].is_number()) {
-                    int64_t id = var["id"];
-                    if (id > maxId) maxId = id;
-                }
+void GatherWriter::sendZeroCopy() {
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    const int fd = socket.native_handle();
+    std::vector<iovec> iov;
+    iov.reserve(batch.size());
+    for (const auto& message : batch) {
+        iov.push_back({const_cast<char*>(message->data()), message->size()});
+    }
+    
+    size_t index = 0;
+    while (index < iov.size()) {
+        msghdr msg{};
+        msg.msg_iov = &iov[index];
+        msg.msg_iovlen = std::min<size_t>(iov.size() - index, IOV_MAX);
+        ssize_t sent = ::sendmsg(fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == ENOBUFS) {
+                // Буфер сокета заполнен или исчерпан лимит закрепленной памяти (optmem)
+                reapCompletions(0);
+                pollfd descriptor{fd, POLLOUT, 0};
+                ::poll(&descriptor, 1, 100);
+                continue;
+            }
+            throw boost::system::system_error(
+                boost::system::error_code(errno, boost::system::system_category()), "sendmsg");
+        }
+        
+        // Каждый успешный вызов с MSG_ZEROCOPY получает следующий номер уведомления
+        ++nextNotification;
+        for (auto remaining = static_cast<size_t>(sent); remaining > 0; ) {
+            if (remaining >= iov[index].iov_len) {
+                remaining -= iov[index].iov_len;
+                ++index;
+            } else {
+                iov[index].iov_base = static_cast<char*>(iov[index].iov_base) + remaining;
+                iov[index].iov_len -= remaining;
+                remaining = 0;
             }
         }
     }
     
-    if (maxId > 0) {
-        idGenerator.setCounter(maxId);
-        LOG_INFO("Restored ID counter to: " + std::to_string(maxId));
+    if (stats) ++stats->zeroCopyWrites;
+    inFlight.emplace_back(nextNotification - 1, std::move(batch));
+    batch = {};
+    reapCompletions(0);
+    // Объем удерживаемых сообщений ограничен: медленный клиент ждет уведомлений
+    while (inFlight.size() > 64) {
+        const size_t before = inFlight.size();
+        reapCompletions(100);
+        if (inFlight.size() == before) break;
     }
+#endif
 }
 
-void DataServer::generateMissingIds() {
-    for (auto& [proto, proto_config] : config.items()) {
-        if (proto_config.contains("variables")) {
-            for (auto& [key, var] : proto_config["variables"].items()) {
-                if (!var.contains("id") || !var["id"].is_number() || var["id"] == 0) {
-                    var["id"] = idGenerator.generate();
-                    LOG_INFO("Generated ID for variable: " + var["name"].get<std::string>() + 
-                            " -> " + std::to_string(var["id"].get<int64_t>()));
-                }
+void GatherWriter::reapCompletions(int timeoutMs) {
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    const int fd = socket.native_handle();
+    if (timeoutMs > 0) {
+        // Ошибки сокета (в том числе уведомления) сообщаются poll без запроса событий
+        pollfd descriptor{fd, 0, 0};
+        ::poll(&descriptor, 1, timeoutMs);
+    }
+    
+    while (!inFlight.empty()) {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+        
+        for (cmsghdr* header = CMSG_FIRSTHDR(&msg); header; header = CMSG_NXTHDR(&msg, header)) {
+            const bool recvErr = (header->cmsg_level == SOL_IP && header->cmsg_type == IP_RECVERR) ||
+                                 (header->cmsg_level == SOL_IPV6 && header->cmsg_type == IPV6_RECVERR);
+            if (!recvErr) continue;
+            sock_extended_err error;
+            std::memcpy(&error, CMSG_DATA(header), sizeof(error));
+            if (error.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            if ((error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && stats) ++stats->zeroCopyCopied;
+            // Уведомления TCP приходят по порядку: диапазон [ee_info, ee_data] завершен
+            while (!inFlight.empty() && static_cast<int32_t>(inFlight.front().first - error.ee_data) <= 0) {
+                inFlight.pop_front();
             }
         }
     }
+#endif
 }
 
-void DataServer::saveConfig(const std::string& filename = "") {
-    std::string targetFile = filename.empty() ? configFile : filename;
-    std::ofstream f(targetFile);
-    if (!f.is_open()) {
-        throw std::runtime_error("Cannot open config file for writing: " + targetFile);
+// Агрегация истории
+namespace {
+
+// Свертка диапазона в четыре независимые полосы: без зависимости между
+// итерациями компилятор векторизует цикл
+void reduceRange(const double* values, size_t count, double& minValue, double& maxValue, double& sum) {
+    double mins[4] = {values[0], values[0], values[0], values[0]};
+    double maxs[4] = {values[0], values[0], values[0], values[0]};
+    double sums[4] = {0.0, 0.0, 0.0, 0.0};
+    
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        for (size_t lane = 0; lane < 4; ++lane) {
+            double x = values[i + lane];
+            mins[lane] = x < mins[lane] ? x : mins[lane];
+            maxs[lane] = x > maxs[lane] ? x : maxs[lane];
+            sums[lane] += x;
+        }
+    }
+    for (; i < count; ++i) {
+        double x = values[i];
+        mins[0] = x < mins[0] ? x : mins[0];
+        maxs[0] = x > maxs[0] ? x : maxs[0];
+        sums[0] += x;
     }
     
-    f << config.dump(4);
-    LOG_INFO("Configuration saved to " + targetFile);
+    minValue = std::min(std::min(mins[0], mins[1]), std::min(mins[2], mins[3]));
+    maxValue = std::max(std::max(maxs[0], maxs[1]), std::max(maxs[2], maxs[3]));
+    sum = (sums[0] + sums[1]) + (sums[2] + sums[3]);
 }
 
-void DataServer::initializeProtocols() {
-    protocols.clear();
+double sumRange(const double* values, size_t count) {
+    double sums[4] = {0.0, 0.0, 0.0, 0.0};
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        for (size_t lane = 0; lane < 4; ++lane) {
+            sums[lane] += values[i + lane];
+        }
+    }
+    for (; i < count; ++i) {
+        sums[0] += values[i];
+    }
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+} // namespace
+
+HistoryBuckets HistoryAggregator::aggregate(const HistorySeries& series, int64_t bucketMs) {
+    if (bucketMs <= 0) {
+        throw std::invalid_argument("Bucket size must be positive");
+    }
     
-    for (auto& [proto, proto_config] : config.items()) {
-        std::unique_ptr<ProtocolHandler> handler;
+    HistoryBuckets buckets;
+    const auto& timestamps = series.timestamps;
+    const double* values = series.values.data();
+    const size_t total = series.size();
+    
+    size_t begin = 0;
+    while (begin < total) {
+        // Начало и последняя метка интервала без переполнения: крайние интервалы
+        // ограничиваются диапазоном int64_t
+        const int64_t timestamp = timestamps[begin];
+        int64_t offset = timestamp % bucketMs;
+        if (offset < 0) offset += bucketMs;
+        const int64_t start = timestamp >= INT64_MIN + offset ? timestamp - offset : INT64_MIN;
+        const int64_t last = start <= INT64_MAX - (bucketMs - 1) ? start + (bucketMs - 1) : INT64_MAX;
+        // История упорядочена по времени: граница интервала ищется бинарным поиском
+        size_t end = static_cast<size_t>(std::upper_bound(timestamps.begin() + static_cast<std::ptrdiff_t>(begin),
+                                                          timestamps.end(), last) - timestamps.begin());
+        size_t count = end - begin;
         
-        if (proto == "modbus_tcp") {
-            handler = std::make_unique<ModbusTcpHandler>(dataCache);
-        } else if (proto == "iec104") {
-            // handler = std::make_unique<IEC104Handler>(dataCache);
-        } else if (proto == "snmp") {
-            // handler = std::make_unique<SNMPHandler>(dataCache);
-        }
+        double minValue, maxValue, sum;
+        reduceRange(values + begin, count, minValue, maxValue, sum);
         
-        if (handler) {
-            handler->setConnectionParameters(proto_config["connection_parameters"]);
-            
-            // Подписка на события данных
-            handler->onDataReceived.connect(
-                [this](int64_t id, const std::string& name, const json& value) {
-                    subscriptionManager.notifySubscribers(id, name, value);
-                });
-            
-            handler->onConnectionStatusChanged.connect(
-                [this, proto](const std::string&, bool connected) {
-                    LOG_INFO(proto + " connection status: " + 
-                            (connected ? "connected" : "disconnected"));
-                });
-            
-            protocols[proto] = std::move(handler);
-        }
+        buckets.start.push_back(start);
+        buckets.count.push_back(static_cast<uint32_t>(count));
+        buckets.min.push_back(minValue);
+        buckets.max.push_back(maxValue);
+        buckets.avg.push_back(sum / static_cast<double>(count));
+        buckets.first.push_back(values[begin]);
+        buckets.last.push_back(values[end - 1]);
+        begin = end;
     }
+    return buckets;
 }
 
-void DataServer::startPolling() {
-    running = true;
+HistorySeries HistoryAggregator::downsample(const HistorySeries& series, size_t points) {
+    const size_t total = series.size();
+    if (points >= total) return series;
     
-    for (auto& [proto, handler] : protocols) {
-        auto& vars = config[proto]["variables"];
-        int pollingInterval = config[proto]["polling_interval_ms"];
-        
-        pollingThreads.emplace_back([this, handler = handler.get(), vars, pollingInterval]() {
+    HistorySeries result;
+    if (points == 0) return result;
+    result.timestamps.reserve(points);
+    result.values.reserve(points);
+    
+    auto take = [&](size_t index) {
+        result.timestamps.push_back(series.timestamps[index]);
+        result.values.push_back(series.values[index]);
+    };
+    
+    if (points < 3) {
+        take(0);
+        if (points == 2) take(total - 1);
+        return result;
+    }
+    
+    // Время в секундах относительно первой точки, чтобы площади считались в double без потери точности
+    std::vector<double> x(total);
+    const int64_t origin = series.timestamps[0];
+    for (size_t i = 0; i < total; ++i) {
+        x[i] = static_cast<double>(series.timestamps[i] - origin) / 1000.0;
+    }
+    const double* y = series.values.data();
+    
+    // Первая и последняя точки сохраняются, остальные делятся на points - 2 интервала
+    const double every = static_cast<double>(total - 2) / static_cast<double>(points - 2);
+    size_t selected = 0;
+    take(0);
+    
+    for (size_t bucket = 0; bucket < points - 2; ++bucket) {
+        // Среднее следующего интервала - третья вершина треугольника
+        size_t avgBegin = static_cast<size_t>(static_cast<double>(bucket + 1) * every) + 1;
+        size_t avgEnd = std::min(static_cast<size_t>(static_cast<double>(bucket + 2) * every) + 1, total);
+        size_t avgCount = avgEnd - avgBegin;
+        double avgX = sumRange(x.data() + avgBegin, avgCount) / static_cast<double>(avgCount);
+        double avgY = sumRange(y + avgBegin, avgCount) / static_cast<double>(avgCount);
+        
+        size_t rangeBegin = static_cast<size_t>(static_cast<double>(bucket) * every) + 1;
+        size_t rangeEnd = static_cast<size_t>(static_cast<double>(bucket + 1) * every) + 1;
+        
+        const double ax = x[selected];
+        const double ay = y[selected];
+        double maxArea = -1.0;
+        size_t next = rangeBegin;
+        for (size_t i = rangeBegin; i < rangeEnd; ++i) {
+            double area = std::abs((ax - avgX) * (y[i] - ay) - (ax - x[i]) * (avgY - ay));
+            if (area > maxArea) {
+                maxArea = area;
+                next = i;
+            }
+        }
+        
+        take(next);
+        selected = next;
+    }
+    
+    take(total - 1);
+    return result;
+}
+
+// Снимок кэша для теплого старта
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[8] = {'P', 'S', 'D', 'S', 'N', 'A', 'P', '1'};
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t entryCount;
+    uint64_t payloadSize;
+    uint64_t checksum;       // FNV-1a данных после заголовка
+};
+
+uint64_t fnvUpdate(uint64_t hash, std::string_view data) {
+    for (char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+template <typename T>
+void appendPod(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendString(std::string& out, std::string_view value) {
+    appendPod(out, static_cast<uint32_t>(value.size()));
+    out.append(value.data(), value.size());
+}
+
+// Последовательное чтение записей снимка с проверкой границ
+class SnapshotReader {
+private:
+    const char* pos;
+    const char* end;
+    
+public:
+    SnapshotReader(const char* begin, const char* finish) : pos(begin), end(finish) {}
+    
+    bool atEnd() const { return pos == end; }
+    
+    template <typename T>
+    bool read(T& value) {
+        if (static_cast<size_t>(end - pos) < sizeof(T)) return false;
+        std::memcpy(&value, pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+    
+    bool readString(std::string_view& value) {
+        uint32_t length;
+        if (!read(length) || static_cast<size_t>(end - pos) < length) return false;
+        value = std::string_view(pos, length);
+        pos += length;
+        return true;
+    }
+};
+
+// Запись: [размер][id][имя][количество] + значения {время мс, качество, значение MessagePack}
+std::string encodeSnapshotEntry(int64_t id, const std::string& name,
+                                const std::vector<HistoricalValue>& samples) {
+    std::string body;
+    appendPod(body, id);
+    appendString(body, name);
+    appendPod(body, static_cast<uint32_t>(samples.size()));
+    for (const auto& sample : samples) {
+        appendPod(body, static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            sample.timestamp.time_since_epoch()).count()));
+        appendString(body, sample.quality);
+        auto packed = json::to_msgpack(sample.value);
+        appendString(body, std::string_view(reinterpret_cast<const char*>(packed.data()), packed.size()));
+    }
+    
+    std::string entry;
+    appendPod(entry, static_cast<uint32_t>(body.size()));
+    entry += body;
+    return entry;
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+} // namespace
+
+bool DataCache::saveSnapshot(const std::string& path, size_t historyDepth) {
+    std::lock_guard<std::mutex> snapshotLock(snapshotMutex);
+    historyDepth = std::max<size_t>(historyDepth, 1);
+    
+    struct ChangedEntry {
+        int64_t id;
+        std::string name;
+        std::vector<HistoricalValue> samples;
+    };
+    std::vector<ChangedEntry> changed;
+    std::vector<int64_t> removed;
+    
+    // Под блокировкой кэша только копируются измененные записи
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (dirtyIds.empty() && std::filesystem::exists(path)) {
+            return false;
+        }
+        for (int64_t id : dirtyIds) {
+            auto it = history.find(id);
+            if (it == history.end() || it->second.empty()) {
+                removed.push_back(id);
+                continue;
+            }
+            size_t count = std::min(historyDepth, it->second.size());
+            changed.push_back({id, idToName[id],
+                std::vector<HistoricalValue>(it->second.end() - static_cast<std::ptrdiff_t>(count), it->second.end())});
+        }
+        dirtyIds.clear();
+    }
+    
+    for (int64_t id : removed) {
+        encodedEntries.erase(id);
+    }
+    for (const auto& entry : changed) {
+        encodedEntries[entry.id] = encodeSnapshotEntry(entry.id, entry.name, entry.samples);
+    }
+    
+    // Запись во временный файл, fsync и атомарное переименование:
+    // после сбоя на диске остается либо старый, либо новый снимок целиком
+    std::string tmpPath = path + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0;
+    
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.entryCount = encodedEntries.size();
+    header.checksum = 14695981039346656037ULL;
+    
+    if (ok) {
+        ok = writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    std::string chunk;
+    for (auto it = encodedEntries.begin(); ok && it != encodedEntries.end(); ++it) {
+        chunk += it->second;
+        if (chunk.size() >= 1 << 20) {
+            header.checksum = fnvUpdate(header.checksum, chunk);
+            header.payloadSize += chunk.size();
+            ok = writeAll(fd, chunk.data(), chunk.size());
+            chunk.clear();
+        }
+    }
+    if (ok && !chunk.empty()) {
+        header.checksum = fnvUpdate(header.checksum, chunk);
+        header.payloadSize += chunk.size();
+        ok = writeAll(fd, chunk.data(), chunk.size());
+    }
+    if (ok) {
+        ok = ::pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+             ::fsync(fd) == 0;
+    }
+    if (fd >= 0) ::close(fd);
+    
+    std::error_code ec;
+    if (ok) {
+        std::filesystem::rename(tmpPath, path, ec);
+    }
+    if (!ok || ec) {
+        std::filesystem::remove(tmpPath, ec);
+        // Записи попадут в следующий снимок
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : changed) dirtyIds.insert(entry.id);
+        for (int64_t id : removed) dirtyIds.insert(id);
+        throw std::runtime_error("Cannot write cache snapshot: " + path);
+    }
+    
+    LOG_DEBUG("Cache snapshot saved to " + path + ": " + std::to_string(changed.size()) +
+              " changed, " + std::to_string(encodedEntries.size()) + " total");
+    return true;
+}
+
+size_t DataCache::loadSnapshot(const std::string& path, const std::function<bool(int64_t)>& filter) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return 0;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        return 0;
+    }
+    auto size = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return 0;
+    
+    const char* base = static_cast<const char*>(data);
+    SnapshotHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    std::string_view payload(base + sizeof(header), size - sizeof(header));
+    
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION ||
+        header.payloadSize != payload.size() ||
+        header.checksum != fnvUpdate(14695981039346656037ULL, payload)) {
+        munmap(data, size);
+        LOG_WARNING("Cache snapshot " + path + " is invalid, ignoring");
+        return 0;
+    }
+    
+    size_t restored = 0;
+    try {
+        SnapshotReader reader(payload.data(), payload.data() + payload.size());
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        for (uint64_t i = 0; i < header.entryCount; ++i) {
+            uint32_t entrySize;
+            int64_t id;
+            std::string_view name;
+            uint32_t count;
+            if (!reader.read(entrySize) || !reader.read(id) || !reader.readString(name) || !reader.read(count)) {
+                throw std::runtime_error("truncated entry");
+            }
+            
+            std::deque<HistoricalValue> samples;
+            for (uint32_t j = 0; j < count; ++j) {
+                int64_t timestampMs;
+                std::string_view quality;
+                std::string_view packed;
+                if (!reader.read(timestampMs) || !reader.readString(quality) || !reader.readString(packed)) {
+                    throw std::runtime_error("truncated value");
+                }
+                samples.push_back({
+                    json::from_msgpack(packed.begin(), packed.end()),
+                    std::chrono::system_clock::time_point(std::chrono::milliseconds(timestampMs)),
+                    std::string(quality)
+                });
+            }
+            
+            if (samples.empty() || (filter && !filter(id))) continue;
+            while (samples.size() > maxHistorySize) samples.pop_front();
+            
+            HistoricalValue current = samples.back();
+            current.quality = "uncertain"; // Значение не подтверждено опросом после перезапуска
+            currentValues[id] = current;
+            idToName[id] = std::string(name);
+            history[id] = std::move(samples);
+            dirtyIds.insert(id);
+            ++restored;
+        }
+    } catch (const std::exception& e) {
+        LOG_WARNING("Cache snapshot " + path + " is damaged: " + e.what());
+    }
+    
+    munmap(data, size);
+    LOG_INFO("Restored " + std::to_string(restored) + " cached values from " + path);
+    return restored;
+}
+
+
+// Управление подключением
+namespace {
+
+double randomUnit() {
+    thread_local std::mt19937 generator{std::random_device{}()};
+    return std::uniform_real_distribution<double>(0.0, 1.0)(generator);
+}
+
+} // namespace
+
+ConnectionManager::Settings ConnectionManager::Settings::fromJson(const json& connectionParams) {
+    Settings settings;
+    if (!connectionParams.is_object()) return settings;
+    settings.backoffInitial = std::chrono::milliseconds(
+        std::max(10, connectionParams.value("backoff_initial_ms", 500)));
+    settings.backoffMax = std::max(settings.backoffInitial, std::chrono::milliseconds(
+        connectionParams.value("backoff_max_ms", 30000)));
+    settings.jitter = std::clamp(connectionParams.value("backoff_jitter", 0.2), 0.0, 1.0);
+    settings.stagger = std::chrono::milliseconds(std::max(0, connectionParams.value("connect_stagger_ms", 250)));
+    settings.probeInterval = std::chrono::milliseconds(
+        std::max(100, connectionParams.value("probe_interval_ms", 30000)));
+    return settings;
+}
+
+std::chrono::milliseconds ConnectionManager::backoffDelay(int failureCount) {
+    // Ограничение сдвига: задержка достигает максимума задолго до переполнения
+    const int shift = std::clamp(failureCount - 1, 0, 20);
+    auto delay = std::min(settings.backoffMax, settings.backoffInitial * (int64_t(1) << shift));
+    // Случайный разброс разводит переподключения устройств, потерявших связь одновременно
+    return std::chrono::milliseconds(static_cast<int64_t>(
+        static_cast<double>(delay.count()) * (1.0 - settings.jitter * randomUnit())));
+}
+
+std::chrono::milliseconds ConnectionManager::recordFailure() {
+    ++failures;
+    auto delay = backoffDelay(failures);
+    nextAttempt = std::chrono::steady_clock::now() + delay;
+    return delay;
+}
+
+void ConnectionManager::recordSuccess() {
+    failures = 0;
+    nextAttempt = {};
+    nextProbe = std::chrono::steady_clock::now() + settings.probeInterval;
+}
+
+std::optional<size_t> ConnectionManager::race(ip::tcp::socket& socket, const std::vector<json>& endpoints,
+                                              std::chrono::milliseconds timeout, std::chrono::milliseconds stagger) {
+    auto& io = static_cast<io_context&>(socket.get_executor().context());
+    
+    struct Attempt {
+        ip::tcp::resolver resolver;
+        ip::tcp::socket socket;
+        steady_timer delay;
+        bool started = false;
+        
+        explicit Attempt(io_context& io) : resolver(io), socket(io), delay(io) {}
+    };
+    
+    std::vector<std::unique_ptr<Attempt>> attempts;
+    for (size_t i = 0; i < endpoints.size(); ++i) {
+        attempts.push_back(std::make_unique<Attempt>(io));
+    }
+    std::optional<size_t> winner;
+    
+    auto cancelAll = [&]() {
+        boost::system::error_code ignored;
+        for (size_t i = 0; i < attempts.size(); ++i) {
+            attempts[i]->delay.cancel();
+            attempts[i]->resolver.cancel();
+            if (!winner || *winner != i) attempts[i]->socket.close(ignored);
+        }
+    };
+    
+    std::function<void(size_t)> launch;
+    // Ошибка адреса сразу запускает следующий еще не начатый адрес
+    auto launchNext = [&]() {
+        for (size_t i = 0; i < attempts.size(); ++i) {
+            if (!attempts[i]->started) {
+                launch(i);
+                return;
+            }
+        }
+    };
+    launch = [&](size_t i) {
+        Attempt& attempt = *attempts[i];
+        if (attempt.started || winner) return;
+        attempt.started = true;
+        attempt.delay.cancel();
+        
+        const json& endpoint = endpoints[i];
+        attempt.resolver.async_resolve(endpoint["host"].get<std::string>(),
+                                       std::to_string(endpoint["port"].get<int>()),
+            [&, i](const boost::system::error_code& ec, ip::tcp::resolver::results_type results) {
+                if (winner) return;
+                if (ec) {
+                    launchNext();
+                    return;
+                }
+                async_connect(attempts[i]->socket, results,
+                    [&, i](const boost::system::error_code& ec, const ip::tcp::endpoint&) {
+                        if (winner) return;
+                        if (ec) {
+                            launchNext();
+                            return;
+                        }
+                        winner = i;
+                        cancelAll();
+                    });
+            });
+    };
+    
+    for (size_t i = 1; i < attempts.size(); ++i) {
+        attempts[i]->delay.expires_after(stagger * static_cast<int>(i));
+        attempts[i]->delay.async_wait([&, i](const boost::system::error_code& ec) {
+            if (!ec) launch(i);
+        });
+    }
+    if (!attempts.empty()) launch(0);
+    
+    io.restart();
+    io.run_for(timeout);
+    if (!io.stopped()) {
+        // Таймаут: отменяем оставшиеся попытки и дожидаемся их завершения
+        cancelAll();
+        io.run();
+    }
+    if (winner) {
+        socket = std::move(attempts[*winner]->socket);
+    }
+    return winner;
+}
+
+void ConnectionManager::startProbe(const json& endpoint, std::chrono::milliseconds timeout) {
+    nextProbe = std::chrono::steady_clock::now() + settings.probeInterval;
+    probe = std::async(std::launch::async, [endpoint, timeout]() {
+        io_context io;
+        ip::tcp::socket socket(io);
+        return race(socket, {endpoint}, timeout, std::chrono::milliseconds(0)).has_value();
+    });
+}
+
+bool ConnectionManager::probeSucceeded() {
+    if (!probe.valid() || probe.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return false;
+    }
+    try {
+        return probe.get();
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+
+// Базовый класс для протоколов с улучшенной обработкой ошибок
+
+ProtocolHandler::ProtocolHandler(const std::string& protoName, DataCache& cache) 
+    : name(protoName), dataCache(cache) {}
+    
+
+
+void ProtocolHandler::setConnectionParameters(const json& config) {
+    connectionParams.clear();
+    connectionParams.push_back(config["primary"]);
+    
+    if (config.contains("secondary")) {
+        for (const auto& secondary : config["secondary"]) {
+            connectionParams.push_back(secondary);
+        }
+    }
+    connectionManager.settings = ConnectionManager::Settings::fromJson(config);
+}
+
+bool ProtocolHandler::connect() {
+    if (connectionParams.empty()) {
+        LOG_ERROR("No connection parameters for " + name);
+        return false;
+    }
+    
+    // Ограниченная экспоненциальная задержка после неудачных попыток
+    if (!connectionManager.attemptDue()) {
+        return false;
+    }
+    
+    std::optional<size_t> index;
+    if (usesTcp()) {
+        // Все адреса одновременно: основной первым, резервные со сдвигом stagger
+        LOG_INFO("Attempting to connect to " + name + " via " +
+                 std::to_string(connectionParams.size()) + " endpoint(s)");
+        index = connectTcp(connectionParams);
+    } else {
+        for (size_t i = 0; i < connectionParams.size() && !index; ++i) {
+            size_t idx = (currentConnectionIndex + i) % connectionParams.size();
+            LOG_INFO("Attempting to connect to " + name + " via " + 
+                        connectionParams[idx]["host"].get<std::string>());
+            if (trySpecificConnect(connectionParams[idx])) {
+                index = idx;
+            }
+        }
+    }
+    
+    if (index) {
+        currentConnectionIndex = *index;
+        connectionManager.recordSuccess();
+        LOG_INFO("Successfully connected to " + name + " via " +
+                 connectionParams[*index].value("host", std::string()));
+        if (!connected.exchange(true) && !switchingEndpoint) {
+            onConnectionStatusChanged(name, true);
+        }
+        return true;
+    }
+    
+    auto delay = connectionManager.recordFailure();
+    LOG_ERROR("All connection attempts failed for " + name + ", next attempt in " +
+              std::to_string(delay.count()) + " ms");
+    if (connected.exchange(false)) {
+        onConnectionStatusChanged(name, false);
+    }
+    return false;
+}
+
+std::optional<size_t> ProtocolHandler::connectTcp(const std::vector<json>& endpoints) {
+    ip::tcp::socket* socket = createTcpContext();
+    if (!socket) return std::nullopt;
+    
+    try {
+        auto winner = ConnectionManager::race(*socket, endpoints, connectTimeout(),
+                                              connectionManager.settings.stagger);
+        if (winner && onTcpConnected(endpoints[*winner])) {
+            return winner;
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR("Connection error for " + name + ": " + e.what());
+    }
+    return std::nullopt;
+}
+
+std::chrono::milliseconds ProtocolHandler::connectTimeout() const {
+    int timeout = 0;
+    for (const auto& params : connectionParams) {
+        timeout = std::max(timeout, params.value("timeout_ms", 5000));
+    }
+    return std::chrono::milliseconds(timeout > 0 ? timeout : 5000);
+}
+
+void ProtocolHandler::checkHealth() {
+    if (!connected || !usesTcp() || currentConnectionIndex == 0 || connectionParams.size() < 2) {
+        return;
+    }
+    // Проверка выполняется в фоне: опрос через резервный адрес не прерывается
+    if (connectionManager.probeSucceeded()) {
+        LOG_INFO("Primary endpoint of " + name + " is reachable again, switching back");
+        // Подписчики видят потерю связи, только если не удалось подключиться ни к одному адресу
+        switchingEndpoint = true;
+        disconnect();
+        const bool reconnected = connect();
+        switchingEndpoint = false;
+        if (!reconnected) onConnectionStatusChanged(name, false);
+    } else if (connectionManager.probeDue()) {
+        connectionManager.startProbe(connectionParams[0], connectTimeout());
+    }
+}
+
+void ProtocolHandler::disconnect() {
+    if (connected.exchange(false) && !switchingEndpoint) {
+        onConnectionStatusChanged(name, false);
+    }
+    LOG_INFO("Disconnected from " + name);
+}
+
+bool ProtocolHandler::isConnected() const { return connected; }
+
+size_t ProtocolHandler::markQuality(const std::vector<int64_t>& ids, const std::string& quality) {
+    return dataCache.setQuality(ids, quality);
+}
+
+void ProtocolHandler::updateData(int64_t id, const std::string& varName, const json& value, const std::string& quality = "good") {
+    (quality == "bad" ? badReads : goodReads).fetch_add(1, std::memory_order_relaxed);
+    dataCache.updateValue(id, varName, value, quality);
+    onDataReceived(id, varName, value);
+}
+
+
+// Modbus handler
+namespace {
+
+// Коды функций Modbus
+constexpr uint8_t MODBUS_READ_COILS = 0x01;
+constexpr uint8_t MODBUS_READ_DISCRETE_INPUTS = 0x02;
+constexpr uint8_t MODBUS_READ_HOLDING_REGISTERS = 0x03;
+constexpr uint8_t MODBUS_READ_INPUT_REGISTERS = 0x04;
+
+// Выполнение асинхронной операции asio с таймаутом в синхронном стиле
+template <typename Start>
+void runWithTimeout(io_context& io, ip::tcp::socket& socket,
+                    std::chrono::milliseconds timeout, Start start) {
+    boost::system::error_code result = error::would_block;
+    start([&result](const boost::system::error_code& ec, auto&&...) { result = ec; });
+    
+    io.restart();
+    io.run_for(timeout);
+    if (!io.stopped()) {
+        // Таймаут: отменяем операцию и дожидаемся её завершения
+        boost::system::error_code ignored;
+        socket.close(ignored);
+        io.run();
+        throw boost::system::system_error(error::timed_out);
+    }
+    if (result) {
+        throw boost::system::system_error(result);
+    }
+}
+
+} // namespace
+
+bool ModbusTcpHandler::trySpecificConnect(const json& connectionParams) {
+    return connectTcp({connectionParams}).has_value();
+}
+
+ip::tcp::socket* ModbusTcpHandler::createTcpContext() {
+    context = std::make_unique<ModbusContext>();
+    return &context->socket;
+}
+
+bool ModbusTcpHandler::onTcpConnected(const json& endpoint) {
+    try {
+        context->host = endpoint["host"];
+        context->port = endpoint["port"];
+        const int unitId = endpoint.value("unit_id", 1);
+        if (unitId < 0 || unitId > 255) {
+            throw std::invalid_argument("unit_id must be in range 0..255, got " + std::to_string(unitId));
+        }
+        context->unitId = static_cast<uint8_t>(unitId);
+        context->timeout = std::chrono::milliseconds(endpoint.value("timeout_ms", 5000));
+        context->socket.set_option(ip::tcp::no_delay(true));
+        
+        LOG_INFO("Modbus connected to " + context->host + ":" + 
+                    std::to_string(context->port));
+        return true;
+    } catch (const std::exception& e) {
+        LOG_ERROR("Modbus connection error: " + std::string(e.what()));
+        context.reset();
+    }
+    return false;
+}
+
+void ModbusTcpHandler::disconnect() {
+    if (context) {
+        boost::system::error_code ignored;
+        context->socket.close(ignored);
+        context.reset();
+    }
+    ProtocolHandler::disconnect();
+}
+
+std::vector<uint8_t> ModbusTcpHandler::transact(const std::vector<uint8_t>& pdu) {
+    if (!context || !context->socket.is_open()) {
+        throw boost::system::system_error(error::not_connected);
+    }
+    
+    // MBAP заголовок: transaction id, protocol id (0), длина, unit id
+    uint16_t tid = ++context->transactionId;
+    auto length = static_cast<uint16_t>(pdu.size() + 1);
+    std::vector<uint8_t> request = {
+        static_cast<uint8_t>(tid >> 8), static_cast<uint8_t>(tid & 0xFF),
+        0, 0,
+        static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length & 0xFF),
+        context->unitId
+    };
+    request.insert(request.end(), pdu.begin(), pdu.end());
+    
+    runWithTimeout(context->io, context->socket, context->timeout, [&](auto handler) {
+        async_write(context->socket, buffer(request), handler);
+    });
+    
+    uint8_t header[7];
+    runWithTimeout(context->io, context->socket, context->timeout, [&](auto handler) {
+        async_read(context->socket, buffer(header), handler);
+    });
+    
+    uint16_t responseTid = static_cast<uint16_t>((header[0] << 8) | header[1]);
+    uint16_t responseLength = static_cast<uint16_t>((header[4] << 8) | header[5]);
+    if (responseLength < 2 || responseLength > 254) {
+        throw boost::system::system_error(error::message_size);
+    }
+    
+    std::vector<uint8_t> response(responseLength - 1u);
+    runWithTimeout(context->io, context->socket, context->timeout, [&](auto handler) {
+        async_read(context->socket, buffer(response), handler);
+    });
+    
+    if (responseTid != tid) {
+        throw boost::system::system_error(error::invalid_argument);
+    }
+    if (response[0] & 0x80) {
+        // Исключение Modbus относится к конкретной переменной, соединение остается рабочим
+        throw std::runtime_error("Modbus exception code " + std::to_string(response.size() > 1 ? response[1] : 0));
+    }
+    return response;
+}
+
+std::vector<uint16_t> ModbusTcpHandler::readRegisters(uint8_t function, uint16_t address, uint16_t count) {
+    auto response = transact({
+        function,
+        static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address & 0xFF),
+        static_cast<uint8_t>(count >> 8), static_cast<uint8_t>(count & 0xFF)
+    });
+    if (response.size() < 2u + count * 2u) {
+        throw std::runtime_error("Short Modbus register response");
+    }
+    
+    std::vector<uint16_t> registers(count);
+    for (size_t i = 0; i < count; ++i) {
+        registers[i] = static_cast<uint16_t>((response[2 + i * 2] << 8) | response[3 + i * 2]);
+    }
+    return registers;
+}
+
+std::vector<bool> ModbusTcpHandler::readBits(uint8_t function, uint16_t address, uint16_t count) {
+    auto response = transact({
+        function,
+        static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address & 0xFF),
+        static_cast<uint8_t>(count >> 8), static_cast<uint8_t>(count & 0xFF)
+    });
+    if (response.size() < 2u + (count + 7u) / 8u) {
+        throw std::runtime_error("Short Modbus coil response");
+    }
+    
+    std::vector<bool> bits(count);
+    for (uint16_t i = 0; i < count; ++i) {
+        bits[i] = (response[2 + i / 8] >> (i % 8)) & 1;
+    }
+    return bits;
+}
+
+json ModbusTcpHandler::readVariable(const json& var) {
+    std::string type = var["type"];
+    auto address = var["address"].get<uint16_t>();
+    // Тип области памяти: holding (по умолчанию), input, coil, discrete
+    std::string area = var.value("register_type", type == "bool" ? "coil" : "holding");
+    
+    if (area == "coil" || area == "discrete") {
+        auto bits = readBits(area == "coil" ? MODBUS_READ_COILS : MODBUS_READ_DISCRETE_INPUTS, address, 1);
+        return static_cast<bool>(bits[0]);
+    }
+    
+    uint8_t function = (area == "input") ? MODBUS_READ_INPUT_REGISTERS : MODBUS_READ_HOLDING_REGISTERS;
+    if (type == "uint16") {
+        return readRegisters(function, address, 1)[0];
+    } else if (type == "int16") {
+        return static_cast<int16_t>(readRegisters(function, address, 1)[0]);
+    } else if (type == "bool") {
+        return readRegisters(function, address, 1)[0] != 0;
+    } else if (type == "float32" || type == "uint32" || type == "int32") {
+        // Старшее слово первым (big-endian word order)
+        auto regs = readRegisters(function, address, 2);
+        uint32_t raw = (static_cast<uint32_t>(regs[0]) << 16) | regs[1];
+        if (type == "uint32") return raw;
+        if (type == "int32") return static_cast<int32_t>(raw);
+        float value;
+        std::memcpy(&value, &raw, sizeof(value));
+        return value;
+    } else if (type == "string") {
+        auto length = var.value("length", 8);
+        auto regs = readRegisters(function, address, static_cast<uint16_t>(length));
+        std::string value;
+        for (uint16_t reg : regs) {
+            char hi = static_cast<char>(reg >> 8);
+            char lo = static_cast<char>(reg & 0xFF);
+            if (hi == '\0') break;
+            value += hi;
+            if (lo == '\0') break;
+            value += lo;
+        }
+        return value;
+    }
+    throw std::runtime_error("Unsupported Modbus type: " + type);
+}
+
+json ModbusTcpHandler::readData(const json& variables) {
+    if (!connected) {
+        if (!connect()) {
+            return json::object();
+        }
+    }
+    
+    json result;
+    try {
+        for (const auto& [key, var] : variables.items()) {
+            try {
+                json value = readVariable(var);
+                
+                int64_t varId = var["id"];
+                std::string varName = var["name"];
+                
+                result[std::to_string(varId)] = {
+                    {"n", varName}, // Сокращенные ключи для экономии места
+                    {"v", value},
+                    {"t", var["type"]}
+                };
+                
+                updateData(varId, varName, value);
+                
+            } catch (const boost::system::system_error&) {
+                // Ошибка транспорта: прерываем цикл опроса и переподключаемся
+                throw;
+            } catch (const std::exception& e) {
+                LOG_ERROR("Error reading variable " + var["name"].get<std::string>() + 
+                            ": " + e.what());
+                updateData(var["id"], var["name"], json(), "bad");
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR("Modbus read error: " + std::string(e.what()));
+        disconnect();
+    }
+    
+    return result;
+}
+
+// Классы обслуживания
+QosClass::Value QosClass::fromString(std::string_view name) {
+    if (name == "critical") return Critical;
+    if (name == "bulk") return Bulk;
+    return Normal;
+}
+
+const char* QosClass::name(Value value) {
+    static const char* const names[] = {"critical", "normal", "bulk"};
+    return value < Count ? names[value] : "normal";
+}
+
+QosPolicy QosPolicy::fromJson(const json& settings) {
+    QosPolicy policy;
+    if (!settings.is_object()) return policy;
+    const json intervals = settings.value("interval_ms", json::object());
+    const json slo = settings.value("slo_ms", json::object());
+    for (size_t lane = 0; lane < QosClass::Count; ++lane) {
+        const char* name = QosClass::name(static_cast<QosClass::Value>(lane));
+        if (intervals.is_object()) {
+            policy.intervalMs[lane] = std::max(0, intervals.value(name, policy.intervalMs[lane]));
+        }
+        if (slo.is_object()) {
+            policy.sloMs[lane] = std::max(0.0, slo.value(name, policy.sloMs[lane]));
+        }
+    }
+    policy.bulkChunk = std::max<size_t>(1, settings.value("bulk_chunk", policy.bulkChunk));
+    return policy;
+}
+
+void LatencySlo::setTarget(double ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    targetMs = ms;
+}
+
+void LatencySlo::record(double ms) {
+    constexpr double alpha = 0.1;
+    std::lock_guard<std::mutex> lock(mutex);
+    averageMs = samples == 0 ? ms : alpha * ms + (1 - alpha) * averageMs;
+    maxMs = std::max(maxMs, ms);
+    ++samples;
+    if (targetMs > 0 && ms > targetMs) ++violations;
+}
+
+json LatencySlo::toJson() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return {
+        {"slo_ms", targetMs},
+        {"latency_ms", averageMs},
+        {"max_latency_ms", maxMs},
+        {"samples", samples},
+        {"violations", violations},
+        {"compliance", samples == 0 ? 1.0 : 1.0 - static_cast<double>(violations) / static_cast<double>(samples)}
+    };
+}
+
+// Система подписки
+// Кольцо рассылки обновлений
+ValueUpdate ValueUpdate::fromJson(int64_t id, const json& value, int64_t timestampMs) {
+    ValueUpdate update;
+    update.id = id;
+    update.timestampMs = timestampMs;
+    switch (value.type()) {
+        case json::value_t::null:
+            update.kind = Kind::Null;
+            break;
+        case json::value_t::boolean:
+            update.kind = Kind::Bool;
+            update.bits = value.get<bool>() ? 1 : 0;
+            break;
+        case json::value_t::number_integer:
+            update.kind = Kind::Integer;
+            update.bits = static_cast<uint64_t>(value.get<int64_t>());
+            break;
+        case json::value_t::number_unsigned:
+            update.kind = Kind::Unsigned;
+            update.bits = value.get<uint64_t>();
+            break;
+        case json::value_t::number_float: {
+            update.kind = Kind::Float;
+            double x = value.get<double>();
+            std::memcpy(&update.bits, &x, sizeof(x));
+            break;
+        }
+        default:
+            update.kind = Kind::Other;
+            break;
+    }
+    return update;
+}
+
+ValueUpdate::Quality ValueUpdate::qualityFromString(std::string_view quality) {
+    if (quality == "good") return Quality::Good;
+    if (quality == "bad") return Quality::Bad;
+    return Quality::Uncertain;
+}
+
+const char* ValueUpdate::qualityName(Quality quality) {
+    switch (quality) {
+        case Quality::Good: return "good";
+        case Quality::Bad: return "bad";
+        default: return "uncertain";
+    }
+}
+
+json ValueUpdate::toJson() const {
+    switch (kind) {
+        case Kind::Bool:
+            return bits != 0;
+        case Kind::Integer:
+            return static_cast<int64_t>(bits);
+        case Kind::Unsigned:
+            return bits;
+        case Kind::Float: {
+            double x;
+            std::memcpy(&x, &bits, sizeof(x));
+            return x;
+        }
+        default:
+            return json();
+    }
+}
+
+UpdateRing::UpdateRing(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    slots = std::make_unique<Slot[]>(size);
+    payloads = std::make_unique<std::shared_ptr<const Payload>[]>(size);
+    mask = size - 1;
+}
+
+void UpdateRing::publish(ValueUpdate update, const json& value) {
+    if (update.kind == ValueUpdate::Kind::Other) {
+        // Значений не больше, чем обновлений: пока обновление в кольце, его значение не перезаписано
+        const uint64_t sequence = nextPayload.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_store(&payloads[sequence & mask], std::make_shared<const Payload>(Payload{sequence, value}));
+        update.bits = sequence;
+    }
+    publish(update);
+}
+
+std::shared_ptr<const json> UpdateRing::payload(const ValueUpdate& update) const {
+    if (update.kind != ValueUpdate::Kind::Other || update.bits == 0) return nullptr;
+    auto stored = std::atomic_load(&payloads[update.bits & mask]);
+    if (!stored || stored->sequence != update.bits) return nullptr;
+    return std::shared_ptr<const json>(stored, &stored->value);
+}
+
+void UpdateRing::publish(const ValueUpdate& update) {
+    const uint64_t ticket = next.fetch_add(1, std::memory_order_acq_rel);
+    Slot& slot = slots[ticket & mask];
+    
+    // Слот предыдущего круга должен быть дописан: производители одного слота не пересекаются
+    const uint64_t previous = ticket > mask ? 2 * (ticket - mask - 1) + 2 : 0;
+    while (slot.stamp.load(std::memory_order_acquire) != previous) {
+        std::this_thread::yield();
+    }
+    
+    slot.stamp.store(2 * ticket + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.id.store(update.id, std::memory_order_relaxed);
+    slot.timestampMs.store(update.timestampMs, std::memory_order_relaxed);
+    slot.bits.store(update.bits, std::memory_order_relaxed);
+    slot.kind.store(static_cast<uint8_t>(update.kind), std::memory_order_relaxed);
+    slot.quality.store(static_cast<uint8_t>(update.quality), std::memory_order_relaxed);
+    slot.stamp.store(2 * ticket + 2, std::memory_order_release);
+    
+    // Блокировка берется только при наличии ожидающих читателей
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        dataReady.notify_all();
+    }
+}
+
+UpdateRing::ReadStatus UpdateRing::read(uint64_t cursor, ValueUpdate& update) const {
+    if (next.load(std::memory_order_acquire) - cursor > mask + 1) {
+        return ReadStatus::Lagged;
+    }
+    
+    const Slot& slot = slots[cursor & mask];
+    const uint64_t expected = 2 * cursor + 2;
+    uint64_t stamp = slot.stamp.load(std::memory_order_acquire);
+    if (stamp < expected) {
+        return ReadStatus::Empty;
+    }
+    if (stamp != expected) {
+        return ReadStatus::Lagged;
+    }
+    
+    update.id = slot.id.load(std::memory_order_relaxed);
+    update.timestampMs = slot.timestampMs.load(std::memory_order_relaxed);
+    update.bits = slot.bits.load(std::memory_order_relaxed);
+    update.kind = static_cast<ValueUpdate::Kind>(slot.kind.load(std::memory_order_relaxed));
+    update.quality = static_cast<ValueUpdate::Quality>(slot.quality.load(std::memory_order_relaxed));
+    
+    // Слот перезаписан во время чтения - читатель отстал
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.stamp.load(std::memory_order_relaxed) != expected) {
+        return ReadStatus::Lagged;
+    }
+    return ReadStatus::Ready;
+}
+
+bool UpdateRing::published(uint64_t cursor) const {
+    return slots[cursor & mask].stamp.load(std::memory_order_acquire) >= 2 * cursor + 2 ||
+           next.load(std::memory_order_acquire) - cursor > mask + 1;
+}
+
+void UpdateRing::waitFor(uint64_t cursor, std::chrono::milliseconds timeout) {
+    waiters.fetch_add(1, std::memory_order_seq_cst);
+    {
+        std::unique_lock<std::mutex> lock(waitMutex);
+        dataReady.wait_for(lock, timeout, [this, cursor]() { return published(cursor); });
+    }
+    waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void UpdateRing::wakeAll() {
+    std::lock_guard<std::mutex> lock(waitMutex);
+    dataReady.notify_all();
+}
+
+// Подписка
+void Subscription::add(int64_t id) {
+    names[id] = dataCache.getNameById(id);
+}
+
+void Subscription::remove(int64_t id) {
+    names.erase(id);
+}
+
+std::vector<int64_t> Subscription::ids() const {
+    std::vector<int64_t> result;
+    result.reserve(names.size());
+    for (const auto& [id, name] : names) result.push_back(id);
+    return result;
+}
+
+Subscription::PollResult Subscription::poll(const Visitor& visitor, size_t limit) {
+    size_t processed = 0;
+    while (processed < limit) {
+        ValueUpdate update;
+        auto status = ring.read(cursor, update);
+        if (status == UpdateRing::ReadStatus::Empty) break;
+        if (status == UpdateRing::ReadStatus::Lagged) {
+            cursor = ring.head();
+            return PollResult::Resync;
+        }
+        
+        ++cursor;
+        ++processed;
+        if (allIds) {
+            static const std::string noName;
+            visitor(update, noName);
+            continue;
+        }
+        auto it = names.find(update.id);
+        if (it != names.end()) visitor(update, it->second);
+    }
+    return processed > 0 ? PollResult::Updates : PollResult::Idle;
+}
+
+bool Subscription::seek(uint64_t position) {
+    const uint64_t head = ring.head();
+    if (position > head || head - position > ring.capacity()) return false;
+    cursor = position;
+    return true;
+}
+
+json Subscription::value(const ValueUpdate& update) const {
+    if (update.kind != ValueUpdate::Kind::Other) return update.toJson();
+    if (auto stored = ring.payload(update)) return *stored;
+    return dataCache.getCurrentValue(update.id);
+}
+
+// Менеджер подписок
+SubscriptionManager::~SubscriptionManager() {
+    dataCache.setUpdateRing(nullptr);
+    stopping = true;
+    ring.wakeAll();
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& session : sessions) {
+        boost::system::error_code ec;
+        session->socket.shutdown(ip::tcp::socket::shutdown_both, ec);
+        if (session->thread.joinable()) session->thread.join();
+    }
+    sessions.clear();
+}
+
+void SubscriptionManager::addSubscriber(int64_t variableId, ip::tcp::socket socket) {
+    // Новый подписчик получает обновления, опубликованные после подписки
+    auto session = std::make_unique<Session>(std::move(socket), ring, dataCache);
+    session->subscription.add(variableId);
+    
+    Session* raw = session.get();
+    session->thread = std::thread([this, raw]() {
+        ThreadPlacement::getInstance().place(ThreadPlacement::Role::Io);
+        runSession(*raw);
+    });
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions.push_back(std::move(session));
+    }
+    LOG_INFO("New subscription for variable ID: " + std::to_string(variableId));
+    removeDisconnected();
+}
+
+void SubscriptionManager::notifySubscribers(int64_t variableId, const json& value) {
+    ring.publish(ValueUpdate::fromJson(variableId, value,
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count()), value);
+}
+
+GatherWriter::Message SubscriptionManager::encodeUpdate(uint64_t position, const ValueUpdate& update,
+                                                       const std::string& name, const Subscription& subscription) {
+    EncodedSlot& slot = encoded[position & (ENCODED_SLOTS - 1)];
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    if (slot.position == position && slot.message) return slot.message;
+    
+    // Компактный формат для экономии трафика
+    std::string message;
+    JsonChunkWriter writer([&message](std::string_view chunk) { message.append(chunk.data(), chunk.size()); }, 256);
+    writer.raw("{\"i\":").number(update.id)
+          .raw(",\"n\":").string(name)
+          .raw(",\"t\":").number(update.timestampMs)
+          .raw(",\"type\":\"data_update\",\"v\":").value(subscription.value(update))
+          .raw("}\n");
+    writer.flush();
+    ++encodedMessages;
+    slot.position = position;
+    slot.message = std::make_shared<const std::string>(std::move(message));
+    return slot.message;
+}
+
+void SubscriptionManager::runSession(Session& session) {
+    GatherWriter::Options options;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        options = sendOptions;
+    }
+    GatherWriter sender(session.socket, options, &sendStats);
+    
+    // Очереди отправки по классам обслуживания: из прочитанной части кольца критичные
+    // обновления записываются в сокет отдельно и раньше обычных и массовых
+    std::array<std::vector<std::pair<GatherWriter::Message, int64_t>>, QosClass::Count> queues;
+    std::shared_ptr<const QosClasses> classes;
+    auto enqueue = [this, &queues, &classes, &session](const ValueUpdate& update, const std::string& name) {
+        auto it = classes->find(update.id);
+        const QosClass::Value lane = it != classes->end() ? it->second : QosClass::Normal;
+        // Курсор уже указывает на следующую позицию кольца
+        const uint64_t position = session.subscription.position() - 1;
+        queues[QosClass::index(lane)].emplace_back(encodeUpdate(position, update, name, session.subscription), update.timestampMs);
+    };
+    auto sendQueued = [&]() {
+        for (size_t lane = 0; lane < QosClass::Count; ++lane) {
+            auto& queue = queues[lane];
+            if (queue.empty()) continue;
+            for (auto& [message, timestampMs] : queue) sender.add(std::move(message));
+            sender.flush();
+            for (const auto& [message, timestampMs] : queue) {
+                recordPush(static_cast<QosClass::Value>(lane), timestampMs);
+            }
+            queue.clear();
+        }
+    };
+    
+    try {
+        while (!stopping) {
+            classes = std::atomic_load(&qosClasses);
+            switch (session.subscription.poll(enqueue)) {
+                case Subscription::PollResult::Updates:
+                    sendQueued();
+                    break;
+                case Subscription::PollResult::Idle:
+                    session.subscription.wait(std::chrono::milliseconds(100));
+                    break;
+                case Subscription::PollResult::Resync: {
+                    // Подписчик не успевает за опросом: полная пересинхронизация текущими значениями
+                    for (auto& queue : queues) queue.clear();
+                    LOG_WARNING("Subscriber lagged behind by more than " + std::to_string(ring.capacity()) +
+                                " updates, resynchronizing");
+                    JsonChunkWriter writer([&session](std::string_view chunk) {
+                        write(session.socket, boost::asio::buffer(chunk.data(), chunk.size()));
+                    }, 16 * 1024);
+                    resync(session, writer);
+                    break;
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG_WARNING("Subscriber disconnected: " + std::string(e.what()));
+    }
+    session.active = false;
+}
+
+void SubscriptionManager::resync(Session& session, JsonChunkWriter& writer) {
+    for (const auto& item : dataCache.getValues(session.subscription.ids())) {
+        writer.raw("{\"i\":").number(item.id)
+              .raw(",\"n\":").string(item.name)
+              .raw(",\"q\":").string(item.value.quality)
+              .raw(",\"t\":").number(std::chrono::duration_cast<std::chrono::milliseconds>(
+                  item.value.timestamp.time_since_epoch()).count())
+              .raw(",\"type\":\"resync\",\"v\":").value(item.value.value)
+              .raw("}\n");
+    }
+    writer.flush();
+}
+
+void SubscriptionManager::removeDisconnected() {
+    std::lock_guard<std::mutex> lock(mutex);
+    sessions.erase(
+        std::remove_if(sessions.begin(), sessions.end(),
+            [](const std::unique_ptr<Session>& session) {
+                if (session->active) return false;
+                if (session->thread.joinable()) session->thread.join();
+                return true;
+            }),
+        sessions.end()
+    );
+}
+
+size_t SubscriptionManager::subscriberCount() {
+    removeDisconnected();
+    std::lock_guard<std::mutex> lock(mutex);
+    return sessions.size();
+}
+
+void SubscriptionManager::setQos(QosClasses classes, const QosPolicy& policy) {
+    std::atomic_store(&qosClasses, std::make_shared<const QosClasses>(std::move(classes)));
+    for (size_t lane = 0; lane < QosClass::Count; ++lane) {
+        pushLatency[lane].setTarget(policy.sloMs[lane]);
+    }
+}
+
+void SubscriptionManager::recordPush(QosClass::Value lane, int64_t timestampMs) {
+    if (timestampMs <= 0) return;
+    const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    pushLatency[QosClass::index(lane)].record(static_cast<double>(std::max<int64_t>(0, nowMs - timestampMs)));
+}
+
+void SubscriptionManager::setSendOptions(const GatherWriter::Options& options) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sendOptions = options;
+}
+
+json SubscriptionManager::sendMetrics() const {
+    return {
+        {"encoded", encodedMessages.load()},
+        {"messages", sendStats.messages.load()},
+        {"writes", sendStats.writes.load()},
+        {"zero_copy_writes", sendStats.zeroCopyWrites.load()},
+        {"zero_copy_copied", sendStats.zeroCopyCopied.load()}
+    };
+}
+
+json SubscriptionManager::qosMetrics() const {
+    json result = json::object();
+    auto classes = std::atomic_load(&qosClasses);
+    std::array<size_t, QosClass::Count> tags{};
+    for (const auto& [id, lane] : *classes) ++tags[QosClass::index(lane)];
+    for (size_t lane = 0; lane < QosClass::Count; ++lane) {
+        json metrics = pushLatency[lane].toJson();
+        // Обычный класс не хранится в таблице классов
+        if (lane != QosClass::Normal) metrics["tags"] = tags[lane];
+        result[QosClass::name(static_cast<QosClass::Value>(lane))] = std::move(metrics);
+    }
+    return result;
+}
+
+
+// Репликация
+namespace {
+
+constexpr uint32_t REPLICATION_VERSION = 4;
+constexpr size_t REPLICATION_HEADER_SIZE = 5;
+constexpr uint32_t REPLICATION_MAX_FRAME = 16 * 1024 * 1024;
+constexpr size_t REPLICATION_FLUSH_SIZE = 64 * 1024;
+
+// Типы кадров журнала репликации. Позиция - номер обновления в кольце рассылки источника:
+// все обновления до нее переданы. Эпоха идентифицирует кольцо (меняется при перезапуске).
+enum ReplicationFrame : uint8_t {
+    REPLICATION_HELLO = 1,   // Источник: [версия u32][эпоха u64];
+                             // получатель: [версия u32][эпоха u64][позиция u64][ключ]
+    REPLICATION_SYNC_BEGIN,  // [количество значений u64]
+    REPLICATION_VALUE,       // [id][время мс][качество u8][тип u8][значение][имя]
+    REPLICATION_SYNC_END,
+    REPLICATION_HEARTBEAT,   // [время мс]
+    REPLICATION_POSITION,    // [позиция u64]
+    REPLICATION_RESUMED      // [позиция u64] - продолжение без полной синхронизации
+};
+
+// Целые числа кадров - big-endian, как длины кадров BINARY: порядок байтов не зависит от платформы
+template <typename T>
+void appendWire(std::string& out, T value) {
+    static_assert(std::is_integral_v<T>, "replication fields are integers");
+    const auto bits = static_cast<std::make_unsigned_t<T>>(value);
+    for (size_t shift = sizeof(T) * 8; shift > 0; shift -= 8) {
+        out.push_back(static_cast<char>(static_cast<uint8_t>(bits >> (shift - 8))));
+    }
+}
+
+void appendWireString(std::string& out, std::string_view value) {
+    appendWire(out, static_cast<uint32_t>(value.size()));
+    out.append(value.data(), value.size());
+}
+
+// Последовательное чтение полей кадра с проверкой границ
+class FrameReader {
+private:
+    const char* pos;
+    const char* end;
+    
+public:
+    FrameReader(const char* begin, const char* finish) : pos(begin), end(finish) {}
+    
+    template <typename T>
+    bool read(T& value) {
+        static_assert(std::is_integral_v<T>, "replication fields are integers");
+        if (static_cast<size_t>(end - pos) < sizeof(T)) return false;
+        std::make_unsigned_t<T> bits = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            bits = static_cast<std::make_unsigned_t<T>>((bits << 8) | static_cast<uint8_t>(pos[i]));
+        }
+        value = static_cast<T>(bits);
+        pos += sizeof(T);
+        return true;
+    }
+    
+    bool readString(std::string_view& value) {
+        uint32_t length;
+        if (!read(length) || static_cast<size_t>(end - pos) < length) return false;
+        value = std::string_view(pos, length);
+        pos += length;
+        return true;
+    }
+};
+
+// Заголовок кадра; длина записывается в finishFrame
+size_t beginFrame(std::string& out, ReplicationFrame type) {
+    out.push_back(static_cast<char>(type));
+    const size_t lengthPos = out.size();
+    appendWire(out, static_cast<uint32_t>(0));
+    return lengthPos;
+}
+
+void finishFrame(std::string& out, size_t lengthPos) {
+    const auto length = static_cast<uint32_t>(out.size() - lengthPos - sizeof(uint32_t));
+    for (size_t i = 0; i < sizeof(length); ++i) {
+        out[lengthPos + i] = static_cast<char>(static_cast<uint8_t>(length >> (24 - 8 * i)));
+    }
+}
+
+// Длина из заголовка кадра [тип u8][длина u32]
+uint32_t frameLength(const char* header) {
+    FrameReader reader(header + 1, header + REPLICATION_HEADER_SIZE);
+    uint32_t length = 0;
+    reader.read(length);
+    return length;
+}
+
+// Скалярное значение - 8 байт, остальные типы - MessagePack; имя передается только при синхронизации
+void appendValueFrame(std::string& out, const ValueUpdate& update, const json& other, std::string_view name) {
+    const size_t lengthPos = beginFrame(out, REPLICATION_VALUE);
+    appendWire(out, update.id);
+    appendWire(out, update.timestampMs);
+    appendWire(out, static_cast<uint8_t>(update.quality));
+    appendWire(out, static_cast<uint8_t>(update.kind));
+    if (update.kind == ValueUpdate::Kind::Other) {
+        auto packed = json::to_msgpack(other);
+        appendWireString(out, std::string_view(reinterpret_cast<const char*>(packed.data()), packed.size()));
+    } else {
+        appendWire(out, update.bits);
+    }
+    appendWireString(out, name);
+    finishFrame(out, lengthPos);
+}
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+template <typename T>
+void appendFrame(std::string& out, ReplicationFrame type, T value) {
+    const size_t lengthPos = beginFrame(out, type);
+    appendWire(out, value);
+    finishFrame(out, lengthPos);
+}
+
+// Приветствие получателя: при совпадении эпохи источник продолжает передачу с позиции
+void sendClientHello(ip::tcp::socket& socket, uint64_t epoch, uint64_t position, std::string_view secret) {
+    std::string out;
+    const size_t lengthPos = beginFrame(out, REPLICATION_HELLO);
+    appendWire(out, REPLICATION_VERSION);
+    appendWire(out, epoch);
+    appendWire(out, position);
+    appendWireString(out, secret);
+    finishFrame(out, lengthPos);
+    write(socket, boost::asio::buffer(out));
+}
+
+// Чтение size байтов до deadline: синхронное чтение asio не ограничено по времени
+void readBefore(ip::tcp::socket& socket, char* data, size_t size, std::chrono::steady_clock::time_point deadline) {
+    while (size > 0) {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        pollfd descriptor{socket.native_handle(), POLLIN, 0};
+        if (remaining <= 0 || ::poll(&descriptor, 1, static_cast<int>(remaining)) <= 0) {
+            throw std::runtime_error("Replication handshake timed out");
+        }
+        const size_t n = socket.read_some(boost::asio::buffer(data, size));
+        data += n;
+        size -= n;
+    }
+}
+
+// Разбор полных кадров буфера; возвращает количество обработанных байтов
+template <typename Handler>
+size_t forEachFrame(const char* data, size_t size, Handler handler) {
+    size_t pos = 0;
+    while (size - pos >= REPLICATION_HEADER_SIZE) {
+        const auto type = static_cast<uint8_t>(data[pos]);
+        const uint32_t length = frameLength(data + pos);
+        if (length > REPLICATION_MAX_FRAME) {
+            throw std::runtime_error("Replication frame too large: " + std::to_string(length));
+        }
+        if (size - pos - REPLICATION_HEADER_SIZE < length) break;
+        
+        const char* payload = data + pos + REPLICATION_HEADER_SIZE;
+        FrameReader reader(payload, payload + length);
+        handler(type, reader);
+        pos += REPLICATION_HEADER_SIZE + length;
+    }
+    return pos;
+}
+
+// Значение из кадра REPLICATION_VALUE
+void readValueFrame(FrameReader& reader, int64_t& id, HistoricalValue& sample, std::string_view& name) {
+    int64_t timestampMs;
+    uint8_t quality, kind;
+    bool ok = reader.read(id) && reader.read(timestampMs) && reader.read(quality) &&
+              reader.read(kind) && kind <= static_cast<uint8_t>(ValueUpdate::Kind::Other) &&
+              quality <= static_cast<uint8_t>(ValueUpdate::Quality::Uncertain);
+    if (ok && kind == static_cast<uint8_t>(ValueUpdate::Kind::Other)) {
+        std::string_view packed;
+        ok = reader.readString(packed);
+        if (ok) sample.value = json::from_msgpack(packed.begin(), packed.end());
+    } else if (ok) {
+        ValueUpdate update;
+        update.kind = static_cast<ValueUpdate::Kind>(kind);
+        ok = reader.read(update.bits);
+        sample.value = update.toJson();
+    }
+    if (!ok || !reader.readString(name)) {
+        throw std::runtime_error("Malformed replication frame");
+    }
+    sample.timestamp = std::chrono::system_clock::time_point(std::chrono::milliseconds(timestampMs));
+    sample.quality = ValueUpdate::qualityName(static_cast<ValueUpdate::Quality>(quality));
+}
+
+// Чтение приветствия источника; возвращает эпоху
+uint64_t readServerHello(FrameReader& reader) {
+    uint32_t version = 0;
+    uint64_t epoch = 0;
+    if (!reader.read(version) || version != REPLICATION_VERSION || !reader.read(epoch)) {
+        throw std::runtime_error("Unsupported replication protocol version");
+    }
+    return epoch;
+}
+
+} // namespace
+
+ReplicationPublisher::ReplicationPublisher(DataCache& cache, SubscriptionManager& manager, unsigned short port,
+                                           std::chrono::milliseconds heartbeat, const std::string& bindAddress,
+                                           std::string sharedSecret, std::chrono::milliseconds handshake)
+    : dataCache(cache), subscriptionManager(manager), heartbeatInterval(heartbeat),
+      secret(std::move(sharedSecret)), handshakeTimeout(handshake),
+      acceptor(io, ip::tcp::endpoint(ip::make_address(bindAddress), port)) {
+    std::random_device random;
+    epoch = (static_cast<uint64_t>(random()) << 32) | random();
+}
+
+ReplicationPublisher::~ReplicationPublisher() {
+    stop();
+}
+
+void ReplicationPublisher::start() {
+    if (running.exchange(true)) return;
+    doAccept();
+    acceptThread = std::thread([this]() { io.run(); });
+    LOG_INFO("Replication publisher listening on port " + std::to_string(port()));
+}
+
+void ReplicationPublisher::stop() {
+    if (!running.exchange(false)) return;
+    io.stop();
+    if (acceptThread.joinable()) acceptThread.join();
+    boost::system::error_code ec;
+    acceptor.close(ec);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& peer : peers) {
+        peer->socket.shutdown(ip::tcp::socket::shutdown_both, ec);
+        if (peer->thread.joinable()) peer->thread.join();
+    }
+    peers.clear();
+}
+
+unsigned short ReplicationPublisher::port() const {
+    boost::system::error_code ec;
+    auto endpoint = acceptor.local_endpoint(ec);
+    return ec ? 0 : endpoint.port();
+}
+
+size_t ReplicationPublisher::peerCount() {
+    removeInactive();
+    std::lock_guard<std::mutex> lock(mutex);
+    return peers.size();
+}
+
+void ReplicationPublisher::doAccept() {
+    acceptor.async_accept([this](const boost::system::error_code& ec, ip::tcp::socket socket) {
+        if (!running) return;
+        if (ec) {
+            LOG_WARNING("Replication accept error: " + ec.message());
+        } else {
+            boost::system::error_code ignored;
+            socket.set_option(ip::tcp::no_delay(true), ignored);
+            auto endpoint = socket.remote_endpoint(ignored);
+            
+            // Подписка создается до чтения текущих значений: обновления между ними не теряются
+            auto subscription = subscriptionManager.createSubscription();
+            subscription->addAll();
+            auto peer = std::make_unique<Peer>(std::move(socket), std::move(subscription));
+            Peer* raw = peer.get();
+            raw->thread = std::thread([this, raw]() { runPeer(*raw); });
+            
+            removeInactive();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                peers.push_back(std::move(peer));
+            }
+            LOG_INFO("Replication peer connected: " + endpoint.address().to_string());
+        }
+        doAccept();
+    });
+}
+
+void ReplicationPublisher::runPeer(Peer& peer) {
+    std::string out;
+    out.reserve(REPLICATION_FLUSH_SIZE * 2);
+    auto lastSent = std::chrono::steady_clock::now();
+    
+    auto flush = [&]() {
+        write(peer.socket, boost::asio::buffer(out));
+        out.clear();
+        lastSent = std::chrono::steady_clock::now();
+    };
+    
+    // Полная синхронизация: все текущие значения с именами
+    auto sync = [&]() {
+        auto values = dataCache.getValues(dataCache.getIds());
+        size_t lengthPos = beginFrame(out, REPLICATION_SYNC_BEGIN);
+        appendWire(out, static_cast<uint64_t>(values.size()));
+        finishFrame(out, lengthPos);
+        for (const auto& item : values) {
+            ValueUpdate update = ValueUpdate::fromJson(item.id, item.value.value,
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    item.value.timestamp.time_since_epoch()).count());
+            update.quality = ValueUpdate::qualityFromString(item.value.quality);
+            appendValueFrame(out, update, item.value.value, item.name);
+            if (out.size() >= REPLICATION_FLUSH_SIZE) flush();
+        }
+        finishFrame(out, beginFrame(out, REPLICATION_SYNC_END));
+        // Значения синхронизации не старше позиции подписки: продолжение возможно с нее
+        appendFrame(out, REPLICATION_POSITION, peer.subscription->position());
+        flush();
+    };
+    
+    const json none;
+    auto appendUpdate = [&](const ValueUpdate& update, const std::string&) {
+        if (update.kind == ValueUpdate::Kind::Other) {
+            appendValueFrame(out, update, peer.subscription->value(update), {});
+        } else {
+            appendValueFrame(out, update, none, {});
+        }
+    };
+    
+    const auto waitInterval = std::min(heartbeatInterval, std::chrono::milliseconds(100));
+    try {
+        // Приветствие получателя: эпоха, позиция последнего принятого обновления и ключ.
+        // Молчащее соединение закрывается по истечении handshakeTimeout
+        const auto deadline = std::chrono::steady_clock::now() + handshakeTimeout;
+        char header[REPLICATION_HEADER_SIZE];
+        readBefore(peer.socket, header, sizeof(header), deadline);
+        const uint32_t length = frameLength(header);
+        if (header[0] != REPLICATION_HELLO || length > 1024) {
+            throw std::runtime_error("Unexpected replication handshake");
+        }
+        std::string hello(length, '\0');
+        readBefore(peer.socket, hello.data(), hello.size(), deadline);
+        FrameReader reader(hello.data(), hello.data() + hello.size());
+        uint32_t version = 0;
+        uint64_t peerEpoch = 0, position = 0;
+        std::string_view peerSecret;
+        if (!reader.read(version) || version != REPLICATION_VERSION ||
+            !reader.read(peerEpoch) || !reader.read(position) || !reader.readString(peerSecret)) {
+            throw std::runtime_error("Unsupported replication protocol version");
+        }
+        // Сравнение целиком: время проверки не зависит от совпавшего префикса
+        if (!secret.empty() && (peerSecret.size() != secret.size() ||
+                                CRYPTO_memcmp(peerSecret.data(), secret.data(), secret.size()) != 0)) {
+            throw std::runtime_error("Invalid replication secret");
+        }
+        
+        size_t lengthPos = beginFrame(out, REPLICATION_HELLO);
+        appendWire(out, REPLICATION_VERSION);
+        appendWire(out, epoch);
+        finishFrame(out, lengthPos);
+        // Позиция еще в кольце: передаются только пропущенные обновления. Позиция 0 - запрос полной
+        // синхронизации: кольцо не содержит значений снимка и значений до подключения получателя
+        if (position != 0 && peerEpoch == epoch && peer.subscription->seek(position)) {
+            appendFrame(out, REPLICATION_RESUMED, position);
+            flush();
+        } else {
+            sync();
+        }
+        
+        while (running) {
+            switch (peer.subscription->poll(appendUpdate)) {
+                case Subscription::PollResult::Updates:
+                    if (out.size() >= REPLICATION_FLUSH_SIZE) {
+                        appendFrame(out, REPLICATION_POSITION, peer.subscription->position());
+                        flush();
+                    }
+                    break;
+                case Subscription::PollResult::Idle:
+                    if (!out.empty()) {
+                        appendFrame(out, REPLICATION_POSITION, peer.subscription->position());
+                        flush();
+                    } else if (std::chrono::steady_clock::now() - lastSent >= heartbeatInterval) {
+                        appendFrame(out, REPLICATION_HEARTBEAT, nowMs());
+                        flush();
+                    }
+                    peer.subscription->wait(waitInterval);
+                    break;
+                case Subscription::PollResult::Resync:
+                    LOG_WARNING("Replication peer lagged behind the update ring, resynchronizing");
+                    out.clear();
+                    sync();
+                    break;
+            }
+        }
+    } catch (const std::exception& e) {
+        if (running) LOG_WARNING("Replication peer disconnected: " + std::string(e.what()));
+    }
+    // Получатель узнает о закрытии сразу, а не при удалении соединения из списка
+    boost::system::error_code ignored;
+    peer.socket.shutdown(ip::tcp::socket::shutdown_both, ignored);
+    peer.active = false;
+}
+
+void ReplicationPublisher::removeInactive() {
+    std::lock_guard<std::mutex> lock(mutex);
+    peers.erase(
+        std::remove_if(peers.begin(), peers.end(),
+            [](const std::unique_ptr<Peer>& peer) {
+                if (peer->active) return false;
+                if (peer->thread.joinable()) peer->thread.join();
+                return true;
+            }),
+        peers.end()
+    );
+}
+
+ReplicationReceiver::ReplicationReceiver(DataCache& cache, std::string primaryHost, unsigned short primaryPort,
+                                         std::chrono::milliseconds timeout, StateHandler handler,
+                                         std::string sharedSecret)
+    : dataCache(cache), host(std::move(primaryHost)), port(primaryPort),
+      failoverTimeout(timeout), onStateChanged(std::move(handler)), secret(std::move(sharedSecret)) {}
+
+ReplicationReceiver::~ReplicationReceiver() {
+    stop();
+}
+
+void ReplicationReceiver::start() {
+    if (running.exchange(true)) return;
+    lastContact = lastActivity = std::chrono::steady_clock::now();
+    thread = std::thread([this]() { run(); });
+}
+
+void ReplicationReceiver::stop() {
+    {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        running = false;
+    }
+    waitCondition.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+void ReplicationReceiver::run() {
+    const auto retryInterval = std::min(failoverTimeout / 4, std::chrono::milliseconds(1000));
+    
+    while (running) {
+        try {
+            receive();
+        } catch (const std::exception& e) {
+            if (running) {
+                LOG_WARNING("Replication from " + host + ":" + std::to_string(port) +
+                            " interrupted: " + e.what());
+            }
+        }
+        alive = false;
+        if (!running) break;
+        
+        // Основной сервер молчит: резервный начинает опрос устройств сам
+        if (!pollingTakenOver && std::chrono::steady_clock::now() - lastContact >= failoverTimeout) {
+            pollingTakenOver = true;
+            LOG_WARNING("Primary server " + host + ":" + std::to_string(port) +
+                        " is silent, taking over device polling");
+            if (onStateChanged) onStateChanged(false);
+        }
+        
+        std::unique_lock<std::mutex> lock(waitMutex);
+        waitCondition.wait_for(lock, retryInterval, [this]() { return !running; });
+    }
+}
+
+void ReplicationReceiver::receive() {
+    ip::tcp::socket socket(io);
+    ip::tcp::resolver resolver(io);
+    auto endpoints = resolver.resolve(host, std::to_string(port));
+    runWithTimeout(io, socket, failoverTimeout, [&](auto handler) {
+        async_connect(socket, endpoints, handler);
+    });
+    socket.set_option(ip::tcp::no_delay(true));
+    lastActivity = std::chrono::steady_clock::now();
+    // После локального опроса нужна полная синхронизация: ни эпоха, ни позиция не передаются
+    sendClientHello(socket, pollingTakenOver ? 0 : epoch, pollingTakenOver ? 0 : position, secret);
+    
+    std::vector<char> buffer(256 * 1024);
+    size_t filled = 0;
+    while (running) {
+        // Кадр больше буфера: буфер расширяется (размер кадра ограничен REPLICATION_MAX_FRAME)
+        if (filled == buffer.size()) buffer.resize(buffer.size() * 2);
+        filled += readSome(socket, buffer.data() + filled, buffer.size() - filled);
+        
+        const size_t consumed = applyFrames(buffer.data(), filled);
+        std::memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+        filled -= consumed;
+    }
+}
+
+size_t ReplicationReceiver::readSome(ip::tcp::socket& socket, char* data, size_t size) {
+    boost::system::error_code result = error::would_block;
+    size_t transferred = 0;
+    socket.async_read_some(boost::asio::buffer(data, size),
+        [&](const boost::system::error_code& ec, size_t bytes) {
+            result = ec;
+            transferred = bytes;
+        });
+    
+    // Ожидание короткими интервалами, чтобы остановка не ждала таймаута отказа
+    io.restart();
+    while (result == error::would_block) {
+        io.run_for(std::chrono::milliseconds(100));
+        if (result != error::would_block) break;
+        if (!running || std::chrono::steady_clock::now() - lastActivity >= failoverTimeout) {
+            boost::system::error_code ignored;
+            socket.close(ignored);
+            io.run();
+            throw boost::system::system_error(running ? error::timed_out : error::operation_aborted);
+        }
+    }
+    if (result) {
+        throw boost::system::system_error(result);
+    }
+    return transferred;
+}
+
+size_t ReplicationReceiver::applyFrames(const char* data, size_t size) {
+    const size_t consumed = forEachFrame(data, size, [this](uint8_t type, FrameReader& reader) {
+        switch (type) {
+            case REPLICATION_HELLO: {
+                const uint64_t serverEpoch = readServerHello(reader);
+                if (serverEpoch != epoch) {
+                    epoch = serverEpoch;
+                    position = 0;
+                }
+                break;
+            }
+            case REPLICATION_SYNC_BEGIN: {
+                uint64_t count = 0;
+                reader.read(count);
+                LOG_INFO("Replication sync from " + host + ":" + std::to_string(port) +
+                         ": " + std::to_string(count) + " values");
+                break;
+            }
+            case REPLICATION_VALUE: {
+                int64_t id;
+                HistoricalValue sample;
+                std::string_view name;
+                readValueFrame(reader, id, sample, name);
+                if (dataCache.applyValue(id, std::string(name), sample)) ++applied;
+                break;
+            }
+            case REPLICATION_POSITION:
+                reader.read(position);
+                break;
+            case REPLICATION_RESUMED:
+                reader.read(position);
+                alive = true;
+                break;
+            case REPLICATION_SYNC_END:
+                alive = true;
+                if (pollingTakenOver) {
+                    // Основной сервер вернулся и передал актуальные значения: локальный опрос не нужен
+                    pollingTakenOver = false;
+                    LOG_INFO("Primary server " + host + ":" + std::to_string(port) +
+                             " is back, stopping local device polling");
+                    if (onStateChanged) onStateChanged(true);
+                }
+                break;
+            default:
+                // HEARTBEAT и неизвестные типы кадров только подтверждают связь
+                break;
+        }
+    });
+    
+    if (consumed > 0) {
+        lastContact = lastActivity = std::chrono::steady_clock::now();
+    }
+    return consumed;
+}
+
+
+// Подключение к нижестоящему серверу данных
+DataServerHandler::DataServerHandler(DataCache& cache, const std::string& deviceName, const json& importSettings)
+    : ProtocolHandler(deviceName, cache) {
+    if (importSettings.is_object()) {
+        importAll = true;
+        idOffset = importSettings.value("id_offset", static_cast<int64_t>(0));
+        namePrefix = importSettings.value("name_prefix", "");
+    }
+}
+
+bool DataServerHandler::trySpecificConnect(const json& connectionParams) {
+    return connectTcp({connectionParams}).has_value();
+}
+
+ip::tcp::socket* DataServerHandler::createTcpContext() {
+    context = std::make_unique<LinkContext>();
+    return &context->socket;
+}
+
+bool DataServerHandler::onTcpConnected(const json& endpoint) {
+    try {
+        context->timeout = std::chrono::milliseconds(endpoint.value("timeout_ms", 5000));
+        context->socket.set_option(ip::tcp::no_delay(true));
+        sendClientHello(context->socket, epoch, position, endpoint.value("secret", ""));
+        // Дальнейшее чтение без блокировки: readData забирает накопленные кадры
+        context->socket.non_blocking(true);
+        context->lastFrame = std::chrono::steady_clock::now();
+        
+        LOG_INFO("Data server link " + name + " connected to " + endpoint["host"].get<std::string>() +
+                 ":" + std::to_string(endpoint["port"].get<int>()));
+        return true;
+    } catch (const std::exception& e) {
+        LOG_ERROR("Data server link " + name + " connection error: " + e.what());
+        context.reset();
+    }
+    return false;
+}
+
+void DataServerHandler::disconnect() {
+    if (context) {
+        boost::system::error_code ignored;
+        context->socket.close(ignored);
+        context.reset();
+    }
+    ProtocolHandler::disconnect();
+}
+
+bool DataServerHandler::updateMapping(const json& variables) {
+    if (variables == mappedVariables) return false;
+    mappedVariables = variables;
+    idMap.clear();
+    nameMap.clear();
+    mappedLocalIds.clear();
+    importedIds.clear();
+    rejectedIds.clear();
+    
+    for (const auto& [key, var] : variables.items()) {
+        if (!var.is_object() || !var.contains("id")) continue;
+        LocalTag tag{var["id"].get<int64_t>(), var.value("name", key)};
+        mappedLocalIds.insert(tag.id);
+        if (var.contains("remote_id")) {
+            idMap[var["remote_id"].get<int64_t>()] = tag;
+        } else if (var.contains("remote_name")) {
+            nameMap[var["remote_name"].get<std::string>()] = tag;
+        }
+    }
+    for (const auto& [remoteId, remoteName] : remoteNames) {
+        auto it = nameMap.find(remoteName);
+        if (it != nameMap.end()) idMap.emplace(remoteId, it->second);
+    }
+    return true;
+}
+
+json DataServerHandler::readData(const json& variables) {
+    // Новое соответствие ID: текущие значения нужно получить заново полной синхронизацией
+    if (updateMapping(variables) && connected) {
+        LOG_INFO("Data server link " + name + " variables changed, resynchronizing");
+        epoch = 0;
+        disconnect();
+    }
+    if (!connected) {
+        if (!connect()) {
+            return json::object();
+        }
+    }
+    
+    size_t applied = 0;
+    try {
+        auto& link = *context;
+        for (;;) {
+            if (link.filled == link.buffer.size()) link.buffer.resize(link.buffer.size() * 2);
+            boost::system::error_code ec;
+            const size_t bytes = link.socket.read_some(
+                boost::asio::buffer(link.buffer.data() + link.filled, link.buffer.size() - link.filled), ec);
+            if (ec == error::would_block || ec == error::try_again) break;
+            if (ec) throw boost::system::system_error(ec);
+            
+            link.filled += bytes;
+            const size_t consumed = applyFrames(link.buffer.data(), link.filled);
+            std::memmove(link.buffer.data(), link.buffer.data() + consumed, link.filled - consumed);
+            link.filled -= consumed;
+            if (consumed > 0) {
+                link.lastFrame = std::chrono::steady_clock::now();
+                ++applied;
+            }
+        }
+        // Источник присылает Heartbeat при простое: молчание означает потерю связи
+        if (std::chrono::steady_clock::now() - link.lastFrame > link.timeout) {
+            throw boost::system::system_error(error::timed_out);
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR("Data server link " + name + " lost: " + e.what());
+        disconnect();
+    }
+    return {{"batches", applied}};
+}
+
+bool DataServerHandler::importedId(int64_t remoteId, const std::string& localName, int64_t& localId) {
+    auto known = importedIds.find(remoteId);
+    if (known != importedIds.end()) {
+        localId = known->second;
+        return true;
+    }
+    if (rejectedIds.count(remoteId)) return false;
+    
+    // Переменная кэша с тем же именем - импортированная этой связью ранее (до пересоздания)
+    const bool overflow = idOffset > 0 ? remoteId > std::numeric_limits<int64_t>::max() - idOffset
+                                       : remoteId < std::numeric_limits<int64_t>::min() - idOffset;
+    localId = overflow ? 0 : remoteId + idOffset;
+    const bool taken = localId > 0 && (mappedLocalIds.count(localId) ||
+                                       (dataCache.idExists(localId) && dataCache.getNameById(localId) != localName));
+    if (localId <= 0 || taken) {
+        rejectedIds.insert(remoteId);
+        LOG_WARNING("Data server link " + name + ": remote ID " + std::to_string(remoteId) +
+                    (taken ? " maps to local ID " + std::to_string(localId) + " which is already in use"
+                           : " is out of range after id_offset") + ", ignoring it");
+        return false;
+    }
+    importedIds.emplace(remoteId, localId);
+    return true;
+}
+
+size_t DataServerHandler::applyFrames(const char* data, size_t size) {
+    return forEachFrame(data, size, [this](uint8_t type, FrameReader& reader) {
+        switch (type) {
+            case REPLICATION_HELLO: {
+                const uint64_t serverEpoch = readServerHello(reader);
+                if (serverEpoch != epoch) {
+                    epoch = serverEpoch;
+                    position = 0;
+                }
+                break;
+            }
+            case REPLICATION_SYNC_BEGIN:
+                ++fullSyncs;
+                break;
+            case REPLICATION_VALUE: {
+                int64_t remoteId;
+                HistoricalValue sample;
+                std::string_view remoteName;
+                readValueFrame(reader, remoteId, sample, remoteName);
+                
+                // Имена передаются при синхронизации: по ним разрешаются переменные remote_name
+                if (!remoteName.empty()) {
+                    auto& known = remoteNames[remoteId];
+                    if (known != remoteName) {
+                        known.assign(remoteName);
+                        auto it = nameMap.find(known);
+                        if (it != nameMap.end()) idMap[remoteId] = it->second;
+                    }
+                }
+                
+                auto it = idMap.find(remoteId);
+                if (it != idMap.end()) {
+                    if (dataCache.applyValue(it->second.id, it->second.name, sample)) {
+                        onDataReceived(it->second.id, it->second.name, sample.value);
+                    }
+                } else if (importAll) {
+                    const std::string localName = remoteName.empty() ? std::string()
+                                                                     : namePrefix + std::string(remoteName);
+                    int64_t localId = 0;
+                    if (importedId(remoteId, localName, localId) &&
+                        dataCache.applyValue(localId, localName, sample)) {
+                        onDataReceived(localId, localName, sample.value);
+                    }
+                }
+                break;
+            }
+            case REPLICATION_POSITION:
+            case REPLICATION_RESUMED:
+                reader.read(position);
+                break;
+            default:
+                break;
+        }
+    });
+}
+
+
+// Таблица тегов
+namespace {
+
+constexpr char TAGDB_MAGIC[8] = {'P', 'S', 'D', 'T', 'A', 'G', 'D', 'B'};
+constexpr uint32_t TAGDB_VERSION = 1;
+
+// Чтение файла целиком одним вызовом
+std::string readFileContent(std::ifstream& f) {
+    f.seekg(0, std::ios::end);
+    std::string content(static_cast<size_t>(f.tellg()), '\0');
+    f.seekg(0, std::ios::beg);
+    f.read(content.data(), static_cast<std::streamsize>(content.size()));
+    return content;
+}
+
+// Однопроходная загрузка конфигурации: SAX-события одновременно строят DOM
+// и собирают таблицу тегов (секция -> variables -> переменная -> id/name)
+class ConfigSaxLoader {
+private:
+    nlohmann::detail::json_sax_dom_parser<json> domParser;
+    std::vector<bool> containerIsObject;
+    std::vector<std::string> keys; // Последний ключ на каждом уровне вложенности
+    
+    bool inVariable = false;
+    bool hasId = false;
+    TagTable::Entry current;
+    
+    size_t depth() const { return containerIsObject.size(); }
+    
+    // Уровни: 1 - корень, 2 - секция, 3 - variables, 4 - переменная
+    bool atVariableField() const {
+        return inVariable && depth() == 4 && containerIsObject[3];
+    }
+    
+public:
+    std::vector<TagTable::Entry> entries;
+    int64_t maxId = 0;
+    size_t missingIds = 0;
+    
+    explicit ConfigSaxLoader(json& result) : domParser(result) {}
+    
+    bool null() { return domParser.null(); }
+    bool boolean(bool val) { return domParser.boolean(val); }
+    
+    bool number_integer(json::number_integer_t val) {
+        if (atVariableField() && keys[3] == "id") {
+            current.id = val;
+            hasId = val != 0;
+        }
+        return domParser.number_integer(val);
+    }
+    
+    bool number_unsigned(json::number_unsigned_t val) {
+        if (atVariableField() && keys[3] == "id") {
+            current.id = static_cast<int64_t>(val);
+            hasId = val != 0;
+        }
+        return domParser.number_unsigned(val);
+    }
+    
+    bool number_float(json::number_float_t val, const json::string_t& str) {
+        return domParser.number_float(val, str);
+    }
+    
+    bool string(json::string_t& val) {
+        if (atVariableField() && keys[3] == "name") {
+            current.name = val;
+        }
+        return domParser.string(val);
+    }
+    
+    bool binary(json::binary_t& val) { return domParser.binary(val); }
+    
+    bool start_object(std::size_t len) {
+        // Объект переменной: корень -> секция -> "variables" -> ключ переменной
+        if (depth() == 3 && containerIsObject[2] && keys[1] == "variables") {
+            inVariable = true;
+            hasId = false;
+            current = TagTable::Entry{0, "", keys[0], keys[2]};
+        }
+        containerIsObject.push_back(true);
+        keys.emplace_back();
+        return domParser.start_object(len);
+    }
+    
+    bool key(json::string_t& val) {
+        keys.back() = val;
+        return domParser.key(val);
+    }
+    
+    bool end_object() {
+        containerIsObject.pop_back();
+        keys.pop_back();
+        if (inVariable && depth() == 3) {
+            inVariable = false;
+            if (hasId) {
+                maxId = std::max(maxId, current.id);
+                entries.push_back(std::move(current));
+            } else {
+                ++missingIds;
+            }
+        }
+        return domParser.end_object();
+    }
+    
+    bool start_array(std::size_t len) {
+        containerIsObject.push_back(false);
+        keys.emplace_back();
+        return domParser.start_array(len);
+    }
+    
+    bool end_array() {
+        containerIsObject.pop_back();
+        keys.pop_back();
+        return domParser.end_array();
+    }
+    
+    template <class Exception>
+    bool parse_error(std::size_t position, const std::string& lastToken, const Exception& ex) {
+        return domParser.parse_error(position, lastToken, ex);
+    }
+};
+
+} // namespace
+
+TagTable::~TagTable() {
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+}
+
+uint64_t TagTable::hashContent(std::string_view content) {
+    // FNV-1a 64, как контрольная сумма снимка кэша
+    return fnvUpdate(14695981039346656037ULL, content);
+}
+
+const TagDbHeader& TagTable::header() const {
+    return *reinterpret_cast<const TagDbHeader*>(base);
+}
+
+std::string_view TagTable::str(uint32_t offset, uint32_t length) const {
+    return std::string_view(base + header().stringsOffset + offset, length);
+}
+
+void TagTable::build(std::vector<Entry> entries, int64_t maxId, uint64_t configHash, uint64_t configSize,
+                     uint32_t generatedIds) {
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.id < b.id; });
+    
+    std::string strings;
+    std::vector<TagRecord> records;
+    records.reserve(entries.size());
+    auto addString = [&strings](const std::string& value, uint32_t& offset, uint32_t& length) {
+        offset = static_cast<uint32_t>(strings.size());
+        length = static_cast<uint32_t>(value.size());
+        strings += value;
+    };
+    for (const auto& entry : entries) {
+        TagRecord rec{};
+        rec.id = entry.id;
+        addString(entry.name, rec.nameOffset, rec.nameLength);
+        addString(entry.section, rec.sectionOffset, rec.sectionLength);
+        addString(entry.key, rec.keyOffset, rec.keyLength);
+        records.push_back(rec);
+    }
+    
+    TagDbHeader hdr{};
+    std::memcpy(hdr.magic, TAGDB_MAGIC, sizeof(hdr.magic));
+    hdr.version = TAGDB_VERSION;
+    hdr.generatedIds = generatedIds;
+    hdr.configHash = configHash;
+    hdr.configSize = configSize;
+    hdr.tagCount = records.size();
+    hdr.recordsOffset = sizeof(TagDbHeader);
+    hdr.stringsOffset = hdr.recordsOffset + records.size() * sizeof(TagRecord);
+    hdr.stringsSize = strings.size();
+    hdr.maxId = maxId;
+    
+    storage.assign(hdr.stringsOffset + strings.size(), 0);
+    std::memcpy(storage.data(), &hdr, sizeof(hdr));
+    if (!records.empty()) {
+        std::memcpy(storage.data() + hdr.recordsOffset, records.data(), records.size() * sizeof(TagRecord));
+    }
+    std::memcpy(storage.data() + hdr.stringsOffset, strings.data(), strings.size());
+    base = storage.data();
+}
+
+bool TagTable::loadFromFile(const std::string& path, uint64_t configHash, uint64_t configSize) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(TagDbHeader)) {
+        ::close(fd);
+        return false;
+    }
+    
+    auto size = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+    
+    // Проверка заголовка: формат, версия, соответствие текущей конфигурации и границы секций
+    const auto* hdr = static_cast<const TagDbHeader*>(data);
+    bool valid = std::memcmp(hdr->magic, TAGDB_MAGIC, sizeof(hdr->magic)) == 0 &&
+                 hdr->version == TAGDB_VERSION &&
+                 hdr->configHash == configHash &&
+                 hdr->configSize == configSize &&
+                 hdr->recordsOffset == sizeof(TagDbHeader) &&
+                 hdr->stringsOffset == hdr->recordsOffset + hdr->tagCount * sizeof(TagRecord) &&
+                 hdr->stringsOffset + hdr->stringsSize == size;
+    if (!valid) {
+        munmap(data, size);
+        return false;
+    }
+    
+    if (mapping) munmap(mapping, mappingSize);
+    storage.clear();
+    mapping = data;
+    mappingSize = size;
+    base = static_cast<const char*>(data);
+    return true;
+}
+
+bool TagTable::saveToFile(const std::string& path) const {
+    if (!base) return false;
+    size_t size = mapping ? mappingSize : storage.size();
+    
+    // Запись во временный файл и атомарное переименование
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream f(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!f.is_open()) return false;
+        f.write(base, static_cast<std::streamsize>(size));
+        if (!f.good()) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    return !ec;
+}
+
+size_t TagTable::size() const {
+    return base ? header().tagCount : 0;
+}
+
+const TagRecord& TagTable::record(size_t index) const {
+    return reinterpret_cast<const TagRecord*>(base + header().recordsOffset)[index];
+}
+
+const TagRecord* TagTable::find(int64_t id) const {
+    if (!base) return nullptr;
+    const auto* begin = reinterpret_cast<const TagRecord*>(base + header().recordsOffset);
+    const auto* end = begin + header().tagCount;
+    auto it = std::lower_bound(begin, end, id,
+                               [](const TagRecord& rec, int64_t value) { return rec.id < value; });
+    return (it != end && it->id == id) ? it : nullptr;
+}
+
+std::string_view TagTable::name(const TagRecord& rec) const {
+    return str(rec.nameOffset, rec.nameLength);
+}
+
+std::string_view TagTable::section(const TagRecord& rec) const {
+    return str(rec.sectionOffset, rec.sectionLength);
+}
+
+std::string_view TagTable::key(const TagRecord& rec) const {
+    return str(rec.keyOffset, rec.keyLength);
+}
+
+int64_t TagTable::maxId() const {
+    return base ? header().maxId : 0;
+}
+
+uint32_t TagTable::generatedIds() const {
+    return base ? header().generatedIds : 0;
+}
+
+
+// Опрос одного устройства
+PollingPolicy PollingPolicy::fromJson(const json& settings) {
+    PollingPolicy policy;
+    if (!settings.is_object()) return policy;
+    policy.errorRateThreshold = std::clamp(settings.value("error_rate_threshold", 0.5), 0.0, 1.0);
+    policy.failureThreshold = std::max(1, settings.value("failure_threshold", 5));
+    policy.openDuration = std::chrono::milliseconds(std::max(10, settings.value("open_ms", 10000)));
+    policy.slowResponse = std::chrono::milliseconds(std::max(0, settings.value("slow_response_ms", 0)));
+    policy.maxStretch = std::max(1, settings.value("max_stretch", 8));
+    policy.openQuality = settings.value("open_quality", "bad");
+    return policy;
+}
+
+DevicePoller::DevicePoller(std::unique_ptr<ProtocolHandler> protocolHandler, json vars, int intervalMs,
+                           const json& policySettings, const json& qosSettings)
+    : handler(std::move(protocolHandler)),
+      variables(std::make_shared<const json>(std::move(vars))),
+      pollingInterval(intervalMs),
+      policy(PollingPolicy::fromJson(policySettings)) {
+    updateQos(qosSettings);
+}
+
+DevicePoller::~DevicePoller() {
+    stop();
+}
+
+void DevicePoller::start() {
+    if (running.exchange(true)) return;
+    thread = std::thread([this]() { run(); });
+}
+
+void DevicePoller::stop() {
+    {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        running = false;
+    }
+    waitCondition.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+void DevicePoller::updateVariables(json vars, int intervalMs) {
+    std::atomic_store(&variables, std::make_shared<const json>(std::move(vars)));
+    pollingInterval = intervalMs;
+}
+
+ProtocolHandler& DevicePoller::getHandler() {
+    return *handler;
+}
+
+void DevicePoller::run() {
+    // Закрепление до первого опроса: поток не мигрирует за пределы своего набора ядер.
+    // Обработчик и его буферы созданы потоком, запустившим опросчик, и по узлам NUMA не размещаются
+    ThreadPlacement::getInstance().place(ThreadPlacement::Role::Poller);
+    
+    std::array<Lane, QosClass::Count> lanes;
+    std::shared_ptr<const json> lanesSource;
+    
+    while (running) {
+        auto wakeAt = std::chrono::steady_clock::time_point::max();
+        if (!handler->isConnected()) {
+            handler->connect();
+        } else if (pollAllowed()) {
+            auto vars = std::atomic_load(&variables);
+            if (vars != lanesSource) {
+                splitLanes(*vars, lanes);
+                lanesSource = vars;
+            }
+            
+            // Читается одна часть самой приоритетной полосы с наступившим сроком,
+            // после чего сроки проверяются снова
+            const auto now = std::chrono::steady_clock::now();
+            for (size_t index = 0; index < QosClass::Count; ++index) {
+                Lane& lane = lanes[index];
+                if (lane.chunks.empty() || lane.due > now) continue;
+                
+                if (!pollChunk(lane)) {
+                    // Разрыв соединения: проход полосы завершается неудачным циклом и после
+                    // переподключения начинается заново
+                    finishCycle(lane, true);
+                } else if (++lane.next == lane.chunks.size()) {
+                    const auto finished = std::chrono::steady_clock::now();
+                    finishCycle(lane, false);
+                    laneLatency[index].record(std::chrono::duration<double, std::milli>(finished - lane.due).count());
+                    std::lock_guard<std::mutex> lock(statsMutex);
+                    lane.due = finished + laneInterval(static_cast<QosClass::Value>(index));
+                }
+                break;
+            }
+            for (const auto& lane : lanes) {
+                if (!lane.chunks.empty()) wakeAt = std::min(wakeAt, lane.due);
+            }
+        }
+        
+        if (wakeAt == std::chrono::steady_clock::time_point::max()) {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            wakeAt = std::chrono::steady_clock::now() + effectiveInterval();
+        }
+        std::unique_lock<std::mutex> lock(waitMutex);
+        waitCondition.wait_until(lock, wakeAt, [this]() { return !running; });
+    }
+}
+
+bool DevicePoller::pollChunk(Lane& lane) {
+    const uint64_t good = handler->goodReadCount();
+    const uint64_t bad = handler->badReadCount();
+    const auto start = std::chrono::steady_clock::now();
+    
+    auto data = handler->readData(lane.chunks[lane.next]);
+    // Данные автоматически обновляются в кэше через callback
+    
+    lane.busy += std::chrono::steady_clock::now() - start;
+    lane.goodReads += handler->goodReadCount() - good;
+    lane.badReads += handler->badReadCount() - bad;
+    const bool connected = handler->isConnected();
+    handler->checkHealth();
+    return connected;
+}
+
+void DevicePoller::finishCycle(Lane& lane, bool connectionLost) {
+    // Разрыв соединения во время чтения - полностью неудачный цикл
+    double cycleErrorRate = 0.0;
+    if (connectionLost) {
+        cycleErrorRate = 1.0;
+    } else if (lane.goodReads + lane.badReads > 0) {
+        cycleErrorRate = static_cast<double>(lane.badReads) / static_cast<double>(lane.goodReads + lane.badReads);
+    }
+    recordCycle(lane.busy, cycleErrorRate);
+    lane.next = 0;
+    lane.busy = {};
+    lane.goodReads = 0;
+    lane.badReads = 0;
+}
+
+// Разбиение переменных по полосам; сроки полос сохраняются при замене списка переменных
+void DevicePoller::splitLanes(const json& vars, std::array<Lane, QosClass::Count>& lanes) const {
+    size_t bulkChunk;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        bulkChunk = qos.bulkChunk;
+    }
+    
+    std::array<json, QosClass::Count> members;
+    for (auto& lane : members) lane = json::object();
+    for (const auto& [key, var] : vars.items()) {
+        const auto lane = var.is_object() ? QosClass::fromString(var.value("priority", "")) : QosClass::Normal;
+        members[QosClass::index(lane)][key] = var;
+    }
+    
+    // Обработчик без частичного чтения получает полный список переменных одной полосой
+    if (!handler->supportsPartialReads()) {
+        for (size_t index = 0; index < QosClass::Count; ++index) {
+            if (index != QosClass::Normal) members[index] = json::object();
+        }
+        members[QosClass::Normal] = vars;
+    }
+    
+    const auto now = std::chrono::steady_clock::now();
+    for (size_t index = 0; index < QosClass::Count; ++index) {
+        Lane& lane = lanes[index];
+        const bool wasEmpty = lane.chunks.empty();
+        lane.chunks.clear();
+        lane.next = 0;
+        lane.busy = {};
+        lane.goodReads = 0;
+        lane.badReads = 0;
+        if (members[index].empty()) continue;
+        if (index != QosClass::Bulk) {
+            lane.chunks.push_back(std::move(members[index]));
+        } else {
+            for (auto& [key, var] : members[index].items()) {
+                if (lane.chunks.empty() || lane.chunks.back().size() >= bulkChunk) {
+                    lane.chunks.push_back(json::object());
+                }
+                lane.chunks.back()[key] = std::move(var);
+            }
+        }
+        if (wasEmpty) lane.due = now;
+    }
+}
+
+bool DevicePoller::pollAllowed() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (breakerState != BreakerState::Open) return true;
+    if (std::chrono::steady_clock::now() - openedAt < policy.openDuration) return false;
+    
+    // Пауза истекла: один пробный цикл решает, замкнуть цепь или снова разомкнуть
+    breakerState = BreakerState::HalfOpen;
+    LOG_INFO("Circuit breaker of " + handler->getName() + " is half-open, probing the device");
+    return true;
+}
+
+void DevicePoller::recordCycle(std::chrono::steady_clock::duration latency, double cycleErrorRate) {
+    constexpr double alpha = 0.3;
+    const double cycleMs = std::chrono::duration<double, std::milli>(latency).count();
+    std::vector<int64_t> openIds;
+    std::string openQuality;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        latencyMs = cycles == 0 ? cycleMs : alpha * cycleMs + (1 - alpha) * latencyMs;
+        errorRate = cycles == 0 ? cycleErrorRate : alpha * cycleErrorRate + (1 - alpha) * errorRate;
+        ++cycles;
+        const bool failed = cycleErrorRate >= policy.errorRateThreshold;
+        if (failed) {
+            ++failedCycles;
+            ++consecutiveFailures;
+        } else {
+            consecutiveFailures = 0;
+        }
+        
+        if (breakerState == BreakerState::HalfOpen) {
+            breakerState = failed ? BreakerState::Open : BreakerState::Closed;
+        } else if (consecutiveFailures >= policy.failureThreshold ||
+                   (cycles >= static_cast<uint64_t>(policy.failureThreshold) &&
+                    errorRate >= policy.errorRateThreshold)) {
+            breakerState = BreakerState::Open;
+        }
+        
+        if (breakerState == BreakerState::Open) {
+            openedAt = std::chrono::steady_clock::now();
+            ++breakerOpens;
+            openQuality = policy.openQuality;
+            LOG_WARNING("Circuit breaker of " + handler->getName() + " opened: error rate " +
+                        std::to_string(errorRate) + ", polling paused for " +
+                        std::to_string(policy.openDuration.count()) + " ms");
+        } else if (breakerState == BreakerState::Closed && !failed) {
+            // Перегрузка: длительный цикл или заметная доля ошибок растягивает интервал
+            const double base = static_cast<double>(pollingInterval.load());
+            const double slow = policy.slowResponse.count() > 0 ? static_cast<double>(policy.slowResponse.count()) : base / 2;
+            const int previous = stretch;
+            if (latencyMs > slow || errorRate > policy.errorRateThreshold / 2) {
+                stretch = std::min(policy.maxStretch, stretch * 2);
+            } else if (latencyMs < slow / 2 && errorRate < policy.errorRateThreshold / 4) {
+                stretch = std::max(1, stretch / 2);
+            }
+            if (stretch != previous) {
+                LOG_INFO("Polling interval of " + handler->getName() + " " +
+                         (stretch > previous ? "stretched" : "restored") + " to " +
+                         std::to_string(effectiveInterval().count()) + " ms");
+            }
+        }
+    }
+    
+    if (!openQuality.empty()) {
+        // Опрос приостановлен: качество всех тегов устройства меняется одной операцией
+        auto vars = std::atomic_load(&variables);
+        for (const auto& [key, var] : vars->items()) {
+            if (var.is_object() && var.contains("id")) openIds.push_back(var["id"].get<int64_t>());
+        }
+        handler->markQuality(openIds, openQuality);
+    }
+}
+
+// Вызывается под statsMutex
+std::chrono::milliseconds DevicePoller::effectiveInterval() const {
+    return std::chrono::milliseconds(static_cast<int64_t>(pollingInterval.load()) * stretch);
+}
+
+// Вызывается под statsMutex; растяжение при перегрузке действует на все полосы
+std::chrono::milliseconds DevicePoller::laneInterval(QosClass::Value lane) const {
+    const int base = qos.intervalMs[QosClass::index(lane)] > 0 ? qos.intervalMs[QosClass::index(lane)] : pollingInterval.load();
+    return std::chrono::milliseconds(static_cast<int64_t>(base) * stretch);
+}
+
+void DevicePoller::updatePolicy(const json& policySettings) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    policy = PollingPolicy::fromJson(policySettings);
+    stretch = std::min(stretch, policy.maxStretch);
+}
+
+void DevicePoller::updateQos(const json& qosSettings) {
+    QosPolicy updated = QosPolicy::fromJson(qosSettings);
+    for (size_t lane = 0; lane < QosClass::Count; ++lane) {
+        laneLatency[lane].setTarget(updated.sloMs[lane]);
+    }
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        if (qos.bulkChunk == updated.bulkChunk) {
+            qos = updated;
+            return;
+        }
+        qos = updated;
+    }
+    // Новый размер частей применяется перестроением полос в потоке опроса
+    if (auto vars = std::atomic_load(&variables)) {
+        std::atomic_store(&variables, std::make_shared<const json>(*vars));
+    }
+}
+
+DevicePoller::BreakerState DevicePoller::state() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return breakerState;
+}
+
+json DevicePoller::metrics() const {
+    static const char* const stateNames[] = {"closed", "open", "half_open"};
+    
+    // Полосы опроса: число переменных, интервал и задержка относительно SLO
+    std::array<size_t, QosClass::Count> laneSizes{};
+    auto vars = std::atomic_load(&variables);
+    const bool partial = handler->supportsPartialReads();
+    for (const auto& [key, var] : vars->items()) {
+        const auto lane = partial && var.is_object() ? QosClass::fromString(var.value("priority", "")) : QosClass::Normal;
+        ++laneSizes[QosClass::index(lane)];
+    }
+    json lanes = json::object();
+    for (size_t index = 0; index < QosClass::Count; ++index) {
+        if (laneSizes[index] == 0) continue;
+        json lane = laneLatency[index].toJson();
+        lane["variables"] = laneSizes[index];
+        std::lock_guard<std::mutex> lock(statsMutex);
+        lane["interval_ms"] = laneInterval(static_cast<QosClass::Value>(index)).count();
+        lanes[QosClass::name(static_cast<QosClass::Value>(index))] = std::move(lane);
+    }
+    
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return {
+        {"lanes", std::move(lanes)},
+        {"state", stateNames[static_cast<int>(breakerState)]},
+        {"connected", handler->isConnected()},
+        {"base_interval_ms", pollingInterval.load()},
+        {"interval_ms", effectiveInterval().count()},
+        {"latency_ms", latencyMs},
+        {"error_rate", errorRate},
+        {"cycles", cycles},
+        {"failed_cycles", failedCycles},
+        {"breaker_opens", breakerOpens},
+        {"good_reads", handler->goodReadCount()},
+        {"bad_reads", handler->badReadCount()}
+    };
+}
+
+
+// Вычисляемые переменные
+// Разбор выражения рекурсивным спуском с генерацией байт-кода; глубина стека
+// и тип результата (логический или числовой) определяются при компиляции
+class Expression::Parser {
+public:
+    Parser(std::string_view text, Expression& expression) : text(text), expression(expression) {}
+    
+    void parse() {
+        expression.boolean = parseConditional();
+        skipSpaces();
+        if (pos < text.size()) fail("unexpected character");
+    }
+    
+private:
+    std::string_view text;
+    Expression& expression;
+    size_t pos = 0;
+    size_t depth = 0;
+    std::unordered_map<int64_t, uint32_t, Int64Hash> slots;
+    
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::invalid_argument(message + " at position " + std::to_string(pos));
+    }
+    
+    void skipSpaces() {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) ++pos;
+    }
+    
+    bool match(std::string_view token) {
+        skipSpaces();
+        if (text.substr(pos, token.size()) != token) return false;
+        pos += token.size();
+        return true;
+    }
+    
+    void expect(std::string_view token) {
+        if (!match(token)) fail("expected '" + std::string(token) + "'");
+    }
+    
+    // pops - количество снимаемых со стека значений, результат всегда одно значение
+    void emit(Op op, size_t pops, uint32_t arg = 0, double value = 0.0) {
+        expression.code.push_back({op, arg, value});
+        depth = depth - pops + 1;
+        expression.maxDepth = std::max(expression.maxDepth, depth);
+    }
+    
+    bool parseConditional() {
+        bool result = parseOr();
+        if (!match("?")) return result;
+        bool whenTrue = parseConditional();
+        expect(":");
+        bool whenFalse = parseConditional();
+        emit(Op::Select, 3);
+        return whenTrue && whenFalse;
+    }
+    
+    bool parseOr() {
+        bool result = parseAnd();
+        while (match("||")) {
+            parseAnd();
+            emit(Op::Or, 2);
+            result = true;
+        }
+        return result;
+    }
+    
+    bool parseAnd() {
+        bool result = parseComparison();
+        while (match("&&")) {
+            parseComparison();
+            emit(Op::And, 2);
+            result = true;
+        }
+        return result;
+    }
+    
+    bool parseComparison() {
+        bool result = parseAdditive();
+        static const std::pair<std::string_view, Op> operators[] = {
+            {"<=", Op::LessEqual}, {">=", Op::GreaterEqual}, {"==", Op::Equal},
+            {"!=", Op::NotEqual}, {"<", Op::Less}, {">", Op::Greater}
+        };
+        for (const auto& [token, op] : operators) {
+            if (match(token)) {
+                parseAdditive();
+                emit(op, 2);
+                return true;
+            }
+        }
+        return result;
+    }
+    
+    bool parseAdditive() {
+        bool result = parseMultiplicative();
+        while (true) {
+            if (match("+")) {
+                parseMultiplicative();
+                emit(Op::Add, 2);
+            } else if (match("-")) {
+                parseMultiplicative();
+                emit(Op::Sub, 2);
+            } else {
+                return result;
+            }
+            result = false;
+        }
+    }
+    
+    bool parseMultiplicative() {
+        bool result = parseUnary();
+        while (true) {
+            if (match("*")) {
+                parseUnary();
+                emit(Op::Mul, 2);
+            } else if (match("/")) {
+                parseUnary();
+                emit(Op::Div, 2);
+            } else if (match("%")) {
+                parseUnary();
+                emit(Op::Mod, 2);
+            } else {
+                return result;
+            }
+            result = false;
+        }
+    }
+    
+    bool parseUnary() {
+        if (match("-")) {
+            parseUnary();
+            emit(Op::Neg, 1);
+            return false;
+        }
+        if (match("!")) {
+            parseUnary();
+            emit(Op::Not, 1);
+            return true;
+        }
+        return parsePrimary();
+    }
+    
+    bool parsePrimary() {
+        skipSpaces();
+        if (pos >= text.size()) fail("unexpected end of expression");
+        
+        const char c = text[pos];
+        if (c == '(') {
+            ++pos;
+            bool result = parseConditional();
+            expect(")");
+            return result;
+        }
+        if (c == '$') {
+            // Ссылка на переменную: $<id>
+            ++pos;
+            int64_t id = 0;
+            auto parsed = std::from_chars(text.data() + pos, text.data() + text.size(), id);
+            if (parsed.ec != std::errc() || id <= 0) fail("expected variable ID after '$'");
+            pos = static_cast<size_t>(parsed.ptr - text.data());
+            auto [it, inserted] = slots.emplace(id, static_cast<uint32_t>(expression.inputIds.size()));
+            if (inserted) expression.inputIds.push_back(id);
+            emit(Op::Input, 0, it->second);
+            return false;
+        }
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            double value = 0.0;
+            auto parsed = std::from_chars(text.data() + pos, text.data() + text.size(), value);
+            if (parsed.ec != std::errc()) fail("invalid number");
+            pos = static_cast<size_t>(parsed.ptr - text.data());
+            emit(Op::Const, 0, 0, value);
+            return false;
+        }
+        if (std::isalpha(static_cast<unsigned char>(c))) {
+            size_t start = pos;
+            while (pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '_')) ++pos;
+            std::string_view word = text.substr(start, pos - start);
+            if (word == "true" || word == "false") {
+                emit(Op::Const, 0, 0, word == "true" ? 1.0 : 0.0);
+                return true;
+            }
+            return parseCall(word, start);
+        }
+        fail("unexpected character");
+    }
+    
+    bool parseCall(std::string_view name, size_t start) {
+        // Функция: код операции и допустимое количество аргументов
+        struct Function { std::string_view name; Op op; size_t minArgs; size_t maxArgs; };
+        static const Function functions[] = {
+            {"abs", Op::Abs, 1, 1}, {"sqrt", Op::Sqrt, 1, 1}, {"round", Op::Round, 1, 1},
+            {"pow", Op::Pow, 2, 2}, {"min", Op::Min, 1, SIZE_MAX}, {"max", Op::Max, 1, SIZE_MAX},
+            {"sum", Op::Sum, 1, SIZE_MAX}, {"avg", Op::Avg, 1, SIZE_MAX}
+        };
+        auto function = std::find_if(std::begin(functions), std::end(functions),
+                                     [name](const Function& f) { return f.name == name; });
+        if (function == std::end(functions)) {
+            pos = start;
+            fail("unknown function '" + std::string(name) + "'");
+        }
+        
+        expect("(");
+        size_t count = 0;
+        if (!match(")")) {
+            do {
+                parseConditional();
+                ++count;
+            } while (match(","));
+            expect(")");
+        }
+        if (count < function->minArgs || count > function->maxArgs) {
+            fail("wrong number of arguments for '" + std::string(name) + "'");
+        }
+        emit(function->op, count, static_cast<uint32_t>(count));
+        return false;
+    }
+};
+
+Expression Expression::compile(std::string_view text) {
+    Expression expression;
+    Parser(text, expression).parse();
+    return expression;
+}
+
+double Expression::evaluate(const double* values, std::vector<double>& stack) const {
+    if (stack.size() < maxDepth) stack.resize(maxDepth);
+    double* s = stack.data();
+    size_t sp = 0;
+    
+    for (const auto& ins : code) {
+        switch (ins.op) {
+            case Op::Const: s[sp++] = ins.value; break;
+            case Op::Input: s[sp++] = values[ins.arg]; break;
+            case Op::Neg: s[sp - 1] = -s[sp - 1]; break;
+            case Op::Not: s[sp - 1] = s[sp - 1] == 0.0 ? 1.0 : 0.0; break;
+            case Op::Abs: s[sp - 1] = std::fabs(s[sp - 1]); break;
+            case Op::Sqrt: s[sp - 1] = std::sqrt(s[sp - 1]); break;
+            case Op::Round: s[sp - 1] = std::round(s[sp - 1]); break;
+            case Op::Add: --sp; s[sp - 1] += s[sp]; break;
+            case Op::Sub: --sp; s[sp - 1] -= s[sp]; break;
+            case Op::Mul: --sp; s[sp - 1] *= s[sp]; break;
+            case Op::Div: --sp; s[sp - 1] /= s[sp]; break;
+            case Op::Mod: --sp; s[sp - 1] = std::fmod(s[sp - 1], s[sp]); break;
+            case Op::Pow: --sp; s[sp - 1] = std::pow(s[sp - 1], s[sp]); break;
+            case Op::Less: --sp; s[sp - 1] = s[sp - 1] < s[sp] ? 1.0 : 0.0; break;
+            case Op::LessEqual: --sp; s[sp - 1] = s[sp - 1] <= s[sp] ? 1.0 : 0.0; break;
+            case Op::Greater: --sp; s[sp - 1] = s[sp - 1] > s[sp] ? 1.0 : 0.0; break;
+            case Op::GreaterEqual: --sp; s[sp - 1] = s[sp - 1] >= s[sp] ? 1.0 : 0.0; break;
+            case Op::Equal: --sp; s[sp - 1] = s[sp - 1] == s[sp] ? 1.0 : 0.0; break;
+            case Op::NotEqual: --sp; s[sp - 1] = s[sp - 1] != s[sp] ? 1.0 : 0.0; break;
+            case Op::And: --sp; s[sp - 1] = s[sp - 1] != 0.0 && s[sp] != 0.0 ? 1.0 : 0.0; break;
+            case Op::Or: --sp; s[sp - 1] = s[sp - 1] != 0.0 || s[sp] != 0.0 ? 1.0 : 0.0; break;
+            case Op::Select:
+                sp -= 2;
+                s[sp - 1] = s[sp - 1] != 0.0 ? s[sp] : s[sp + 1];
+                break;
+            case Op::Min:
+            case Op::Max:
+            case Op::Sum:
+            case Op::Avg: {
+                double* args = s + sp - ins.arg;
+                double result = args[0];
+                for (uint32_t i = 1; i < ins.arg; ++i) {
+                    if (ins.op == Op::Min) result = std::min(result, args[i]);
+                    else if (ins.op == Op::Max) result = std::max(result, args[i]);
+                    else result += args[i];
+                }
+                if (ins.op == Op::Avg) result /= ins.arg;
+                sp -= ins.arg - 1;
+                s[sp - 1] = result;
+                break;
+            }
+        }
+    }
+    return s[0];
+}
+
+namespace {
+
+constexpr double kNoValue = std::numeric_limits<double>::quiet_NaN();
+
+bool sameValue(double a, double b) {
+    return a == b || (std::isnan(a) && std::isnan(b));
+}
+
+ValueUpdate::Quality worseQuality(ValueUpdate::Quality a, ValueUpdate::Quality b) {
+    using Quality = ValueUpdate::Quality;
+    if (a == Quality::Bad || b == Quality::Bad) return Quality::Bad;
+    if (a == Quality::Uncertain || b == Quality::Uncertain) return Quality::Uncertain;
+    return Quality::Good;
+}
+
+// Числовое значение входа; логические значения - 0 и 1
+std::optional<double> numericValue(const ValueUpdate& update) {
+    switch (update.kind) {
+        case ValueUpdate::Kind::Bool: return update.bits != 0 ? 1.0 : 0.0;
+        case ValueUpdate::Kind::Integer: return static_cast<double>(static_cast<int64_t>(update.bits));
+        case ValueUpdate::Kind::Unsigned: return static_cast<double>(update.bits);
+        case ValueUpdate::Kind::Float: {
+            double x;
+            std::memcpy(&x, &update.bits, sizeof(x));
+            return x;
+        }
+        default: return std::nullopt;
+    }
+}
+
+std::optional<double> numericValue(const json& value) {
+    if (value.is_boolean()) return value.get<bool>() ? 1.0 : 0.0;
+    if (value.is_number()) return value.get<double>();
+    return std::nullopt;
+}
+
+} // namespace
+
+DerivedTagEngine::DerivedTagEngine(DataCache& cache, SubscriptionManager& manager)
+    : dataCache(cache), subscriptionManager(manager) {}
+
+DerivedTagEngine::~DerivedTagEngine() {
+    stop();
+}
+
+std::vector<DerivedTagEngine::Definition> DerivedTagEngine::definitionsFromJson(const json& section) {
+    std::vector<Definition> definitions;
+    if (!section.is_object() || !section.contains("variables")) return definitions;
+    
+    for (auto& [key, var] : section["variables"].items()) {
+        if (!var.is_object() || !var.contains("id") || !var["id"].is_number()) continue;
+        definitions.push_back({var["id"].get<int64_t>(), var.value("name", key), var.value("expression", "")});
+    }
+    return definitions;
+}
+
+void DerivedTagEngine::configure(const std::vector<Definition>& definitions) {
+    tags.clear();
+    inputs.clear();
+    compileErrors.clear();
+    
+    std::vector<Tag> compiled;
+    std::unordered_map<int64_t, size_t, Int64Hash> compiledIds;
+    for (const auto& definition : definitions) {
+        try {
+            compiled.push_back({definition.id, definition.name, Expression::compile(definition.expression), {}});
+            compiledIds[definition.id] = compiled.size() - 1;
+        } catch (const std::invalid_argument& e) {
+            compileErrors[definition.name] = e.what();
+        }
+    }
+    
+    // Топологическая сортировка (алгоритм Кана) по ссылкам на другие вычисляемые переменные;
+    // переменные в цикле и зависящие от них не достигают нулевой степени и отклоняются
+    std::vector<size_t> unresolved(compiled.size(), 0);
+    std::vector<std::vector<size_t>> consumers(compiled.size());
+    for (size_t i = 0; i < compiled.size(); ++i) {
+        for (int64_t id : compiled[i].expression.inputs()) {
+            auto it = compiledIds.find(id);
+            if (it == compiledIds.end()) continue;
+            ++unresolved[i];
+            consumers[it->second].push_back(i);
+        }
+    }
+    std::vector<size_t> order;
+    for (size_t i = 0; i < compiled.size(); ++i) {
+        if (unresolved[i] == 0) order.push_back(i);
+    }
+    for (size_t k = 0; k < order.size(); ++k) {
+        for (size_t consumer : consumers[order[k]]) {
+            if (--unresolved[consumer] == 0) order.push_back(consumer);
+        }
+    }
+    for (size_t i = 0; i < compiled.size(); ++i) {
+        if (unresolved[i] != 0) compileErrors[compiled[i].name] = "cyclic dependency";
+    }
+    
+    tags.reserve(order.size());
+    for (size_t i : order) tags.push_back(std::move(compiled[i]));
+    for (size_t index = 0; index < tags.size(); ++index) {
+        for (int64_t id : tags[index].expression.inputs()) {
+            inputs[id].dependents.push_back(index);
+        }
+    }
+    // Указатели на элементы unordered_map не меняются при вставке
+    for (auto& tag : tags) {
+        for (int64_t id : tag.expression.inputs()) tag.sources.push_back(&inputs[id]);
+    }
+    queued.assign(tags.size(), 0);
+    
+    for (const auto& [name, error] : compileErrors) {
+        LOG_ERROR("Derived tag " + name + ": " + error);
+    }
+}
+
+void DerivedTagEngine::start() {
+    if (tags.empty() || running.exchange(true)) return;
+    thread = std::thread([this]() { run(); });
+}
+
+void DerivedTagEngine::stop() {
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+void DerivedTagEngine::run() {
+    // Подписка создается до чтения кэша: изменения между чтением и подпиской не теряются
+    auto subscription = subscriptionManager.createSubscription();
+    subscription->addAll();
+    loadInputs();
+    
+    auto visitor = [this](const ValueUpdate& update, const std::string&) {
+        auto it = inputs.find(update.id);
+        if (it == inputs.end()) return;
+        auto value = numericValue(update);
+        setInput(it->second, value.value_or(kNoValue), value ? update.quality : ValueUpdate::Quality::Bad);
+    };
+    
+    while (running) {
+        switch (subscription->poll(visitor)) {
+            case Subscription::PollResult::Updates:
+                evaluatePending();
+                break;
+            case Subscription::PollResult::Resync:
+                loadInputs();
+                break;
+            case Subscription::PollResult::Idle:
+                subscription->wait(std::chrono::milliseconds(100));
+                break;
+        }
+    }
+}
+
+void DerivedTagEngine::loadInputs() {
+    std::vector<int64_t> ids;
+    ids.reserve(inputs.size());
+    for (const auto& [id, input] : inputs) ids.push_back(id);
+    
+    for (const auto& item : dataCache.getValues(ids)) {
+        auto value = numericValue(item.value.value);
+        setInput(inputs[item.id], value.value_or(kNoValue),
+                 value ? ValueUpdate::qualityFromString(item.value.quality) : ValueUpdate::Quality::Bad);
+    }
+    // Выражения из одних констант вычисляются один раз
+    for (size_t index = 0; index < tags.size(); ++index) {
+        if (tags[index].sources.empty() && !tags[index].published) {
+            queued[index] = 1;
+            pending.push(index);
+        }
+    }
+    evaluatePending();
+}
+
+void DerivedTagEngine::setInput(Input& input, double value, ValueUpdate::Quality quality) {
+    if (input.known && input.quality == quality && sameValue(input.value, value)) return;
+    input.value = value;
+    input.quality = quality;
+    input.known = true;
+    for (size_t index : input.dependents) {
+        if (queued[index]) continue;
+        queued[index] = 1;
+        pending.push(index);
+    }
+}
+
+void DerivedTagEngine::evaluatePending() {
+    while (!pending.empty()) {
+        size_t index = pending.top();
+        pending.pop();
+        queued[index] = 0;
+        evaluate(index);
+    }
+}
+
+void DerivedTagEngine::evaluate(size_t index) {
+    Tag& tag = tags[index];
+    values.clear();
+    auto quality = ValueUpdate::Quality::Good;
+    for (const Input* source : tag.sources) {
+        // Переменная вычисляется после получения всех входов
+        if (!source->known) return;
+        values.push_back(source->value);
+        quality = worseQuality(quality, source->quality);
+    }
+    
+    double result = tag.expression.evaluate(values.data(), stack);
+    ++evaluations;
+    // Деление на ноль и входы без числового значения: null с качеством "bad"
+    if (!std::isfinite(result)) {
+        result = kNoValue;
+        quality = ValueUpdate::Quality::Bad;
+    }
+    if (tag.published && tag.lastQuality == quality && sameValue(tag.lastValue, result)) return;
+    tag.published = true;
+    tag.lastValue = result;
+    tag.lastQuality = quality;
+    
+    json value;
+    if (!std::isnan(result)) {
+        value = tag.expression.isBoolean() ? json(result != 0.0) : json(result);
+    }
+    dataCache.updateValue(tag.id, tag.name, value, ValueUpdate::qualityName(quality));
+    
+    // Зависимые вычисляемые переменные пересчитываются в этом же проходе
+    auto it = inputs.find(tag.id);
+    if (it != inputs.end()) setInput(it->second, result, quality);
+}
+
+
+// Тревоги и события
+namespace {
+
+const char* alarmEventTypeName(AlarmEvent::Type type) {
+    switch (type) {
+        case AlarmEvent::Type::Raised: return "raised";
+        case AlarmEvent::Type::Cleared: return "cleared";
+        default: return "acknowledged";
+    }
+}
+
+const char* alarmRuleTypeName(AlarmEngine::RuleType type) {
+    switch (type) {
+        case AlarmEngine::RuleType::High: return "high";
+        case AlarmEngine::RuleType::Low: return "low";
+        default: return "rate";
+    }
+}
+
+} // namespace
+
+json AlarmEvent::toJson() const {
+    return {
+        {"seq", sequence},
+        {"t", timestampMs},
+        {"type", alarmEventTypeName(type)},
+        {"rule", rule},
+        {"id", tagId},
+        {"v", value},
+        {"severity", severity},
+        {"message", message}
+    };
+}
+
+AlarmEvent AlarmEvent::fromJson(const json& event) {
+    AlarmEvent result;
+    result.sequence = event.value("seq", uint64_t(0));
+    result.timestampMs = event.value("t", int64_t(0));
+    const std::string type = event.value("type", "raised");
+    result.type = type == "cleared" ? Type::Cleared : type == "acknowledged" ? Type::Acknowledged : Type::Raised;
+    result.rule = event.value("rule", "");
+    result.tagId = event.value("id", int64_t(0));
+    result.value = event.value("v", 0.0);
+    result.severity = event.value("severity", 0);
+    result.message = event.value("message", "");
+    return result;
+}
+
+void AlarmEngine::configure(const json& section) {
+    const json settings = section.is_object() ? section : json::object();
+    const json journalSettings = settings.value("journal", json::object());
+    const json ruleSettings = settings.value("rules", json::object());
+    std::vector<Rule> configured;
+    
+    for (auto& [name, item] : ruleSettings.items()) {
+        if (!item.is_object() || !item.contains("tag") || !item["tag"].is_number()) {
+            LOG_WARNING("Alarm rule " + name + " has no tag ID, skipped");
+            continue;
+        }
+        Rule rule;
+        rule.name = name;
+        rule.tagId = item["tag"].get<int64_t>();
+        const std::string type = item.value("type", "high");
+        if (type == "high") {
+            rule.type = RuleType::High;
+        } else if (type == "low") {
+            rule.type = RuleType::Low;
+        } else if (type == "rate") {
+            rule.type = RuleType::Rate;
+        } else {
+            LOG_WARNING("Alarm rule " + name + " has unknown type " + type + ", skipped");
+            continue;
+        }
+        rule.limit = item.value("limit", 0.0);
+        rule.deadband = std::max(0.0, item.value("deadband", 0.0));
+        rule.severity = item.value("severity", 500);
+        rule.message = item.value("message", name);
+        configured.push_back(std::move(rule));
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Правило с тем же именем и переменной сохраняет состояние тревоги
+        for (auto& rule : configured) {
+            auto old = std::find_if(rules.begin(), rules.end(), [&rule](const Rule& r) {
+                return r.name == rule.name && r.tagId == rule.tagId && r.type == rule.type;
+            });
+            if (old == rules.end()) continue;
+            rule.active = old->active;
+            rule.acknowledged = old->acknowledged;
+            rule.hasValue = old->hasValue;
+            rule.lastValue = old->lastValue;
+            rule.lastTimestampMs = old->lastTimestampMs;
+            rule.raisedAtMs = old->raisedAtMs;
+            rule.lastSequence = old->lastSequence;
+        }
+        rules = std::move(configured);
+        rulesByTag.clear();
+        for (auto& bits : tagFilter) bits.store(0, std::memory_order_relaxed);
+        for (size_t index = 0; index < rules.size(); ++index) {
+            rulesByTag[rules[index].tagId].push_back(index);
+            size_t bit = filterBit(rules[index].tagId);
+            tagFilter[bit / 64].fetch_or(uint64_t(1) << (bit % 64), std::memory_order_release);
+        }
+        maxEvents = std::max<size_t>(1, journalSettings.value("max_events", size_t{1000}));
+        while (events.size() > maxEvents) events.pop_front();
+    }
+    
+    openJournal(journalSettings.value("file", ""));
+}
+
+void AlarmEngine::openJournal(const std::string& file) {
+    std::lock_guard<std::mutex> journalLock(journalMutex);
+    if (file == journalFile) return;
+    journal.close();
+    journalFile = file;
+    journalLines = 0;
+    if (journalFile.empty()) return;
+    
+    // События предыдущего запуска: продолжение нумерации и история для подписчиков
+    std::vector<AlarmEvent> restored;
+    for (const std::string& path : {journalFile + ".1", journalFile}) {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (path == journalFile) ++journalLines;
+            try {
+                restored.push_back(AlarmEvent::fromJson(json::parse(line)));
+            } catch (const std::exception&) {
+                // Оборванная последняя строка после аварийного завершения
+            }
+        }
+    }
+    std::sort(restored.begin(), restored.end(),
+              [](const AlarmEvent& a, const AlarmEvent& b) { return a.sequence < b.sequence; });
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!restored.empty() && restored.back().sequence >= nextSequence) {
+            events.clear();
+            size_t first = restored.size() > maxEvents ? restored.size() - maxEvents : 0;
+            events.assign(restored.begin() + static_cast<std::ptrdiff_t>(first), restored.end());
+            nextSequence = restored.back().sequence + 1;
+        }
+    }
+    
+    journal.open(journalFile, std::ios::app);
+    if (!journal.is_open()) {
+        LOG_ERROR("Cannot open alarm journal: " + journalFile);
+    } else if (!restored.empty()) {
+        LOG_INFO("Alarm journal " + journalFile + ": " + std::to_string(restored.size()) + " events restored");
+    }
+}
+
+void AlarmEngine::evaluate(int64_t id, const HistoricalValue& value, uint64_t sequence) {
+    size_t bit = filterBit(id);
+    if ((tagFilter[bit / 64].load(std::memory_order_acquire) & (uint64_t(1) << (bit % 64))) == 0) return;
+    // Недостоверные и нечисловые значения не изменяют состояние тревог
+    if (value.quality == "bad" || !(value.value.is_number() || value.value.is_boolean())) return;
+    
+    const double x = value.value.is_boolean() ? (value.value.get<bool>() ? 1.0 : 0.0) : value.value.get<double>();
+    const int64_t timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        value.timestamp.time_since_epoch()).count();
+    std::vector<AlarmEvent> emitted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = rulesByTag.find(id);
+        if (it == rulesByTag.end()) return;
+        
+        for (size_t index : it->second) {
+            Rule& rule = rules[index];
+            // Более поздняя запись уже проверена другим потоком
+            if (sequence <= rule.lastSequence) continue;
+            rule.lastSequence = sequence;
+            bool active = rule.active;
+            // Гистерезис: активная тревога снимается только после выхода за уставку на deadband
+            switch (rule.type) {
+                case RuleType::High:
+                    active = rule.active ? x > rule.limit - rule.deadband : x > rule.limit;
+                    break;
+                case RuleType::Low:
+                    active = rule.active ? x < rule.limit + rule.deadband : x < rule.limit;
+                    break;
+                case RuleType::Rate:
+                    // Скорость изменения в единицах в секунду между соседними значениями
+                    if (rule.hasValue && timestampMs > rule.lastTimestampMs) {
+                        double rate = std::fabs(x - rule.lastValue) * 1000.0 /
+                                      static_cast<double>(timestampMs - rule.lastTimestampMs);
+                        active = rule.active ? rate > rule.limit - rule.deadband : rate > rule.limit;
+                    } else if (rule.hasValue) {
+                        continue;
+                    }
+                    break;
+            }
+            rule.hasValue = true;
+            rule.lastValue = x;
+            rule.lastTimestampMs = timestampMs;
+            
+            if (active == rule.active) continue;
+            rule.active = active;
+            if (active) {
+                rule.acknowledged = false;
+                rule.raisedAtMs = timestampMs;
+            }
+            record(rule, active ? AlarmEvent::Type::Raised : AlarmEvent::Type::Cleared, timestampMs, emitted);
+        }
+    }
+    publish(emitted);
+}
+
+bool AlarmEngine::acknowledge(const std::string& name) {
+    std::vector<AlarmEvent> emitted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto rule = std::find_if(rules.begin(), rules.end(), [&name](const Rule& r) { return r.name == name; });
+        if (rule == rules.end() || rule->acknowledged) return false;
+        rule->acknowledged = true;
+        record(*rule, AlarmEvent::Type::Acknowledged,
+               std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::system_clock::now().time_since_epoch()).count(),
+               emitted);
+    }
+    publish(emitted);
+    return true;
+}
+
+json AlarmEngine::activeAlarms() {
+    std::lock_guard<std::mutex> lock(mutex);
+    json result = json::array();
+    for (const auto& rule : rules) {
+        if (!rule.active && rule.acknowledged) continue;
+        result.push_back({
+            {"rule", rule.name},
+            {"id", rule.tagId},
+            {"type", alarmRuleTypeName(rule.type)},
+            {"active", rule.active},
+            {"acknowledged", rule.acknowledged},
+            {"since", rule.raisedAtMs},
+            {"v", rule.lastValue},
+            {"severity", rule.severity},
+            {"message", rule.message}
+        });
+    }
+    return result;
+}
+
+std::vector<AlarmEvent> AlarmEngine::eventsSince(uint64_t since, size_t limit, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (timeout.count() > 0) {
+        eventAdded.wait_for(lock, timeout, [this, since]() { return nextSequence - 1 > since; });
+    }
+    
+    // Номера событий в очереди возрастают
+    auto first = std::upper_bound(events.begin(), events.end(), since,
+                                  [](uint64_t seq, const AlarmEvent& e) { return seq < e.sequence; });
+    std::vector<AlarmEvent> result;
+    for (auto it = first; it != events.end() && result.size() < limit; ++it) {
+        result.push_back(*it);
+    }
+    return result;
+}
+
+uint64_t AlarmEngine::lastSequence() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return nextSequence - 1;
+}
+
+size_t AlarmEngine::ruleCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return rules.size();
+}
+
+// Вызывается под mutex
+void AlarmEngine::record(Rule& rule, AlarmEvent::Type type, int64_t timestampMs, std::vector<AlarmEvent>& emitted) {
+    AlarmEvent event;
+    event.sequence = nextSequence++;
+    event.timestampMs = timestampMs;
+    event.type = type;
+    event.rule = rule.name;
+    event.tagId = rule.tagId;
+    event.value = rule.lastValue;
+    event.severity = rule.severity;
+    event.message = rule.message;
+    
+    events.push_back(event);
+    if (events.size() > maxEvents) events.pop_front();
+    emitted.push_back(std::move(event));
+    eventAdded.notify_all();
+}
+
+void AlarmEngine::publish(const std::vector<AlarmEvent>& emitted) {
+    if (emitted.empty()) return;
+    {
+        std::lock_guard<std::mutex> journalLock(journalMutex);
+        if (journal.is_open()) {
+            for (const auto& event : emitted) {
+                // Ограничение журнала: заполненный файл заменяет предыдущий <файл>.1
+                if (journalLines >= maxEvents) {
+                    journal.close();
+                    std::error_code ec;
+                    std::filesystem::rename(journalFile, journalFile + ".1", ec);
+                    journal.open(journalFile, std::ios::trunc);
+                    journalLines = 0;
+                }
+                journal << event.toJson().dump() << '\n';
+                ++journalLines;
+            }
+            journal.flush();
+        }
+    }
+    
+    for (const auto& event : emitted) {
+        LOG_INFO(std::string("Alarm ") + alarmEventTypeName(event.type) + ": " + event.rule +
+                 " (ID: " + std::to_string(event.tagId) + ")");
+        onEvent(event);
+    }
+}
+
+
+// Экспорт в вышестоящий архив (store-and-forward)
+namespace {
+
+// Заголовок записи дисковой очереди; длина 0 - конец записей сегмента
+struct QueueRecordHeader {
+    uint32_t length;
+    uint32_t checksum;   // Младшие 32 бита FNV-1a данных: обрыв записи при аварии
+    uint64_t sequence;
+};
+
+constexpr size_t QUEUE_RECORD_ALIGN = 8;
+
+size_t queueRecordSize(size_t length) {
+    size_t size = sizeof(QueueRecordHeader) + length;
+    return (size + QUEUE_RECORD_ALIGN - 1) / QUEUE_RECORD_ALIGN * QUEUE_RECORD_ALIGN;
+}
+
+uint32_t queueChecksum(std::string_view data) {
+    return static_cast<uint32_t>(fnvUpdate(14695981039346656037ULL, data));
+}
+
+// Запись по смещению; false - конец записей или поврежденная запись
+bool readQueueRecord(const char* data, size_t size, size_t offset, QueueRecordHeader& header) {
+    if (offset + sizeof(header) > size) return false;
+    std::memcpy(&header, data + offset, sizeof(header));
+    if (header.length == 0 || header.sequence == 0 || offset + sizeof(header) + header.length > size) return false;
+    return header.checksum == queueChecksum(std::string_view(data + offset + sizeof(header), header.length));
+}
+
+std::string segmentFileName(uint64_t index) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llu.seg", static_cast<unsigned long long>(index));
+    return name;
+}
+
+// Сброс измененных страниц отображения на диск; начало выравнивается на границу страницы
+bool syncMapped(char* data, size_t offset, size_t length) {
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t start = offset - offset % pageSize;
+    return msync(data + start, offset + length - start, MS_SYNC) == 0;
+}
+    
+} // namespace
+
+DiskQueue::DiskQueue(const std::string& dir, size_t segmentSize, size_t maxSegments)
+    : directory(dir), segmentSize(std::max<size_t>(segmentSize, 4096)), maxSegments(std::max<size_t>(maxSegments, 2)) {
+    std::filesystem::create_directories(directory);
+    
+    // Подтвержденная позиция: отображенный в память файл из одного числа
+    const std::string cursorPath = directory + "/cursor";
+    int fd = ::open(cursorPath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || ::ftruncate(fd, sizeof(uint64_t)) != 0) {
+        if (fd >= 0) ::close(fd);
+        throw std::runtime_error("Cannot open queue cursor: " + cursorPath);
+    }
+    void* cursor = mmap(nullptr, sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (cursor == MAP_FAILED) throw std::runtime_error("Cannot map queue cursor: " + cursorPath);
+    acked = static_cast<uint64_t*>(cursor);
+    
+    // Существующие сегменты по возрастанию номера; записи сканируются до первой неполной
+    std::vector<uint64_t> indexes;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.path().extension() != ".seg") continue;
+        indexes.push_back(std::strtoull(entry.path().stem().string().c_str(), nullptr, 10));
+    }
+    std::sort(indexes.begin(), indexes.end());
+    
+    for (uint64_t index : indexes) {
+        Segment segment = mapSegment(index, 0);
+        QueueRecordHeader header;
+        while (readQueueRecord(segment.data, segment.size, segment.writeOffset, header)) {
+            if (segment.firstSequence == 0) segment.firstSequence = header.sequence;
+            segment.lastSequence = header.sequence;
+            segment.writeOffset += queueRecordSize(header.length);
+        }
+        nextSequence = std::max(nextSequence, segment.lastSequence + 1);
+        segments.push_back(std::move(segment));
+    }
+    nextSequence = std::max(nextSequence, *acked + 1);
+    
+    // Полностью подтвержденные и пустые сегменты, кроме последнего, не нужны
+    while (segments.size() > 1 && segments.front().lastSequence <= *acked) {
+        unmapSegment(segments.front(), true);
+        segments.pop_front();
+    }
+}
+
+DiskQueue::~DiskQueue() {
+    for (auto& segment : segments) unmapSegment(segment, false);
+    if (acked) munmap(acked, sizeof(uint64_t));
+}
+
+DiskQueue::Segment DiskQueue::mapSegment(uint64_t index, size_t size) {
+    Segment segment;
+    segment.index = index;
+    segment.path = directory + "/" + segmentFileName(index);
+    
+    // size = 0 - открытие существующего сегмента, иначе создание нового заданного размера
+    int fd = ::open(segment.path.c_str(), size > 0 ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    if (fd < 0) throw std::runtime_error("Cannot open queue segment: " + segment.path);
+    struct stat st;
+    if (size > 0 ? ::ftruncate(fd, static_cast<off_t>(size)) != 0 : fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot size queue segment: " + segment.path);
+    }
+    segment.size = size > 0 ? size : static_cast<size_t>(st.st_size);
+    // Новый сегмент: размер файла и запись в каталоге сбрасываются до первых записей
+    if (size > 0) {
+        int dirFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (::fsync(fd) != 0 || dirFd < 0 || ::fsync(dirFd) != 0) {
+            LOG_WARNING("Export queue " + directory + " segment sync failed: " + std::strerror(errno));
+        }
+        if (dirFd >= 0) ::close(dirFd);
+    }
+    void* data = segment.size > 0 ? mmap(nullptr, segment.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (data == MAP_FAILED) throw std::runtime_error("Cannot map queue segment: " + segment.path);
+    segment.data = static_cast<char*>(data);
+    return segment;
+}
+
+void DiskQueue::unmapSegment(Segment& segment, bool remove) {
+    if (segment.data) munmap(segment.data, segment.size);
+    segment.data = nullptr;
+    if (remove) {
+        std::error_code ec;
+        std::filesystem::remove(segment.path, ec);
+    }
+}
+
+// Вызывается под mutex: переполнение, самый старый сегмент удаляется без подтверждения
+void DiskQueue::dropFront() {
+    Segment& segment = segments.front();
+    if (segment.lastSequence > *acked) {
+        droppedRecords += segment.lastSequence - std::max(*acked, segment.firstSequence - 1);
+        *acked = segment.lastSequence;
+        syncCursor();
+    }
+    unmapSegment(segment, true);
+    segments.pop_front();
+    readOffset = 0;
+}
+
+uint64_t DiskQueue::append(std::string_view data) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t recordSize = queueRecordSize(data.size());
+    
+    if (segments.empty() || segments.back().writeOffset + recordSize > segments.back().size) {
+        if (segments.size() >= maxSegments) {
+            LOG_WARNING("Export queue " + directory + " is full, dropping oldest segment");
+            dropFront();
+        }
+        uint64_t index = segments.empty() ? 1 : segments.back().index + 1;
+        // Записи, не помещающиеся в сегмент, получают сегмент своего размера
+        segments.push_back(mapSegment(index, std::max(segmentSize, recordSize)));
+    }
+    
+    Segment& segment = segments.back();
+    QueueRecordHeader header{static_cast<uint32_t>(data.size()), queueChecksum(data), nextSequence++};
+    std::memcpy(segment.data + segment.writeOffset + sizeof(header), data.data(), data.size());
+    std::memcpy(segment.data + segment.writeOffset, &header, sizeof(header));
+    if (!syncMapped(segment.data, segment.writeOffset, recordSize)) {
+        LOG_WARNING("Export queue " + directory + " sync failed: " + std::strerror(errno));
+    }
+    segment.writeOffset += recordSize;
+    if (segment.firstSequence == 0) segment.firstSequence = header.sequence;
+    segment.lastSequence = header.sequence;
+    return header.sequence;
+}
+
+bool DiskQueue::front(Record& record) {
+    std::lock_guard<std::mutex> lock(mutex);
+    while (!segments.empty()) {
+        Segment& segment = segments.front();
+        QueueRecordHeader header;
+        if (readOffset < segment.writeOffset && readQueueRecord(segment.data, segment.size, readOffset, header)) {
+            if (header.sequence <= *acked) {
+                readOffset += queueRecordSize(header.length);
+                continue;
+            }
+            record.sequence = header.sequence;
+            record.data.assign(segment.data + readOffset + sizeof(header), header.length);
+            return true;
+        }
+        // Первый сегмент прочитан: переход к следующему, последний остается для записи
+        if (segments.size() == 1) return false;
+        unmapSegment(segment, true);
+        segments.pop_front();
+        readOffset = 0;
+    }
+    return false;
+}
+
+void DiskQueue::acknowledge(uint64_t sequence) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sequence <= *acked) return;
+    *acked = std::min(sequence, nextSequence - 1);
+    syncCursor();
+    while (segments.size() > 1 && segments.front().lastSequence <= *acked) {
+        unmapSegment(segments.front(), true);
+        segments.pop_front();
+        readOffset = 0;
+    }
+}
+
+uint64_t DiskQueue::backlog() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return nextSequence - 1 - *acked;
+}
+
+uint64_t DiskQueue::dropped() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return droppedRecords;
+}
+
+size_t DiskQueue::segmentCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return segments.size();
+}
+
+// Вызывается под mutex после изменения подтвержденной позиции
+void DiskQueue::syncCursor() {
+    if (!syncMapped(reinterpret_cast<char*>(acked), 0, sizeof(uint64_t))) {
+        LOG_WARNING("Export queue " + directory + " cursor sync failed: " + std::strerror(errno));
+    }
+}
+
+TcpHistorianTarget::TcpHistorianTarget(const std::string& host, unsigned short port, std::chrono::milliseconds timeout)
+    : host(host), port(port), timeout(timeout) {}
+
+bool TcpHistorianTarget::connect() {
+    try {
+        ip::tcp::resolver resolver(io);
+        auto endpoints = resolver.resolve(host, std::to_string(port));
+        runWithTimeout(io, socket, timeout, [&](auto handler) {
+            async_connect(socket, endpoints, handler);
+        });
+        // Локальный адрес без слушающего сокета: TCP может соединиться сам с собой
+        if (socket.local_endpoint() == socket.remote_endpoint()) {
+            disconnect();
+            return false;
+        }
+        socket.set_option(ip::tcp::no_delay(true));
+        return true;
+    } catch (const std::exception& e) {
+        LOG_DEBUG("Historian " + describe() + " connect error: " + e.what());
+        disconnect();
+        return false;
+    }
+}
+
+bool TcpHistorianTarget::send(uint64_t sequence, std::string_view batch) {
+    try {
+        // Поля кадра - big-endian, как в кадрах репликации
+        std::string header;
+        appendWire(header, static_cast<uint32_t>(batch.size()));
+        appendWire(header, sequence);
+        std::array<const_buffer, 2> frame = {buffer(header), buffer(batch.data(), batch.size())};
+        runWithTimeout(io, socket, timeout, [&](auto handler) {
+            async_write(socket, frame, handler);
+        });
+        std::array<char, sizeof(uint64_t)> reply;
+        runWithTimeout(io, socket, timeout, [&](auto handler) {
+            async_read(socket, buffer(reply), handler);
+        });
+        uint64_t confirmed = 0;
+        FrameReader(reply.data(), reply.data() + reply.size()).read(confirmed);
+        return confirmed == sequence;
+    } catch (const std::exception& e) {
+        LOG_WARNING("Historian " + describe() + " send error: " + e.what());
+        return false;
+    }
+}
+
+void TcpHistorianTarget::disconnect() {
+    boost::system::error_code ec;
+    socket.close(ec);
+}
+
+std::string TcpHistorianTarget::describe() const {
+    return host + ":" + std::to_string(port);
+}
+
+HistorianExporter::Settings HistorianExporter::Settings::fromJson(const json& settings) {
+    Settings result;
+    if (!settings.is_object()) return result;
+    result.directory = settings.value("directory", result.directory);
+    result.segmentSize = settings.value("segment_size", result.segmentSize);
+    result.maxSegments = settings.value("max_segments", result.maxSegments);
+    result.batchSize = std::max<size_t>(1, settings.value("batch_size", result.batchSize));
+    result.batchInterval = std::chrono::milliseconds(std::max(10, settings.value("batch_interval_ms", 1000)));
+    result.replayRate = std::max(0.1, settings.value("replay_rate", result.replayRate));
+    result.retryInterval = std::chrono::milliseconds(std::max(10, settings.value("retry_interval_ms", 2000)));
+    return result;
+}
+
+HistorianExporter::HistorianExporter(DataCache& cache, SubscriptionManager& manager,
+                                     std::unique_ptr<HistorianTarget> target, const Settings& settings)
+    : dataCache(cache), subscriptionManager(manager), target(std::move(target)), settings(settings),
+      queue(settings.directory, settings.segmentSize, settings.maxSegments) {}
+
+HistorianExporter::~HistorianExporter() {
+    stop();
+}
+
+std::unique_ptr<HistorianTarget> HistorianExporter::createTarget(const json& settings) {
+    const std::string type = settings.value("type", "tcp");
+    if (type == "tcp") {
+        return std::make_unique<TcpHistorianTarget>(
+            settings.value("host", "localhost"), settings.value("port", 9100),
+            std::chrono::milliseconds(settings.value("timeout_ms", 5000)));
+    }
+    throw std::invalid_argument("Unknown historian target type: " + type);
+}
+
+std::string HistorianExporter::encodeBatch(const json& updates) {
+    namespace zlib = boost::beast::zlib;
+    const std::string text = updates.dump();
+    zlib::deflate_stream deflate;
+    
+    const uint32_t rawSize = static_cast<uint32_t>(text.size());
+    std::string batch;
+    appendWire(batch, rawSize);
+    batch.resize(sizeof(rawSize) + deflate.upper_bound(text.size()));
+    
+    zlib::z_params zs;
+    zs.next_in = text.data();
+    zs.avail_in = text.size();
+    zs.next_out = batch.data() + sizeof(rawSize);
+    zs.avail_out = batch.size() - sizeof(rawSize);
+    boost::system::error_code ec;
+    deflate.write(zs, zlib::Flush::finish, ec);
+    if (ec && ec != zlib::error::end_of_stream) throw boost::system::system_error(ec);
+    batch.resize(sizeof(rawSize) + zs.total_out);
+    return batch;
+}
+
+json HistorianExporter::decodeBatch(std::string_view batch) {
+    namespace zlib = boost::beast::zlib;
+    uint32_t rawSize = 0;
+    if (!FrameReader(batch.data(), batch.data() + batch.size()).read(rawSize)) {
+        throw std::runtime_error("Truncated export batch");
+    }
+    
+    std::string text(rawSize, '\0');
+    zlib::inflate_stream inflate;
+    zlib::z_params zs;
+    zs.next_in = batch.data() + sizeof(rawSize);
+    zs.avail_in = batch.size() - sizeof(rawSize);
+    zs.next_out = text.data();
+    zs.avail_out = text.size();
+    boost::system::error_code ec;
+    inflate.write(zs, zlib::Flush::finish, ec);
+    if (ec && ec != zlib::error::end_of_stream) throw boost::system::system_error(ec);
+    if (zs.total_out != rawSize) throw std::runtime_error("Corrupted export batch");
+    return json::parse(text);
+}
+
+void HistorianExporter::start() {
+    if (running.exchange(true)) return;
+    collector = std::thread([this]() { collect(); });
+    sender = std::thread([this]() { forward(); });
+    LOG_INFO("Historian export to " + target->describe() + ", queued batches: " + std::to_string(queue.backlog()));
+}
+
+void HistorianExporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (collector.joinable()) collector.join();
+    if (sender.joinable()) sender.join();
+    target->disconnect();
+}
+
+json HistorianExporter::metrics() {
+    return {
+        {"target", target->describe()},
+        {"connected", connected.load()},
+        {"backlog", queue.backlog()},
+        {"dropped", queue.dropped()},
+        {"sent", sentBatches.load()},
+        {"segments", queue.segmentCount()}
+    };
+}
+
+void HistorianExporter::flush(json& batch) {
+    if (batch.empty()) return;
+    try {
+        queue.append(encodeBatch(batch));
+    } catch (const std::exception& e) {
+        LOG_ERROR(std::string("Export queue error: ") + e.what());
+    }
+    batch = json::array();
+    wake.notify_all();
+}
+
+void HistorianExporter::collect() {
+    auto subscription = subscriptionManager.createSubscription();
+    subscription->addAll();
+    json batch = json::array();
+    auto batchStarted = std::chrono::steady_clock::now();
+    
+    auto visitor = [&](const ValueUpdate& update, const std::string&) {
+        if (batch.empty()) batchStarted = std::chrono::steady_clock::now();
+        batch.push_back({update.id, update.timestampMs, ValueUpdate::qualityName(update.quality),
+                         subscription->value(update)});
+        if (batch.size() >= settings.batchSize) flush(batch);
+    };
+    
+    while (running) {
+        auto result = subscription->poll(visitor, settings.batchSize);
+        if (result == Subscription::PollResult::Resync) {
+            // Сборщик отстал от кольца: вместо потерянных обновлений - текущие значения
+            LOG_WARNING("Historian export lagged behind, exporting current values");
+            for (const auto& item : dataCache.getValues(dataCache.getIds())) {
+                batch.push_back({item.id,
+                                 std::chrono::duration_cast<std::chrono::milliseconds>(
+                                     item.value.timestamp.time_since_epoch()).count(),
+                                 item.value.quality, item.value.value});
+                if (batch.size() >= settings.batchSize) flush(batch);
+            }
+        }
+        if (!batch.empty() && std::chrono::steady_clock::now() - batchStarted >= settings.batchInterval) {
+            flush(batch);
+        }
+        if (result == Subscription::PollResult::Idle) {
+            subscription->wait(std::min(settings.batchInterval, std::chrono::milliseconds(100)));
+        }
+    }
+    flush(batch);
+}
+
+bool HistorianExporter::pause(std::chrono::steady_clock::time_point until) {
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    wake.wait_until(lock, until, [this]() { return !running; });
+    return running;
+}
+
+void HistorianExporter::forward() {
+    const auto replayInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / settings.replayRate));
+    auto lastSend = std::chrono::steady_clock::time_point{};
+    DiskQueue::Record record;
+    
+    while (running) {
+        if (!connected) {
+            if (!target->connect()) {
+                if (!pause(std::chrono::steady_clock::now() + settings.retryInterval)) break;
+                continue;
+            }
+            connected = true;
+            LOG_INFO("Historian " + target->describe() + " connected, backlog: " + std::to_string(queue.backlog()));
+        }
+        
+        if (!queue.front(record)) {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait_for(lock, std::chrono::milliseconds(100));
+            continue;
+        }
+        // Накопленные пакеты передаются не быстрее replay_rate, чтобы не перегрузить канал и архив
+        if (queue.backlog() > 1 && !pause(lastSend + replayInterval)) break;
+        
+        lastSend = std::chrono::steady_clock::now();
+        if (target->send(record.sequence, record.data)) {
+            queue.acknowledge(record.sequence);
+            ++sentBatches;
+        } else {
+            target->disconnect();
+            connected = false;
+        }
+    }
+}
+
+
+#ifdef HAVE_IO_URING
+// Сетевой цикл io_uring
+namespace {
+
+int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int ioUringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+constexpr unsigned short RECV_BUFFER_GROUP = 0;
+
+} // namespace
+
+IoUringServer::Settings IoUringServer::Settings::fromJson(const json& settings) {
+    Settings result;
+    if (!settings.is_object()) return result;
+    result.entries = std::clamp(settings.value("entries", result.entries), 64u, 32768u);
+    // Размер кольца предоставленных буферов должен быть степенью двойки
+    const unsigned buffers = std::clamp(settings.value("recv_buffers", result.recvBuffers), 16u, 32768u);
+    result.recvBuffers = 1;
+    while (result.recvBuffers < buffers) result.recvBuffers <<= 1;
+    result.recvBufferSize = std::max<size_t>(512, settings.value("recv_buffer_size", result.recvBufferSize));
+    result.sendBuffers = std::min(settings.value("send_buffers", result.sendBuffers), 16384u);
+    result.sendBufferSize = std::max<size_t>(512, settings.value("send_buffer_size", result.sendBufferSize));
+    result.workers = std::max<size_t>(1, settings.value("workers", result.workers));
+    return result;
+}
+
+IoUringServer::IoUringServer(Settings settings, Handler handler)
+    : settings(settings), handler(std::move(handler)) {
+    wakeFd = ::eventfd(0, EFD_CLOEXEC);
+    if (wakeFd < 0) throw std::system_error(errno, std::generic_category(), "eventfd");
+}
+
+IoUringServer::~IoUringServer() {
+    stop();
+    teardown();
+    ::close(wakeFd);
+}
+
+bool IoUringServer::supported() {
+    // Многоразовый recv и SEND_ZC с зарегистрированным буфером - начиная с Linux 6.0
+    utsname info;
+    if (::uname(&info) != 0) return false;
+    int major = 0;
+    std::from_chars(info.release, info.release + std::strlen(info.release), major);
+    if (major < 6) return false;
+    
+    // io_uring может быть запрещен sysctl kernel.io_uring_disabled или seccomp
+    io_uring_params params{};
+    const int fd = ioUringSetup(4, &params);
+    if (fd < 0) return false;
+    ::close(fd);
+    return (params.features & IORING_FEAT_SINGLE_MMAP) && (params.features & IORING_FEAT_NODROP);
+}
+
+unsigned short IoUringServer::listen(unsigned short port) {
+    listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) throw std::system_error(errno, std::generic_category(), "socket");
+    int one = 1;
+    ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        ::listen(listenFd, SOMAXCONN) < 0) {
+        const int error = errno;
+        ::close(listenFd);
+        listenFd = -1;
+        throw std::system_error(error, std::generic_category(), "bind/listen on port " + std::to_string(port));
+    }
+    socklen_t length = sizeof(address);
+    ::getsockname(listenFd, reinterpret_cast<sockaddr*>(&address), &length);
+    listenPort = ntohs(address.sin_port);
+    return listenPort;
+}
+
+void IoUringServer::setupRing() {
+    io_uring_params params{};
+    ringFd = ioUringSetup(settings.entries, &params);
+    if (ringFd < 0) throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+    
+    // Кольца отправки и завершения отображаются одним mmap (IORING_FEAT_SINGLE_MMAP)
+    sqRingSize = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                                  params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    cqRingSize = sqRingSize;
+    sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        sqRing = nullptr;
+        throw std::system_error(errno, std::generic_category(), "mmap io_uring rings");
+    }
+    cqRing = sqRing;
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqeMemory = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqeMemory == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap io_uring sqes");
+    sqes = static_cast<io_uring_sqe*>(sqeMemory);
+    
+    char* base = static_cast<char*>(sqRing);
+    sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+    
+    // Кольцо предоставленных буферов приема: ядро выбирает буфер при поступлении данных
+    recvRingSize = settings.recvBuffers * sizeof(io_uring_buf);
+    void* ringMemory = ::mmap(nullptr, recvRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ringMemory == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap buffer ring");
+    recvRing = static_cast<io_uring_buf_ring*>(ringMemory);
+    recvMemory.reset(new char[settings.recvBuffers * settings.recvBufferSize]);
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(recvRing);
+    registration.ring_entries = settings.recvBuffers;
+    registration.bgid = RECV_BUFFER_GROUP;
+    if (ioUringRegister(ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        throw std::system_error(errno, std::generic_category(), "io_uring register buffer ring");
+    }
+    for (unsigned id = 0; id < settings.recvBuffers; ++id) {
+        recycleRecvBuffer(static_cast<unsigned short>(id));
+    }
+    
+    // Зарегистрированные буферы ответов; без них ответы отправляются из памяти соединения
+    if (settings.sendBuffers > 0) {
+        sendMemory.reset(new char[settings.sendBuffers * settings.sendBufferSize]);
+        std::vector<iovec> buffers(settings.sendBuffers);
+        for (unsigned i = 0; i < settings.sendBuffers; ++i) {
+            buffers[i] = {sendMemory.get() + i * settings.sendBufferSize, settings.sendBufferSize};
+        }
+        if (ioUringRegister(ringFd, IORING_REGISTER_BUFFERS, buffers.data(), settings.sendBuffers) < 0) {
+            LOG_WARNING("io_uring: cannot register send buffers (" + std::string(std::strerror(errno)) +
+                        "), responses are sent without them");
+            sendMemory.reset();
+        } else {
+            for (int i = static_cast<int>(settings.sendBuffers) - 1; i >= 0; --i) freeSendBuffers.push_back(i);
+        }
+    }
+}
+
+void IoUringServer::teardown() {
+    stopping = true;
+    jobsCondition.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    workers.clear();
+    
+    // Соединения, переданные обработчику, закрывает он сам
+    for (const auto& [fd, connection] : connections) {
+        if (connection.state != State::Processing) ::close(fd);
+    }
+    connections.clear();
+    if (listenFd >= 0) ::close(listenFd);
+    listenFd = -1;
+    // Закрытие кольца отменяет незавершенные операции
+    if (ringFd >= 0) ::close(ringFd);
+    ringFd = -1;
+    if (sqRing) ::munmap(sqRing, sqRingSize);
+    if (sqes) ::munmap(sqes, sqesSize);
+    if (recvRing) ::munmap(recvRing, recvRingSize);
+    sqRing = cqRing = nullptr;
+    sqes = nullptr;
+    recvRing = nullptr;
+    freeSendBuffers.clear();
+}
+
+void IoUringServer::stop() {
+    stopping = true;
+    jobsCondition.notify_all();
+    const uint64_t one = 1;
+    [[maybe_unused]] auto written = ::write(wakeFd, &one, sizeof(one));
+}
+
+json IoUringServer::metrics() const {
+    const uint64_t enters = enterCount;
+    return {
+        {"backend", "io_uring"},
+        {"accepted", acceptedCount.load()},
+        {"requests", requestCount.load()},
+        {"enter_calls", enters},
+        {"sqes", sqeCount.load()},
+        {"sqes_per_enter", enters == 0 ? 0.0 : static_cast<double>(sqeCount) / static_cast<double>(enters)}
+    };
+}
+
+// Без SQPOLL ядро читает очередь только в io_uring_enter, поэтому запись хвоста
+// до заполнения SQE безопасна
+io_uring_sqe* IoUringServer::nextSqe() {
+    const unsigned tail = *sqTail;
+    // Очередь заполнена: накопленные операции передаются ядру без ожидания. При переполненной
+    // очереди завершений ядро их не принимает (EBUSY) - завершения снимаются с кольца
+    // для обработки в цикле, и передача повторяется
+    while (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) > sqMask) {
+        if (submit(0) == 0) {
+            reapCompletions();
+            std::this_thread::yield();
+        }
+    }
+    io_uring_sqe* sqe = &sqes[tail & sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray[tail & sqMask] = tail & sqMask;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++pendingSqes;
+    return sqe;
+}
+
+void IoUringServer::reapCompletions() {
+    unsigned head = *cqHead;
+    const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) reaped.push_back(cqes[head & cqMask]);
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+}
+
+unsigned IoUringServer::submit(unsigned waitFor) {
+    const unsigned toSubmit = pendingSqes;
+    int result;
+    do {
+        result = ioUringEnter(ringFd, toSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+        // Переполнение очереди завершений: сначала нужно обработать готовые
+        if (errno == EBUSY || errno == EAGAIN) return 0;
+        throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+    }
+    const unsigned submitted = std::min(static_cast<unsigned>(result), toSubmit);
+    pendingSqes -= submitted;
+    ++enterCount;
+    sqeCount += submitted;
+    return submitted;
+}
+
+void IoUringServer::run() {
+    if (listenFd < 0) listen(0);
+    try {
+        setupRing();
+        for (size_t i = 0; i < settings.workers; ++i) {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+        armAccept();
+        armWake();
+        LOG_INFO("TCP server uses io_uring on port " + std::to_string(listenPort.load()) + ", " +
+                 std::to_string(settings.workers) + " request workers");
+        
+        while (!stopping) {
+            // Все операции, подготовленные при обработке предыдущих завершений, - одним вызовом;
+            // ожидание - только если снятых с кольца завершений не осталось
+            submit(reaped.empty() ? 1 : 0);
+            reapCompletions();
+            // Обработка может снять с кольца новые завершения (nextSqe при заполненной очереди)
+            while (!reaped.empty()) {
+                const io_uring_cqe cqe = reaped.front();
+                reaped.pop_front();
+                handleCqe(cqe);
+            }
+        }
+    } catch (...) {
+        teardown();
+        throw;
+    }
+    teardown();
+}
+
+void IoUringServer::armAccept() {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = userData(Op::Accept, listenFd);
+}
+
+void IoUringServer::armRecv(int fd) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    sqe->user_data = userData(Op::Recv, fd);
+    connections[fd].recvArmed = true;
+}
+
+void IoUringServer::armWake() {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeValue);
+    sqe->len = sizeof(wakeValue);
+    sqe->user_data = userData(Op::Wake, wakeFd);
+}
+
+void IoUringServer::recycleRecvBuffer(unsigned short bufferId) {
+    // Единственный производитель буферов - поток цикла
+    // В C++ пустая структура __DECLARE_FLEX_ARRAY имеет ненулевой размер и смещает bufs,
+    // поэтому записи кольца адресуются от его начала, как в ядре
+    const unsigned short tail = recvRing->tail;
+    io_uring_buf& buffer = reinterpret_cast<io_uring_buf*>(recvRing)[tail & (settings.recvBuffers - 1)];
+    buffer.addr = reinterpret_cast<uint64_t>(recvMemory.get() + bufferId * settings.recvBufferSize);
+    buffer.len = static_cast<uint32_t>(settings.recvBufferSize);
+    buffer.bid = bufferId;
+    __atomic_store_n(&recvRing->tail, static_cast<unsigned short>(tail + 1), __ATOMIC_RELEASE);
+}
+
+void IoUringServer::handleCqe(const io_uring_cqe& cqe) {
+    const auto op = static_cast<Op>(cqe.user_data >> 32);
+    const int fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+    switch (op) {
+        case Op::Accept:
+            if (cqe.res >= 0) {
+                ++acceptedCount;
+                Connection connection;
+                connection.generation = ++nextGeneration;
+                connections[cqe.res] = std::move(connection);
+                armRecv(cqe.res);
+            } else if (cqe.res != -ECANCELED) {
+                LOG_WARNING("io_uring accept error: " + std::string(std::strerror(-cqe.res)));
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE) && !stopping) armAccept();
+            break;
+        case Op::Recv:
+            onRecv(fd, cqe);
+            break;
+        case Op::Send:
+            continueSend(fd, cqe);
+            break;
+        case Op::Wake:
+            drainCompletions();
+            if (!stopping) armWake();
+            break;
+        case Op::Cancel:
+        case Op::Close:
+            break;
+    }
+}
+
+void IoUringServer::onRecv(int fd, const io_uring_cqe& cqe) {
+    auto it = connections.find(fd);
+    const bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    size_t searchFrom = 0;
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+        const auto bufferId = static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (it != connections.end() && cqe.res > 0) {
+            searchFrom = it->second.received.size();
+            it->second.received.append(recvMemory.get() + bufferId * settings.recvBufferSize,
+                                       static_cast<size_t>(cqe.res));
+        }
+        recycleRecvBuffer(bufferId);
+    }
+    if (it == connections.end()) return;
+    
+    Connection& connection = it->second;
+    if (!more) connection.recvArmed = false;
+    
+    if (connection.state == State::Reading) {
+        if (cqe.res == -ENOBUFS) {
+            // Все буферы приема заняты: чтение возобновляется с освобожденными
+            if (!more) armRecv(fd);
+            return;
+        }
+        if (cqe.res <= 0) {
+            closeConnection(fd);
+            return;
+        }
+        if (connection.received.find('\n', searchFrom) == std::string::npos) {
+            if (connection.received.size() > settings.maxRequestLine) {
+                // Пока многоразовый recv активен, отключение чтения завершает его,
+                // и соединение закрывается по res == 0
+                LOG_WARNING("TCP client closed: request line exceeds " +
+                            std::to_string(settings.maxRequestLine) + " bytes");
+                std::string().swap(connection.received);
+                if (more) {
+                    ::shutdown(fd, SHUT_RDWR);
+                } else {
+                    closeConnection(fd);
+                }
+                return;
+            }
+            if (!more) armRecv(fd);
+            return;
+        }
+        // Запрос получен: чтение отменяется, чтобы данные сокета не забирало кольцо
+        // после передачи соединения потоку
+        connection.state = State::Cancelling;
+        if (connection.recvArmed) {
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = userData(Op::Recv, fd);
+            sqe->user_data = userData(Op::Cancel, fd);
+            return;
+        }
+    }
+    if (connection.state == State::Cancelling && !connection.recvArmed) dispatch(fd);
+}
+
+void IoUringServer::dispatch(int fd) {
+    Connection& connection = connections[fd];
+    connection.state = State::Processing;
+    ++requestCount;
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobs.push_back({fd, connection.generation, std::move(connection.received)});
+    }
+    jobsCondition.notify_one();
+}
+
+void IoUringServer::workerLoop() {
+    ThreadPlacement::getInstance().place(ThreadPlacement::Role::Io);
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            jobsCondition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        
+        Completion completion{job.fd, job.generation, true, {}};
+        try {
+            completion.handled = handler(job.fd, job.received, completion.response);
+        } catch (const std::exception& e) {
+            LOG_ERROR("TCP client handling error: " + std::string(e.what()));
+            completion.response.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(completionsMutex);
+            completions.push_back(std::move(completion));
+        }
+        const uint64_t one = 1;
+        [[maybe_unused]] auto written = ::write(wakeFd, &one, sizeof(one));
+    }
+}
+
+void IoUringServer::drainCompletions() {
+    std::vector<Completion> ready;
+    {
+        std::lock_guard<std::mutex> lock(completionsMutex);
+        ready.swap(completions);
+    }
+    for (auto& completion : ready) {
+        auto it = connections.find(completion.fd);
+        if (it == connections.end() || it->second.generation != completion.generation) continue;
+        if (!completion.handled) {
+            // Дескриптор принадлежит обработчику
+            connections.erase(it);
+        } else if (completion.response.empty()) {
+            closeConnection(completion.fd);
+        } else {
+            it->second.response = std::move(completion.response);
+            startSend(completion.fd);
+        }
+    }
+}
+
+void IoUringServer::startSend(int fd) {
+    Connection& connection = connections[fd];
+    connection.state = State::Sending;
+    connection.sent = 0;
+    if (connection.response.size() <= settings.sendBufferSize && !freeSendBuffers.empty()) {
+        connection.sendBuffer = freeSendBuffers.back();
+        freeSendBuffers.pop_back();
+        std::memcpy(sendMemory.get() + static_cast<size_t>(connection.sendBuffer) * settings.sendBufferSize,
+                    connection.response.data(), connection.response.size());
+    }
+    submitSend(fd, connection);
+}
+
+void IoUringServer::submitSend(int fd, Connection& connection) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->fd = fd;
+    sqe->len = static_cast<uint32_t>(connection.response.size() - connection.sent);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = userData(Op::Send, fd);
+    if (connection.sendBuffer >= 0) {
+        // Зарегистрированный буфер: ядро не закрепляет страницы при каждой отправке
+        sqe->opcode = IORING_OP_SEND_ZC;
+        sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+        sqe->buf_index = static_cast<uint16_t>(connection.sendBuffer);
+        sqe->addr = reinterpret_cast<uint64_t>(sendMemory.get() +
+                                               static_cast<size_t>(connection.sendBuffer) * settings.sendBufferSize +
+                                               connection.sent);
+    } else {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->addr = reinterpret_cast<uint64_t>(connection.response.data() + connection.sent);
+    }
+}
+
+void IoUringServer::continueSend(int fd, const io_uring_cqe& cqe) {
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+    Connection& connection = it->second;
+    
+    if (cqe.flags & IORING_CQE_F_NOTIF) {
+        // Ядро освободило зарегистрированный буфер
+        --connection.notifications;
+    } else {
+        if (cqe.flags & IORING_CQE_F_MORE) ++connection.notifications;
+        if (cqe.res < 0) {
+            connection.sendDone = true;
+        } else {
+            connection.sent += static_cast<size_t>(cqe.res);
+            if (connection.sent < connection.response.size()) {
+                submitSend(fd, connection);
+            } else {
+                connection.sendDone = true;
+            }
+        }
+    }
+    if (connection.sendDone && connection.notifications == 0) closeConnection(fd);
+}
+
+void IoUringServer::closeConnection(int fd) {
+    auto it = connections.find(fd);
+    if (it != connections.end()) {
+        if (it->second.sendBuffer >= 0) freeSendBuffers.push_back(it->second.sendBuffer);
+        connections.erase(it);
+    }
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = userData(Op::Close, fd);
+}
+#endif
+
+TlsServer::Settings TlsServer::Settings::fromJson(const json& settings) {
+    Settings result;
+    if (!settings.is_object()) return result;
+    result.port = settings.value("port", result.port);
+    result.certFile = settings.value("cert_file", "");
+    result.keyFile = settings.value("key_file", "");
+    result.caFile = settings.value("ca_file", "");
+    result.requireClientCert = settings.value("require_client_cert", false);
+    result.writeClients = settings.value("write_clients", std::vector<std::string>{});
+    if (settings.contains("tokens") && settings["tokens"].is_object()) {
+        for (const auto& [name, token] : settings["tokens"].items()) {
+            if (token.is_string() && !token.get<std::string>().empty()) {
+                result.tokens.emplace_back(name, token.get<std::string>());
+            }
+        }
+    }
+    result.sessionTickets = settings.value("session_tickets", true);
+    result.sessionCacheSize = settings.value("session_cache_size", result.sessionCacheSize);
+    result.sessionTimeout = std::chrono::seconds(
+        settings.value("session_timeout_s", static_cast<int64_t>(result.sessionTimeout.count())));
+    result.allowPlaintextWrites = settings.value("allow_plaintext_writes", false);
+    result.handshakeTimeout = std::chrono::milliseconds(
+        settings.value("handshake_timeout_ms", static_cast<int64_t>(result.handshakeTimeout.count())));
+    result.idleTimeout = std::chrono::milliseconds(
+        settings.value("idle_timeout_ms", static_cast<int64_t>(result.idleTimeout.count())));
+    return result;
+}
+
+void TlsServer::Deadline::expireAfter(std::chrono::milliseconds timeout) {
+    if (timeout.count() <= 0) {
+        cancel();
+        return;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    at.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+bool TlsServer::Deadline::expired(std::chrono::steady_clock::time_point now) const {
+    const auto deadline = at.load(std::memory_order_relaxed);
+    return deadline != 0 && now.time_since_epoch().count() >= deadline;
+}
+
+TlsServer::TlsServer(Settings settings, Handler handler)
+    : settings(std::move(settings)), handler(std::move(handler)), context(ssl::context::tls_server),
+      acceptor(io, ip::tcp::endpoint(ip::tcp::v4(), this->settings.port)) {
+    configureContext();
+    listenPort = acceptor.local_endpoint().port();
+}
+
+TlsServer::~TlsServer() {
+    stop();
+}
+
+void TlsServer::configureContext() {
+    if (settings.certFile.empty() || settings.keyFile.empty()) {
+        throw std::runtime_error("TLS requires cert_file and key_file");
+    }
+    SSL_CTX* ctx = context.native_handle();
+    
+    // Только TLS 1.3: рукопожатие за один обмен, без пересогласования и сжатия.
+    // Закрытие TCP без close_notify - штатное: запросы и ответы имеют собственные границы,
+    // а сессия такого соединения остается пригодной для возобновления
+    SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_COMPRESSION | SSL_OP_NO_RENEGOTIATION | SSL_OP_IGNORE_UNEXPECTED_EOF);
+    SSL_CTX_set1_groups_list(ctx, "X25519:P-256");
+    context.use_certificate_chain_file(settings.certFile);
+    context.use_private_key_file(settings.keyFile, ssl::context::pem);
+    
+    // Возобновление: один билет на рукопожатие или кэш сессий сервера (session_tickets = false).
+    // Контекст сессии обязателен для возобновления сессий с сертификатом клиента
+    static const unsigned char sessionContext[] = "psdik";
+    SSL_CTX_set_session_id_context(ctx, sessionContext, sizeof(sessionContext) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, static_cast<long>(settings.sessionCacheSize));
+    SSL_CTX_set_timeout(ctx, static_cast<long>(settings.sessionTimeout.count()));
+    SSL_CTX_set_num_tickets(ctx, 1);
+    if (!settings.sessionTickets) SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    
+    if (!settings.caFile.empty()) {
+        context.load_verify_file(settings.caFile);
+        SSL_CTX_set_client_CA_list(ctx, SSL_load_client_CA_file(settings.caFile.c_str()));
+        context.set_verify_mode(ssl::verify_peer |
+                                (settings.requireClientCert ? ssl::verify_fail_if_no_peer_cert : 0));
+    }
+}
+
+void TlsServer::start() {
+    if (running.exchange(true)) return;
+    acceptThread = std::thread([this]() { acceptLoop(); });
+    LOG_INFO("TLS server started on port " + std::to_string(port()));
+}
+
+void TlsServer::stop() {
+    if (!running.exchange(false)) return;
+    if (acceptThread.joinable()) acceptThread.join();
+    boost::system::error_code ec;
+    acceptor.close(ec);
+    
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    for (auto& session : sessions) {
+        session->stream.lowest_layer().shutdown(ip::tcp::socket::shutdown_both, ec);
+    }
+    for (auto& session : sessions) {
+        if (session->thread.joinable()) session->thread.join();
+    }
+    sessions.clear();
+}
+
+void TlsServer::acceptLoop() {
+    ThreadPlacement::getInstance().place(ThreadPlacement::Role::Io);
+    while (running) {
+        try {
+            // Ожидание соединения с таймаутом: цикл завершается после stop() и проверяет сроки
+            pollfd descriptor{acceptor.native_handle(), POLLIN, 0};
+            const int ready = ::poll(&descriptor, 1, 200);
+            closeExpired();
+            if (ready <= 0) continue;
+            
+            ip::tcp::socket socket(io);
+            acceptor.accept(socket);
+            socket.set_option(ip::tcp::no_delay(true));
+            removeInactive();
+            
+            auto session = std::make_unique<Session>(std::move(socket), context);
+            Session* raw = session.get();
+            std::lock_guard<std::mutex> lock(sessionsMutex);
+            session->thread = std::thread([this, raw]() {
+                ThreadPlacement::getInstance().place(ThreadPlacement::Role::Io);
+                runSession(*raw);
+            });
+            sessions.push_back(std::move(session));
+        } catch (const std::exception& e) {
+            LOG_ERROR("TLS server error: " + std::string(e.what()));
+        }
+    }
+}
+
+void TlsServer::removeInactive() {
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    sessions.erase(
+        std::remove_if(sessions.begin(), sessions.end(),
+            [](const std::unique_ptr<Session>& session) {
+                if (session->active) return false;
+                if (session->thread.joinable()) session->thread.join();
+                return true;
+            }),
+        sessions.end()
+    );
+}
+
+void TlsServer::closeExpired() {
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    for (auto& session : sessions) {
+        if (!session->active || !session->deadline.expired(now)) continue;
+        // Закрытие сокета прерывает чтение потока соединения
+        session->deadline.cancel();
+        ++timedOutSessions;
+        boost::system::error_code ignored;
+        session->stream.lowest_layer().shutdown(ip::tcp::socket::shutdown_both, ignored);
+    }
+}
+
+void TlsServer::runSession(Session& session) {
+    ++openSessions;
+    ClientAuth auth;
+    auth.encrypted = true;
+    try {
+        session.deadline.expireAfter(settings.handshakeTimeout);
+        session.stream.handshake(Stream::server);
+        session.deadline.cancel();
+        SSL* ssl = session.stream.native_handle();
+        if (SSL_session_reused(ssl)) {
+            ++resumedHandshakes;
+        } else {
+            ++fullHandshakes;
+        }
+        identify(ssl, auth);
+    } catch (const std::exception& e) {
+        ++failedHandshakes;
+        LOG_WARNING("TLS handshake failed: " + std::string(e.what()));
+        --openSessions;
+        session.active = false;
+        return;
+    }
+    
+    try {
+        handler(session.stream, auth, session.deadline);
+    } catch (const std::exception& e) {
+        LOG_WARNING("TLS session error: " + std::string(e.what()));
+    }
+    // Без ожидания close_notify клиента: соединение закрывается сразу
+    boost::system::error_code ignored;
+    session.stream.lowest_layer().shutdown(ip::tcp::socket::shutdown_both, ignored);
+    --openSessions;
+    session.active = false;
+}
+
+void TlsServer::identify(SSL* ssl, ClientAuth& auth) const {
+    // Сертификат и результат проверки сохраняются в сессии и при возобновлении
+    X509* certificate = SSL_get1_peer_certificate(ssl);
+    if (!certificate) return;
+    char commonName[256] = {};
+    X509_NAME_get_text_by_NID(X509_get_subject_name(certificate), NID_commonName, commonName, sizeof(commonName));
+    X509_free(certificate);
+    if (SSL_get_verify_result(ssl) != X509_V_OK) return;
+    
+    auth.client = commonName;
+    auth.write = settings.writeClients.empty() ||
+                 std::find(settings.writeClients.begin(), settings.writeClients.end(), auth.client) !=
+                     settings.writeClients.end();
+}
+
+bool TlsServer::authorize(std::string_view token, ClientAuth& auth) const {
+    // Все токены сравниваются целиком: время проверки не зависит от совпавшего префикса
+    const std::string* client = nullptr;
+    for (const auto& [name, expected] : settings.tokens) {
+        if (expected.size() == token.size() && CRYPTO_memcmp(expected.data(), token.data(), token.size()) == 0) {
+            client = &name;
+        }
+    }
+    if (!client) return false;
+    auth.write = true;
+    auth.client = *client;
+    return true;
+}
+
+json TlsServer::metrics() const {
+    return {
+        {"port", port()},
+        {"full_handshakes", fullHandshakes.load()},
+        {"resumed_handshakes", resumedHandshakes.load()},
+        {"failed_handshakes", failedHandshakes.load()},
+        {"denied_writes", deniedCount.load()},
+        {"sessions", openSessions.load()},
+        {"timed_out_sessions", timedOutSessions.load()}
+    };
+}
+
+
+// Главный класс сервера
+DataServer::DataServer() : subscriptionManager(dataCache) {
+    lastConfigCheck = std::chrono::steady_clock::now();
+}
+
+DataServer::~DataServer() {
+    stop();
+}
+
+void DataServer::setTagCacheFile(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(configMutex);
+    tagCacheFile = filename;
+}
+
+bool DataServer::loadedFromTagCache() const {
+    return tagCacheHit;
+}
+
+void DataServer::loadConfig(const std::string& filename) {
+    configFile = filename;
+    std::ifstream f(filename, std::ios::binary);
+    if (!f.is_open()) {
+        throw std::runtime_error("Cannot open config file: " + filename);
+    }
+    
+    std::string content = readFileContent(f);
+    
+    std::lock_guard<std::mutex> lock(configMutex);
+    updateConfigFingerprint(content);
+    uint64_t contentHash = configHash;
+    tagCacheHit = false;
+    
+    // Быстрый старт: скомпилированная база тегов соответствует файлу конфигурации
+    if (!tagCacheFile.empty()) {
+        auto table = std::make_unique<TagTable>();
+        if (table->loadFromFile(tagCacheFile, contentHash, content.size())) {
+            // Разбор без сбора тегов: таблица и максимальный ID уже в базе
+            config = json::parse(content);
+            if (table->generatedIds() > 0) {
+                // ID, сгенерированные при предыдущем запуске, берутся из базы тегов
+                for (size_t i = 0; i < table->size(); ++i) {
+                    const auto& rec = table->record(i);
+                    auto& var = config[std::string(table->section(rec))]["variables"][std::string(table->key(rec))];
+                    if (!var.contains("id") || !var["id"].is_number() || var["id"] == 0) {
+                        var["id"] = rec.id;
+                    }
+                }
+            }
+            if (table->maxId() > 0) {
+                idGenerator.setCounter(table->maxId());
+            }
+            setTagTable(std::move(table));
+            publishConfigSnapshot();
+            tagCacheHit = true;
+            LOG_INFO("Configuration loaded from tag cache " + tagCacheFile + " (" +
+                     std::to_string(tagTable->size()) + " tags)");
+            
+            initializeProtocols();
+            return;
+        }
+    }
+    
+    // Один проход SAX: DOM конфигурации, таблица тегов и максимальный ID
+    json parsed;
+    ConfigSaxLoader loader(parsed);
+    if (!json::sax_parse(content, &loader)) {
+        throw std::runtime_error("Cannot parse config file: " + filename);
+    }
+    config = std::move(parsed);
+    LOG_INFO("Configuration loaded from " + filename + " (" +
+             std::to_string(loader.entries.size() + loader.missingIds) + " tags)");
+    
+    // Восстановление счетчика ID из конфига
+    if (loader.maxId > 0) {
+        idGenerator.setCounter(loader.maxId);
+        LOG_INFO("Restored ID counter to: " + std::to_string(loader.maxId));
+    }
+    
+    if (loader.missingIds > 0) {
+        // Генерация ID для переменных, если их нет
+        auto generated = static_cast<uint32_t>(generateMissingIds());
+        rebuildTagTable(contentHash, content.size(), generated);
+    } else {
+        installTagTable(std::move(loader.entries), loader.maxId, contentHash, content.size());
+    }
+    publishConfigSnapshot();
+    
+    // Инициализация обработчиков протоколов
+    initializeProtocols();
+}
+
+namespace {
+
+constexpr const char* REDACTED = "<redacted>";
+
+// Секреты конфигурации (токены TLS, ключи репликации, путь к закрытому ключу) не отдаются
+// клиентам: значения заменяются отметкой, имена токенов сохраняются
+void redactSecrets(json& node) {
+    if (node.is_array()) {
+        for (auto& element : node) redactSecrets(element);
+        return;
+    }
+    if (!node.is_object()) return;
+    for (auto& [key, value] : node.items()) {
+        if (key == "variables") continue;
+        if (key == "tokens" && value.is_object()) {
+            for (auto& token : value) token = REDACTED;
+        } else if ((key == "secret" || key == "key_file") && value.is_string() &&
+                   !value.get_ref<const std::string&>().empty()) {
+            value = REDACTED;
+        } else {
+            redactSecrets(value);
+        }
+    }
+}
+
+// Конфигурация, полученная через get_config и возвращенная update_config: отметки
+// заменяются значениями по тому же пути из прежней конфигурации
+void restoreRedacted(json& updated, const json& previous) {
+    if (updated.is_array() && previous.is_array()) {
+        for (size_t i = 0; i < std::min(updated.size(), previous.size()); ++i) {
+            restoreRedacted(updated[i], previous[i]);
+        }
+        return;
+    }
+    if (!updated.is_object() || !previous.is_object()) return;
+    for (auto& [key, value] : updated.items()) {
+        auto old = previous.find(key);
+        if (old == previous.end()) continue;
+        if (value == REDACTED) {
+            value = *old;
+        } else {
+            restoreRedacted(value, *old);
+        }
+    }
+}
+    
+} // namespace
+
+void DataServer::publishConfigSnapshot() {
+    json snapshot = config;
+    redactSecrets(snapshot);
+    configSnapshot = std::make_shared<const json>(std::move(snapshot));
+}
+
+std::shared_ptr<const json> DataServer::configView() {
+    std::lock_guard<std::mutex> lock(configMutex);
+    return configSnapshot;
+}
+
+void DataServer::rebuildTagTable(uint64_t contentHash, uint64_t contentSize, uint32_t generatedIds) {
+    std::vector<TagTable::Entry> entries;
+    int64_t maxId = 0;
+    for (auto& [proto, proto_config] : config.items()) {
+        if (!proto_config.is_object() || !proto_config.contains("variables")) continue;
+        for (auto& [key, var] : proto_config["variables"].items()) {
+            if (!var.contains("id") || !var["id"].is_number()) continue;
+            int64_t id = var["id"];
+            maxId = std::max(maxId, id);
+            entries.push_back({id, var.value("name", ""), proto, key});
+        }
+    }
+    installTagTable(std::move(entries), maxId, contentHash, contentSize, generatedIds);
+}
+
+void DataServer::installTagTable(std::vector<TagTable::Entry> entries, int64_t maxId,
+                                 uint64_t contentHash, uint64_t contentSize, uint32_t generatedIds) {
+    // Файл кэша сохраняется только для таблицы, соответствующей содержимому файла
+    bool persist = !tagCacheFile.empty() && contentHash != 0;
+    
+    auto table = std::make_unique<TagTable>();
+    table->build(std::move(entries), maxId, contentHash, contentSize, generatedIds);
+    
+    if (persist && !table->saveToFile(tagCacheFile)) {
+        LOG_WARNING("Cannot write tag cache " + tagCacheFile);
+    }
+    setTagTable(std::move(table));
+}
+
+void DataServer::setTagTable(std::unique_ptr<TagTable> table) {
+    if (tagTable) {
+        nameIndex.update(*tagTable, *table);
+    } else {
+        nameIndex.build(*table);
+    }
+    tagTable = std::move(table);
+}
+
+void DataServer::restoreIdCounter() {
+    int64_t maxId = 0;
+    for (auto& [proto, proto_config] : config.items()) {
+        if (proto_config.contains("variables")) {
+            for (auto& [key, var] : proto_config["variables"].items()) {
+                if (var.contains("id") && var["id"].is_number()) {
+                    int64_t id = var["id"];
+                    if (id > maxId) maxId = id;
+                }
+            }
+        }
+    }
+    
+    if (maxId > 0) {
+        idGenerator.setCounter(maxId);
+        LOG_INFO("Restored ID counter to: " + std::to_string(maxId));
+    }
+}
+
+size_t DataServer::generateMissingIds() {
+    size_t generated = 0;
+    for (auto& [proto, proto_config] : config.items()) {
+        if (proto_config.contains("variables")) {
+            for (auto& [key, var] : proto_config["variables"].items()) {
+                if (!var.contains("id") || !var["id"].is_number() || var["id"] == 0) {
+                    var["id"] = idGenerator.generate();
+                    ++generated;
+                    LOG_INFO("Generated ID for variable: " + var["name"].get<std::string>() + 
+                            " -> " + std::to_string(var["id"].get<int64_t>()));
+                }
+            }
+        }
+    }
+    return generated;
+}
+
+void DataServer::saveConfig(const std::string& filename = "") {
+    std::lock_guard<std::mutex> lock(configMutex);
+    writeConfigFile(filename);
+}
+
+void DataServer::writeConfigFile(const std::string& filename) {
+    std::string targetFile = filename.empty() ? configFile : filename;
+    std::ofstream f(targetFile);
+    if (!f.is_open()) {
+        throw std::runtime_error("Cannot open config file for writing: " + targetFile);
+    }
+    
+    std::string content = config.dump(4);
+    f << content;
+    f.close();
+    
+    // Собственная запись не должна вызывать повторную загрузку
+    if (targetFile == configFile) {
+        updateConfigFingerprint(content);
+        rebuildTagTable(configHash, content.size());
+    }
+    LOG_INFO("Configuration saved to " + targetFile);
+}
+
+void DataServer::updateConfigFingerprint(const std::string& content) {
+    std::error_code ec;
+    configMtime = std::filesystem::last_write_time(configFile, ec);
+    configSize = std::filesystem::file_size(configFile, ec);
+    configHash = TagTable::hashContent(content);
+}
+
+std::unique_ptr<ProtocolHandler> DataServer::createHandler(const std::string& proto, const json& protoConfig) {
+    // Несколько устройств одного протокола: секции с явным полем "protocol"
+    std::string protocolType = protoConfig.value("protocol", proto);
+    std::unique_ptr<ProtocolHandler> handler;
+    
+    if (protocolType == "modbus_tcp") {
+        handler = std::make_unique<ModbusTcpHandler>(dataCache, proto);
+    } else if (protocolType == "data_server") {
+        handler = std::make_unique<DataServerHandler>(dataCache, proto, protoConfig.value("import_all", json()));
+    } else if (protocolType == "iec104") {
+        // handler = std::make_unique<IEC104Handler>(dataCache);
+    } else if (protocolType == "snmp") {
+        // handler = std::make_unique<SNMPHandler>(dataCache);
+    }
+    
+    if (handler) {
+        handler->setConnectionParameters(protoConfig["connection_parameters"]);
+        
+        // Обновления значений попадают в кольцо рассылки из кэша (DataCache::store)
+        handler->onConnectionStatusChanged.connect(
+            [this, proto](const std::string&, bool connected) {
+                LOG_INFO(proto + " connection status: " + 
+                        (connected ? "connected" : "disconnected"));
+            });
+    }
+    return handler;
+}
+
+void DataServer::initializeProtocols() {
+    protocols.clear();
+    updateQosClasses();
+    
+    for (auto& [proto, proto_config] : config.items()) {
+        if (!proto_config.is_object() || !proto_config.contains("connection_parameters")) {
+            continue;
+        }
+        
+        auto handler = createHandler(proto, proto_config);
+        if (handler) {
+            auto poller = std::make_unique<DevicePoller>(
+                std::move(handler),
+                proto_config.value("variables", json::object()),
+                proto_config.value("polling_interval_ms", 1000),
+                proto_config.value("circuit_breaker", json::object()),
+                qosSettings(proto_config));
+            if (pollingActive) poller->start();
+            protocols[proto] = std::move(poller);
+        }
+    }
+}
+
+json DataServer::qosSettings(const json& section) const {
+    json settings = config.value("server_settings", json::object()).value("qos", json::object());
+    if (!settings.is_object()) settings = json::object();
+    settings.merge_patch(section.value("qos", json::object()));
+    return settings;
+}
+
+void DataServer::updateQosClasses() {
+    // Обычный класс не хранится: подписчики ищут в таблице только отличающиеся ID
+    SubscriptionManager::QosClasses classes;
+    for (auto& [proto, proto_config] : config.items()) {
+        if (!proto_config.is_object() || !proto_config.contains("variables")) continue;
+        for (auto& [key, var] : proto_config["variables"].items()) {
+            if (!var.is_object() || !var.contains("id") || !var["id"].is_number()) continue;
+            const auto lane = QosClass::fromString(var.value("priority", ""));
+            if (lane != QosClass::Normal) classes[var["id"].get<int64_t>()] = lane;
+        }
+    }
+    subscriptionManager.setQos(std::move(classes), QosPolicy::fromJson(qosSettings(json::object())));
+}
+
+namespace {
+
+// Идентификаторы переменных секции конфигурации
+std::set<int64_t> sectionVariableIds(const json& section) {
+    std::set<int64_t> ids;
+    if (section.is_object() && section.contains("variables")) {
+        for (auto& [key, var] : section["variables"].items()) {
+            if (var.contains("id") && var["id"].is_number()) {
+                ids.insert(var["id"].get<int64_t>());
+            }
+        }
+    }
+    return ids;
+}
+
+} // namespace
+
+void DataServer::applyConfigChanges(json newConfig) {
+    // Опросчики удаленных и переподключаемых устройств останавливаются после освобождения
+    // configMutex: ожидание таймаута устройства не задерживает читателей конфигурации
+    std::lock_guard<std::mutex> lifecycle(pollersMutex);
+    std::vector<std::unique_ptr<DevicePoller>> retired;
+    std::vector<DevicePoller*> added;
+    std::set<int64_t> removedIds;
+    
+    std::unique_lock<std::mutex> lock(configMutex);
+    json oldConfig = std::move(config);
+    config = std::move(newConfig);
+    restoreRedacted(config, oldConfig);
+    
+    // Переменные без ID сохраняют ID из предыдущей конфигурации
+    for (auto& [proto, proto_config] : config.items()) {
+        if (!proto_config.is_object() || !proto_config.contains("variables") ||
+            !oldConfig.contains(proto) || !oldConfig[proto].contains("variables")) {
+            continue;
+        }
+        const auto& oldVars = oldConfig[proto]["variables"];
+        for (auto& [key, var] : proto_config["variables"].items()) {
+            if ((!var.contains("id") || !var["id"].is_number() || var["id"] == 0) &&
+                oldVars.contains(key) && oldVars[key].contains("id")) {
+                var["id"] = oldVars[key]["id"];
+            }
+        }
+    }
+    
+    restoreIdCounter();
+    size_t generated = generateMissingIds();
+    
+    // ID всех переменных новой конфигурации: переменная могла перейти в другую секцию
+    std::set<int64_t> currentIds;
+    for (auto& [proto, proto_config] : config.items()) {
+        auto ids = sectionVariableIds(proto_config);
+        currentIds.insert(ids.begin(), ids.end());
+    }
+    
+    // Удаленные устройства
+    for (auto it = protocols.begin(); it != protocols.end(); ) {
+        const auto& name = it->first;
+        if (!config.contains(name) || !config[name].is_object() ||
+            !config[name].contains("connection_parameters")) {
+            LOG_INFO("Removing device " + name);
+            retired.push_back(std::move(it->second));
+            for (int64_t id : sectionVariableIds(oldConfig.value(name, json::object()))) {
+                if (!currentIds.count(id)) removedIds.insert(id);
+            }
+            it = protocols.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    
+    // Новые и измененные устройства
+    for (auto& [proto, proto_config] : config.items()) {
+        if (!proto_config.is_object() || !proto_config.contains("connection_parameters")) {
+            continue;
+        }
+        
+        const json oldSection = oldConfig.value(proto, json::object());
+        json variables = proto_config.value("variables", json::object());
+        int pollingInterval = proto_config.value("polling_interval_ms", 1000);
+        auto existing = protocols.find(proto);
+        
+        // Переменные, исчезнувшие из конфигурации, удаляются из кэша
+        for (int64_t id : sectionVariableIds(oldSection)) {
+            if (!currentIds.count(id)) removedIds.insert(id);
+        }
+        
+        bool connectionChanged = existing == protocols.end() ||
+            oldSection.value("connection_parameters", json()) != proto_config["connection_parameters"] ||
+            oldSection.value("protocol", proto) != proto_config.value("protocol", proto);
+        
+        if (connectionChanged) {
+            // Новое устройство или изменены параметры подключения: пересоздаем только его
+            auto handler = createHandler(proto, proto_config);
+            if (existing != protocols.end()) {
+                LOG_INFO("Reconnecting device " + proto + " with new connection parameters");
+                retired.push_back(std::move(existing->second));
+                protocols.erase(existing);
+            } else {
+                LOG_INFO("Adding device " + proto);
+            }
+            if (handler) {
+                auto poller = std::make_unique<DevicePoller>(std::move(handler), std::move(variables), pollingInterval,
+                                                             proto_config.value("circuit_breaker", json::object()),
+                                                             qosSettings(proto_config));
+                added.push_back(poller.get());
+                protocols[proto] = std::move(poller);
+            }
+        } else if (oldSection.value("variables", json::object()) != variables ||
+                   oldSection.value("polling_interval_ms", 1000) != pollingInterval) {
+            // Изменились только переменные: соединение сохраняется
+            LOG_INFO("Updating variables of device " + proto);
+            existing->second->updateVariables(std::move(variables), pollingInterval);
+        }
+        if (!connectionChanged &&
+            oldSection.value("circuit_breaker", json::object()) != proto_config.value("circuit_breaker", json::object())) {
+            existing->second->updatePolicy(proto_config.value("circuit_breaker", json::object()));
+        }
+        if (!connectionChanged) {
+            existing->second->updateQos(qosSettings(proto_config));
+        }
+    }
+    updateQosClasses();
+    
+    // Вычисляемые переменные перекомпилируются только при изменении их секции
+    const json derivedSection = config.value("derived", json::object());
+    const json oldDerivedSection = oldConfig.value("derived", json::object());
+    if (derivedSection != oldDerivedSection) {
+        if (derivedTags) derivedTags->stop();
+        for (int64_t id : sectionVariableIds(oldDerivedSection)) {
+            if (!currentIds.count(id)) dataCache.removeValue(id);
+        }
+        if (running) startDerivedTags(derivedSection);
+    }
+    
+    if (oldConfig.value("alarms", json::object()) != config.value("alarms", json::object())) {
+        LOG_INFO("Updating alarm rules");
+        alarmEngine.configure(config.value("alarms", json::object()));
+    }
+    
+    // Сгенерированные ID сохраняются в файл, чтобы они не менялись между перезагрузками
+    if (generated > 0 && !configFile.empty()) {
+        writeConfigFile("");
+    } else {
+        rebuildTagTable();
+    }
+    publishConfigSnapshot();
+    lock.unlock();
+    
+    // Новое соединение устройства открывается после закрытия прежнего
+    for (auto& poller : retired) poller->stop();
+    for (int64_t id : removedIds) dataCache.removeValue(id);
+    if (pollingActive) {
+        for (auto* poller : added) poller->start();
+    }
+}
+
+ProtocolHandler* DataServer::getProtocolHandler(const std::string& proto) {
+    std::lock_guard<std::mutex> lock(configMutex);
+    auto it = protocols.find(proto);
+    return it != protocols.end() ? &it->second->getHandler() : nullptr;
+}
+
+void DataServer::restoreSnapshot() {
+    std::lock_guard<std::mutex> lock(configMutex);
+    snapshotFile.clear();
+    if (!config.contains("server_settings") || !config["server_settings"].contains("snapshot")) {
+        return;
+    }
+    
+    const auto& settings = config["server_settings"]["snapshot"];
+    snapshotFile = settings.value("file", "");
+    snapshotInterval = std::chrono::milliseconds(std::max(100, settings.value("interval_ms", 5000)));
+    snapshotHistoryDepth = static_cast<size_t>(std::max(0, settings.value("history_depth", 10)));
+    if (snapshotFile.empty()) return;
+    
+    // Восстанавливаются только переменные, оставшиеся в конфигурации
+    const TagTable* table = tagTable.get();
+    dataCache.loadSnapshot(snapshotFile, [table](int64_t id) {
+        return table && table->find(id) != nullptr;
+    });
+}
+
+void DataServer::writeSnapshot() {
+    if (snapshotFile.empty()) return;
+    
+    try {
+        dataCache.saveSnapshot(snapshotFile, snapshotHistoryDepth);
+    } catch (const std::exception& e) {
+        LOG_ERROR(std::string("Snapshot error: ") + e.what());
+    }
+}
+
+void DataServer::setPollingActive(bool active) {
+    // Состав опросчиков меняется только под pollersMutex: список действителен до его освобождения,
+    // а остановка (ожидание цикла опроса) не держит configMutex
+    std::lock_guard<std::mutex> lifecycle(pollersMutex);
+    if (pollingActive.exchange(active) == active) return;
+    
+    std::vector<DevicePoller*> pollers;
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        for (auto& [proto, poller] : protocols) pollers.push_back(poller.get());
+    }
+    for (auto* poller : pollers) {
+        if (active) {
+            poller->start();
+        } else {
+            poller->stop();
+        }
+    }
+}
+
+void DataServer::startReplication() {
+    json settings;
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        if (config.contains("server_settings") && config["server_settings"].contains("replication")) {
+            settings = config["server_settings"]["replication"];
+        }
+    }
+    
+    replicationPublisher.reset();
+    replicationReceiver.reset();
+    const std::string role = settings.is_object() ? settings.value("role", "none") : "none";
+    
+    if (role == "primary") {
+        try {
+            replicationPublisher = std::make_unique<ReplicationPublisher>(
+                dataCache, subscriptionManager, settings.value("port", 8090),
+                std::chrono::milliseconds(std::max(10, settings.value("heartbeat_ms", 500))),
+                settings.value("bind_address", "127.0.0.1"), settings.value("secret", ""),
+                std::chrono::milliseconds(std::max(10, settings.value("handshake_timeout_ms", 5000))));
+            replicationPublisher->start();
+        } catch (const std::exception& e) {
+            replicationPublisher.reset();
+            LOG_ERROR(std::string("Replication publisher error: ") + e.what());
+        }
+    } else if (role == "standby") {
+        const json primary = settings.value("primary", json::object());
+        replicationReceiver = std::make_unique<ReplicationReceiver>(
+            dataCache, primary.value("host", "localhost"), primary.value("port", 8090),
+            std::chrono::milliseconds(std::max(100, settings.value("failover_timeout_ms", 3000))),
+            [this](bool primaryAlive) {
+                {
+                    std::lock_guard<std::mutex> lock(pollingSwitchMutex);
+                    pollingSwitch = !primaryAlive;
+                }
+                pollingSwitchCondition.notify_one();
+            },
+            settings.value("secret", ""));
+        replicationReceiver->start();
+        
+        // Переключение опроса: применяется последнее запрошенное состояние
+        pollingThreads.emplace_back([this]() {
             while (running) {
-                if (!handler->isConnected()) {
-                    handler->connect();
-                } else {
-                    auto data = handler->readData(vars);
-                    // Данные автоматически обновляются в кэше через callback
+                std::optional<bool> target;
+                {
+                    std::unique_lock<std::mutex> lock(pollingSwitchMutex);
+                    pollingSwitchCondition.wait_for(lock, std::chrono::milliseconds(100),
+                                                    [this]() { return pollingSwitch.has_value(); });
+                    target = std::exchange(pollingSwitch, std::nullopt);
                 }
-                
-                std::this_thread::sleep_for(std::chrono::milliseconds(pollingInterval));
+                if (target) setPollingActive(*target);
+            }
+        });
+        LOG_INFO("Standby mode: replicating from " + primary.value("host", "localhost") + ":" +
+                 std::to_string(primary.value("port", 8090)));
+    } else if (role != "none") {
+        LOG_WARNING("Unknown replication role: " + role);
+    }
+}
+
+void DataServer::startDerivedTags(const json& section) {
+    if (derivedTags) derivedTags->stop();
+    derivedTags.reset();
+    
+    auto definitions = DerivedTagEngine::definitionsFromJson(section);
+    if (definitions.empty()) return;
+    derivedTags = std::make_unique<DerivedTagEngine>(dataCache, subscriptionManager);
+    derivedTags->configure(definitions);
+    derivedTags->start();
+    LOG_INFO("Derived tags: " + std::to_string(derivedTags->tagCount()) + " compiled, " +
+             std::to_string(derivedTags->errors().size()) + " rejected");
+}
+
+void DataServer::startExport() {
+    json settings;
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        if (config.contains("server_settings") && config["server_settings"].contains("export")) {
+            settings = config["server_settings"]["export"];
+        }
+    }
+    
+    if (exporter) exporter->stop();
+    exporter.reset();
+    if (!settings.is_object() || !settings.value("enabled", false)) return;
+    
+    try {
+        exporter = std::make_unique<HistorianExporter>(
+            dataCache, subscriptionManager, HistorianExporter::createTarget(settings.value("target", json::object())),
+            HistorianExporter::Settings::fromJson(settings));
+        exporter->start();
+    } catch (const std::exception& e) {
+        exporter.reset();
+        LOG_ERROR(std::string("Historian export error: ") + e.what());
+    }
+}
+
+unsigned short DataServer::replicationPort() const {
+    return replicationPublisher ? replicationPublisher->port() : 0;
+}
+
+void DataServer::startPolling() {
+    running = true;
+    
+    // Последние известные значения доступны клиентам до первого опроса
+    restoreSnapshot();
+    
+    // Правила тревог проверяются при записи каждого значения, начиная с первого опроса;
+    // размещение потоков и параметры отправки подписчикам настраиваются до запуска опросчиков
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        alarmEngine.configure(config.value("alarms", json::object()));
+        const json serverSettings = config.value("server_settings", json::object());
+        auto placement = ThreadPlacement::Settings::fromJson(serverSettings.value("affinity", json::object()));
+        ThreadPlacement::getInstance().configure(placement);
+        if (placement.enabled) {
+            LOG_INFO("Thread affinity: " + std::to_string(placement.pollerSets.size()) + " poller CPU sets, " +
+                     std::to_string(placement.ioCpus.size()) + " I/O CPUs");
+        }
+        subscriptionManager.setSendOptions(
+            GatherWriter::Options::fromJson(serverSettings.value("subscribers", json::object())));
+    }
+    dataCache.setAlarmEngine(&alarmEngine);
+    
+    // Экспорт в архив подписывается на обновления до первого опроса
+    startExport();
+    
+    // Резервный сервер получает значения от основного и не опрашивает устройства до отказа
+    startReplication();
+    if (!replicationReceiver) {
+        setPollingActive(true);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        startDerivedTags(config.value("derived", json::object()));
+    }
+    
+    // Поток для проверки обновления конфигурации
+    pollingThreads.emplace_back([this]() {
+        while (running) {
+            checkConfigUpdate();
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    });
+    
+    // Поток периодической записи снимка кэша
+    if (!snapshotFile.empty()) {
+        pollingThreads.emplace_back([this]() {
+            auto nextSnapshot = std::chrono::steady_clock::now() + snapshotInterval;
+            while (running) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                if (std::chrono::steady_clock::now() >= nextSnapshot) {
+                    writeSnapshot();
+                    nextSnapshot = std::chrono::steady_clock::now() + snapshotInterval;
+                }
+            }
+        });
+    }
+}
+
+void DataServer::checkConfigUpdate() {
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration_cast<std::chrono::seconds>(now - lastConfigCheck).count() < 1) {
+        return;
+    }
+    
+    lastConfigCheck = now;
+    
+    try {
+        // Дешевая проверка по времени изменения и размеру, затем по хешу содержимого
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(configFile, ec);
+        if (ec) return;
+        auto size = std::filesystem::file_size(configFile, ec);
+        if (ec) return;
+        
+        {
+            std::lock_guard<std::mutex> lock(configMutex);
+            if (mtime == configMtime && size == configSize) return;
+        }
+        
+        std::ifstream f(configFile, std::ios::binary);
+        if (!f.is_open()) return;
+        std::string content = readFileContent(f);
+        uint64_t hash = TagTable::hashContent(content);
+        
+        {
+            std::lock_guard<std::mutex> lock(configMutex);
+            configMtime = mtime;
+            configSize = size;
+            if (hash == configHash) return;
+            configHash = hash;
+        }
+        
+        json newConfig = json::parse(content);
+        LOG_INFO("Configuration file changed, applying changes...");
+        applyConfigChanges(std::move(newConfig));
+    } catch (const std::exception& e) {
+        LOG_ERROR("Error checking config update: " + std::string(e.what()));
+    }
+}
+
+void DataServer::startTcpServer() {
+    unsigned short port = 8080;
+    json network = json::object();
+    json tls = json::object();
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        if (config.contains("server_settings")) {
+            port = config["server_settings"].value("tcp_port", port);
+            network = config["server_settings"].value("network", json::object());
+            tls = config["server_settings"].value("tls", json::object());
+        }
+    }
+    if (network.is_object()) writeTimeoutMs = std::max(0, network.value("write_timeout_ms", 10000));
+    if (tls.is_object() && tls.value("enabled", false)) {
+        startTlsServer(tls);
+    } else {
+        LOG_WARNING("TLS is disabled: write requests on the plaintext port are not authenticated");
+    }
+    
+    const std::string backend = network.is_object() ? network.value("backend", "asio") : "asio";
+    if (backend == "io_uring") {
+#ifdef HAVE_IO_URING
+        if (IoUringServer::supported()) {
+            auto uringSettings = IoUringServer::Settings::fromJson(network.value("io_uring", json::object()));
+            uringSettings.maxRequestLine = MAX_REQUEST_LINE;
+            auto server = std::make_unique<IoUringServer>(
+                uringSettings,
+                [this](int fd, std::string& received, std::string& response) {
+                    std::string_view request(received.data(), received.find('\n'));
+                    if (respondInline(request, response)) return true;
+                    
+                    // Потоковые ответы, текстовые команды, подписки и WebSocket - в потоке соединения
+                    std::thread([this, fd, data = std::move(received)]() {
+                        ThreadPlacement::getInstance().place(ThreadPlacement::Role::Io);
+                        try {
+                            handleTcpClient(ip::tcp::socket(tcpService, ip::tcp::v4(), fd), data);
+                        } catch (const std::exception& e) {
+                            LOG_ERROR("TCP client handling error: " + std::string(e.what()));
+                        }
+                    }).detach();
+                    return false;
+                });
+            tcpListenPort = server->listen(port);
+            IoUringServer* raw = server.get();
+            {
+                std::lock_guard<std::mutex> lock(uringMutex);
+                uringServer = std::move(server);
+            }
+            // Остановка, вызванная до публикации цикла
+            if (!running) raw->stop();
+            raw->run();
+            return;
+        }
+        LOG_WARNING("io_uring is not supported by the kernel, falling back to the asio TCP server");
+#else
+        LOG_WARNING("Server is built without ENABLE_IO_URING, falling back to the asio TCP server");
+#endif
+    }
+    runAsioServer(port);
+}
+
+void DataServer::runAsioServer(unsigned short port) {
+    ip::tcp::acceptor acceptor(tcpService, ip::tcp::endpoint(ip::tcp::v4(), port));
+    tcpListenPort = acceptor.local_endpoint().port();
+    
+    LOG_INFO("TCP server started on port " + std::to_string(tcpListenPort.load()));
+    
+    while (running) {
+        try {
+            // Ожидание соединения с таймаутом: цикл завершается после stop()
+            pollfd descriptor{acceptor.native_handle(), POLLIN, 0};
+            if (::poll(&descriptor, 1, 200) <= 0) continue;
+            
+            ip::tcp::socket socket(tcpService);
+            acceptor.accept(socket);
+            
+            std::thread([this, sock = std::move(socket)]() mutable {
+                ThreadPlacement::getInstance().place(ThreadPlacement::Role::Io);
+                handleTcpClient(std::move(sock));
+            }).detach();
+        } catch (const std::exception& e) {
+            LOG_ERROR("TCP server error: " + std::string(e.what()));
+        }
+    }
+}
+
+void DataServer::startTlsServer(const json& section) {
+    auto settings = TlsServer::Settings::fromJson(section);
+    // Запрет записи через открытый порт действует и при ошибке настройки TLS
+    plaintextWrites = settings.allowPlaintextWrites;
+    if (plaintextWrites) {
+        LOG_WARNING("allow_plaintext_writes is set: write requests on the plaintext port are not authenticated");
+    }
+    try {
+        auto server = std::make_unique<TlsServer>(std::move(settings),
+            [this](TlsServer::Stream& stream, ClientAuth& auth, TlsServer::Deadline& idle) {
+                handleTlsClient(stream, auth, idle);
+            });
+        TlsServer* raw = server.get();
+        {
+            std::lock_guard<std::mutex> lock(tlsMutex);
+            tlsServer = std::move(server);
+        }
+        raw->start();
+    } catch (const std::exception& e) {
+        LOG_ERROR("TLS server not started: " + std::string(e.what()));
+    }
+}
+
+unsigned short DataServer::tlsPort() {
+    std::lock_guard<std::mutex> lock(tlsMutex);
+    return tlsServer ? tlsServer->port() : 0;
+}
+
+bool DataServer::isWriteRequest(const json& request) const {
+    if (!request.is_object() || !request.contains("action") || !request["action"].is_string()) return false;
+    const auto& action = request["action"].get_ref<const std::string&>();
+    return action == "update_config" || action == "save_config" || action == "ack_alarm";
+}
+
+json DataServer::handleClientRequest(const json& request, ClientAuth& auth) {
+    if (auth.write || !isWriteRequest(request)) return handleJsonRequest(request);
+    
+    // Токен в самом запросе принимается только через TLS-порт
+    if (auth.encrypted && request.contains("token") && request["token"].is_string() &&
+        tlsServer->authorize(request["token"].get<std::string>(), auth)) {
+        return handleJsonRequest(request);
+    }
+    if (auth.encrypted) tlsServer->recordDenied();
+    LOG_WARNING("Write request denied: " + request["action"].get<std::string>());
+    return {{"status", "error"}, {"message", "Write access denied"}};
+}
+
+bool DataServer::respondInline(std::string_view request, std::string& response) {
+    response.clear();
+    // Текстовые команды и HTTP обрабатываются в потоке соединения
+    if (request.empty() || request.front() != '{') return false;
+    
+    json requestJson;
+    try {
+        requestJson = json::parse(request);
+    } catch (const json::parse_error&) {
+        return true; // Неизвестная команда: соединение закрывается без ответа
+    }
+    if (requestJson.empty()) return true;
+    
+    // Потоковые ответы ограничены пулом буферов, ожидание событий тревог - долгий запрос
+    if (isStreamedRequest(requestJson) ||
+        (requestJson.contains("action") && requestJson["action"] == "get_alarm_events")) {
+        return false;
+    }
+    ClientAuth auth = plaintextAuth();
+    response = handleClientRequest(requestJson, auth).dump();
+    response += '\n';
+    return true;
+}
+
+namespace {
+
+// Целое число в начале строки (допускаются ведущие пробелы, как в std::stoll)
+template <typename T>
+bool parseInteger(std::string_view text, T& value) {
+    size_t start = text.find_first_not_of(" \t");
+    if (start == std::string_view::npos) return false;
+    const char* first = text.data() + start;
+    auto result = std::from_chars(first, text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr != first;
+}
+
+bool startsWith(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+template <typename Stream>
+void writeText(Stream& stream, std::string_view text) {
+    write(stream, boost::asio::buffer(text.data(), text.size()));
+}
+
+constexpr const char* writeDeniedText = "{\"status\": \"error\", \"message\": \"Write access denied\"}\n";
+    
+} // namespace
+
+bool TextCommand::parse(std::string_view line, TextCommand& command) {
+    command = TextCommand{};
+    
+    if (startsWith(line, "SUBSCRIBE")) {
+        // Формат: SUBSCRIBE variable_id
+        auto pos = line.find(' ');
+        if (pos == std::string_view::npos) return false;
+        command.type = Type::Subscribe;
+        if (!parseInteger(line.substr(pos + 1), command.variableId)) {
+            command.error = "{\"error\": \"Invalid variable ID format\"}\n";
+        }
+        return true;
+    }
+    if (line == "GET_ALL") {
+        command.type = Type::GetAll;
+        return true;
+    }
+    if (startsWith(line, "GET_HISTORY")) {
+        // Формат: GET_HISTORY variable_id count
+        auto pos1 = line.find(' ');
+        auto pos2 = pos1 == std::string_view::npos ? pos1 : line.find(' ', pos1 + 1);
+        if (pos2 == std::string_view::npos) return false;
+        command.type = Type::GetHistory;
+        int count = 0;
+        if (!parseInteger(line.substr(pos1 + 1, pos2 - pos1 - 1), command.variableId)) {
+            command.error = "{\"error\": \"Invalid variable ID\"}\n";
+        } else if (!parseInteger(line.substr(pos2 + 1), count)) {
+            command.error = "{\"error\": \"Invalid count\"}\n";
+        }
+        command.count = static_cast<size_t>(std::max(count, 0));
+        return true;
+    }
+    if (line == "GET_CONFIG") {
+        command.type = Type::GetConfig;
+        return true;
+    }
+    if (line == "BINARY") {
+        // Переход соединения на кадры MessagePack
+        command.type = Type::Binary;
+        return true;
+    }
+    if (startsWith(line, "SAVE_CONFIG")) {
+        // Формат: SAVE_CONFIG [filename]
+        command.type = Type::SaveConfig;
+        auto pos = line.find(' ');
+        if (pos != std::string_view::npos) {
+            command.argument = line.substr(pos + 1);
+        }
+        return true;
+    }
+    return false;
+}
+
+template <typename Stream>
+void DataServer::writeJsonResponse(Stream& stream, const json& request, ClientAuth& auth) {
+    // Большие ответы сериализуются в буферы пула и передаются по мере заполнения:
+    // блокирующая запись в сокет ограничивает скорость сериализации скоростью клиента
+    if (isStreamedRequest(request)) {
+        bool started = false;
+        JsonChunkWriter writer([&stream, &started](std::string_view chunk) {
+            started = true;
+            write(stream, boost::asio::buffer(chunk.data(), chunk.size()));
+        }, responseBuffers);
+        try {
+            writeStreamedResponse(request, writer);
+        } catch (const std::exception& e) {
+            if (started) throw;
+            json error = {{"status", "error"}, {"message", e.what()}};
+            writeText(stream, error.dump() + "\n");
+            return;
+        }
+        writer.raw("\n");
+        writer.flush();
+        return;
+    }
+    
+    // JSON запрос
+    writeText(stream, handleClientRequest(request, auth).dump() + "\n");
+}
+
+void DataServer::handleTcpClient(ip::tcp::socket socket, std::string_view prefetched) {
+    try {
+        setWriteDeadline(socket);
+        
+        // Строка запроса читается в буфер на стеке потока соединения: ожидание данных
+        // от клиента не занимает буферы пула
+        std::array<char, 16 * 1024> requestBuffer;
+        
+        // Байты, уже прочитанные сетевым циклом io_uring, обрабатываются первыми
+        const bool prefetchFits = prefetched.size() <= requestBuffer.size();
+        size_t received = 0;
+        const char* newline = nullptr;
+        if (prefetchFits && !prefetched.empty()) {
+            std::memcpy(requestBuffer.data(), prefetched.data(), prefetched.size());
+            received = prefetched.size();
+            newline = static_cast<const char*>(std::memchr(requestBuffer.data(), '\n', received));
+        }
+        while (prefetchFits && !newline && received < requestBuffer.size()) {
+            size_t n = socket.read_some(boost::asio::buffer(requestBuffer.data() + received,
+                                                            requestBuffer.size() - received));
+            newline = static_cast<const char*>(std::memchr(requestBuffer.data() + received, '\n', n));
+            received += n;
+        }
+        
+        std::string_view request;
+        std::string_view rest; // Байты, прочитанные после строки запроса
+        std::string longRequest;
+        if (newline) {
+            request = std::string_view(requestBuffer.data(), static_cast<size_t>(newline - requestBuffer.data()));
+            rest = std::string_view(newline + 1, received - request.size() - 1);
+        } else {
+            // Запрос длиннее буфера (например, update_config с большой конфигурацией)
+            if (prefetchFits) {
+                longRequest.assign(requestBuffer.data(), received);
+            } else {
+                longRequest.assign(prefetched.data(), prefetched.size());
+            }
+            boost::system::error_code error;
+            size_t length = read_until(socket, boost::asio::dynamic_buffer(longRequest, MAX_REQUEST_LINE), '\n', error);
+            if (error) {
+                if (error == boost::asio::error::not_found) {
+                    LOG_WARNING("TCP client closed: request line exceeds " + std::to_string(MAX_REQUEST_LINE) + " bytes");
+                }
+                return;
+            }
+            request = std::string_view(longRequest.data(), length - 1);
+            rest = std::string_view(longRequest).substr(length);
+        }
+        
+        // HTTP-запрос на обновление до WebSocket
+        if (startsWith(request, "GET ") && websocketEnabled()) {
+            std::string initial = newline ? std::string(requestBuffer.data(), received) : std::move(longRequest);
+            handleWebSocket(std::move(socket), initial);
+            return;
+        }
+        
+        TextCommand command;
+        if (TextCommand::parse(request, command)) {
+            if (command.type == TextCommand::Type::Binary) {
+                handleBinarySession(std::move(socket), std::string(rest));
+                return;
+            }
+            // Арена команды - один буфер пула, занятый только на время ответа; при исчерпании
+            // пула соединение завершается ошибкой без долгого ожидания. Без выделений памяти
+            // в куче обрабатываются команды с числовыми значениями: строки длиннее SSO
+            // и значения-объекты json копируются в куче
+            BufferPool::Lease arenaLease = requestArenas.acquire(std::chrono::milliseconds(100));
+            std::pmr::monotonic_buffer_resource arena(arenaLease.data(), arenaLease.size());
+            handleTextCommand(command, socket, arena);
+            return;
+        }
+        
+        json requestJson;
+        try {
+            requestJson = json::parse(request);
+        } catch (const json::parse_error&) {
+            return; // Неизвестная команда
+        }
+        
+        if (!requestJson.empty()) {
+            ClientAuth auth = plaintextAuth();
+            writeJsonResponse(socket, requestJson, auth);
+        }
+        
+    } catch (const std::exception& e) {
+        LOG_ERROR("TCP client handling error: " + std::string(e.what()));
+    }
+}
+
+void DataServer::handleTextCommand(const TextCommand& command, ip::tcp::socket& socket,
+                                   std::pmr::memory_resource& arena) {
+    if (command.error) {
+        writeText(socket, command.error);
+        return;
+    }
+    
+    switch (command.type) {
+        case TextCommand::Type::Subscribe:
+            if (dataCache.idExists(command.variableId)) {
+                // Сокет будет использоваться для push-уведомлений
+                subscriptionManager.addSubscriber(command.variableId, std::move(socket));
+            } else {
+                writeText(socket, "{\"error\": \"Unknown variable ID\"}\n");
             }
-        });
+            return;
+        case TextCommand::Type::SaveConfig:
+            if (!plaintextWrites) {
+                LOG_WARNING("Write request denied: SAVE_CONFIG");
+                writeText(socket, writeDeniedText);
+                return;
+            }
+            saveConfig(std::string(command.argument));
+            writeText(socket, "{\"status\": \"success\", \"message\": \"Configuration saved\"}\n");
+            return;
+        default:
+            break;
     }
     
-    // Поток для проверки обновления конфигурации
-    pollingThreads.emplace_back([this]() {
-        while (running) {
-            checkConfigUpdate();
-            std::this_thread::sleep_for(std::chrono::seconds(5));
+    JsonChunkWriter writer([&socket](std::string_view chunk) {
+        write(socket, boost::asio::buffer(chunk.data(), chunk.size()));
+    }, responseBuffers);
+    writeTextResponse(command, writer, arena);
+}
+
+void DataServer::writeTextResponse(const TextCommand& command, JsonChunkWriter& writer,
+                                   std::pmr::memory_resource& arena) {
+    if (command.type == TextCommand::Type::GetAll) {
+        writeAllValues(writer);
+    } else if (command.type == TextCommand::Type::GetHistory) {
+        // Копия истории размещается на арене соединения
+        std::pmr::vector<HistoricalValue> samples(&arena);
+        dataCache.copyHistory(command.variableId, command.count, samples);
+        writeHistory(samples.data(), samples.size(), writer);
+    } else {
+        writer.value(*configView(), 4);
+    }
+    writer.raw("\n");
+    writer.flush();
+}
+
+namespace {
+
+// Сопоставление имени с шаблоном: * - любая последовательность, ? - один символ
+bool globMatch(std::string_view pattern, std::string_view name) {
+    size_t p = 0, n = 0;
+    size_t starPattern = std::string_view::npos, starName = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++p;
+            ++n;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            starPattern = p++;
+            starName = n;
+        } else if (starPattern != std::string_view::npos) {
+            p = starPattern + 1;
+            n = ++starName;
+        } else {
+            return false;
         }
-    });
+    }
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
 }
 
-void DataServer::checkConfigUpdate() {
-    auto now = std::chrono::steady_clock::now();
-    if (std::chrono::duration_cast<std::chrono::seconds>(now - lastConfigCheck).count() < 5) {
-        return;
+} // namespace
+
+// Индекс имен тегов
+void TagNameIndex::build(const TagTable& table) {
+    entries.clear();
+    entries.reserve(table.size());
+    for (size_t i = 0; i < table.size(); ++i) {
+        const auto& rec = table.record(i);
+        entries.push_back({std::string(table.name(rec)), rec.id});
+    }
+    std::sort(entries.begin(), entries.end());
+}
+
+void TagNameIndex::update(const TagTable& oldTable, const TagTable& newTable) {
+    // Обе таблицы упорядочены по ID: разница находится одним проходом
+    std::vector<Entry> removed;
+    std::vector<Entry> added;
+    size_t i = 0, j = 0;
+    while (i < oldTable.size() || j < newTable.size()) {
+        const TagRecord* oldRec = i < oldTable.size() ? &oldTable.record(i) : nullptr;
+        const TagRecord* newRec = j < newTable.size() ? &newTable.record(j) : nullptr;
+        if (oldRec && (!newRec || oldRec->id < newRec->id)) {
+            removed.push_back({std::string(oldTable.name(*oldRec)), oldRec->id});
+            ++i;
+        } else if (!oldRec || newRec->id < oldRec->id) {
+            added.push_back({std::string(newTable.name(*newRec)), newRec->id});
+            ++j;
+        } else {
+            if (oldTable.name(*oldRec) != newTable.name(*newRec)) {
+                removed.push_back({std::string(oldTable.name(*oldRec)), oldRec->id});
+                added.push_back({std::string(newTable.name(*newRec)), newRec->id});
+            }
+            ++i;
+            ++j;
+        }
     }
     
-    lastConfigCheck = now;
+    if (!removed.empty()) {
+        std::sort(removed.begin(), removed.end());
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [&removed](const Entry& entry) {
+            return std::binary_search(removed.begin(), removed.end(), entry);
+        }), entries.end());
+    }
+    if (!added.empty()) {
+        std::sort(added.begin(), added.end());
+        const auto middle = static_cast<std::ptrdiff_t>(entries.size());
+        entries.insert(entries.end(), std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+        std::inplace_merge(entries.begin(), entries.begin() + middle, entries.end());
+    }
+}
+
+std::vector<TagNameIndex::Entry>::const_iterator TagNameIndex::lowerBound(std::string_view name) const {
+    return std::lower_bound(entries.begin(), entries.end(), name,
+                            [](const Entry& entry, std::string_view value) { return entry.name < value; });
+}
+
+std::optional<int64_t> TagNameIndex::find(std::string_view name) const {
+    auto it = lowerBound(name);
+    if (it == entries.end() || it->name != name) return std::nullopt;
+    return it->id;
+}
+
+std::vector<const TagNameIndex::Entry*> TagNameIndex::prefix(std::string_view prefix, size_t limit) const {
+    std::vector<const Entry*> result;
+    for (auto it = lowerBound(prefix); it != entries.end() && startsWith(it->name, prefix); ++it) {
+        if (limit > 0 && result.size() == limit) break;
+        result.push_back(&*it);
+    }
+    return result;
+}
+
+std::vector<const TagNameIndex::Entry*> TagNameIndex::match(std::string_view pattern, size_t limit) const {
+    const auto literal = pattern.substr(0, pattern.find_first_of("*?"));
+    if (literal.size() == pattern.size()) {
+        // Шаблон без подстановочных символов - точное имя
+        std::vector<const Entry*> result;
+        for (auto it = lowerBound(pattern); it != entries.end() && it->name == pattern; ++it) {
+            if (limit > 0 && result.size() == limit) break;
+            result.push_back(&*it);
+        }
+        return result;
+    }
     
-    try {
-        std::ifstream f(configFile);
-        if (!f.is_open()) return;
-        
-        json newConfig = json::parse(f);
-        if (newConfig != config) {
-            LOG_INFO("Configuration file changed, reloading...");
-            config = newConfig;
-            restoreIdCounter();
-            generateMissingIds();
-            initializeProtocols();
+    std::vector<const Entry*> result;
+    for (auto it = lowerBound(literal); it != entries.end() && startsWith(it->name, literal); ++it) {
+        if (limit > 0 && result.size() == limit) break;
+        if (globMatch(pattern, it->name)) result.push_back(&*it);
+    }
+    return result;
+}
+
+std::vector<int64_t> DataServer::resolveRequestIds(const json& request) {
+    std::vector<int64_t> ids;
+    if (request.contains("variable_ids")) {
+        ids = request["variable_ids"].get<std::vector<int64_t>>();
+    } else if (request.contains("variable_id")) {
+        ids.push_back(request["variable_id"].get<int64_t>());
+    }
+    
+    if (request.contains("names") || request.contains("pattern")) {
+        // Шаблоны имен разрешаются по индексу имен в порядке имен
+        auto patterns = request.contains("names") ? request["names"].get<std::vector<std::string>>()
+                                                  : std::vector<std::string>{request["pattern"].get<std::string>()};
+        const size_t limit = request.value("limit", size_t{0});
+        std::lock_guard<std::mutex> lock(configMutex);
+        for (const auto& pattern : patterns) {
+            for (const auto* entry : nameIndex.match(pattern, limit)) ids.push_back(entry->id);
         }
-    } catch (const std::exception& e) {
-        LOG_ERROR("Error checking config update: " + std::string(e.what()));
+    } else if (ids.empty()) {
+        throw std::invalid_argument("variable_ids, names or pattern is required");
     }
+    
+    // Повторы убираются с сохранением порядка запроса
+    std::unordered_set<int64_t, Int64Hash> seen;
+    ids.erase(std::remove_if(ids.begin(), ids.end(),
+                             [&seen](int64_t id) { return !seen.insert(id).second; }),
+              ids.end());
+    return ids;
 }
 
-void DataServer::startTcpServer() {
-    io_service service;
-    ip::tcp::acceptor acceptor(service, ip::tcp::endpoint(ip::tcp::v4(), 8080));
+bool DataServer::isBatchRequest(const json& request) const {
+    if (!request.contains("action") || !request["action"].is_string()) return false;
+    const auto& action = request["action"].get_ref<const std::string&>();
+    return action == "get_values" || action == "get_values_by_pattern" ||
+           (action == "get_history" && (request.contains("variable_ids") || request.contains("names")));
+}
+
+bool DataServer::isStreamedRequest(const json& request) const {
+    if (!request.contains("action") || !request["action"].is_string()) return false;
+    const auto& action = request["action"].get_ref<const std::string&>();
+    return action == "get_all" || action == "get_config" || action == "get_values" ||
+           action == "get_values_by_pattern" || action == "get_history";
+}
+
+namespace {
+
+// Элемент ответа в формате get_all: "id":{"n":...,"v":...,"t":...,"q":...}
+void writeValueEntry(const NamedValue& item, bool first, JsonChunkWriter& writer) {
+    writer.raw(first ? "\"" : ",\"").number(item.id).raw("\":{\"n\":").string(item.name)
+          .raw(",\"v\":").value(item.value.value)
+          .raw(",\"t\":").number(std::chrono::duration_cast<std::chrono::milliseconds>(
+              item.value.timestamp.time_since_epoch()).count())
+          .raw(",\"q\":").string(item.value.quality)
+          .raw("}");
+}
+
+// Элемент истории в ответе json: сокращенные ключи, как при потоковой записи
+json historyEntry(HistoricalValue& item) {
+    return {
+        {"v", std::move(item.value)},
+        {"t", std::chrono::duration_cast<std::chrono::milliseconds>(item.timestamp.time_since_epoch()).count()},
+        {"q", std::move(item.quality)}
+    };
+}
     
-    LOG_INFO("TCP server started on port 8080");
+} // namespace
+
+void DataServer::writeAllValues(JsonChunkWriter& writer) {
+    // Значения читаются порциями: блокировка кэша не удерживается на время записи в сокет,
+    // а копия в памяти ограничена размером порции
+    constexpr size_t batchSize = 4096;
+    auto ids = dataCache.getIds();
     
-    while (running) {
-        try {
-            ip::tcp::socket socket(service);
-            acceptor.accept(socket);
-            
-            std::thread([this, sock = std::move(socket)]() mutable {
-                handleTcpClient(std::move(sock));
-            }).detach();
-        } catch (const std::exception& e) {
-            LOG_ERROR("TCP server error: " + std::string(e.what()));
+    bool first = true;
+    writer.raw("{");
+    for (size_t offset = 0; offset < ids.size(); offset += batchSize) {
+        std::vector<int64_t> batch(ids.begin() + static_cast<std::ptrdiff_t>(offset),
+                                   ids.begin() + static_cast<std::ptrdiff_t>(std::min(offset + batchSize, ids.size())));
+        for (const auto& item : dataCache.getValues(batch)) {
+            writeValueEntry(item, first, writer);
+            first = false;
         }
     }
+    writer.raw("}");
 }
 
-void DataServer::handleTcpClient(ip::tcp::socket socket) {
-    try {
-        streambuf buffer;
-        read_until(socket, buffer, '\n');
-        std::istream is(&buffer);
-        std::string request;
-        std::getline(is, request);
-        
-        json requestJson;
-        try {
-            requestJson = json::parse(request);
-        } catch (const json::parse_error&) {
-            // Простой текстовый запрос
-            if (request.find("SUBSCRIBE") == 0) {
-                // Формат: SUBSCRIBE variable_id
-                auto pos = request.find(' ');
-                if (pos != std::string::npos) {
-                    std::string varIdStr = request.substr(pos + 1);
-                    try {
-                        int64_t varId = std::stoll(varIdStr);
-                        if (dataCache.idExists(varId)) {
-                            subscriptionManager.addSubscriber(varId, std::move(socket));
-                            return; // Сокет будет использоваться для push-уведомлений
-                        } else {
-                            std::string response = "{\"error\": \"Unknown variable ID\"}\n";
-                            write(socket, boost::asio::buffer(response));
-                        }
-                    } catch (const std::exception& e) {
-                        std::string response = "{\"error\": \"Invalid variable ID format\"}\n";
-                        write(socket, boost::asio::buffer(response));
-                    }
-                }
-            } else if (request == "GET_ALL") {
-                auto data = dataCache.getAllCurrentValues();
-                std::string response = data.dump() + "\n";
-                write(socket, boost::asio::buffer(response));
-            } else if (request.find("GET_HISTORY") == 0) {
-                // Формат: GET_HISTORY variable_id count
-                auto pos1 = request.find(' ');
-                auto pos2 = request.find(' ', pos1 + 1);
-                if (pos1 != std::string::npos && pos2 != std::string::npos) {
-                    std::string varIdStr = request.substr(pos1 + 1, pos2 - pos1 - 1);
-                    int count = std::stoi(request.substr(pos2 + 1));
-                    try {
-                        int64_t varId = std::stoll(varIdStr);
-                        auto history = dataCache.getHistory(varId, count);
-                        json historyJson = json::array();
-                        for (const auto& item : history) {
-                            historyJson.push_back({
-                                {"v", item.value}, // Сокращенные ключи
-                                {"t", std::chrono::duration_cast<std::chrono::milliseconds>(
-                                    item.timestamp.time_since_epoch()).count()},
-                                {"q", item.quality}
-                            });
-                        }
-                        std::string response = historyJson.dump() + "\n";
-                        write(socket, boost::asio::buffer(response));
-                    } catch (const std::exception& e) {
-                        std::string response = "{\"error\": \"Invalid variable ID\"}\n";
-                        write(socket, boost::asio::buffer(response));
-                    }
-                }
-            } else if (request == "GET_CONFIG") {
-                std::string response = config.dump(4) + "\n";
-                write(socket, boost::asio::buffer(response));
-            } else if (request.find("SAVE_CONFIG") == 0) {
-                // Формат: SAVE_CONFIG [filename]
-                auto pos = request.find(' ');
-                std::string filename;
-                if (pos != std::string::npos) {
-                    filename = request.substr(pos + 1);
-                }
-                saveConfig(filename);
-                std::string response = "{\"status\": \"success\", \"message\": \"Configuration saved\"}\n";
-                write(socket, boost::asio::buffer(response));
-            }
+void DataServer::writeHistory(const HistoricalValue* samples, size_t count, JsonChunkWriter& writer) {
+    writer.raw("[");
+    for (size_t i = 0; i < count; ++i) {
+        const auto& item = samples[i];
+        writer.raw(i > 0 ? ",{\"v\":" : "{\"v\":").value(item.value)
+              .raw(",\"t\":").number(std::chrono::duration_cast<std::chrono::milliseconds>(
+                  item.timestamp.time_since_epoch()).count())
+              .raw(",\"q\":").string(item.quality)
+              .raw("}");
+    }
+    writer.raw("]");
+}
+
+void DataServer::writeStreamedResponse(const json& request, JsonChunkWriter& writer) {
+    const auto& action = request["action"].get_ref<const std::string&>();
+    
+    if (action == "get_all") {
+        writeAllValues(writer);
+        return;
+    }
+    if (action == "get_config") {
+        // Общая копия конфигурации: память запроса не зависит от ее размера
+        writer.value(*configView(), request.value("indent", -1));
+        return;
+    }
+    if (!isBatchRequest(request)) {
+        // get_history по одному variable_id: массив значений
+        auto samples = dataCache.getHistory(request.at("variable_id").get<int64_t>(),
+                                              request.value("count", size_t{10}));
+        writeHistory(samples.data(), samples.size(), writer);
+        return;
+    }
+    
+    // Разбор запроса до начала записи: ошибка не оставляет частичного ответа
+    auto ids = resolveRequestIds(request);
+    
+    bool first = true;
+    writer.raw("{");
+    if (action != "get_history") {
+        for (const auto& item : dataCache.getValues(ids)) {
+            writeValueEntry(item, first, writer);
+            first = false;
         }
-        
-        // JSON запрос
-        if (!requestJson.empty()) {
-            json response = handleJsonRequest(requestJson);
-            std::string responseStr = response.dump() + "\n";
-            write(socket, boost::asio::buffer(responseStr));
+    } else {
+        const size_t count = request.value("count", size_t{10});
+        for (const auto& [id, samples] : dataCache.getHistories(ids, count)) {
+            writer.raw(first ? "\"" : ",\"").number(id).raw("\":");
+            writeHistory(samples.data(), samples.size(), writer);
+            first = false;
         }
-        
-    } catch (const std::exception& e) {
-        LOG_ERROR("TCP client handling error: " + std::string(e.what()));
     }
+    writer.raw("}");
 }
 
 json DataServer::handleJsonRequest(const json& request) {
@@ -592,9 +6909,33 @@ json DataServer::handleJsonRequest(const json& request) {
         
         if (action == "get_all") {
             response = dataCache.getAllCurrentValues();
+        } else if (isBatchRequest(request)) {
+            // Пакетные get_values и get_history: ответ по ID переменных строится сразу в json,
+            // без сериализации и повторного разбора
+            try {
+                auto ids = resolveRequestIds(request);
+                response = json::object();
+                if (action != "get_history") {
+                    for (auto& item : dataCache.getValues(ids)) {
+                        json entry = historyEntry(item.value);
+                        entry["n"] = std::move(item.name);
+                        response[std::to_string(item.id)] = std::move(entry);
+                    }
+                } else {
+                    for (auto& [id, samples] : dataCache.getHistories(ids, request.value("count", size_t{10}))) {
+                        json entries = json::array();
+                        for (auto& item : samples) {
+                            entries.push_back(historyEntry(item));
+                        }
+                        response[std::to_string(id)] = std::move(entries);
+                    }
+                }
+            } catch (const std::exception& e) {
+                response = {{"status", "error"}, {"message", e.what()}};
+            }
         } else if (action == "get_history") {
             int64_t variableId = request["variable_id"];
-            int count = request.value("count", 10);
+            const size_t count = request.value("count", size_t{10});
             auto history = dataCache.getHistory(variableId, count);
             response = json::array();
             for (const auto& item : history) {
@@ -605,8 +6946,54 @@ json DataServer::handleJsonRequest(const json& request) {
                     {"q", item.quality}
                 });
             }
+        } else if (action == "aggregate_history") {
+            // Агрегаты по интервалам bucket_ms для нескольких переменных, ответ по столбцам
+            try {
+                auto ids = resolveRequestIds(request);
+                int64_t bucketMs = request.at("bucket_ms").get<int64_t>();
+                if (bucketMs <= 0) {
+                    throw std::invalid_argument("bucket_ms must be positive");
+                }
+                int64_t from = request.value("from", INT64_MIN);
+                int64_t to = request.value("to", INT64_MAX);
+                std::vector<std::string> functions = request.value("functions",
+                    std::vector<std::string>{"min", "max", "avg", "first", "last"});
+                
+                response = json::object();
+                for (int64_t id : ids) {
+                    auto buckets = HistoryAggregator::aggregate(dataCache.getNumericHistory(id, from, to), bucketMs);
+                    json columns = {{"t", buckets.start}, {"n", buckets.count}};
+                    for (const auto& function : functions) {
+                        if (function == "min") columns["min"] = buckets.min;
+                        else if (function == "max") columns["max"] = buckets.max;
+                        else if (function == "avg") columns["avg"] = buckets.avg;
+                        else if (function == "first") columns["first"] = buckets.first;
+                        else if (function == "last") columns["last"] = buckets.last;
+                        else throw std::invalid_argument("Unknown aggregate function: " + function);
+                    }
+                    response[std::to_string(id)] = std::move(columns);
+                }
+            } catch (const std::exception& e) {
+                response = {{"status", "error"}, {"message", e.what()}};
+            }
+        } else if (action == "downsample_history") {
+            // Прореживание LTTB до points точек для нескольких переменных
+            try {
+                auto ids = resolveRequestIds(request);
+                size_t points = request.at("points").get<size_t>();
+                int64_t from = request.value("from", INT64_MIN);
+                int64_t to = request.value("to", INT64_MAX);
+                
+                response = json::object();
+                for (int64_t id : ids) {
+                    auto series = HistoryAggregator::downsample(dataCache.getNumericHistory(id, from, to), points);
+                    response[std::to_string(id)] = {{"t", series.timestamps}, {"v", series.values}};
+                }
+            } catch (const std::exception& e) {
+                response = {{"status", "error"}, {"message", e.what()}};
+            }
         } else if (action == "get_config") {
-            response = config;
+            response = *configView();
         } else if (action == "save_config") {
             try {
                 std::string filename = request.value("filename", "");
@@ -618,25 +7005,99 @@ json DataServer::handleJsonRequest(const json& request) {
         } else if (action == "update_config") {
             try {
                 json newConfig = request["config"];
-                config = newConfig;
-                restoreIdCounter();
-                generateMissingIds();
-                initializeProtocols();
+                applyConfigChanges(std::move(newConfig));
                 saveConfig();
                 response = {{"status", "success"}, {"message", "Configuration updated and saved"}};
             } catch (const std::exception& e) {
                 response = {{"status", "error"}, {"message", e.what()}};
             }
+        } else if (action == "get_device_metrics") {
+            // Метрики политики опроса по устройствам
+            std::lock_guard<std::mutex> lock(configMutex);
+            response = json::object();
+            for (const auto& [proto, poller] : protocols) {
+                response[proto] = poller->metrics();
+            }
+        } else if (action == "get_qos_metrics") {
+            // Задержка опроса по полосам устройств и доставки подписчикам по классам
+            std::lock_guard<std::mutex> lock(configMutex);
+            json devices = json::object();
+            for (const auto& [proto, poller] : protocols) {
+                devices[proto] = poller->metrics()["lanes"];
+            }
+            response = {{"polling", std::move(devices)}, {"push", subscriptionManager.qosMetrics()}};
+        } else if (action == "get_subscriber_metrics") {
+            // Подписчики TCP и отправка закодированных один раз сообщений
+            response = subscriptionManager.sendMetrics();
+            response["subscribers"] = subscriptionManager.subscriberCount();
+        } else if (action == "get_network_metrics") {
+            // Сетевой цикл TCP-сервера: asio или io_uring с числом вызовов io_uring_enter
+            response = {{"backend", "asio"}};
+#ifdef HAVE_IO_URING
+            std::lock_guard<std::mutex> lock(uringMutex);
+            if (uringServer) response = uringServer->metrics();
+#endif
+            response["port"] = tcpPort();
+            std::lock_guard<std::mutex> tlsLock(tlsMutex);
+            if (tlsServer) response["tls"] = tlsServer->metrics();
+        } else if (action == "get_derived_status") {
+            // Вычисляемые переменные и ошибки компиляции их выражений
+            std::lock_guard<std::mutex> lock(configMutex);
+            response = {{"tags", 0}, {"evaluations", 0}, {"errors", json::object()}};
+            if (derivedTags) {
+                response["tags"] = derivedTags->tagCount();
+                response["evaluations"] = derivedTags->evaluationCount();
+                response["errors"] = derivedTags->errors();
+            }
+        } else if (action == "get_alarms") {
+            response = alarmEngine.activeAlarms();
+        } else if (action == "ack_alarm") {
+            bool acknowledged = alarmEngine.acknowledge(request.value("rule", ""));
+            response = {{"status", acknowledged ? "success" : "error"}};
+            if (!acknowledged) response["message"] = "Alarm not found or already acknowledged";
+        } else if (action == "get_alarm_events") {
+            // Поток событий: клиент передает номер последнего полученного события;
+            // wait_ms - ожидание новых событий (long polling), не более 30 с
+            auto waitMs = std::clamp<int64_t>(request.value("wait_ms", int64_t(0)), 0, 30000);
+            auto events = alarmEngine.eventsSince(request.value("since", uint64_t(0)),
+                                                  request.value("limit", size_t(1000)),
+                                                  std::chrono::milliseconds(waitMs));
+            json items = json::array();
+            for (const auto& event : events) items.push_back(event.toJson());
+            response = {{"last", alarmEngine.lastSequence()}, {"events", std::move(items)}};
+        } else if (action == "get_export_status") {
+            response = exporter ? exporter->metrics() : json{{"enabled", false}};
+        } else if (action == "resolve") {
+            // Имена -> ID по индексу имен: точные имена (names), префикс (prefix) или шаблон (pattern)
+            try {
+                const size_t limit = request.value("limit", size_t{0});
+                std::lock_guard<std::mutex> lock(configMutex);
+                response = json::object();
+                if (request.contains("names")) {
+                    for (const auto& name : request["names"].get<std::vector<std::string>>()) {
+                        auto id = nameIndex.find(name);
+                        response[name] = id ? json(*id) : json();
+                    }
+                } else if (request.contains("prefix") || request.contains("pattern")) {
+                    auto entries = request.contains("prefix")
+                        ? nameIndex.prefix(request["prefix"].get<std::string>(), limit)
+                        : nameIndex.match(request["pattern"].get<std::string>(), limit);
+                    // Повторяющееся имя - наименьший ID, как при точном поиске
+                    for (const auto* entry : entries) response.emplace(entry->name, entry->id);
+                } else {
+                    response = {{"status", "error"}, {"message", "names, prefix or pattern is required"}};
+                }
+            } catch (const std::exception& e) {
+                response = {{"status", "error"}, {"message", e.what()}};
+            }
         } else if (action == "get_id_map") {
             // Возвращает маппинг ID -> имя для всех переменных
-            json idMap;
-            for (auto& [proto, proto_config] : config.items()) {
-                if (proto_config.contains("variables")) {
-                    for (auto& [key, var] : proto_config["variables"].items()) {
-                        int64_t id = var["id"];
-                        std::string name = var["name"];
-                        idMap[std::to_string(id)] = name;
-                    }
+            std::lock_guard<std::mutex> lock(configMutex);
+            json idMap = json::object();
+            if (tagTable) {
+                for (size_t i = 0; i < tagTable->size(); ++i) {
+                    const auto& rec = tagTable->record(i);
+                    idMap[std::to_string(rec.id)] = tagTable->name(rec);
                 }
             }
             response = idMap;
@@ -646,12 +7107,445 @@ json DataServer::handleJsonRequest(const json& request) {
     return response;
 }
 
+// WebSocket
+void DataServer::setWriteDeadline(ip::tcp::socket& socket) {
+    // Ядро разрывает соединение, если переданные данные не подтверждаются дольше таймаута,
+    // в том числе при нулевом окне приема клиента; 0 - системный таймаут
+    const auto timeout = static_cast<unsigned int>(writeTimeoutMs.load());
+    if (::setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout, sizeof(timeout)) != 0) {
+        LOG_WARNING("TCP_USER_TIMEOUT is not supported: " + std::string(std::strerror(errno)));
+    }
+}
+
+bool DataServer::websocketEnabled() {
+    std::lock_guard<std::mutex> lock(configMutex);
+    if (!config.contains("server_settings") || !config["server_settings"].contains("websocket")) {
+        return true;
+    }
+    return config["server_settings"]["websocket"].value("enabled", true);
+}
+
+void DataServer::handleBinarySession(ip::tcp::socket socket, std::string received) {
+    ClientAuth auth = plaintextAuth();
+    runBinarySession(socket, std::move(received), auth);
+}
+
+template <typename Stream>
+void DataServer::runBinarySession(Stream& stream, std::string received, ClientAuth& auth,
+                                  TlsServer::Deadline* idle) {
+    // Кадр: длина полезной нагрузки (4 байта, big-endian) и запрос или ответ в MessagePack.
+    // Подтверждение - текстом: клиент определяет поддержку кадров по первой строке ответа
+    constexpr size_t maxFrame = 64 * 1024 * 1024;
+    writeText(stream, "{\"status\": \"success\", \"encoding\": \"msgpack\"}\n");
+    stream.lowest_layer().set_option(ip::tcp::no_delay(true));
+    
+    std::vector<uint8_t> responses;
+    std::vector<char> chunk(65536);
+    while (true) {
+        // Все полные кадры буфера обрабатываются до чтения: ответы конвейера - одной записью
+        size_t offset = 0;
+        while (received.size() - offset >= 4) {
+            const auto* header = reinterpret_cast<const uint8_t*>(received.data() + offset);
+            const size_t length = (size_t{header[0]} << 24) | (size_t{header[1]} << 16) |
+                                  (size_t{header[2]} << 8) | size_t{header[3]};
+            if (length > maxFrame) {
+                LOG_WARNING("Binary session closed: frame of " + std::to_string(length) + " bytes");
+                return;
+            }
+            if (received.size() - offset - 4 < length) break;
+            
+            json response;
+            try {
+                const auto* payload = header + 4;
+                response = handleClientRequest(json::from_msgpack(payload, payload + length), auth);
+            } catch (const std::exception& e) {
+                response = {{"status", "error"}, {"message", e.what()}};
+            }
+            const size_t start = responses.size();
+            responses.resize(start + 4);
+            json::to_msgpack(response, responses);
+            const auto size = static_cast<uint32_t>(responses.size() - start - 4);
+            responses[start] = static_cast<uint8_t>(size >> 24);
+            responses[start + 1] = static_cast<uint8_t>(size >> 16);
+            responses[start + 2] = static_cast<uint8_t>(size >> 8);
+            responses[start + 3] = static_cast<uint8_t>(size);
+            offset += 4 + length;
+        }
+        received.erase(0, offset);
+        if (!responses.empty()) {
+            write(stream, boost::asio::buffer(responses));
+            responses.clear();
+        }
+        
+        boost::system::error_code error;
+        if (idle) idle->expireAfter(tlsServer->idleTimeout());
+        size_t n = stream.read_some(boost::asio::buffer(chunk), error);
+        if (idle) idle->cancel();
+        if (error) return; // Клиент закрыл соединение или истек срок ожидания
+        received.append(chunk.data(), n);
+    }
+}
+
+void DataServer::handleTlsClient(TlsServer::Stream& stream, ClientAuth& auth, TlsServer::Deadline& idle) {
+    setWriteDeadline(stream.next_layer());
+    std::string buffer;
+    while (true) {
+        boost::system::error_code error;
+        idle.expireAfter(tlsServer->idleTimeout());
+        const size_t length = read_until(stream, boost::asio::dynamic_buffer(buffer, MAX_REQUEST_LINE), '\n', error);
+        idle.cancel();
+        if (error == boost::asio::error::not_found) {
+            LOG_WARNING("TLS client closed: request line exceeds " + std::to_string(MAX_REQUEST_LINE) + " bytes");
+        }
+        if (error) return; // Клиент закрыл соединение, истек срок ожидания или строка слишком длинная
+        std::string_view request(buffer.data(), length - 1);
+        if (!request.empty() && request.back() == '\r') request.remove_suffix(1);
+        
+        TextCommand command;
+        if (startsWith(request, "AUTH ")) {
+            // Право записи на все последующие запросы соединения
+            const bool granted = tlsServer->authorize(request.substr(5), auth);
+            if (!granted) tlsServer->recordDenied();
+            writeText(stream, granted ? "{\"status\": \"success\"}\n"
+                                      : "{\"status\": \"error\", \"message\": \"Invalid token\"}\n");
+        } else if (TextCommand::parse(request, command)) {
+            if (command.error) {
+                writeText(stream, command.error);
+            } else if (command.type == TextCommand::Type::Binary) {
+                runBinarySession(stream, buffer.substr(length), auth, &idle);
+                return;
+            } else if (command.type == TextCommand::Type::Subscribe) {
+                if (dataCache.idExists(command.variableId)) {
+                    streamTlsSubscription(stream, command.variableId);
+                    return;
+                }
+                writeText(stream, "{\"error\": \"Unknown variable ID\"}\n");
+            } else if (command.type == TextCommand::Type::SaveConfig) {
+                if (auth.write) {
+                    saveConfig(std::string(command.argument));
+                    writeText(stream, "{\"status\": \"success\", \"message\": \"Configuration saved\"}\n");
+                } else {
+                    tlsServer->recordDenied();
+                    LOG_WARNING("Write request denied: SAVE_CONFIG");
+                    writeText(stream, writeDeniedText);
+                }
+            } else {
+                std::pmr::monotonic_buffer_resource arena;
+                JsonChunkWriter writer([&stream](std::string_view chunk) {
+                    write(stream, boost::asio::buffer(chunk.data(), chunk.size()));
+                }, responseBuffers);
+                writeTextResponse(command, writer, arena);
+            }
+        } else {
+            json requestJson = json::parse(request, nullptr, false);
+            if (requestJson.is_discarded()) return; // Неизвестная команда
+            if (!requestJson.empty()) writeJsonResponse(stream, requestJson, auth);
+        }
+        buffer.erase(0, length);
+    }
+}
+
+void DataServer::streamTlsSubscription(TlsServer::Stream& stream, int64_t variableId) {
+    // Формат обновлений - как у подписчиков открытого порта. Поток TLS не допускает
+    // записи из нескольких потоков, поэтому кольцо читает поток соединения
+    auto subscription = subscriptionManager.createSubscription();
+    subscription->add(variableId);
+    JsonChunkWriter writer([&stream](std::string_view chunk) {
+        write(stream, boost::asio::buffer(chunk.data(), chunk.size()));
+    }, 16 * 1024);
+    LOG_INFO("New TLS subscription for variable ID: " + std::to_string(variableId));
+    
+    while (tlsServer->isRunning()) {
+        auto result = subscription->poll([&writer, &subscription](const ValueUpdate& update, const std::string& name) {
+            writer.raw("{\"i\":").number(update.id)
+                  .raw(",\"n\":").string(name)
+                  .raw(",\"t\":").number(update.timestampMs)
+                  .raw(",\"type\":\"data_update\",\"v\":").value(subscription->value(update))
+                  .raw("}\n");
+        });
+        if (result == Subscription::PollResult::Idle) {
+            subscription->wait(std::chrono::milliseconds(100));
+            continue;
+        }
+        if (result == Subscription::PollResult::Resync) {
+            LOG_WARNING("TLS subscriber lagged behind, resynchronizing");
+            for (const auto& item : dataCache.getValues(subscription->ids())) {
+                writer.raw("{\"i\":").number(item.id)
+                      .raw(",\"n\":").string(item.name)
+                      .raw(",\"q\":").string(item.value.quality)
+                      .raw(",\"t\":").number(std::chrono::duration_cast<std::chrono::milliseconds>(
+                          item.value.timestamp.time_since_epoch()).count())
+                      .raw(",\"type\":\"resync\",\"v\":").value(item.value.value)
+                      .raw("}\n");
+            }
+        }
+        writer.flush();
+    }
+}
+
+void DataServer::handleWebSocket(ip::tcp::socket socket, std::string_view received) {
+    WebSocketSession::Settings settings;
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        if (config.contains("server_settings") && config["server_settings"].contains("websocket")) {
+            const auto& ws = config["server_settings"]["websocket"];
+            settings.permessageDeflate = ws.value("permessage_deflate", settings.permessageDeflate);
+            settings.batchInterval = std::chrono::milliseconds(
+                std::max(1, ws.value("batch_interval_ms", static_cast<int>(settings.batchInterval.count()))));
+            settings.maxQueuedFrames = ws.value("max_queued_frames", settings.maxQueuedFrames);
+        }
+    }
+    
+    // Сокет переносится в io_context сессии: асинхронные операции выполняет поток соединения
+    const auto protocol = socket.local_endpoint().protocol();
+    WebSocketSession session(*this, socket.release(), protocol, settings);
+    session.run(received);
+}
+
+WebSocketSession::WebSocketSession(DataServer& server, ip::tcp::socket::native_handle_type handle,
+                                   const ip::tcp::socket::protocol_type& protocol, Settings settings)
+    : server(server), settings(settings), ws(ip::tcp::socket(io, protocol, handle)), timer(io),
+      subscription(server.subscriptionManager.createSubscription()) {}
+
+void WebSocketSession::run(std::string_view received) {
+    namespace beast = boost::beast;
+    namespace http = boost::beast::http;
+    namespace websocket = boost::beast::websocket;
+    
+    try {
+        beast::flat_buffer buffer;
+        auto prepared = buffer.prepare(received.size());
+        buffer.commit(boost::asio::buffer_copy(prepared, boost::asio::buffer(received.data(), received.size())));
+        
+        http::request<http::string_body> request;
+        http::read(ws.next_layer(), buffer, request);
+        if (!websocket::is_upgrade(request)) {
+            http::response<http::string_body> response{http::status::upgrade_required, request.version()};
+            response.set(http::field::upgrade, "websocket");
+            response.set(http::field::content_type, "text/plain");
+            response.body() = "WebSocket endpoint\n";
+            response.prepare_payload();
+            http::write(ws.next_layer(), response);
+            return;
+        }
+        
+        websocket::permessage_deflate deflate;
+        deflate.server_enable = settings.permessageDeflate;
+        ws.set_option(deflate);
+        ws.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+        ws.accept(request);
+        ws.text(true);
+        LOG_INFO("WebSocket client connected");
+        
+        doRead();
+        scheduleTick();
+        io.run();
+    } catch (const std::exception& e) {
+        LOG_WARNING("WebSocket session error: " + std::string(e.what()));
+    }
+}
+
+void WebSocketSession::doRead() {
+    ws.async_read(readBuffer, [this](boost::system::error_code ec, std::size_t) {
+        if (ec) {
+            // Закрытие соединения клиентом или ошибка: сессия завершается
+            io.stop();
+            return;
+        }
+        handleMessage(boost::beast::buffers_to_string(readBuffer.data()));
+        readBuffer.consume(readBuffer.size());
+        doRead();
+    });
+}
+
+void WebSocketSession::handleMessage(const std::string& text) {
+    json request = json::parse(text, nullptr, false);
+    if (request.is_discarded() || !request.is_object()) {
+        send(R"({"type":"error","message":"Invalid JSON"})");
+        return;
+    }
+    
+    std::string action;
+    try {
+        // Нестроковое поле action - ошибка запроса, а не исключение в обработчике чтения
+        const auto actionField = request.find("action");
+        if (actionField != request.end()) {
+            if (!actionField->is_string()) throw std::runtime_error("Field 'action' must be a string");
+            action = actionField->get<std::string>();
+        }
+        if (action == "subscribe" || action == "unsubscribe") {
+            auto ids = server.resolveRequestIds(request);
+            for (int64_t id : ids) {
+                if (action == "subscribe") subscription->add(id);
+                else subscription->remove(id);
+            }
+            send(json{{"type", action == "subscribe" ? "subscribed" : "unsubscribed"}, {"variable_ids", ids}}.dump());
+            // Начальное состояние: текущие значения новых подписок
+            if (action == "subscribe") sendValues("snapshot", ids);
+        } else {
+            // Остальные действия - как в JSON-протоколе TCP
+            ClientAuth auth = server.plaintextAuth();
+            send(json{{"type", "response"}, {"action", action}, {"data", server.handleClientRequest(request, auth)}}.dump());
+        }
+    } catch (const std::exception& e) {
+        send(json{{"type", "error"}, {"action", action}, {"message", e.what()}}.dump());
+    }
+}
+
+void WebSocketSession::scheduleTick() {
+    timer.expires_after(settings.batchInterval);
+    timer.async_wait([this](boost::system::error_code ec) {
+        if (ec) return;
+        if (!server.running) {
+            ws.async_close(boost::beast::websocket::close_code::going_away,
+                           [this](boost::system::error_code) { io.stop(); });
+            return;
+        }
+        publishUpdates();
+        scheduleTick();
+    });
+}
+
+void WebSocketSession::publishUpdates() {
+    // Клиент не успевает принимать кадры: кольцо не читается, при отставании будет resync
+    if (outbox.size() >= settings.maxQueuedFrames) return;
+    
+    // Несколько обновлений одного ID за интервал объединяются в последнее значение
+    std::vector<std::pair<ValueUpdate, const std::string*>> batch;
+    std::unordered_map<int64_t, size_t, Int64Hash> positions;
+    auto result = subscription->poll([&batch, &positions](const ValueUpdate& update, const std::string& name) {
+        auto [it, inserted] = positions.emplace(update.id, batch.size());
+        if (inserted) {
+            batch.emplace_back(update, &name);
+        } else {
+            batch[it->second].first = update;
+        }
+    });
+    
+    if (result == Subscription::PollResult::Resync) {
+        LOG_WARNING("WebSocket client lagged behind, resynchronizing");
+        sendValues("resync", subscription->ids());
+        return;
+    }
+    if (batch.empty()) return;
+    
+    // Критичные обновления - отдельный кадр, который ставится в очередь перед
+    // еще не отправленными кадрами; остальные классы - общий кадр в конце очереди
+    auto classes = server.subscriptionManager.qosTable();
+    std::array<std::vector<size_t>, QosClass::Count> lanes;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        auto it = classes->find(batch[i].first.id);
+        lanes[QosClass::index(it != classes->end() ? it->second : QosClass::Normal)].push_back(i);
+    }
+    
+    auto buildFrame = [this, &batch](std::initializer_list<const std::vector<size_t>*> parts) {
+        std::string frame;
+        JsonChunkWriter writer([&frame](std::string_view chunk) { frame.append(chunk.data(), chunk.size()); });
+        writer.raw("{\"type\":\"updates\",\"updates\":[");
+        bool first = true;
+        for (const auto* part : parts) {
+            for (size_t index : *part) {
+                const auto& [update, name] = batch[index];
+                writer.raw(first ? "{\"i\":" : ",{\"i\":").number(update.id)
+                      .raw(",\"n\":").string(*name)
+                      .raw(",\"t\":").number(update.timestampMs)
+                      .raw(",\"v\":").value(subscription->value(update))
+                      .raw("}");
+                first = false;
+            }
+        }
+        writer.raw("]}");
+        writer.flush();
+        return frame;
+    };
+    
+    if (!lanes[QosClass::Critical].empty()) {
+        // Первый кадр очереди может уже передаваться; порядок критичных кадров сохраняется
+        outbox.insert(outbox.begin() + static_cast<std::ptrdiff_t>((writing ? 1u : 0u) + urgentFrames), buildFrame({&lanes[QosClass::Critical]}));
+        ++urgentFrames;
+        if (!writing) doWrite();
+    }
+    if (!lanes[QosClass::Normal].empty() || !lanes[QosClass::Bulk].empty()) {
+        send(buildFrame({&lanes[QosClass::Normal], &lanes[QosClass::Bulk]}));
+    }
+    // Задержка учитывается при постановке кадра в очередь отправки
+    for (size_t lane = 0; lane < QosClass::Count; ++lane) {
+        for (size_t index : lanes[lane]) {
+            server.subscriptionManager.recordPush(static_cast<QosClass::Value>(lane), batch[index].first.timestampMs);
+        }
+    }
+}
+
+void WebSocketSession::sendValues(const char* type, const std::vector<int64_t>& ids) {
+    std::string frame;
+    JsonChunkWriter writer([&frame](std::string_view chunk) { frame.append(chunk.data(), chunk.size()); });
+    writer.raw("{\"type\":").string(type).raw(",\"values\":{");
+    bool first = true;
+    for (const auto& item : server.dataCache.getValues(ids)) {
+        writeValueEntry(item, first, writer);
+        first = false;
+    }
+    writer.raw("}}");
+    writer.flush();
+    send(std::move(frame));
+}
+
+void WebSocketSession::send(std::string frame) {
+    outbox.push_back(std::move(frame));
+    if (!writing) doWrite();
+}
+
+void WebSocketSession::doWrite() {
+    writing = true;
+    if (urgentFrames > 0) --urgentFrames;
+    ws.async_write(boost::asio::buffer(outbox.front()), [this](boost::system::error_code ec, std::size_t) {
+        if (ec) {
+            io.stop();
+            return;
+        }
+        outbox.pop_front();
+        if (outbox.empty()) {
+            writing = false;
+        } else {
+            doWrite();
+        }
+    });
+}
+
 void DataServer::stop() {
     running = false;
+#ifdef HAVE_IO_URING
+    {
+        std::lock_guard<std::mutex> lock(uringMutex);
+        if (uringServer) uringServer->stop();
+    }
+#endif
+    // Остановка ожидает обработчиков TLS-соединений, которые сами берут tlsMutex
+    TlsServer* tls = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(tlsMutex);
+        tls = tlsServer.get();
+    }
+    if (tls) tls->stop();
+    // Прием останавливается первым: после него состояние опроса больше не переключается
+    if (replicationReceiver) replicationReceiver->stop();
+    if (replicationPublisher) replicationPublisher->stop();
     for (auto& thread : pollingThreads) {
         if (thread.joinable()) thread.join();
     }
     pollingThreads.clear();
+    
+    setPollingActive(false);
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        if (derivedTags) derivedTags->stop();
+    }
+    dataCache.setAlarmEngine(nullptr);
+    // Последний неполный пакет экспорта сохраняется в дисковой очереди
+    if (exporter) exporter->stop();
+    
+    // Финальный снимок после остановки опроса
+    writeSnapshot();
 }
 
 
@@ -664,6 +7558,7 @@ int main() {
     
     try {
         DataServer server;
+        server.setTagCacheFile("config.json.tagdb");
         server.loadConfig("config.json");
         server.startPolling();
         
@@ -14,10 +14,30 @@
 // #include "DataServer.h"
 
 #include "../include/psdik.h"
+#include "psdik_client.h"
 
 using namespace testing;
 using json = nlohmann::json;
 
+// Счетчик выделений памяти текущего потока для проверки путей без аллокаций
+namespace {
+thread_local size_t threadAllocations = 0;
+}
+
+void* operator new(std::size_t size) {
+    ++threadAllocations;
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
 // Mock классы для тестирования
 class MockProtocolHandler : public ProtocolHandler {
 public:
@@ -135,6 +155,71 @@ TEST_F(DataCacheTest, HistoryLimit) {
     EXPECT_LE(history.size(), 100); // Должно быть ограничено maxHistorySize
 }
 
+TEST_F(DataCacheTest, RemoveValue) {
+    cache.removeValue(2);
+    
+    EXPECT_FALSE(cache.idExists(2));
+    EXPECT_TRUE(cache.getHistory(2, 10).empty());
+    EXPECT_FALSE(cache.getAllCurrentValues().contains("2"));
+}
+
+TEST_F(DataCacheTest, SnapshotRoundTrip) {
+    const std::string path = "test_cache.snapshot";
+    cache.updateValue(1, "Temperature", 24.0, "good");
+    ASSERT_TRUE(cache.saveSnapshot(path, 10));
+    
+    DataCache restored;
+    EXPECT_EQ(restored.loadSnapshot(path), 3u);
+    
+    auto allValues = restored.getAllCurrentValues();
+    EXPECT_EQ(allValues["1"]["v"], 24.0);
+    EXPECT_EQ(allValues["1"]["q"], "uncertain");
+    EXPECT_EQ(allValues["3"]["v"], 1);
+    
+    auto history = restored.getHistory(1, 10);
+    ASSERT_EQ(history.size(), 2u);
+    EXPECT_EQ(history[0].value, 23.5);
+    EXPECT_EQ(history[1].quality, "good");
+    
+    std::remove(path.c_str());
+}
+
+TEST_F(DataCacheTest, SnapshotFilterAndRemovedValues) {
+    const std::string path = "test_cache.snapshot";
+    ASSERT_TRUE(cache.saveSnapshot(path, 10));
+    
+    // Повторная запись без изменений не выполняется
+    EXPECT_FALSE(cache.saveSnapshot(path, 10));
+    
+    cache.removeValue(2);
+    ASSERT_TRUE(cache.saveSnapshot(path, 10));
+    
+    DataCache restored;
+    EXPECT_EQ(restored.loadSnapshot(path, [](int64_t id) { return id != 3; }), 1u);
+    EXPECT_TRUE(restored.idExists(1));
+    EXPECT_FALSE(restored.idExists(2));
+    EXPECT_FALSE(restored.idExists(3));
+    
+    std::remove(path.c_str());
+}
+
+TEST_F(DataCacheTest, CorruptedSnapshotIgnored) {
+    const std::string path = "test_cache.snapshot";
+    ASSERT_TRUE(cache.saveSnapshot(path, 10));
+    {
+        std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(-1, std::ios::end);
+        f.put('\x7f');
+    }
+    
+    DataCache restored;
+    EXPECT_EQ(restored.loadSnapshot(path), 0u);
+    EXPECT_EQ(restored.loadSnapshot("missing.snapshot"), 0u);
+    EXPECT_TRUE(restored.getAllCurrentValues().empty());
+    
+    std::remove(path.c_str());
+}
+
 TEST_F(DataCacheTest, QualityTracking) {
     cache.updateValue(5, "FaultySensor", json(), "bad");
     
@@ -202,212 +287,2814 @@ TEST_F(ModbusTcpHandlerTest, ConnectionParametersSetting) {
     SUCCEED();
 }
 
-// Интеграционные тесты
-class DataServerIntegrationTest : public Test {
+// Тесты управления подключением
+class ConnectionManagerTest : public Test {
 protected:
-    DataServer server;
-    std::string testConfigFile = "test_config.json";
+    DataCache cache;
+    io_context io;
     
-    void SetUp() override {
-        // Создаем тестовый конфиг
-        createTestConfig();
+    // Свободный порт, на котором никто не слушает
+    unsigned short closedPort() {
+        ip::tcp::acceptor probe(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+        return probe.local_endpoint().port();
     }
     
-    void TearDown() override {
-        // Удаляем тестовый конфиг
-        std::remove(testConfigFile.c_str());
+    json endpoint(unsigned short port) {
+        return {{"host", "127.0.0.1"}, {"port", port}, {"timeout_ms", 500}};
     }
+};
+
+TEST_F(ConnectionManagerTest, BackoffIsCappedWithJitter) {
+    ConnectionManager manager;
+    manager.settings = ConnectionManager::Settings::fromJson(
+        {{"backoff_initial_ms", 100}, {"backoff_max_ms", 1000}, {"backoff_jitter", 0.2}});
     
-    void createTestConfig() {
-        json config = {
-            {"modbus_tcp", {
-                {"connection_parameters", {
-                    {"primary", {
-                        {"host", "localhost"},
-                        {"port", 502},
-                        {"timeout_ms", 100}
-                    }}
-                }},
-                {"variables", {
-                    {"temp1", {
-                        {"id", 1001},
-                        {"name", "Temperature1"},
-                        {"address", 100},
-                        {"type", "float32"},
-                        {"polling_interval_ms", 1000}
-                    }}
-                }},
-                {"polling_interval_ms", 100}
-            }}
-        };
-        
-        std::ofstream f(testConfigFile);
-        f << config.dump(4);
+    for (int i = 0; i < 20; ++i) {
+        auto first = manager.backoffDelay(1).count();
+        EXPECT_GE(first, 80);
+        EXPECT_LE(first, 100);
+        auto capped = manager.backoffDelay(1000).count();
+        EXPECT_GE(capped, 800);
+        EXPECT_LE(capped, 1000);
     }
-};
+    EXPECT_LE(manager.backoffDelay(3).count(), 400);
+    
+    manager.recordFailure();
+    EXPECT_FALSE(manager.attemptDue());
+    manager.recordSuccess();
+    EXPECT_TRUE(manager.attemptDue());
+    EXPECT_EQ(manager.failureCount(), 0);
+}
 
-TEST_F(DataServerIntegrationTest, ConfigLoading) {
-    EXPECT_NO_THROW(server.loadConfig(testConfigFile));
+TEST_F(ConnectionManagerTest, FailsOverToSecondaryAndProbesPrimary) {
+    const unsigned short primaryPort = closedPort();
+    ip::tcp::acceptor secondary(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    
+    ModbusTcpHandler handler(cache, "plc");
+    handler.setConnectionParameters({
+        {"primary", endpoint(primaryPort)},
+        {"secondary", {endpoint(secondary.local_endpoint().port())}},
+        {"probe_interval_ms", 100}
+    });
+    std::vector<bool> events;
+    handler.onConnectionStatusChanged.connect([&events](const std::string& name, bool connected) {
+        EXPECT_EQ(name, "plc");
+        events.push_back(connected);
+    });
+    
+    // Отказ основного адреса сразу запускает резервный, не дожидаясь сдвига stagger
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(handler.connect());
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(200));
+    EXPECT_EQ(handler.activeEndpoint(), 1u);
+    
+    // Основной адрес снова доступен: фоновая проверка переключает обратно без события потери связи
+    ip::tcp::acceptor primary(io, ip::tcp::endpoint(ip::address_v4::loopback(), primaryPort));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    while (handler.activeEndpoint() != 0 && std::chrono::steady_clock::now() < deadline) {
+        handler.checkHealth();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    EXPECT_EQ(handler.activeEndpoint(), 0u);
+    EXPECT_TRUE(handler.isConnected());
+    EXPECT_EQ(events, (std::vector<bool>{true}));
+    handler.disconnect();
+    EXPECT_EQ(events, (std::vector<bool>{true, false}));
 }
 
-TEST_F(DataServerIntegrationTest, ProtocolInitialization) {
-    server.loadConfig(testConfigFile);
-    // После загрузки конфига протоколы должны быть инициализированы
-    SUCCEED(); // В реальной реализации будет проверка состояния
+TEST_F(ConnectionManagerTest, UnreachableEndpointsBackOff) {
+    ModbusTcpHandler handler(cache, "plc");
+    handler.setConnectionParameters({
+        {"primary", endpoint(closedPort())},
+        {"secondary", {endpoint(closedPort())}},
+        {"backoff_initial_ms", 200}
+    });
+    
+    EXPECT_FALSE(handler.connect());
+    // Повторная попытка до истечения задержки не выполняется и не блокирует поток
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(handler.connect());
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(10));
+    EXPECT_FALSE(handler.isConnected());
 }
 
-// Тесты TCP сервера
-class TcpServerTest : public Test {
-protected:
-    boost::asio::io_service io_service;
-    int test_port = 8081;
+// Тесты политики опроса устройств
+class FlakyHandler : public ProtocolHandler {
+public:
+    std::atomic<bool> failing{false};
+    std::atomic<int> latencyMs{0};
+    std::atomic<int> reads{0};
+    bool partialReads = true;
+    // Ключи переменных каждого чтения по порядку
+    std::mutex logMutex;
+    std::vector<std::vector<std::string>> readLog;
     
-    void SetUp() override {
-        // Даем время на освобождение порта
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    FlakyHandler(DataCache& cache) : ProtocolHandler("flaky", cache) {}
+    
+    bool supportsPartialReads() const override { return partialReads; }
+    
+    std::vector<std::vector<std::string>> log() {
+        std::lock_guard<std::mutex> lock(logMutex);
+        return readLog;
     }
-};
-
-TEST_F(TcpServerTest, ConnectionHandling) {
-    // Тестируем базовое подключение
-    using boost::asio::ip::tcp;
     
-    try {
-        tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), test_port));
-        acceptor.close();
-        SUCCEED();
-    } catch (const std::exception& e) {
-        FAIL() << "Failed to handle TCP connection: " << e.what();
+    json readData(const json& variables) override {
+        {
+            std::lock_guard<std::mutex> lock(logMutex);
+            readLog.emplace_back();
+            for (const auto& [key, var] : variables.items()) readLog.back().push_back(key);
+        }
+        ++reads;
+        std::this_thread::sleep_for(std::chrono::milliseconds(latencyMs.load()));
+        for (const auto& [key, var] : variables.items()) {
+            if (failing) {
+                updateData(var["id"], var["name"], json(), "bad");
+            } else {
+                updateData(var["id"], var["name"], 1.0);
+            }
+        }
+        return json::object();
     }
-}
+    
+protected:
+    bool trySpecificConnect(const json&) override { return true; }
+};
 
-// Тесты JSON API
-class JsonApiTest : public Test {
+class DevicePollerPolicyTest : public Test {
 protected:
-    DataServer server;
     DataCache cache;
+    FlakyHandler* handler = nullptr;
+    std::unique_ptr<DevicePoller> poller;
+    // Параметры обработчика, устанавливаемые до первого чтения
+    bool partialReads = true;
+    bool failing = false;
     
-    void SetUp() override {
-        // Добавляем тестовые данные в кэш
-        cache.updateValue(1001, "Temperature", 25.0, "good");
-        cache.updateValue(1002, "Pressure", 101.3, "good");
+    void startPoller(int intervalMs, const json& policy, json variables = json(), const json& qos = json()) {
+        auto flaky = std::make_unique<FlakyHandler>(cache);
+        flaky->setConnectionParameters({{"primary", {{"host", "localhost"}, {"port", 1}}}});
+        flaky->partialReads = partialReads;
+        flaky->failing = failing;
+        handler = flaky.get();
+        if (variables.is_null()) {
+            variables = {
+                {"a", {{"id", 1}, {"name", "A"}}},
+                {"b", {{"id", 2}, {"name", "B"}}}
+            };
+        }
+        poller = std::make_unique<DevicePoller>(std::move(flaky), variables, intervalMs, policy, qos);
+        poller->start();
+    }
+    
+    template <typename Predicate>
+    bool eventually(Predicate predicate, std::chrono::milliseconds timeout = std::chrono::milliseconds(3000)) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!predicate()) {
+            if (std::chrono::steady_clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return true;
+    }
+    
+    void TearDown() override {
+        if (poller) poller->stop();
     }
 };
 
-TEST_F(JsonApiTest, GetAllAction) {
-    json request = {{"action", "get_all"}};
+TEST_F(DevicePollerPolicyTest, BreakerOpensAndRecovers) {
+    startPoller(10, {{"failure_threshold", 3}, {"open_ms", 300}});
+    ASSERT_TRUE(eventually([&]() { return cache.idExists(1); }));
+    EXPECT_EQ(poller->state(), DevicePoller::BreakerState::Closed);
     
-    // В реальной реализации здесь будет вызов handleJsonRequest
-    // auto response = server.handleJsonRequest(request);
-    // EXPECT_TRUE(response.contains("1001"));
-    // EXPECT_TRUE(response.contains("1002"));
-    SUCCEED();
+    handler->failing = true;
+    ASSERT_TRUE(eventually([&]() { return poller->state() == DevicePoller::BreakerState::Open; }));
+    
+    // Разомкнутая цепь: опрос приостановлен, качество тегов выставлено массово
+    const int readsWhenOpened = handler->reads;
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    EXPECT_EQ(handler->reads, readsWhenOpened);
+    EXPECT_EQ(cache.getHistory(2, 1)[0].quality, "bad");
+    
+    auto metrics = poller->metrics();
+    EXPECT_EQ(metrics["state"], "open");
+    EXPECT_EQ(metrics["breaker_opens"], 1);
+    EXPECT_GT(metrics["failed_cycles"].get<int>(), 0);
+    
+    // Устройство восстановилось: пробный цикл замыкает цепь
+    handler->failing = false;
+    ASSERT_TRUE(eventually([&]() { return poller->state() == DevicePoller::BreakerState::Closed; }));
+    EXPECT_EQ(cache.getHistory(1, 1)[0].quality, "good");
+    EXPECT_GT(handler->reads, readsWhenOpened);
 }
 
-TEST_F(JsonApiTest, GetHistoryAction) {
-    json request = {
-        {"action", "get_history"},
-        {"variable_id", 1001},
-        {"count", 5}
+TEST_F(DevicePollerPolicyTest, SlowDeviceStretchesInterval) {
+    startPoller(20, {{"slow_response_ms", 15}, {"max_stretch", 4}});
+    handler->latencyMs = 30;
+    ASSERT_TRUE(eventually([&]() { return poller->metrics()["interval_ms"] == 80; }));
+    EXPECT_EQ(poller->metrics()["base_interval_ms"], 20);
+    EXPECT_EQ(poller->state(), DevicePoller::BreakerState::Closed);
+    
+    handler->latencyMs = 0;
+    EXPECT_TRUE(eventually([&]() { return poller->metrics()["interval_ms"] == 20; }));
+}
+
+TEST_F(DevicePollerPolicyTest, BulkQualityUpdate) {
+    cache.updateValue(1, "A", 1.0, "good");
+    cache.updateValue(2, "B", 2.0, "bad");
+    EXPECT_EQ(cache.setQuality({1, 2, 3}, "bad"), 1u);
+    EXPECT_EQ(cache.getCurrentValue(1), 1.0);
+    EXPECT_EQ(cache.getHistory(1, 1)[0].quality, "bad");
+    EXPECT_EQ(cache.getHistory(1, 10).size(), 2u);
+}
+
+TEST_F(DevicePollerPolicyTest, CriticalLanePreemptsBulkReads) {
+    // Восемь массовых переменных читаются по одной; каждое чтение дольше интервала критичной
+    // полосы, поэтому после любой части массовой срок критичной уже наступил
+    json variables = {{"interlock", {{"id", 1}, {"name", "Interlock"}, {"priority", "critical"}}}};
+    for (int i = 0; i < 8; ++i) {
+        variables["bulk" + std::to_string(i)] = {{"id", 100 + i}, {"name", "Bulk" + std::to_string(i)},
+                                                 {"priority", "bulk"}};
+    }
+    json qos = {
+        {"interval_ms", {{"critical", 20}, {"bulk", 50}}},
+        {"slo_ms", {{"critical", 40}}},
+        {"bulk_chunk", 1}
     };
+    startPoller(1000, {{"slow_response_ms", 1000}}, variables, qos);
+    handler->latencyMs = 30;
+    ASSERT_TRUE(eventually([&]() { return poller->metrics()["lanes"]["bulk"]["samples"].get<int>() >= 1; }));
     
-    // auto response = server.handleJsonRequest(request);
-    // EXPECT_TRUE(response.is_array());
-    SUCCEED();
+    auto lanes = poller->metrics()["lanes"];
+    EXPECT_FALSE(lanes.contains("normal"));
+    EXPECT_EQ(lanes["critical"]["variables"], 1);
+    EXPECT_EQ(lanes["bulk"]["variables"], 8);
+    EXPECT_EQ(lanes["critical"]["interval_ms"], 20);
+    EXPECT_EQ(lanes["critical"]["slo_ms"], 40.0);
+    EXPECT_GE(lanes["bulk"]["max_latency_ms"].get<double>(), 240.0);
+    EXPECT_TRUE(cache.idExists(107));
+    
+    // Две части массовой полосы подряд не читаются: между ними всегда критичная
+    auto log = handler->log();
+    ASSERT_GE(log.size(), 9u);
+    EXPECT_EQ(log[0], std::vector<std::string>{"interlock"});
+    for (size_t i = 1; i < log.size(); ++i) {
+        ASSERT_EQ(log[i].size(), 1u);
+        EXPECT_TRUE(log[i][0] == "interlock" || log[i - 1][0] == "interlock") << "read " << i;
+    }
 }
 
-TEST_F(JsonApiTest, InvalidAction) {
-    json request = {{"action", "invalid_action"}};
+TEST_F(DevicePollerPolicyTest, BreakerCountsLanePassesNotChunks) {
+    // Четыре части за проход: порог в три неудачных цикла - двенадцать чтений, а не три
+    json variables = json::object();
+    for (int i = 0; i < 4; ++i) {
+        variables["bulk" + std::to_string(i)] = {{"id", 100 + i}, {"name", "Bulk" + std::to_string(i)},
+                                                 {"priority", "bulk"}};
+    }
+    failing = true;
+    startPoller(10, {{"failure_threshold", 3}, {"open_ms", 10000}}, variables,
+                {{"interval_ms", {{"bulk", 10}}}, {"bulk_chunk", 1}});
+    ASSERT_TRUE(eventually([&]() { return poller->state() == DevicePoller::BreakerState::Open; }));
+    EXPECT_EQ(handler->reads, 12);
+    EXPECT_EQ(poller->metrics()["failed_cycles"], 3);
+}
+
+TEST_F(DevicePollerPolicyTest, HandlerWithoutPartialReadsGetsAllVariables) {
+    json variables = {
+        {"interlock", {{"id", 1}, {"name", "Interlock"}, {"priority", "critical"}}},
+        {"bulk0", {{"id", 100}, {"name", "Bulk0"}, {"priority", "bulk"}}},
+        {"bulk1", {{"id", 101}, {"name", "Bulk1"}, {"priority", "bulk"}}}
+    };
+    partialReads = false;
+    startPoller(10, json::object(), variables, {{"bulk_chunk", 1}});
+    ASSERT_TRUE(eventually([&]() { return handler->reads >= 3; }));
     
-    // auto response = server.handleJsonRequest(request);
-    // EXPECT_TRUE(response.empty());
-    SUCCEED();
+    for (const auto& keys : handler->log()) EXPECT_EQ(keys.size(), 3u);
+    auto lanes = poller->metrics()["lanes"];
+    EXPECT_EQ(lanes.size(), 1u);
+    EXPECT_EQ(lanes["normal"]["variables"], 3);
 }
 
-// Тесты конфигурации
-class ConfigTest : public Test {
-protected:
-    std::string tempConfigFile = "temp_config.json";
+TEST(QosTest, PolicyAndPushMetrics) {
+    auto policy = QosPolicy::fromJson({{"slo_ms", {{"critical", 50}}}, {"bulk_chunk", 0}});
+    EXPECT_EQ(policy.sloMs[QosClass::Critical], 50.0);
+    EXPECT_EQ(policy.sloMs[QosClass::Bulk], 10000.0);
+    EXPECT_EQ(policy.intervalMs[QosClass::Normal], 0);
+    EXPECT_EQ(policy.bulkChunk, 1u);
+    EXPECT_EQ(QosClass::fromString("critical"), QosClass::Critical);
+    EXPECT_EQ(QosClass::fromString("unknown"), QosClass::Normal);
     
-    void TearDown() override {
-        std::remove(tempConfigFile.c_str());
+    io_context io;
+    DataCache cache;
+    SubscriptionManager manager(cache);
+    manager.setQos({{7, QosClass::Critical}}, policy);
+    
+    ip::tcp::acceptor acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    ip::tcp::socket client(io);
+    client.connect(acceptor.local_endpoint());
+    ip::tcp::socket serverSide(io);
+    acceptor.accept(serverSide);
+    manager.addSubscriber(7, std::move(serverSide));
+    
+    cache.updateValue(7, "Interlock", 1.0, "good");
+    boost::asio::streambuf buffer;
+    read_until(client, buffer, '\n');
+    // Задержка учитывается после записи в сокет
+    for (int i = 0; i < 100 && manager.qosMetrics()["critical"]["samples"] == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
-};
+    
+    auto metrics = manager.qosMetrics();
+    EXPECT_EQ(metrics["critical"]["tags"], 1);
+    EXPECT_EQ(metrics["critical"]["samples"], 1);
+    EXPECT_EQ(metrics["critical"]["slo_ms"], 50.0);
+    EXPECT_EQ(metrics["normal"]["samples"], 0);
+}
 
-TEST_F(ConfigTest, ConfigValidation) {
-    json validConfig = {
-        {"modbus_tcp", {
-            {"connection_parameters", {
-                {"primary", {
-                    {"host", "192.168.1.100"},
-                    {"port", 502}
-                }}
-            }},
-            {"variables", {
-                {"var1", {
-                    {"id", 1},
-                    {"name", "TestVar"},
-                    {"type", "float32"}
-                }}
-            }}
-        }}
-    };
+TEST(GatherWriterTest, SubscribersShareEncodedMessage) {
+    io_context io;
+    DataCache cache;
+    cache.updateValue(7, "Flow", 1.0, "good");
+    SubscriptionManager manager(cache);
     
-    std::ofstream f(tempConfigFile);
-    f << validConfig.dump();
-    f.close();
+    ip::tcp::acceptor acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    std::vector<ip::tcp::socket> clients;
+    for (int i = 0; i < 2; ++i) {
+        clients.emplace_back(io);
+        clients.back().connect(acceptor.local_endpoint());
+        ip::tcp::socket serverSide(io);
+        acceptor.accept(serverSide);
+        manager.addSubscriber(7, std::move(serverSide));
+    }
     
-    DataServer server;
-    EXPECT_NO_THROW(server.loadConfig(tempConfigFile));
+    manager.notifySubscribers(7, 2.0);
+    std::vector<std::string> lines;
+    for (auto& client : clients) {
+        boost::asio::streambuf buffer;
+        read_until(client, buffer, '\n');
+        std::istream is(&buffer);
+        lines.emplace_back();
+        std::getline(is, lines.back());
+    }
+    EXPECT_EQ(lines[0], lines[1]);
+    EXPECT_EQ(json::parse(lines[0])["v"], 2.0);
+    
+    // Одно кодирование на обновление независимо от числа подписчиков
+    auto metrics = manager.sendMetrics();
+    EXPECT_EQ(metrics["encoded"], 1);
+    EXPECT_EQ(metrics["messages"], 2);
 }
 
-TEST_F(ConfigTest, InvalidConfigHandling) {
-    json invalidConfig = {
-        {"modbus_tcp", {
-            {"invalid_section", "invalid_data"}
-        }}
+TEST(GatherWriterTest, ZeroCopyBatchArrivesIntact) {
+    io_context io;
+    ip::tcp::acceptor acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    ip::tcp::socket client(io);
+    client.connect(acceptor.local_endpoint());
+    ip::tcp::socket serverSide(io);
+    acceptor.accept(serverSide);
+    
+    // Без поддержки MSG_ZEROCOPY пакет отправляется обычным writev
+    GatherWriter::Stats stats;
+    std::string expected;
+    {
+        GatherWriter writer(serverSide, GatherWriter::Options::fromJson({{"zero_copy", true}, {"zero_copy_min_bytes", 1024}}),
+                            &stats);
+        for (int batch = 0; batch < 3; ++batch) {
+            for (int i = 0; i < 200; ++i) {
+                auto message = std::make_shared<const std::string>("{\"i\":" + std::to_string(batch * 200 + i) + "}\n");
+                expected += *message;
+                writer.add(std::move(message));
+            }
+            writer.flush();
+        }
+        EXPECT_EQ(writer.pendingBytes(), 0u);
+        
+        std::string received(expected.size(), '\0');
+        read(client, boost::asio::buffer(received));
+        EXPECT_EQ(received, expected);
+    }
+    EXPECT_EQ(stats.messages, 600u);
+    EXPECT_EQ(stats.writes, 3u);
+}
+
+#ifdef HAVE_IO_URING
+TEST(NetworkBackendTest, IoUringServerHandlesAndHandsOff) {
+    if (!IoUringServer::supported()) GTEST_SKIP() << "io_uring is not available";
+    
+    // Короткие запросы обрабатываются в цикле кольца, остальные передаются вместе с сокетом
+    IoUringServer server(IoUringServer::Settings::fromJson({{"recv_buffer_size", 512}, {"workers", 2}}),
+                         [](int fd, std::string& received, std::string& response) {
+                             if (received.rfind("PING", 0) == 0) {
+                                 response = "PONG " + std::to_string(received.size()) + "\n";
+                                 return true;
+                             }
+                             std::thread([fd]() {
+                                 const char reply[] = "HANDED\n";
+                                 EXPECT_EQ(::write(fd, reply, sizeof(reply) - 1), 7);
+                                 ::close(fd);
+                             }).detach();
+                             return false;
+                         });
+    unsigned short port = server.listen(0);
+    std::thread loop([&server]() { server.run(); });
+    
+    io_context io;
+    auto request = [&io, port](const std::vector<std::string>& parts) {
+        ip::tcp::socket socket(io);
+        socket.connect(ip::tcp::endpoint(ip::address_v4::loopback(), port));
+        for (const auto& part : parts) {
+            write(socket, boost::asio::buffer(part));
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        boost::asio::streambuf buffer;
+        read_until(socket, buffer, '\n');
+        std::istream is(&buffer);
+        std::string line;
+        std::getline(is, line);
+        return line;
     };
     
-    std::ofstream f(tempConfigFile);
-    f << invalidConfig.dump();
-    f.close();
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(request({"PING\n"}), "PONG 5");
+    }
+    EXPECT_EQ(request({"PI", "NG\n"}), "PONG 5");
+    // Запрос длиннее буфера кольца собирается из нескольких completion
+    EXPECT_EQ(request({"PING" + std::string(2000, 'x') + "\n"}), "PONG 2005");
+    EXPECT_EQ(request({"GET_ALL\n"}), "HANDED");
+    
+    auto metrics = server.metrics();
+    EXPECT_EQ(metrics["backend"], "io_uring");
+    EXPECT_EQ(metrics["accepted"], 23);
+    EXPECT_EQ(metrics["requests"], 23);
+    EXPECT_GE(metrics["sqes"].get<uint64_t>(), metrics["accepted"].get<uint64_t>());
+    
+    server.stop();
+    loop.join();
+}
+
+TEST(NetworkBackendTest, IoUringServerSurvivesFullSubmissionQueue) {
+    if (!IoUringServer::supported()) GTEST_SKIP() << "io_uring is not available";
+    
+    // Очередь отправки из 64 записей: одновременные запросы сотен соединений ее переполняют
+    IoUringServer server(IoUringServer::Settings::fromJson({{"entries", 64}, {"workers", 4}}),
+                         [](int, std::string& received, std::string& response) {
+                             response = "PONG " + std::to_string(received.size()) + "\n";
+                             return true;
+                         });
+    unsigned short port = server.listen(0);
+    std::thread loop([&server]() { server.run(); });
+    
+    constexpr int clients = 400;
+    io_context io;
+    std::vector<ip::tcp::socket> sockets;
+    for (int i = 0; i < clients; ++i) {
+        sockets.emplace_back(io);
+        sockets.back().connect(ip::tcp::endpoint(ip::address_v4::loopback(), port));
+    }
+    for (auto& socket : sockets) write(socket, boost::asio::buffer(std::string("PING\n")));
     
+    int answered = 0;
+    for (auto& socket : sockets) {
+        boost::asio::streambuf buffer;
+        read_until(socket, buffer, '\n');
+        std::istream is(&buffer);
+        std::string line;
+        std::getline(is, line);
+        if (line == "PONG 5") ++answered;
+    }
+    EXPECT_EQ(answered, clients);
+    EXPECT_EQ(server.metrics()["requests"], clients);
+    
+    server.stop();
+    loop.join();
+}
+#endif
+
+TEST(NetworkBackendTest, DataServerServesSelectedBackend) {
+    const std::string configFile = "test_network_config.json";
+    {
+        std::ofstream f(configFile);
+        f << json({{"server_settings", {{"tcp_port", 0}, {"network", {{"backend", "io_uring"}}}}}}).dump(4);
+    }
     DataServer server;
-    // В реальной реализации должна быть обработка ошибок
-    // EXPECT_THROW(server.loadConfig(tempConfigFile), std::exception);
-    SUCCEED();
+    server.loadConfig(configFile);
+    server.startPolling();
+    std::thread tcp([&server]() { server.startTcpServer(); });
+    for (int i = 0; i < 200 && server.tcpPort() == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_NE(server.tcpPort(), 0);
+    
+    io_context io;
+    auto request = [&io, &server](const std::string& line) {
+        ip::tcp::socket socket(io);
+        socket.connect(ip::tcp::endpoint(ip::address_v4::loopback(), server.tcpPort()));
+        write(socket, boost::asio::buffer(line));
+        boost::asio::streambuf buffer;
+        read_until(socket, buffer, '\n');
+        std::istream is(&buffer);
+        std::string response;
+        std::getline(is, response);
+        return response;
+    };
+    
+    // Без поддержки io_uring сервер работает на asio
+    auto metrics = json::parse(request("{\"action\": \"get_network_metrics\"}\n"));
+    EXPECT_EQ(metrics["port"], server.tcpPort());
+#ifdef HAVE_IO_URING
+    EXPECT_EQ(metrics["backend"], IoUringServer::supported() ? "io_uring" : "asio");
+#else
+    EXPECT_EQ(metrics["backend"], "asio");
+#endif
+    EXPECT_TRUE(json::parse(request("{\"action\": \"get_alarms\"}\n")).is_array());
+    // Текстовые команды обрабатываются в потоке соединения
+    EXPECT_TRUE(json::parse(request("GET_ALL\n")).is_object());
+    
+    server.stop();
+    tcp.join();
+    std::remove(configFile.c_str());
 }
 
-TEST_F(ConfigTest, MissingIdGeneration) {
-    json configWithoutIds = {
-        {"modbus_tcp", {
-            {"connection_parameters", {
-                {"primary", {
-                    {"host", "localhost"},
-                    {"port", 502}
-                }}
+TEST(DataClientTest, PipelinedBinaryRequestsAndIdMap) {
+    const std::string configFile = "test_client_config.json";
+    const std::string snapshotFile = "test_client.snapshot";
+    {
+        DataCache cache;
+        cache.updateValue(1, "Pump.Flow", 10.0, "good");
+        cache.updateValue(2, "Tank.Level", 2.5, "good");
+        cache.saveSnapshot(snapshotFile, 10);
+        std::ofstream f(configFile);
+        f << json({
+            // Команда BINARY передается из цикла io_uring потоку соединения вместе с сокетом
+            {"server_settings", {
+                {"tcp_port", 0},
+                {"snapshot", {{"file", snapshotFile}}},
+                {"network", {{"backend", "io_uring"}}}
             }},
-            {"variables", {
-                {"var1", {
-                    {"name", "TestVar1"},
-                    {"type", "float32"}
-                }},
-                {"var2", {
-                    {"name", "TestVar2"},
-                    {"type", "uint16"}
+            {"iec104", {
+                {"connection_parameters", {{"primary", {{"host", "localhost"}, {"port", 2404}}}}},
+                {"variables", {
+                    {"flow", {{"id", 1}, {"name", "Pump.Flow"}}},
+                    {"level", {{"id", 2}, {"name", "Tank.Level"}}}
                 }}
             }}
-        }}
-    };
+        }).dump(4);
+    }
+    DataServer server;
+    server.loadConfig(configFile);
+    server.startPolling();
+    std::thread tcp([&server]() { server.startTcpServer(); });
+    for (int i = 0; i < 200 && server.tcpPort() == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    
+    {
+        DataClient client(DataClient::Settings::fromJson({{"port", server.tcpPort()}, {"pool_size", 2}}));
+        // Запросы отправляются без ожидания ответов; ответы соединения приходят по порядку
+        std::vector<std::future<json>> responses;
+        for (int i = 0; i < 50; ++i) {
+            responses.push_back(client.requestAsync({{"action", "get_values"}, {"variable_ids", {1 + i % 2}}}));
+        }
+        for (size_t i = 0; i < 50; ++i) {
+            json values = responses[i].get();
+            const std::string id = std::to_string(1 + i % 2);
+            ASSERT_TRUE(values.contains(id)) << values.dump();
+            EXPECT_EQ(values[id]["v"], i % 2 == 0 ? 10.0 : 2.5);
+        }
+        EXPECT_EQ(client.request({{"action", "aggregate_history"}, {"variable_ids", {1}}})["status"], "error");
+        
+        auto names = client.idMap();
+        EXPECT_EQ(names->at(1), "Pump.Flow");
+        EXPECT_EQ(client.findId("Tank.Level"), 2);
+        EXPECT_FALSE(client.findId("Missing").has_value());
+        EXPECT_EQ(client.idMap(), names); // Карта взята из кэша
+        
+        auto metrics = client.metrics();
+        EXPECT_EQ(metrics["encoding"], "msgpack");
+        EXPECT_EQ(metrics["requests"], 52);
+    }
+    
+    server.stop();
+    tcp.join();
+    std::remove(configFile.c_str());
+    std::remove(snapshotFile.c_str());
+}
+
+TEST(DataClientTest, SubscriptionRestoredAfterDisconnect) {
+    io_context io;
+    ip::tcp::acceptor acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    
+    std::mutex mutex;
+    std::condition_variable updated;
+    std::vector<double> values;
+    DataClient client(DataClient::Settings::fromJson({
+        {"port", acceptor.local_endpoint().port()}, {"reconnect_delay_ms", 20}
+    }));
+    client.subscribe(7, [&](int64_t id, const std::string& name, const json& value, int64_t) {
+        EXPECT_EQ(id, 7);
+        EXPECT_EQ(name, "Flow");
+        std::lock_guard<std::mutex> lock(mutex);
+        values.push_back(value.get<double>());
+        updated.notify_all();
+    });
+    
+    // Сервер отправляет одно обновление и закрывает соединение: клиент подписывается заново
+    for (int connection = 0; connection < 2; ++connection) {
+        ip::tcp::socket socket(io);
+        acceptor.accept(socket);
+        boost::asio::streambuf buffer;
+        read_until(socket, buffer, '\n');
+        std::istream is(&buffer);
+        std::string command;
+        std::getline(is, command);
+        EXPECT_EQ(command, "SUBSCRIBE 7");
+        
+        std::string update = "{\"i\":7,\"n\":\"Flow\",\"t\":1,\"type\":\"data_update\",\"v\":" +
+                             std::to_string(connection + 1) + ".5}\n";
+        write(socket, boost::asio::buffer(update));
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(updated.wait_for(lock, std::chrono::seconds(5),
+                                     [&]() { return values.size() == static_cast<size_t>(connection + 1); }));
+    }
+    EXPECT_EQ(values, (std::vector<double>{1.5, 2.5}));
+    EXPECT_EQ(client.metrics()["resubscribes"], 1);
+}
+
+// Самоподписанный сертификат ECDSA P-256 и его ключ в формате PEM
+void writeSelfSignedCertificate(const std::string& certFile, const std::string& keyFile, const std::string& commonName) {
+    EVP_PKEY* key = EVP_PKEY_Q_keygen(nullptr, nullptr, "EC", "P-256");
+    X509* certificate = X509_new();
+    X509_set_version(certificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 86400);
+    X509_set_pubkey(certificate, key);
+    X509_NAME* name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               reinterpret_cast<const unsigned char*>(commonName.c_str()), -1, -1, 0);
+    X509_set_issuer_name(certificate, name);
+    X509_sign(certificate, key, EVP_sha256());
+    
+    FILE* file = std::fopen(certFile.c_str(), "w");
+    PEM_write_X509(file, certificate);
+    std::fclose(file);
+    file = std::fopen(keyFile.c_str(), "w");
+    PEM_write_PrivateKey(file, key, nullptr, nullptr, 0, nullptr, nullptr);
+    std::fclose(file);
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+}
+
+TEST(TlsTransportTest, ResumedSessionsAndWriteAuthorization) {
+    const std::string configFile = "test_tls_config.json";
+    writeSelfSignedCertificate("test_tls_server.pem", "test_tls_server.key", "localhost");
+    writeSelfSignedCertificate("test_tls_client.pem", "test_tls_client.key", "operator");
+    {
+        std::ofstream f(configFile);
+        f << json({
+            {"server_settings", {
+                {"tcp_port", 0},
+                {"tls", {
+                    {"enabled", true},
+                    {"port", 0},
+                    {"cert_file", "test_tls_server.pem"},
+                    {"key_file", "test_tls_server.key"},
+                    {"ca_file", "test_tls_client.pem"},
+                    {"tokens", {{"scada", "s3cret"}}}
+                }}
+            }},
+            {"iec104", {
+                {"connection_parameters", {{"primary", {{"host", "localhost"}, {"port", 2404}}}}},
+                {"variables", {{"flow", {{"id", 1}, {"name", "Pump.Flow"}}}}}
+            }}
+        }).dump(4);
+    }
+    DataServer server;
+    server.loadConfig(configFile);
+    server.startPolling();
+    std::thread tcp([&server]() { server.startTcpServer(); });
+    for (int i = 0; i < 200 && (server.tcpPort() == 0 || server.tlsPort() == 0); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_NE(server.tlsPort(), 0);
+    
+    auto settings = [&server](json tls) {
+        tls["ca_file"] = "test_tls_server.pem";
+        tls["server_name"] = "localhost";
+        return DataClient::Settings::fromJson({{"port", server.tlsPort()}, {"pool_size", 2}, {"tls", tls}});
+    };
+    const json ackAlarm = {{"action", "ack_alarm"}, {"rule", "missing"}};
+    const std::string denied = "Write access denied";
+    {
+        // Второе соединение пула возобновляет сессию первого; запись без прав отклоняется
+        DataClient client(settings(json::object()));
+        EXPECT_EQ(client.request({{"action", "resolve"}, {"names", {"Pump.Flow"}}})["Pump.Flow"], 1);
+        EXPECT_EQ(client.request(ackAlarm)["message"], denied);
+        EXPECT_EQ(client.findId("Pump.Flow"), 1);
+        auto metrics = client.metrics();
+        EXPECT_EQ(metrics["tls_handshakes"], 2);
+        EXPECT_EQ(metrics["tls_resumed"], 1);
+        
+        // Запросы конвейера получают ответы в порядке отправки
+        std::vector<std::future<json>> responses;
+        for (int i = 0; i < 16; ++i) {
+            responses.push_back(client.requestAsync(i % 2 ? json{{"action", "get_alarms"}}
+                                                          : json{{"action", "resolve"}, {"names", {"Pump.Flow"}}}));
+        }
+        for (size_t i = 0; i < responses.size(); ++i) {
+            json response = responses[i].get();
+            EXPECT_EQ(response.is_array(), i % 2 == 1) << response;
+        }
+        
+        // Токен в запросе дает право записи только этому запросу
+        json withToken = ackAlarm;
+        withToken["token"] = "s3cret";
+        EXPECT_NE(client.request(withToken)["message"], denied);
+        withToken["token"] = "wrong";
+        EXPECT_EQ(client.request(withToken)["message"], denied);
+    }
+    {
+        // Токен команды AUTH и сертификат клиента (mTLS) действуют на все запросы соединения
+        DataClient byToken(settings({{"token", "s3cret"}}));
+        EXPECT_NE(byToken.request(ackAlarm)["message"], denied);
+        DataClient byCertificate(settings({{"cert_file", "test_tls_client.pem"}, {"key_file", "test_tls_client.key"}}));
+        EXPECT_NE(byCertificate.request(ackAlarm)["message"], denied);
+        EXPECT_THROW(DataClient(settings({{"token", "wrong"}})).request(ackAlarm), std::runtime_error);
+    }
+    
+    // Сертификат сервера не проверяется по чужому корню: рукопожатие отклоняется
+    DataClient untrusted(DataClient::Settings::fromJson({
+        {"port", server.tlsPort()}, {"tls", {{"ca_file", "test_tls_client.pem"}}}
+    }));
+    EXPECT_ANY_THROW(untrusted.request({{"action", "get_alarms"}}));
+    
+    // Имя сервера проверяется и без server_name (по адресу 127.0.0.1): сертификат выдан localhost
+    for (const json& name : {json(nullptr), json("other.example")}) {
+        json tls = {{"ca_file", "test_tls_server.pem"}};
+        if (name.is_string()) tls["server_name"] = name;
+        DataClient wrongName(DataClient::Settings::fromJson({{"port", server.tlsPort()}, {"tls", tls}}));
+        EXPECT_ANY_THROW(wrongName.request({{"action", "get_alarms"}}));
+    }
+    
+    // Открытый порт: чтение разрешено, запись - только через TLS
+    DataClient plaintext(DataClient::Settings::fromJson({{"port", server.tcpPort()}, {"pool_size", 1}}));
+    EXPECT_TRUE(plaintext.request({{"action", "get_alarms"}}).is_array());
+    EXPECT_EQ(plaintext.request(ackAlarm)["message"], denied);
+    
+    auto tls = plaintext.request({{"action", "get_network_metrics"}})["tls"];
+    EXPECT_EQ(tls["port"], server.tlsPort());
+    EXPECT_GE(tls["resumed_handshakes"].get<int>(), 1);
+    EXPECT_GE(tls["failed_handshakes"].get<int>(), 1);
+    EXPECT_GE(tls["denied_writes"].get<int>(), 2);
+    
+    server.stop();
+    tcp.join();
+    for (const char* file : {"test_tls_server.pem", "test_tls_server.key", "test_tls_client.pem", "test_tls_client.key"}) {
+        std::remove(file);
+    }
+    std::remove(configFile.c_str());
+}
+
+TEST(TlsTransportTest, HandshakeAndIdleDeadlinesCloseSessions) {
+    writeSelfSignedCertificate("test_tls_deadline.pem", "test_tls_deadline.key", "localhost");
+    TlsServer::Settings settings;
+    settings.port = 0;
+    settings.certFile = "test_tls_deadline.pem";
+    settings.keyFile = "test_tls_deadline.key";
+    settings.handshakeTimeout = std::chrono::milliseconds(300);
+    settings.idleTimeout = std::chrono::milliseconds(400);
+    // Обработчик ждет запрос со сроком ожидания, как handleTlsClient
+    TlsServer server(settings, [&server](TlsServer::Stream& stream, ClientAuth&, TlsServer::Deadline& idle) {
+        std::string buffer;
+        boost::system::error_code error;
+        idle.expireAfter(server.idleTimeout());
+        read_until(stream, boost::asio::dynamic_buffer(buffer), '\n', error);
+        idle.cancel();
+    });
+    server.start();
+    io_context io;
+    const ip::tcp::endpoint endpoint(ip::make_address("127.0.0.1"), server.port());
+    
+    // Соединение без рукопожатия закрывается по сроку рукопожатия
+    auto start = std::chrono::steady_clock::now();
+    ip::tcp::socket silent(io);
+    silent.connect(endpoint);
+    char byte;
+    boost::system::error_code error;
+    silent.read_some(boost::asio::buffer(&byte, 1), error);
+    EXPECT_TRUE(error);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(3));
+    
+    // Соединение после рукопожатия без запросов закрывается по сроку ожидания
+    ssl::context context(ssl::context::tls_client);
+    ssl::stream<ip::tcp::socket> idle(io, context);
+    idle.lowest_layer().connect(endpoint);
+    idle.handshake(ssl::stream_base::client);
+    start = std::chrono::steady_clock::now();
+    idle.read_some(boost::asio::buffer(&byte, 1), error);
+    EXPECT_TRUE(error);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(300));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(3));
+    
+    auto metrics = server.metrics();
+    EXPECT_EQ(metrics["timed_out_sessions"], 2);
+    EXPECT_EQ(metrics["failed_handshakes"], 1);
+    EXPECT_EQ(metrics["full_handshakes"], 1);
+    server.stop();
+    std::remove("test_tls_deadline.pem");
+    std::remove("test_tls_deadline.key");
+}
+
+TEST(ExpressionTest, CompilesAndEvaluates) {
+    std::vector<double> stack;
+    
+    auto sum = Expression::compile("$1 + $2 * 0.5 - $1 % 4");
+    ASSERT_EQ(sum.inputs(), (std::vector<int64_t>{1, 2}));
+    EXPECT_FALSE(sum.isBoolean());
+    double values[] = {10.0, 4.0};
+    EXPECT_DOUBLE_EQ(sum.evaluate(values, stack), 10.0);
+    
+    auto interlock = Expression::compile("$5 > 10 && !($7 == 1) || false");
+    EXPECT_TRUE(interlock.isBoolean());
+    double open[] = {12.0, 0.0};
+    EXPECT_EQ(interlock.evaluate(open, stack), 1.0);
+    double closed[] = {12.0, 1.0};
+    EXPECT_EQ(interlock.evaluate(closed, stack), 0.0);
+    
+    auto functions = Expression::compile("$3 >= 0 ? max(abs(-2), avg($3, 4, 8)) : pow(2, 3)");
+    double positive[] = {3.0};
+    EXPECT_DOUBLE_EQ(functions.evaluate(positive, stack), 5.0);
+    double negative[] = {-1.0};
+    EXPECT_DOUBLE_EQ(functions.evaluate(negative, stack), 8.0);
+    
+    for (const char* invalid : {"1 +", "$1 $2", "foo(1)", "min()", "pow(1)", "$x", "(1", ""}) {
+        EXPECT_THROW(Expression::compile(invalid), std::invalid_argument) << invalid;
+    }
+}
+
+class DerivedTagTest : public Test {
+protected:
+    DataCache cache;
+    SubscriptionManager manager{cache};
+    DerivedTagEngine engine{cache, manager};
+    
+    template <typename Predicate>
+    bool eventually(Predicate predicate, std::chrono::milliseconds timeout = std::chrono::milliseconds(3000)) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!predicate()) {
+            if (std::chrono::steady_clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return true;
+    }
+    
+    void TearDown() override {
+        engine.stop();
+    }
+};
+
+TEST_F(DerivedTagTest, RecomputesOnlyAffectedTags) {
+    cache.updateValue(1, "Flow.A", 10.0, "good");
+    cache.updateValue(2, "Flow.B", 20, "good");
+    cache.updateValue(3, "Level", 1.5, "good");
+    
+    engine.configure({
+        {101, "Flow.High", "$100 > 50"},
+        {100, "Flow.Total", "$1 + $2"},
+        {102, "Level.Double", "$3 * 2"}
+    });
+    ASSERT_EQ(engine.tagCount(), 3u);
+    engine.start();
+    
+    ASSERT_TRUE(eventually([&]() { return cache.idExists(101); }));
+    EXPECT_EQ(cache.getCurrentValue(100), 30.0);
+    EXPECT_EQ(cache.getCurrentValue(101), false);
+    EXPECT_EQ(cache.getCurrentValue(102), 3.0);
+    EXPECT_EQ(cache.getNameById(100), "Flow.Total");
+    const uint64_t initial = engine.evaluationCount();
+    EXPECT_EQ(initial, 3u);
+    
+    // Изменение входа пересчитывает сумму и зависящий от нее признак, но не уровень
+    cache.updateValue(1, "Flow.A", 40.0, "good");
+    ASSERT_TRUE(eventually([&]() { return cache.getCurrentValue(101) == true; }));
+    EXPECT_EQ(cache.getCurrentValue(100), 60.0);
+    EXPECT_EQ(engine.evaluationCount(), initial + 2);
+    EXPECT_EQ(cache.getHistory(102, 10).size(), 1u);
+    
+    // Качество результата - худшее из качеств входов
+    cache.updateValue(2, "Flow.B", 20, "uncertain");
+    ASSERT_TRUE(eventually([&]() { return cache.getHistory(100, 1)[0].quality == "uncertain"; }));
+    EXPECT_TRUE(eventually([&]() { return cache.getHistory(101, 1)[0].quality == "uncertain"; }));
+    EXPECT_EQ(cache.getHistory(102, 1)[0].quality, "good");
+}
+
+TEST_F(DerivedTagTest, RejectsCyclesAndInvalidExpressions) {
+    engine.configure({
+        {200, "Loop.A", "$201 + 1"},
+        {201, "Loop.B", "$200 * 2"},
+        {202, "Loop.C", "$201 - 1"},
+        {203, "Broken", "$1 +"},
+        {204, "Ratio", "$1 / $2"}
+    });
+    EXPECT_EQ(engine.tagCount(), 1u);
+    const auto& errors = engine.errors();
+    ASSERT_EQ(errors.size(), 4u);
+    EXPECT_EQ(errors.at("Loop.A"), "cyclic dependency");
+    EXPECT_EQ(errors.at("Loop.C"), "cyclic dependency");
+    EXPECT_NE(errors.at("Broken").find("position"), std::string::npos);
+    
+    // Деление на ноль публикуется как null с качеством "bad"
+    cache.updateValue(1, "A", 1.0, "good");
+    cache.updateValue(2, "B", 0.0, "good");
+    engine.start();
+    ASSERT_TRUE(eventually([&]() { return cache.idExists(204); }));
+    EXPECT_TRUE(cache.getCurrentValue(204).is_null());
+    EXPECT_EQ(cache.getHistory(204, 1)[0].quality, "bad");
+    
+    cache.updateValue(2, "B", 4.0, "good");
+    EXPECT_TRUE(eventually([&]() { return cache.getCurrentValue(204) == 0.25; }));
+}
+
+class AlarmEngineTest : public Test {
+protected:
+    DataCache cache;
+    AlarmEngine engine;
+    const std::string journalFile = "test_alarms.journal";
+    
+    void SetUp() override {
+        cache.setAlarmEngine(&engine);
+    }
+    
+    void TearDown() override {
+        cache.setAlarmEngine(nullptr);
+        std::remove(journalFile.c_str());
+        std::remove((journalFile + ".1").c_str());
+    }
+    
+    std::vector<std::string> eventTypes(uint64_t since = 0) {
+        std::vector<std::string> types;
+        for (const auto& event : engine.eventsSince(since, 100)) {
+            types.push_back(event.toJson()["type"]);
+        }
+        return types;
+    }
+};
+
+TEST_F(AlarmEngineTest, HighLimitWithDeadbandAndAcknowledge) {
+    engine.configure(json::object({{"rules", {
+        {"Tank.High", {{"tag", 1}, {"type", "high"}, {"limit", 80.0}, {"deadband", 5.0}, {"severity", 700}}},
+        {"Tank.Low", {{"tag", 1}, {"type", "low"}, {"limit", 10.0}}}
+    }}}));
+    ASSERT_EQ(engine.ruleCount(), 2u);
+    
+    cache.updateValue(2, "Other", 1000.0, "good");
+    cache.updateValue(1, "Tank", 50.0, "good");
+    EXPECT_EQ(engine.lastSequence(), 0u);
+    
+    cache.updateValue(1, "Tank", 85.0, "good");
+    auto alarms = engine.activeAlarms();
+    ASSERT_EQ(alarms.size(), 1u);
+    EXPECT_EQ(alarms[0]["rule"], "Tank.High");
+    EXPECT_EQ(alarms[0]["severity"], 700);
+    EXPECT_FALSE(alarms[0]["acknowledged"].get<bool>());
+    
+    // В пределах гистерезиса тревога не снимается; недостоверное значение не учитывается
+    cache.updateValue(1, "Tank", 78.0, "good");
+    cache.updateValue(1, "Tank", 0.0, "bad");
+    EXPECT_TRUE(engine.activeAlarms()[0]["active"].get<bool>());
+    
+    cache.updateValue(1, "Tank", 74.0, "good");
+    alarms = engine.activeAlarms();
+    ASSERT_EQ(alarms.size(), 1u);
+    EXPECT_FALSE(alarms[0]["active"].get<bool>());
+    
+    // Снятая и квитированная тревога уходит из списка
+    EXPECT_TRUE(engine.acknowledge("Tank.High"));
+    EXPECT_FALSE(engine.acknowledge("Tank.High"));
+    EXPECT_TRUE(engine.activeAlarms().empty());
+    EXPECT_EQ(eventTypes(), (std::vector<std::string>{"raised", "cleared", "acknowledged"}));
+    EXPECT_EQ(eventTypes(1), (std::vector<std::string>{"cleared", "acknowledged"}));
+}
+
+TEST_F(AlarmEngineTest, LateEvaluationOfOlderWriteIsIgnored) {
+    engine.configure(json::object({{"rules", {
+        {"Tank.High", {{"tag", 1}, {"type", "high"}, {"limit", 80.0}}}
+    }}}));
+    
+    // Записи 1 (50) и 2 (85) проверяются в обратном порядке: тревога соответствует записи 2
+    const auto now = std::chrono::system_clock::now();
+    engine.evaluate(1, {85.0, now, "good"}, 2);
+    engine.evaluate(1, {50.0, now, "good"}, 1);
+    auto alarms = engine.activeAlarms();
+    ASSERT_EQ(alarms.size(), 1u);
+    EXPECT_TRUE(alarms[0]["active"].get<bool>());
+    EXPECT_EQ(alarms[0]["v"], 85.0);
+    EXPECT_EQ(eventTypes(), (std::vector<std::string>{"raised"}));
+    
+    engine.evaluate(1, {50.0, now, "good"}, 3);
+    EXPECT_FALSE(engine.activeAlarms()[0]["active"].get<bool>());
+}
+
+TEST_F(AlarmEngineTest, RateOfChange) {
+    engine.configure(json::object({{"rules", {
+        {"Pressure.Rate", {{"tag", 3}, {"type", "rate"}, {"limit", 10.0}, {"deadband", 2.0}}}
+    }}}));
+    
+    std::vector<AlarmEvent> received;
+    engine.onEvent.connect([&received](const AlarmEvent& event) { received.push_back(event); });
+    
+    auto start = std::chrono::system_clock::now();
+    auto at = [start](int ms) { return start + std::chrono::milliseconds(ms); };
+    cache.applyValue(3, "Pressure", {100.0, at(0), "good"});
+    cache.applyValue(3, "Pressure", {105.0, at(1000), "good"});   // 5/с
+    EXPECT_TRUE(received.empty());
+    cache.applyValue(3, "Pressure", {110.0, at(1250), "good"});   // 20/с
+    ASSERT_EQ(received.size(), 1u);
+    EXPECT_EQ(received[0].type, AlarmEvent::Type::Raised);
+    EXPECT_EQ(received[0].value, 110.0);
+    cache.applyValue(3, "Pressure", {119.0, at(2250), "good"});   // 9/с - в пределах гистерезиса
+    EXPECT_EQ(received.size(), 1u);
+    cache.applyValue(3, "Pressure", {120.0, at(3250), "good"});   // 1/с
+    ASSERT_EQ(received.size(), 2u);
+    EXPECT_EQ(received[1].type, AlarmEvent::Type::Cleared);
+}
+
+TEST_F(AlarmEngineTest, JournalIsBoundedAndRestored) {
+    const json section = {
+        {"journal", {{"file", journalFile}, {"max_events", 4}}},
+        {"rules", {{"Level.High", {{"tag", 1}, {"type", "high"}, {"limit", 10.0}}}}}
+    };
+    engine.configure(section);
+    for (int i = 0; i < 5; ++i) {
+        cache.updateValue(1, "Level", 20.0, "good");
+        cache.updateValue(1, "Level", 0.0, "good");
+    }
+    EXPECT_EQ(engine.lastSequence(), 10u);
+    
+    auto countLines = [](const std::string& path) {
+        std::ifstream in(path);
+        return std::count(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>(), '\n');
+    };
+    EXPECT_EQ(countLines(journalFile), 2);
+    EXPECT_EQ(countLines(journalFile + ".1"), 4);
+    
+    // Новый экземпляр продолжает нумерацию и отдает последние события из журнала
+    AlarmEngine restored;
+    restored.configure(section);
+    EXPECT_EQ(restored.lastSequence(), 10u);
+    auto events = restored.eventsSince(7, 100);
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_EQ(events[0].sequence, 8u);
+    EXPECT_EQ(events[2].type, AlarmEvent::Type::Cleared);
+    EXPECT_TRUE(restored.eventsSince(10, 100, std::chrono::milliseconds(20)).empty());
+}
+
+class DiskQueueTest : public Test {
+protected:
+    const std::string directory = "test_export_queue";
+    
+    void SetUp() override { std::filesystem::remove_all(directory); }
+    void TearDown() override { std::filesystem::remove_all(directory); }
+};
+
+TEST_F(DiskQueueTest, AcknowledgedPositionSurvivesReopen) {
+    {
+        DiskQueue queue(directory);
+        EXPECT_EQ(queue.append("first"), 1u);
+        EXPECT_EQ(queue.append("second"), 2u);
+        EXPECT_EQ(queue.append("third"), 3u);
+        
+        DiskQueue::Record record;
+        ASSERT_TRUE(queue.front(record));
+        EXPECT_EQ(record.sequence, 1u);
+        EXPECT_EQ(record.data, "first");
+        queue.acknowledge(1);
+        ASSERT_TRUE(queue.front(record));
+        EXPECT_EQ(record.data, "second");
+        EXPECT_EQ(queue.backlog(), 2u);
+    }
+    
+    DiskQueue queue(directory);
+    EXPECT_EQ(queue.backlog(), 2u);
+    DiskQueue::Record record;
+    ASSERT_TRUE(queue.front(record));
+    EXPECT_EQ(record.sequence, 2u);
+    EXPECT_EQ(queue.append("fourth"), 4u);
+    queue.acknowledge(4);
+    EXPECT_FALSE(queue.front(record));
+    EXPECT_EQ(queue.backlog(), 0u);
+}
+
+TEST_F(DiskQueueTest, OverflowDropsOldestSegment) {
+    DiskQueue queue(directory, 4096, 3);
+    const std::string payload(1000, 'x');
+    for (int i = 0; i < 30; ++i) queue.append(payload);
+    
+    EXPECT_LE(queue.segmentCount(), 3u);
+    EXPECT_GT(queue.dropped(), 0u);
+    EXPECT_EQ(queue.backlog() + queue.dropped(), 30u);
+    
+    // Чтение продолжается с первой сохранившейся записи
+    DiskQueue::Record record;
+    ASSERT_TRUE(queue.front(record));
+    EXPECT_EQ(record.sequence, queue.dropped() + 1);
+    queue.acknowledge(30);
+    EXPECT_EQ(queue.segmentCount(), 1u);
+}
+
+// Локальный приемник экспорта: принимает кадры, распаковывает пакеты и подтверждает их
+class LocalHistorianSink {
+public:
+    explicit LocalHistorianSink(unsigned short port)
+        : acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), port)) {
+        thread = std::thread([this]() { run(); });
+    }
+    
+    ~LocalHistorianSink() {
+        boost::system::error_code ec;
+        acceptor.close(ec);
+        socket.shutdown(ip::tcp::socket::shutdown_both, ec);
+        thread.join();
+    }
+    
+    std::vector<json> updates() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return received;
+    }
+    
+    std::vector<uint64_t> sequences() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return batches;
+    }
+    
+private:
+    io_context io;
+    ip::tcp::acceptor acceptor;
+    ip::tcp::socket socket{io};
+    std::mutex mutex;
+    std::vector<json> received;
+    std::vector<uint64_t> batches;
+    std::thread thread;
+    
+    // Заголовок кадра [u32 длина][u64 номер] в big-endian
+    void run() {
+        boost::system::error_code ec;
+        acceptor.accept(socket, ec);
+        while (!ec) {
+            std::array<uint8_t, 12> header;
+            if (!read(socket, buffer(header), ec)) break;
+            uint64_t length = 0;
+            uint64_t sequence = 0;
+            for (size_t i = 0; i < 4; ++i) length = (length << 8) | header[i];
+            for (size_t i = 4; i < 12; ++i) sequence = (sequence << 8) | header[i];
+            std::string batch(length, '\0');
+            read(socket, buffer(batch), ec);
+            if (ec) break;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto& update : HistorianExporter::decodeBatch(batch)) received.push_back(update);
+                batches.push_back(sequence);
+            }
+            write(socket, buffer(header.data() + 4, 8), ec);
+        }
+    }
+};
+
+TEST_F(DiskQueueTest, ExporterBuffersWhileTargetIsDown) {
+    // Свободный порт, на котором приемник пока не слушает
+    unsigned short port;
+    {
+        io_context io;
+        ip::tcp::acceptor probe(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+        port = probe.local_endpoint().port();
+    }
+    
+    DataCache cache;
+    SubscriptionManager manager(cache);
+    HistorianExporter::Settings settings;
+    settings.directory = directory;
+    settings.batchSize = 10;
+    settings.batchInterval = std::chrono::milliseconds(20);
+    settings.retryInterval = std::chrono::milliseconds(50);
+    settings.replayRate = 200;
+    HistorianExporter exporter(cache, manager,
+        HistorianExporter::createTarget({{"host", "127.0.0.1"}, {"port", port}, {"timeout_ms", 500}}), settings);
+    exporter.start();
+    
+    for (int i = 1; i <= 50; ++i) cache.updateValue(i, "Var" + std::to_string(i), i * 1.5, "good");
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    while (exporter.metrics()["backlog"] < 5 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(exporter.metrics()["backlog"], 5);
+    EXPECT_FALSE(exporter.metrics()["connected"].get<bool>());
+    
+    // Приемник появился: накопленное передается по порядку и подтверждается
+    LocalHistorianSink sink(port);
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (sink.updates().size() < 50 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    auto updates = sink.updates();
+    ASSERT_EQ(updates.size(), 50u);
+    for (size_t i = 0; i < 50; ++i) {
+        EXPECT_EQ(updates[i][0], i + 1);
+        EXPECT_EQ(updates[i][2], "good");
+        EXPECT_EQ(updates[i][3], static_cast<double>(i + 1) * 1.5);
+    }
+    EXPECT_EQ(sink.sequences(), (std::vector<uint64_t>{1, 2, 3, 4, 5}));
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (exporter.metrics()["backlog"] != 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(exporter.metrics()["backlog"], 0);
+    EXPECT_EQ(exporter.metrics()["sent"], 5);
+    exporter.stop();
+}
+
+TEST(ThreadPlacementTest, ParsesCpuListsAndSettings) {
+    EXPECT_EQ(ThreadPlacement::parseCpuList("0-3, 8,10-11"), (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_TRUE(ThreadPlacement::parseCpuList("").empty());
+    EXPECT_EQ(ThreadPlacement::parseCpuList("x,5"), (std::vector<int>{5}));
+    EXPECT_EQ(ThreadPlacement::parseCpuList("0-2000000000,-1,3-2,2"), (std::vector<int>{2}));
+    EXPECT_TRUE(ThreadPlacement::parseCpuList(std::to_string(CPU_SETSIZE)).empty());
+    
+    auto settings = ThreadPlacement::Settings::fromJson({{"enabled", true}, {"pollers", "2-3"}, {"io", {0, 1}}});
+    EXPECT_TRUE(settings.enabled);
+    EXPECT_EQ(settings.pollerSets, (std::vector<std::vector<int>>{{2}, {3}}));
+    EXPECT_EQ(settings.ioCpus, (std::vector<int>{0, 1}));
+    EXPECT_EQ(ThreadPlacement::Settings::fromJson({{"io", {1, -1, 1 << 20}}}).ioCpus, (std::vector<int>{1}));
+    
+    // По умолчанию - по набору ядер на узел NUMA
+    settings = ThreadPlacement::Settings::fromJson({{"enabled", true}});
+    EXPECT_EQ(settings.pollerSets, ThreadPlacement::numaNodes());
+    EXPECT_FALSE(settings.pollerSets.empty());
+}
+
+TEST(ThreadPlacementTest, PinsPollerThread) {
+    auto& placement = ThreadPlacement::getInstance();
+    placement.configure(ThreadPlacement::Settings::fromJson({{"enabled", true}, {"pollers", "0"}}));
+    
+    int cpuCount = -1;
+    std::thread([&]() {
+        if (!placement.place(ThreadPlacement::Role::Poller)) return;
+        cpu_set_t set;
+        pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+        cpuCount = CPU_COUNT(&set) == 1 && CPU_ISSET(0, &set) ? 1 : 0;
+    }).join();
+    EXPECT_EQ(cpuCount, 1);
+    
+    // Роль без настроенных ядер и отключенное размещение не изменяют привязку
+    EXPECT_FALSE(placement.place(ThreadPlacement::Role::Io));
+    placement.configure({});
+    EXPECT_FALSE(placement.place(ThreadPlacement::Role::Poller));
+}
+
+// Интеграционные тесты
+class DataServerIntegrationTest : public Test {
+protected:
+    DataServer server;
+    std::string testConfigFile = "test_config.json";
+    
+    void SetUp() override {
+        // Создаем тестовый конфиг
+        createTestConfig();
+    }
+    
+    void TearDown() override {
+        // Удаляем тестовый конфиг
+        std::remove(testConfigFile.c_str());
+    }
+    
+    void createTestConfig() {
+        json config = {
+            {"modbus_tcp", {
+                {"connection_parameters", {
+                    {"primary", {
+                        {"host", "localhost"},
+                        {"port", 502},
+                        {"timeout_ms", 100}
+                    }}
+                }},
+                {"variables", {
+                    {"temp1", {
+                        {"id", 1001},
+                        {"name", "Temperature1"},
+                        {"address", 100},
+                        {"type", "float32"},
+                        {"polling_interval_ms", 1000}
+                    }}
+                }},
+                {"polling_interval_ms", 100}
+            }}
+        };
+        
+        std::ofstream f(testConfigFile);
+        f << config.dump(4);
+    }
+};
+
+TEST_F(DataServerIntegrationTest, ConfigLoading) {
+    EXPECT_NO_THROW(server.loadConfig(testConfigFile));
+}
+
+TEST_F(DataServerIntegrationTest, ProtocolInitialization) {
+    server.loadConfig(testConfigFile);
+    // После загрузки конфига протоколы должны быть инициализированы
+    SUCCEED(); // В реальной реализации будет проверка состояния
+}
+
+// Тесты TCP сервера
+class TcpServerTest : public Test {
+protected:
+    boost::asio::io_service io_service;
+    int test_port = 8081;
+    
+    void SetUp() override {
+        // Даем время на освобождение порта
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+};
+
+TEST_F(TcpServerTest, ConnectionHandling) {
+    // Тестируем базовое подключение
+    using boost::asio::ip::tcp;
+    
+    try {
+        tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), test_port));
+        acceptor.close();
+        SUCCEED();
+    } catch (const std::exception& e) {
+        FAIL() << "Failed to handle TCP connection: " << e.what();
+    }
+}
+
+// Тесты JSON API
+class JsonApiTest : public Test {
+protected:
+    DataServer server;
+    DataCache cache;
+    
+    void SetUp() override {
+        // Добавляем тестовые данные в кэш
+        cache.updateValue(1001, "Temperature", 25.0, "good");
+        cache.updateValue(1002, "Pressure", 101.3, "good");
+    }
+};
+
+TEST_F(JsonApiTest, GetAllAction) {
+    json request = {{"action", "get_all"}};
+    
+    // В реальной реализации здесь будет вызов handleJsonRequest
+    // auto response = server.handleJsonRequest(request);
+    // EXPECT_TRUE(response.contains("1001"));
+    // EXPECT_TRUE(response.contains("1002"));
+    SUCCEED();
+}
+
+TEST_F(JsonApiTest, GetHistoryAction) {
+    json request = {
+        {"action", "get_history"},
+        {"variable_id", 1001},
+        {"count", 5}
+    };
+    
+    // auto response = server.handleJsonRequest(request);
+    // EXPECT_TRUE(response.is_array());
+    SUCCEED();
+}
+
+TEST_F(JsonApiTest, InvalidAction) {
+    json request = {{"action", "invalid_action"}};
+    
+    // auto response = server.handleJsonRequest(request);
+    // EXPECT_TRUE(response.empty());
+    SUCCEED();
+}
+
+// Тесты конфигурации
+class ConfigTest : public Test {
+protected:
+    std::string tempConfigFile = "temp_config.json";
+    
+    void TearDown() override {
+        std::remove(tempConfigFile.c_str());
+    }
+};
+
+TEST_F(ConfigTest, ConfigValidation) {
+    json validConfig = {
+        {"modbus_tcp", {
+            {"connection_parameters", {
+                {"primary", {
+                    {"host", "192.168.1.100"},
+                    {"port", 502}
+                }}
+            }},
+            {"variables", {
+                {"var1", {
+                    {"id", 1},
+                    {"name", "TestVar"},
+                    {"type", "float32"}
+                }}
+            }}
+        }}
+    };
+    
+    std::ofstream f(tempConfigFile);
+    f << validConfig.dump();
+    f.close();
+    
+    DataServer server;
+    EXPECT_NO_THROW(server.loadConfig(tempConfigFile));
+}
+
+TEST_F(ConfigTest, InvalidConfigHandling) {
+    json invalidConfig = {
+        {"modbus_tcp", {
+            {"invalid_section", "invalid_data"}
+        }}
+    };
+    
+    std::ofstream f(tempConfigFile);
+    f << invalidConfig.dump();
+    f.close();
+    
+    DataServer server;
+    // В реальной реализации должна быть обработка ошибок
+    // EXPECT_THROW(server.loadConfig(tempConfigFile), std::exception);
+    SUCCEED();
+}
+
+TEST_F(ConfigTest, MissingIdGeneration) {
+    json configWithoutIds = {
+        {"modbus_tcp", {
+            {"connection_parameters", {
+                {"primary", {
+                    {"host", "localhost"},
+                    {"port", 502}
+                }}
+            }},
+            {"variables", {
+                {"var1", {
+                    {"name", "TestVar1"},
+                    {"type", "float32"}
+                }},
+                {"var2", {
+                    {"name", "TestVar2"},
+                    {"type", "uint16"}
+                }}
+            }}
+        }}
+    };
+    
+    std::ofstream f(tempConfigFile);
+    f << configWithoutIds.dump();
+    f.close();
+    
+    DataServer server;
+    server.loadConfig(tempConfigFile);
+    // После загрузки ID должны быть сгенерированы автоматически
+    SUCCEED();
+}
+
+// Тесты инкрементальной перезагрузки конфигурации
+class ConfigHotReloadTest : public Test {
+protected:
+    std::string configFile = "hot_reload_config.json";
+    DataServer server;
+    
+    static json makeDevice(int port, const json& variables) {
+        return {
+            {"protocol", "modbus_tcp"},
+            {"connection_parameters", {
+                {"primary", {
+                    {"host", "127.0.0.1"},
+                    {"port", port}
+                }}
+            }},
+            {"variables", variables},
+            {"polling_interval_ms", 100}
+        };
+    }
+    
+    json baseConfig() {
+        return {
+            {"device1", makeDevice(1502, {
+                {"temp", {{"id", 2001}, {"name", "Temp"}, {"address", 0}, {"type", "uint16"}}}
+            })},
+            {"device2", makeDevice(1503, {
+                {"level", {{"id", 2002}, {"name", "Level"}, {"address", 0}, {"type", "uint16"}}}
+            })}
+        };
+    }
+    
+    void writeConfig(const json& config) {
+        std::ofstream f(configFile);
+        f << config.dump(4);
+    }
+    
+    void SetUp() override {
+        writeConfig(baseConfig());
+        server.loadConfig(configFile);
+    }
+    
+    void TearDown() override {
+        std::remove(configFile.c_str());
+    }
+};
+
+TEST_F(ConfigHotReloadTest, VariableChangeKeepsHandlers) {
+    auto* handler1 = server.getProtocolHandler("device1");
+    auto* handler2 = server.getProtocolHandler("device2");
+    ASSERT_NE(handler1, nullptr);
+    ASSERT_NE(handler2, nullptr);
+    
+    json config = baseConfig();
+    config["device2"]["variables"]["flow"] = {{"id", 2003}, {"name", "Flow"}, {"address", 1}, {"type", "uint16"}};
+    server.applyConfigChanges(config);
+    
+    // Соединения не пересоздаются, если не менялись параметры подключения
+    EXPECT_EQ(server.getProtocolHandler("device1"), handler1);
+    EXPECT_EQ(server.getProtocolHandler("device2"), handler2);
+    
+    auto idMap = server.handleJsonRequest({{"action", "get_id_map"}});
+    EXPECT_EQ(idMap["2003"], "Flow");
+    // get_config отдает копию конфигурации, опубликованную изменением
+    auto current = server.handleJsonRequest({{"action", "get_config"}});
+    EXPECT_EQ(current["device2"]["variables"]["flow"]["id"], 2003);
+}
+
+TEST_F(ConfigHotReloadTest, GetConfigRedactsSecrets) {
+    json config = baseConfig();
+    config["server_settings"] = {
+        {"tls", {{"enabled", false}, {"key_file", "/etc/psdik/server.key"}, {"tokens", {{"scada", "t0ken-scada"}}}}},
+        {"replication", {{"role", "none"}, {"secret", "repl-k3y"}}}
+    };
+    config["device1"]["connection_parameters"]["primary"]["secret"] = "gw-k3y";
+    server.applyConfigChanges(config);
+    
+    auto current = server.handleJsonRequest({{"action", "get_config"}});
+    const std::string text = current.dump();
+    EXPECT_EQ(text.find("t0ken-scada"), std::string::npos);
+    EXPECT_EQ(text.find("repl-k3y"), std::string::npos);
+    EXPECT_EQ(text.find("gw-k3y"), std::string::npos);
+    EXPECT_EQ(text.find("server.key"), std::string::npos);
+    EXPECT_EQ(current["server_settings"]["tls"]["tokens"]["scada"], "<redacted>");
+    
+    // Возвращенная конфигурация сохраняет прежние секреты
+    current["device2"]["polling_interval_ms"] = 200;
+    auto response = server.handleJsonRequest({{"action", "update_config"}, {"config", current}});
+    ASSERT_EQ(response["status"], "success");
+    std::ifstream saved(configFile);
+    json written = json::parse(saved);
+    EXPECT_EQ(written["server_settings"]["tls"]["tokens"]["scada"], "t0ken-scada");
+    EXPECT_EQ(written["server_settings"]["replication"]["secret"], "repl-k3y");
+    EXPECT_EQ(written["device1"]["connection_parameters"]["primary"]["secret"], "gw-k3y");
+    EXPECT_EQ(written["device2"]["polling_interval_ms"], 200);
+}
+
+TEST_F(ConfigHotReloadTest, ConnectionChangeRecreatesOnlyAffectedDevice) {
+    auto* handler1 = server.getProtocolHandler("device1");
+    auto* handler2 = server.getProtocolHandler("device2");
+    
+    json config = baseConfig();
+    config["device2"]["connection_parameters"]["primary"]["port"] = 1504;
+    server.applyConfigChanges(config);
+    
+    EXPECT_EQ(server.getProtocolHandler("device1"), handler1);
+    EXPECT_NE(server.getProtocolHandler("device2"), handler2);
+}
+
+TEST_F(ConfigHotReloadTest, AddAndRemoveDevices) {
+    json config = baseConfig();
+    config.erase("device1");
+    config["device3"] = makeDevice(1505, json::object());
+    server.applyConfigChanges(config);
+    
+    EXPECT_EQ(server.getProtocolHandler("device1"), nullptr);
+    EXPECT_NE(server.getProtocolHandler("device2"), nullptr);
+    EXPECT_NE(server.getProtocolHandler("device3"), nullptr);
+}
+
+TEST_F(ConfigHotReloadTest, StuckDeviceDoesNotBlockConfigReaders) {
+    // Устройство принимает соединение и не отвечает: опросчик ждет таймаута чтения
+    io_context io;
+    ip::tcp::acceptor device(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    json config = baseConfig();
+    config["device1"]["connection_parameters"]["primary"]["port"] = device.local_endpoint().port();
+    config["device1"]["connection_parameters"]["primary"]["timeout_ms"] = 3000;
+    server.applyConfigChanges(config);
+    auto* stuck = server.getProtocolHandler("device1");
+    server.startPolling();
+    
+    ip::tcp::socket connection(io);
+    device.accept(connection);
+    std::array<uint8_t, 12> request{};
+    read(connection, boost::asio::buffer(request)); // Запрос отправлен, опросчик ждет ответа
+    
+    std::atomic<bool> applied{false};
+    std::thread reload([&]() {
+        server.applyConfigChanges(baseConfig());
+        applied = true;
+    });
+    
+    // Новый обработчик виден и конфигурация читается, пока прежний опросчик еще останавливается
+    while (server.getProtocolHandler("device1") == stuck) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    auto resolved = server.handleJsonRequest({{"action", "resolve"}, {"names", {"Temp"}}});
+    EXPECT_FALSE(applied);
+    EXPECT_EQ(resolved["Temp"], 2001);
+    
+    reload.join();
+    server.stop();
+}
+
+TEST_F(ConfigHotReloadTest, MissingIdsKeepPreviousValues) {
+    json config = baseConfig();
+    config["device1"]["variables"]["temp"].erase("id");
+    server.applyConfigChanges(config);
+    
+    auto idMap = server.handleJsonRequest({{"action", "get_id_map"}});
+    EXPECT_EQ(idMap["2001"], "Temp");
+}
+
+TEST_F(ConfigHotReloadTest, FileChangeDetectedWithoutReloadOfUnchangedFile) {
+    auto* handler1 = server.getProtocolHandler("device1");
+    
+    // Файл не менялся: обработчики остаются прежними
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    server.checkConfigUpdate();
+    EXPECT_EQ(server.getProtocolHandler("device1"), handler1);
+    
+    json config = baseConfig();
+    config["device3"] = makeDevice(1505, json::object());
+    writeConfig(config);
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    server.checkConfigUpdate();
+    EXPECT_EQ(server.getProtocolHandler("device1"), handler1);
+    EXPECT_NE(server.getProtocolHandler("device3"), nullptr);
+}
+
+// Тесты таблицы тегов и кэша базы тегов
+class TagTableTest : public Test {
+protected:
+    std::string configFile = "tag_table_config.json";
+    std::string cacheFile = "tag_table_config.json.tagdb";
+    
+    json makeConfig(int tagCount) {
+        json variables = json::object();
+        for (int i = 1; i <= tagCount; ++i) {
+            variables["var" + std::to_string(i)] = {
+                {"id", 5000 + i},
+                {"name", "Var" + std::to_string(i)},
+                {"address", i},
+                {"type", "uint16"}
+            };
+        }
+        return {
+            {"server_settings", {{"tcp_port", 8090}}},
+            {"modbus_tcp", {
+                {"connection_parameters", {{"primary", {{"host", "127.0.0.1"}, {"port", 1502}}}}},
+                {"variables", variables},
+                {"polling_interval_ms", 100}
+            }}
+        };
+    }
+    
+    void writeConfig(const json& config) {
+        std::ofstream f(configFile);
+        f << config.dump(4);
+    }
+    
+    void TearDown() override {
+        std::remove(configFile.c_str());
+        std::remove(cacheFile.c_str());
+    }
+};
+
+TEST_F(TagTableTest, BuildAndLookup) {
+    TagTable table;
+    table.build({{30, "C", "s", "c"}, {10, "A", "s", "a"}, {20, "B", "s", "b"}}, 30, 1, 1);
+    
+    ASSERT_EQ(table.size(), 3u);
+    EXPECT_EQ(table.record(0).id, 10);
+    ASSERT_NE(table.find(20), nullptr);
+    EXPECT_EQ(table.name(*table.find(20)), "B");
+    EXPECT_EQ(table.key(*table.find(30)), "c");
+    EXPECT_EQ(table.find(25), nullptr);
+}
+
+TEST_F(TagTableTest, IdMapFromSinglePassLoad) {
+    writeConfig(makeConfig(100));
+    DataServer server;
+    server.loadConfig(configFile);
+    
+    auto idMap = server.handleJsonRequest({{"action", "get_id_map"}});
+    EXPECT_EQ(idMap.size(), 100u);
+    EXPECT_EQ(idMap["5042"], "Var42");
+}
+
+TEST_F(TagTableTest, CacheUsedOnNextStart) {
+    writeConfig(makeConfig(100));
+    {
+        DataServer server;
+        server.setTagCacheFile(cacheFile);
+        server.loadConfig(configFile);
+        EXPECT_FALSE(server.loadedFromTagCache());
+    }
+    
+    DataServer server;
+    server.setTagCacheFile(cacheFile);
+    server.loadConfig(configFile);
+    EXPECT_TRUE(server.loadedFromTagCache());
+    
+    auto idMap = server.handleJsonRequest({{"action", "get_id_map"}});
+    EXPECT_EQ(idMap.size(), 100u);
+    auto config = server.handleJsonRequest({{"action", "get_config"}});
+    EXPECT_EQ(config, makeConfig(100));
+}
+
+TEST_F(TagTableTest, CacheInvalidatedByConfigChange) {
+    writeConfig(makeConfig(100));
+    {
+        DataServer server;
+        server.setTagCacheFile(cacheFile);
+        server.loadConfig(configFile);
+    }
     
-    std::ofstream f(tempConfigFile);
-    f << configWithoutIds.dump();
-    f.close();
+    writeConfig(makeConfig(101));
+    DataServer server;
+    server.setTagCacheFile(cacheFile);
+    server.loadConfig(configFile);
+    EXPECT_FALSE(server.loadedFromTagCache());
+    
+    auto idMap = server.handleJsonRequest({{"action", "get_id_map"}});
+    EXPECT_EQ(idMap.size(), 101u);
+}
+
+TEST_F(TagTableTest, GeneratedIdsAreCached) {
+    json config = makeConfig(2);
+    config["modbus_tcp"]["variables"]["var1"].erase("id");
+    writeConfig(config);
+    
+    std::string generatedId;
+    {
+        DataServer server;
+        server.setTagCacheFile(cacheFile);
+        server.loadConfig(configFile);
+        auto idMap = server.handleJsonRequest({{"action", "get_id_map"}});
+        ASSERT_EQ(idMap.size(), 2u);
+        for (auto& [id, name] : idMap.items()) {
+            if (name == "Var1") generatedId = id;
+        }
+    }
     
+    // ID, сгенерированные при первом запуске, восстанавливаются из кэша
     DataServer server;
-    server.loadConfig(tempConfigFile);
-    // После загрузки ID должны быть сгенерированы автоматически
-    SUCCEED();
+    server.setTagCacheFile(cacheFile);
+    server.loadConfig(configFile);
+    EXPECT_TRUE(server.loadedFromTagCache());
+    auto idMap = server.handleJsonRequest({{"action", "get_id_map"}});
+    EXPECT_EQ(idMap[generatedId], "Var1");
+}
+
+TEST_F(TagTableTest, NameIndexLookupsAndIncrementalUpdate) {
+    TagTable oldTable;
+    oldTable.build({{1, "Pump.Flow", "s", "a"}, {2, "Pump.Speed", "s", "b"}, {3, "Tank.Level", "s", "c"},
+                    {4, "Pump.Flow", "t", "d"}}, 4, 1, 1);
+    TagNameIndex index;
+    index.build(oldTable);
+    
+    EXPECT_EQ(index.find("Pump.Flow"), 1);
+    EXPECT_FALSE(index.find("Pump").has_value());
+    auto pumps = index.prefix("Pump.");
+    ASSERT_EQ(pumps.size(), 3u);
+    EXPECT_EQ(pumps[2]->name, "Pump.Speed");
+    EXPECT_EQ(index.prefix("Pump.", 1).size(), 1u);
+    auto speed = index.match("*.S?eed");
+    ASSERT_EQ(speed.size(), 1u);
+    EXPECT_EQ(speed[0]->id, 2);
+    EXPECT_EQ(index.match("Tank.Level").size(), 1u);
+    
+    // Переименование, удаление и новый тег применяются без перестроения индекса
+    TagTable newTable;
+    newTable.build({{1, "Pump.Flow", "s", "a"}, {2, "Pump.Rate", "s", "b"}, {4, "Pump.Flow", "t", "d"},
+                    {5, "Valve.State", "s", "e"}}, 5, 2, 1);
+    index.update(oldTable, newTable);
+    EXPECT_EQ(index.size(), 4u);
+    EXPECT_FALSE(index.find("Pump.Speed").has_value());
+    EXPECT_FALSE(index.find("Tank.Level").has_value());
+    EXPECT_EQ(index.find("Pump.Rate"), 2);
+    EXPECT_EQ(index.find("Valve.State"), 5);
+    
+    TagNameIndex rebuilt;
+    rebuilt.build(newTable);
+    auto updatedOrder = index.prefix("");
+    auto rebuiltOrder = rebuilt.prefix("");
+    ASSERT_EQ(updatedOrder.size(), rebuiltOrder.size());
+    for (size_t i = 0; i < updatedOrder.size(); ++i) {
+        EXPECT_TRUE(*updatedOrder[i] == *rebuiltOrder[i]);
+    }
+}
+
+TEST_F(TagTableTest, ResolveAndValuesByPatternFollowConfigChanges) {
+    const std::string snapshotFile = "test_tagtable.snapshot";
+    {
+        DataCache cache;
+        cache.updateValue(5041, "Var41", 1.0, "good");
+        cache.updateValue(5042, "Var42", 2.0, "good");
+        cache.updateValue(5051, "Var51", 3.0, "good");
+        cache.saveSnapshot(snapshotFile, 1);
+    }
+    json config = makeConfig(100);
+    config["server_settings"]["snapshot"] = {{"file", snapshotFile}};
+    writeConfig(config);
+    DataServer server;
+    server.loadConfig(configFile);
+    server.startPolling();
+    
+    auto resolved = server.handleJsonRequest({{"action", "resolve"}, {"names", {"Var42", "Missing"}}});
+    EXPECT_EQ(resolved["Var42"], 5042);
+    EXPECT_TRUE(resolved["Missing"].is_null());
+    EXPECT_EQ(server.handleJsonRequest({{"action", "resolve"}, {"prefix", "Var9"}}).size(), 11u);
+    EXPECT_EQ(server.handleJsonRequest({{"action", "resolve"}, {"pattern", "Var1?"}, {"limit", 5}}).size(), 5u);
+    EXPECT_EQ(server.handleJsonRequest({{"action", "resolve"}})["status"], "error");
+    
+    auto values = server.handleJsonRequest({{"action", "get_values_by_pattern"}, {"pattern", "Var4?"}});
+    ASSERT_EQ(values.size(), 2u) << values.dump();
+    EXPECT_EQ(values["5042"]["v"], 2.0);
+    EXPECT_EQ(server.handleJsonRequest({{"action", "get_values_by_pattern"}})["status"], "error");
+    
+    // Индекс следует за изменением конфигурации
+    config["modbus_tcp"]["variables"]["var42"]["name"] = "Renamed";
+    config["modbus_tcp"]["variables"].erase("var99");
+    ASSERT_EQ(server.handleJsonRequest({{"action", "update_config"}, {"config", config}})["status"], "success");
+    resolved = server.handleJsonRequest({{"action", "resolve"}, {"names", {"Var42", "Renamed", "Var99"}}});
+    EXPECT_TRUE(resolved["Var42"].is_null());
+    EXPECT_EQ(resolved["Renamed"], 5042);
+    EXPECT_TRUE(resolved["Var99"].is_null());
+    
+    server.stop();
+    std::remove(snapshotFile.c_str());
+}
+
+// Тесты агрегации истории
+class HistoryAggregatorTest : public Test {
+protected:
+    HistorySeries makeSeries(size_t count, int64_t stepMs) {
+        HistorySeries series;
+        for (size_t i = 0; i < count; ++i) {
+            series.timestamps.push_back(1000000 + static_cast<int64_t>(i) * stepMs);
+            series.values.push_back(static_cast<double>(i % 10));
+        }
+        return series;
+    }
+};
+
+TEST_F(HistoryAggregatorTest, BucketAggregates) {
+    auto series = makeSeries(25, 100);
+    auto buckets = HistoryAggregator::aggregate(series, 1000);
+    
+    ASSERT_EQ(buckets.size(), 3u);
+    EXPECT_EQ(buckets.start[0], 1000000);
+    EXPECT_EQ(buckets.count[0], 10u);
+    EXPECT_EQ(buckets.min[0], 0.0);
+    EXPECT_EQ(buckets.max[0], 9.0);
+    EXPECT_DOUBLE_EQ(buckets.avg[0], 4.5);
+    EXPECT_EQ(buckets.first[1], 0.0);
+    EXPECT_EQ(buckets.last[1], 9.0);
+    EXPECT_EQ(buckets.count[2], 5u);
+    EXPECT_DOUBLE_EQ(buckets.avg[2], 2.0);
+    
+    EXPECT_THROW(HistoryAggregator::aggregate(series, 0), std::invalid_argument);
+    
+    // Крайние метки времени и размеры интервалов не переполняют int64_t
+    HistorySeries extremes;
+    extremes.timestamps = {INT64_MIN, -1, 0, INT64_MAX - 1, INT64_MAX};
+    extremes.values = {1.0, 2.0, 3.0, 4.0, 5.0};
+    auto wide = HistoryAggregator::aggregate(extremes, INT64_MAX);
+    ASSERT_EQ(wide.size(), 4u);
+    EXPECT_EQ(wide.start.front(), INT64_MIN);
+    EXPECT_EQ(wide.start.back(), INT64_MAX);
+    EXPECT_EQ(wide.count[2], 2u);
+    EXPECT_TRUE(std::is_sorted(wide.start.begin(), wide.start.end()));
+    
+    auto edge = HistoryAggregator::aggregate(extremes, 1000);
+    ASSERT_EQ(edge.size(), 4u);
+    EXPECT_EQ(edge.count.back(), 2u);
+    EXPECT_DOUBLE_EQ(edge.avg.back(), 4.5);
+}
+
+TEST_F(HistoryAggregatorTest, DownsampleKeepsEndsAndPeaks) {
+    auto series = makeSeries(1000, 10);
+    series.values[500] = 100.0;
+    
+    auto reduced = HistoryAggregator::downsample(series, 50);
+    ASSERT_EQ(reduced.size(), 50u);
+    EXPECT_EQ(reduced.timestamps.front(), series.timestamps.front());
+    EXPECT_EQ(reduced.timestamps.back(), series.timestamps.back());
+    EXPECT_TRUE(std::is_sorted(reduced.timestamps.begin(), reduced.timestamps.end()));
+    EXPECT_NE(std::find(reduced.values.begin(), reduced.values.end(), 100.0), reduced.values.end());
+    
+    EXPECT_EQ(HistoryAggregator::downsample(series, 2000).size(), 1000u);
+    EXPECT_EQ(HistoryAggregator::downsample(series, 2).size(), 2u);
+}
+
+TEST_F(HistoryAggregatorTest, NumericHistorySkipsBadValues) {
+    DataCache cache;
+    cache.updateValue(1, "Var1", 1.5, "good");
+    cache.updateValue(1, "Var1", json(), "bad");
+    cache.updateValue(1, "Var1", true, "good");
+    cache.updateValue(1, "Var1", "text", "good");
+    
+    auto series = cache.getNumericHistory(1);
+    ASSERT_EQ(series.size(), 2u);
+    EXPECT_EQ(series.values[0], 1.5);
+    EXPECT_EQ(series.values[1], 1.0);
+    EXPECT_TRUE(cache.getNumericHistory(1, 0, 1).values.empty());
+}
+
+TEST_F(HistoryAggregatorTest, BatchRequests) {
+    DataServer server;
+    auto response = server.handleJsonRequest({
+        {"action", "aggregate_history"},
+        {"variable_ids", {1, 2}},
+        {"bucket_ms", 60000},
+        {"functions", {"min", "avg"}}
+    });
+    ASSERT_TRUE(response.contains("1"));
+    ASSERT_TRUE(response.contains("2"));
+    EXPECT_TRUE(response["1"]["t"].empty());
+    EXPECT_TRUE(response["1"].contains("avg"));
+    EXPECT_FALSE(response["1"].contains("max"));
+    
+    response = server.handleJsonRequest({{"action", "downsample_history"}, {"variable_id", 1}, {"points", 300}});
+    EXPECT_TRUE(response["1"]["v"].empty());
+    
+    response = server.handleJsonRequest({{"action", "aggregate_history"}, {"variable_ids", {1}}});
+    EXPECT_EQ(response["status"], "error");
+    response = server.handleJsonRequest({{"action", "aggregate_history"}, {"variable_ids", json::array()},
+                                         {"bucket_ms", -1}});
+    EXPECT_EQ(response["status"], "error");
+}
+
+TEST(NetworkBackendTest, StalledClientIsDisconnectedAfterWriteTimeout) {
+    // Конфигурация в несколько мегабайт: ответ GET_CONFIG не помещается в буферы сокетов
+    const std::string configFile = "test_write_timeout_config.json";
+    json config = {{"server_settings", {{"tcp_port", 0}, {"network", {{"write_timeout_ms", 300}}}}}};
+    for (int i = 0; i < 20000; ++i) {
+        config["tags"]["variables"]["v" + std::to_string(i)] = {
+            {"id", i + 1}, {"name", std::string(100, 'x') + std::to_string(i)}
+        };
+    }
+    {
+        std::ofstream f(configFile);
+        f << config.dump();
+    }
+    DataServer server;
+    server.loadConfig(configFile);
+    server.startPolling();
+    std::thread tcp([&server]() { server.startTcpServer(); });
+    for (int i = 0; i < 200 && server.tcpPort() == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_NE(server.tcpPort(), 0);
+    
+    // Клиент не читает ответ: сервер разрывает соединение и освобождает буфер ответа
+    io_context io;
+    ip::tcp::socket client(io);
+    client.open(ip::tcp::v4());
+    client.set_option(socket_base::receive_buffer_size(4096));
+    client.connect(ip::tcp::endpoint(ip::address_v4::loopback(), server.tcpPort()));
+    write(client, boost::asio::buffer(std::string("GET_CONFIG\n")));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    
+    std::string received;
+    boost::system::error_code error;
+    read(client, boost::asio::dynamic_buffer(received), error);
+    EXPECT_EQ(error, boost::asio::error::connection_reset);
+    EXPECT_LT(received.size(), config.dump().size());
+    
+    server.stop();
+    tcp.join();
+    std::remove(configFile.c_str());
+}
+
+// Тесты пакетных запросов
+class BatchRequestTest : public Test {
+protected:
+    const std::string configFile = "test_batch_config.json";
+    const std::string snapshotFile = "test_batch.snapshot";
+    DataServer server;
+    
+    void SetUp() override {
+        // Значения попадают в кэш сервера через снимок теплого старта
+        DataCache cache;
+        cache.updateValue(1, "Pump.Flow", 10.0, "good");
+        cache.updateValue(1, "Pump.Flow", 11.0, "good");
+        cache.updateValue(2, "Pump.Speed", 1500, "good");
+        cache.updateValue(3, "Tank.Level", 2.5, "good");
+        cache.saveSnapshot(snapshotFile, 10);
+        
+        json config = {
+            {"server_settings", {{"snapshot", {{"file", snapshotFile}}}}},
+            {"iec104", {
+                {"connection_parameters", {{"primary", {{"host", "localhost"}, {"port", 2404}}}}},
+                {"variables", {
+                    {"flow", {{"id", 1}, {"name", "Pump.Flow"}}},
+                    {"speed", {{"id", 2}, {"name", "Pump.Speed"}}},
+                    {"level", {{"id", 3}, {"name", "Tank.Level"}}}
+                }}
+            }}
+        };
+        std::ofstream f(configFile);
+        f << config.dump(4);
+        f.close();
+        
+        server.loadConfig(configFile);
+        server.startPolling();
+    }
+    
+    void TearDown() override {
+        server.stop();
+        std::remove(configFile.c_str());
+        std::remove(snapshotFile.c_str());
+    }
+};
+
+TEST_F(BatchRequestTest, GetValuesByIdsAndPatterns) {
+    auto response = server.handleJsonRequest({{"action", "get_values"}, {"variable_ids", {3, 42}}});
+    ASSERT_EQ(response.size(), 1u);
+    EXPECT_EQ(response["3"]["n"], "Tank.Level");
+    EXPECT_EQ(response["3"]["v"], 2.5);
+    
+    response = server.handleJsonRequest({{"action", "get_values"}, {"names", {"Pump.*"}}});
+    ASSERT_EQ(response.size(), 2u);
+    EXPECT_EQ(response["1"]["v"], 11.0);
+    EXPECT_EQ(response["2"]["v"], 1500);
+    
+    response = server.handleJsonRequest({{"action", "get_values"}});
+    EXPECT_EQ(response["status"], "error");
+}
+
+TEST_F(BatchRequestTest, GetHistoryBatch) {
+    auto response = server.handleJsonRequest({
+        {"action", "get_history"}, {"variable_ids", {1, 3}}, {"names", {"Tank.?evel"}}, {"count", 5}
+    });
+    ASSERT_EQ(response.size(), 2u);
+    ASSERT_EQ(response["1"].size(), 2u);
+    EXPECT_EQ(response["1"][0]["v"], 10.0);
+    EXPECT_EQ(response["3"][0]["q"], "good");
+    
+    // Одиночный variable_id сохраняет прежний формат ответа
+    response = server.handleJsonRequest({{"action", "get_history"}, {"variable_id", 1}, {"count", 1}});
+    ASSERT_TRUE(response.is_array());
+    EXPECT_EQ(response.size(), 1u);
+}
+
+TEST_F(BatchRequestTest, ChunkedWriterBoundsChunks) {
+    std::vector<std::string> chunks;
+    JsonChunkWriter writer([&chunks](std::string_view chunk) { chunks.emplace_back(chunk); }, 64);
+    writer.raw("[");
+    for (int i = 0; i < 100; ++i) {
+        if (i > 0) writer.raw(",");
+        writer.raw("{\"s\":").string("line\n\"" + std::to_string(i) + "\"").raw(",\"v\":").value(json{{"x", i}}).raw("}");
+    }
+    writer.raw("]");
+    writer.flush();
+    
+    ASSERT_GT(chunks.size(), 10u);
+    std::string text;
+    for (const auto& chunk : chunks) {
+        EXPECT_LT(chunk.size(), 128u);
+        text += chunk;
+    }
+    auto parsed = json::parse(text);
+    ASSERT_EQ(parsed.size(), 100u);
+    EXPECT_EQ(parsed[99]["s"], "line\n\"99\"");
+    EXPECT_EQ(parsed[99]["v"]["x"], 99);
+}
+
+TEST_F(BatchRequestTest, StreamedTcpResponses) {
+    io_context io;
+    ip::tcp::acceptor acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    
+    auto query = [&](const std::string& request) {
+        ip::tcp::socket client(io);
+        client.connect(acceptor.local_endpoint());
+        write(client, boost::asio::buffer(request));
+        ip::tcp::socket serverSide(io);
+        acceptor.accept(serverSide);
+        server.handleTcpClient(std::move(serverSide));
+        
+        boost::asio::streambuf response;
+        read_until(client, response, '\n');
+        std::istream is(&response);
+        std::string line;
+        std::getline(is, line);
+        return json::parse(line);
+    };
+    
+    auto all = query("GET_ALL\n");
+    ASSERT_EQ(all.size(), 3u);
+    EXPECT_EQ(all["2"]["n"], "Pump.Speed");
+    
+    auto history = query("GET_HISTORY 1 10\n");
+    ASSERT_EQ(history.size(), 2u);
+    EXPECT_EQ(history[1]["v"], 11.0);
+    
+    auto config = query("{\"action\": \"get_config\"}\n");
+    EXPECT_TRUE(config.contains("iec104"));
+}
+
+TEST_F(BatchRequestTest, TextCommandParsing) {
+    TextCommand command;
+    size_t before = threadAllocations;
+    
+    ASSERT_TRUE(TextCommand::parse("GET_HISTORY 4611686018427387904 25", command));
+    EXPECT_EQ(command.type, TextCommand::Type::GetHistory);
+    EXPECT_EQ(command.variableId, 4611686018427387904LL);
+    EXPECT_EQ(command.count, 25u);
+    EXPECT_EQ(command.error, nullptr);
+    
+    ASSERT_TRUE(TextCommand::parse("SUBSCRIBE abc", command));
+    EXPECT_NE(command.error, nullptr);
+    ASSERT_TRUE(TextCommand::parse("SAVE_CONFIG backup.json", command));
+    EXPECT_EQ(command.argument, "backup.json");
+    EXPECT_FALSE(TextCommand::parse("GET_HISTORY 1", command));
+    EXPECT_FALSE(TextCommand::parse("{\"action\": \"get_all\"}", command));
+    
+    EXPECT_EQ(threadAllocations - before, 0u);
+}
+
+TEST_F(BatchRequestTest, TextRequestsWithoutAllocations) {
+    io_context io;
+    ip::tcp::acceptor acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    const std::string request = "GET_HISTORY 1 10\n";
+    char response[4096];
+    
+    // Первые запросы прогревают пулы буферов; далее выделений памяти нет
+    size_t allocations = 0;
+    for (int i = 0; i < 5; ++i) {
+        ip::tcp::socket client(io);
+        client.connect(acceptor.local_endpoint());
+        write(client, boost::asio::buffer(request));
+        ip::tcp::socket serverSide(io);
+        acceptor.accept(serverSide);
+        
+        size_t before = threadAllocations;
+        server.handleTcpClient(std::move(serverSide));
+        allocations = threadAllocations - before;
+        
+        size_t length = read(client, boost::asio::buffer(response), transfer_at_least(1));
+        ASSERT_EQ(json::parse(std::string(response, length)).size(), 2u);
+    }
+    EXPECT_EQ(allocations, 0u);
+}
+
+TEST_F(BatchRequestTest, IdleConnectionsDoNotHoldBuffers) {
+    io_context io;
+    ip::tcp::acceptor acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    
+    // Клиентов без запроса больше, чем арен в пуле: их потоки ждут строку запроса
+    std::vector<ip::tcp::socket> idle;
+    std::vector<std::thread> handlers;
+    auto serve = [&]() {
+        ip::tcp::socket serverSide(io);
+        acceptor.accept(serverSide);
+        handlers.emplace_back([this, socket = std::move(serverSide)]() mutable {
+            server.handleTcpClient(std::move(socket));
+        });
+    };
+    for (int i = 0; i < 150; ++i) {
+        idle.emplace_back(io);
+        idle.back().connect(acceptor.local_endpoint());
+        serve();
+    }
+    
+    ip::tcp::socket client(io);
+    client.connect(acceptor.local_endpoint());
+    write(client, boost::asio::buffer(std::string("GET_ALL\n")));
+    serve();
+    boost::asio::streambuf response;
+    read_until(client, response, '\n');
+    std::istream is(&response);
+    std::string line;
+    std::getline(is, line);
+    EXPECT_EQ(json::parse(line).size(), 3u);
+    
+    for (auto& socket : idle) socket.close();
+    for (auto& handler : handlers) handler.join();
+}
+
+TEST_F(BatchRequestTest, WebSocketSubscribe) {
+    namespace websocket = boost::beast::websocket;
+    io_context io;
+    ip::tcp::acceptor acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    
+    websocket::stream<ip::tcp::socket> ws(io);
+    ws.next_layer().connect(acceptor.local_endpoint());
+    ip::tcp::socket serverSide(io);
+    acceptor.accept(serverSide);
+    std::thread serverThread([this, sock = std::move(serverSide)]() mutable {
+        server.handleTcpClient(std::move(sock));
+    });
+    
+    websocket::permessage_deflate deflate;
+    deflate.client_enable = true;
+    ws.set_option(deflate);
+    ws.handshake("localhost", "/");
+    
+    auto readFrame = [&ws]() {
+        boost::beast::flat_buffer buffer;
+        ws.read(buffer);
+        return json::parse(boost::beast::buffers_to_string(buffer.data()));
+    };
+    
+    ws.write(boost::asio::buffer(std::string(R"({"action": "subscribe", "names": ["Pump.*"]})")));
+    auto subscribed = readFrame();
+    EXPECT_EQ(subscribed["type"], "subscribed");
+    EXPECT_EQ(subscribed["variable_ids"].size(), 2u);
+    auto snapshot = readFrame();
+    EXPECT_EQ(snapshot["type"], "snapshot");
+    EXPECT_EQ(snapshot["values"]["1"]["v"], 11.0);
+    
+    ws.write(boost::asio::buffer(std::string(R"({"action": "get_values", "variable_ids": [3]})")));
+    auto response = readFrame();
+    EXPECT_EQ(response["type"], "response");
+    EXPECT_EQ(response["data"]["3"]["n"], "Tank.Level");
+    
+    // Нестроковое action - кадр с ошибкой, сессия продолжает работать
+    ws.write(boost::asio::buffer(std::string(R"({"action": 5})")));
+    auto error = readFrame();
+    EXPECT_EQ(error["type"], "error");
+    ws.write(boost::asio::buffer(std::string(R"({"action": "get_values", "variable_ids": [3]})")));
+    EXPECT_EQ(readFrame()["type"], "response");
+    
+    ws.close(websocket::close_code::normal);
+    serverThread.join();
+}
+
+TEST_F(BatchRequestTest, WebSocketOverIpv6) {
+    namespace websocket = boost::beast::websocket;
+    io_context io;
+    ip::tcp::acceptor acceptor(io);
+    boost::system::error_code ec;
+    acceptor.open(ip::tcp::v6(), ec);
+    if (!ec) acceptor.bind(ip::tcp::endpoint(ip::address_v6::loopback(), 0), ec);
+    if (ec) GTEST_SKIP() << "IPv6 loopback is not available";
+    acceptor.listen();
+    
+    websocket::stream<ip::tcp::socket> ws(io);
+    ws.next_layer().connect(acceptor.local_endpoint());
+    ip::tcp::socket serverSide(io);
+    acceptor.accept(serverSide);
+    std::thread serverThread([this, sock = std::move(serverSide)]() mutable {
+        server.handleTcpClient(std::move(sock));
+    });
+    
+    ws.handshake("localhost", "/");
+    ws.write(boost::asio::buffer(std::string(R"({"action": "get_values", "variable_ids": [3]})")));
+    boost::beast::flat_buffer buffer;
+    ws.read(buffer);
+    EXPECT_EQ(json::parse(boost::beast::buffers_to_string(buffer.data()))["data"]["3"]["n"], "Tank.Level");
+    
+    ws.close(websocket::close_code::normal);
+    serverThread.join();
+}
+
+TEST_F(BatchRequestTest, SubscriptionPollAndResync) {
+    DataCache cache;
+    cache.updateValue(1, "Var1", 1.0, "good");
+    UpdateRing ring(4);
+    Subscription subscription(ring, cache);
+    subscription.add(1);
+    
+    std::vector<int64_t> received;
+    auto visitor = [&received](const ValueUpdate& update, const std::string& name) {
+        EXPECT_EQ(name, "Var1");
+        received.push_back(update.id);
+    };
+    
+    EXPECT_EQ(subscription.poll(visitor), Subscription::PollResult::Idle);
+    ring.publish(ValueUpdate::fromJson(1, 2.0, 0));
+    ring.publish(ValueUpdate::fromJson(2, 3.0, 0));
+    EXPECT_EQ(subscription.poll(visitor), Subscription::PollResult::Updates);
+    EXPECT_EQ(received, std::vector<int64_t>{1});
+    
+    for (int i = 0; i < 10; ++i) ring.publish(ValueUpdate::fromJson(1, i, 0));
+    EXPECT_EQ(subscription.poll(visitor), Subscription::PollResult::Resync);
+    EXPECT_EQ(subscription.poll(visitor), Subscription::PollResult::Idle);
+}
+
+TEST_F(BatchRequestTest, BufferPoolIsBounded) {
+    BufferPool pool(1024, 2);
+    EXPECT_EQ(pool.available(), 2u);
+    
+    auto first = std::make_unique<BufferPool::Lease>(pool.acquire());
+    auto second = pool.acquire();
+    EXPECT_EQ(pool.available(), 0u);
+    EXPECT_EQ(second.size(), 1024u);
+    EXPECT_THROW(pool.acquire(std::chrono::milliseconds(20)), std::runtime_error);
+    
+    // Третий буфер выдается только после возврата одного из занятых
+    std::atomic<bool> acquired{false};
+    std::thread waiter([&]() {
+        auto third = pool.acquire();
+        acquired = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(acquired);
+    
+    first.reset();
+    waiter.join();
+    EXPECT_TRUE(acquired);
+    EXPECT_EQ(pool.available(), 1u);
+}
+
+// Тесты кольца рассылки обновлений
+class UpdateRingTest : public Test {
+protected:
+    UpdateRing ring{8};
+    
+    ValueUpdate makeUpdate(int64_t id, double value) {
+        return ValueUpdate::fromJson(id, value, 1000 + id);
+    }
+};
+
+TEST_F(UpdateRingTest, PublishAndRead) {
+    uint64_t cursor = ring.head();
+    ValueUpdate update;
+    EXPECT_EQ(ring.read(cursor, update), UpdateRing::ReadStatus::Empty);
+    
+    ring.publish(makeUpdate(1, 2.5));
+    ring.publish(ValueUpdate::fromJson(2, "text", 0));
+    
+    ASSERT_EQ(ring.read(cursor, update), UpdateRing::ReadStatus::Ready);
+    EXPECT_EQ(update.id, 1);
+    EXPECT_EQ(update.timestampMs, 1001);
+    EXPECT_EQ(update.toJson(), 2.5);
+    
+    ASSERT_EQ(ring.read(cursor + 1, update), UpdateRing::ReadStatus::Ready);
+    EXPECT_EQ(update.kind, ValueUpdate::Kind::Other);
+    EXPECT_EQ(ring.payload(update), nullptr);
+    EXPECT_EQ(ring.read(cursor + 2, update), UpdateRing::ReadStatus::Empty);
+}
+
+TEST_F(UpdateRingTest, StringValuesTravelWithUpdates) {
+    // Подписчик получает каждое опубликованное строковое значение, а не текущее из кэша
+    DataCache cache;
+    cache.setUpdateRing(&ring);
+    Subscription subscription(ring, cache);
+    subscription.add(3);
+    cache.updateValue(3, "State", "starting", "good");
+    cache.updateValue(3, "State", "running", "good");
+    cache.updateValue(3, "State", json{{"mode", "auto"}}, "good");
+    
+    std::vector<json> values;
+    subscription.poll([&](const ValueUpdate& update, const std::string&) {
+        values.push_back(subscription.value(update));
+    });
+    ASSERT_EQ(values.size(), 3u);
+    EXPECT_EQ(values[0], "starting");
+    EXPECT_EQ(values[1], "running");
+    EXPECT_EQ(values[2]["mode"], "auto");
+    
+    // Значение, перезаписанное в кольце значений, заменяется текущим
+    ValueUpdate update;
+    const uint64_t stale = ring.head() - 1;
+    ASSERT_EQ(ring.read(stale, update), UpdateRing::ReadStatus::Ready);
+    for (int i = 0; i < 8; ++i) cache.updateValue(4, "Other", "x" + std::to_string(i), "good");
+    EXPECT_EQ(ring.payload(update), nullptr);
+    EXPECT_EQ(subscription.value(update)["mode"], "auto");
+    cache.setUpdateRing(nullptr);
+}
+
+TEST_F(UpdateRingTest, LaggingReaderDetected) {
+    uint64_t cursor = ring.head();
+    for (int i = 0; i < 9; ++i) {
+        ring.publish(makeUpdate(i, i));
+    }
+    
+    ValueUpdate update;
+    EXPECT_EQ(ring.read(cursor, update), UpdateRing::ReadStatus::Lagged);
+    ASSERT_EQ(ring.read(cursor + 1, update), UpdateRing::ReadStatus::Ready);
+    EXPECT_EQ(update.id, 1);
+}
+
+TEST_F(UpdateRingTest, ConcurrentProducers) {
+    UpdateRing bigRing(1 << 16);
+    const int producers = 4;
+    const int perProducer = 10000;
+    
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&bigRing, p]() {
+            for (int i = 0; i < perProducer; ++i) {
+                bigRing.publish(ValueUpdate::fromJson(p, static_cast<int64_t>(i), i));
+            }
+        });
+    }
+    
+    // Читатель видит обновления каждого производителя по порядку и без потерь
+    std::vector<int64_t> expected(producers, 0);
+    uint64_t cursor = 0;
+    while (cursor < static_cast<uint64_t>(producers * perProducer)) {
+        ValueUpdate update;
+        auto status = bigRing.read(cursor, update);
+        ASSERT_NE(status, UpdateRing::ReadStatus::Lagged);
+        if (status == UpdateRing::ReadStatus::Empty) {
+            bigRing.waitFor(cursor, std::chrono::milliseconds(10));
+            continue;
+        }
+        auto& next = expected[static_cast<size_t>(update.id)];
+        EXPECT_EQ(update.toJson(), next);
+        EXPECT_EQ(update.timestampMs, next);
+        ++next;
+        ++cursor;
+    }
+    for (auto& t : threads) t.join();
+}
+
+TEST_F(UpdateRingTest, SubscriberReceivesUpdates) {
+    io_context io;
+    DataCache cache;
+    cache.updateValue(7, "Flow", 1.0, "good");
+    SubscriptionManager manager(cache);
+    
+    ip::tcp::acceptor acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), 0));
+    ip::tcp::socket client(io);
+    client.connect(acceptor.local_endpoint());
+    ip::tcp::socket serverSide(io);
+    acceptor.accept(serverSide);
+    manager.addSubscriber(7, std::move(serverSide));
+    EXPECT_EQ(manager.subscriberCount(), 1u);
+    
+    manager.notifySubscribers(8, 5.0);
+    manager.notifySubscribers(7, 2.0);
+    
+    boost::asio::streambuf buffer;
+    read_until(client, buffer, '\n');
+    std::istream is(&buffer);
+    std::string line;
+    std::getline(is, line);
+    auto message = json::parse(line);
+    EXPECT_EQ(message["i"], 7);
+    EXPECT_EQ(message["n"], "Flow");
+    EXPECT_EQ(message["v"], 2.0);
+    EXPECT_EQ(message["type"], "data_update");
+}
+
+// Тесты репликации
+class ReplicationTest : public Test {
+protected:
+    const std::string primaryConfig = "test_primary_config.json";
+    const std::string standbyConfig = "test_standby_config.json";
+    const std::string snapshotFile = "test_primary.snapshot";
+    
+    // Ожидание условия, выполняемого другим потоком
+    template <typename Predicate>
+    bool eventually(Predicate predicate, std::chrono::milliseconds timeout = std::chrono::milliseconds(3000)) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!predicate()) {
+            if (std::chrono::steady_clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return true;
+    }
+    
+    void writeConfig(const std::string& filename, const json& replication, const std::string& snapshot = "") {
+        json settings = {{"replication", replication}};
+        if (!snapshot.empty()) settings["snapshot"] = {{"file", snapshot}};
+        json config = {
+            {"server_settings", settings},
+            {"iec104", {
+                {"connection_parameters", {{"primary", {{"host", "localhost"}, {"port", 2404}}}}},
+                {"variables", {
+                    {"flow", {{"id", 1}, {"name", "Pump.Flow"}}},
+                    {"mode", {{"id", 2}, {"name", "Pump.Mode"}}}
+                }}
+            }}
+        };
+        std::ofstream f(filename);
+        f << config.dump(4);
+    }
+    
+    void TearDown() override {
+        std::remove(primaryConfig.c_str());
+        std::remove(standbyConfig.c_str());
+        std::remove(snapshotFile.c_str());
+    }
+};
+
+TEST_F(ReplicationTest, PublisherStreamsToReceiver) {
+    DataCache primary;
+    SubscriptionManager manager(primary);
+    primary.updateValue(1, "Pump.Flow", 10.0, "good");
+    primary.updateValue(2, "Pump.Mode", "auto", "good");
+    
+    ReplicationPublisher publisher(primary, manager, 0, std::chrono::milliseconds(50));
+    publisher.start();
+    
+    DataCache standby;
+    ReplicationReceiver receiver(standby, "127.0.0.1", publisher.port(), std::chrono::milliseconds(1000), nullptr);
+    receiver.start();
+    
+    // Полная синхронизация передает значения вместе с именами
+    ASSERT_TRUE(eventually([&]() { return receiver.primaryAlive(); }));
+    EXPECT_EQ(standby.getCurrentValue(1), 10.0);
+    EXPECT_EQ(standby.getCurrentValue(2), "auto");
+    EXPECT_EQ(standby.getNameById(1), "Pump.Flow");
+    EXPECT_EQ(publisher.peerCount(), 1u);
+    
+    // Поток обновлений сохраняет время и качество основного сервера
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    primary.updateValue(1, "Pump.Flow", json(), "bad");
+    primary.updateValue(2, "Pump.Mode", json::array({"manual", 3}), "good");
+    ASSERT_TRUE(eventually([&]() { return standby.getCurrentValue(2).is_array(); }));
+    
+    auto flow = standby.getHistory(1, 1);
+    ASSERT_EQ(flow.size(), 1u);
+    EXPECT_TRUE(flow[0].value.is_null());
+    EXPECT_EQ(flow[0].quality, "bad");
+    EXPECT_EQ(std::chrono::duration_cast<std::chrono::milliseconds>(flow[0].timestamp.time_since_epoch()),
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  primary.getHistory(1, 1)[0].timestamp.time_since_epoch()));
+    EXPECT_EQ(standby.getCurrentValue(2), json::array({"manual", 3}));
+    EXPECT_EQ(standby.getHistory(2, 10).size(), 2u);
+    
+    receiver.stop();
+    publisher.stop();
+}
+
+TEST_F(ReplicationTest, FramesUseNetworkByteOrder) {
+    DataCache primary;
+    SubscriptionManager manager(primary);
+    ReplicationPublisher publisher(primary, manager, 0, std::chrono::milliseconds(50));
+    publisher.start();
+    
+    // Приветствие получателя: [тип][длина 24][версия 4][эпоха 0][позиция 0][пустой ключ],
+    // все поля big-endian
+    io_context io;
+    ip::tcp::socket socket(io);
+    socket.connect(ip::tcp::endpoint(ip::address_v4::loopback(), publisher.port()));
+    std::string hello = {'\x01', 0, 0, 0, 24, 0, 0, 0, 4};
+    hello.append(20, '\0');
+    write(socket, boost::asio::buffer(hello));
+    
+    unsigned char reply[9];
+    read(socket, boost::asio::buffer(reply));
+    EXPECT_EQ(reply[0], 1);
+    EXPECT_EQ(std::vector<int>(reply + 1, reply + 9), (std::vector<int>{0, 0, 0, 12, 0, 0, 0, 4}));
+    
+    socket.close();
+    publisher.stop();
+}
+
+TEST_F(ReplicationTest, PublisherRequiresSecretAndTimelyHello) {
+    DataCache primary;
+    SubscriptionManager manager(primary);
+    primary.updateValue(1, "Pump.Flow", 10.0, "good");
+    ReplicationPublisher publisher(primary, manager, 0, std::chrono::milliseconds(50), "127.0.0.1", "k3y",
+                                   std::chrono::milliseconds(200));
+    publisher.start();
+    
+    // Соединение без приветствия закрывается по истечении срока
+    io_context io;
+    ip::tcp::socket silent(io);
+    silent.connect(ip::tcp::endpoint(ip::address_v4::loopback(), publisher.port()));
+    auto start = std::chrono::steady_clock::now();
+    char byte;
+    boost::system::error_code error;
+    silent.read_some(boost::asio::buffer(&byte, 1), error);
+    EXPECT_TRUE(error);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(3));
+    
+    // Получатель с неверным ключом не получает значений
+    DataCache rejected;
+    ReplicationReceiver wrong(rejected, "127.0.0.1", publisher.port(), std::chrono::milliseconds(1000), nullptr, "other");
+    wrong.start();
+    DataCache standby;
+    ReplicationReceiver receiver(standby, "127.0.0.1", publisher.port(), std::chrono::milliseconds(1000), nullptr, "k3y");
+    receiver.start();
+    ASSERT_TRUE(eventually([&]() { return receiver.primaryAlive(); }));
+    EXPECT_EQ(standby.getCurrentValue(1), 10.0);
+    EXPECT_FALSE(wrong.primaryAlive());
+    EXPECT_FALSE(rejected.idExists(1));
+    
+    wrong.stop();
+    receiver.stop();
+    publisher.stop();
+}
+
+TEST_F(ReplicationTest, StandbyFailsOverAndBack) {
+    {
+        DataCache cache;
+        cache.updateValue(1, "Pump.Flow", 42.0, "good");
+        cache.saveSnapshot(snapshotFile, 10);
+    }
+    writeConfig(primaryConfig, {{"role", "primary"}, {"port", 0}, {"heartbeat_ms", 50}}, snapshotFile);
+    auto primary = std::make_unique<DataServer>();
+    primary->loadConfig(primaryConfig);
+    primary->startPolling();
+    const unsigned short port = primary->replicationPort();
+    ASSERT_NE(port, 0);
+    EXPECT_TRUE(primary->isPolling());
+    
+    writeConfig(standbyConfig, {
+        {"role", "standby"},
+        {"failover_timeout_ms", 300},
+        {"primary", {{"host", "127.0.0.1"}, {"port", port}}}
+    });
+    DataServer standby;
+    standby.loadConfig(standbyConfig);
+    standby.startPolling();
+    
+    // Резервный сервер отдает клиентам значения основного и не опрашивает устройства
+    ASSERT_TRUE(eventually([&]() {
+        return standby.handleJsonRequest({{"action", "get_all"}}).contains("1");
+    }));
+    EXPECT_EQ(standby.handleJsonRequest({{"action", "get_all"}})["1"]["v"], 42.0);
+    EXPECT_FALSE(standby.isPolling());
+    
+    // Основной сервер остановлен: резервный переходит на собственный опрос
+    primary->stop();
+    primary.reset();
+    EXPECT_TRUE(eventually([&]() { return standby.isPolling(); }));
+    
+    // Основной сервер вернулся на тот же порт: после синхронизации опрос на резервном прекращается
+    DataCache restored;
+    SubscriptionManager manager(restored);
+    restored.updateValue(1, "Pump.Flow", 43.0, "good");
+    ReplicationPublisher publisher(restored, manager, port, std::chrono::milliseconds(50));
+    publisher.start();
+    EXPECT_TRUE(eventually([&]() { return !standby.isPolling(); }));
+    EXPECT_EQ(standby.handleJsonRequest({{"action", "get_all"}})["1"]["v"], 43.0);
+    
+    standby.stop();
+    publisher.stop();
+}
+
+TEST_F(ReplicationTest, StandbyResynchronizesAfterTakeoverFromSamePrimary) {
+    // Основной сервер не перезапускается (эпоха та же), но молчит дольше таймаута отказа
+    DataCache primary;
+    SubscriptionManager manager(primary);
+    primary.updateValue(1, "Pump.Flow", 1.0, "good");
+    ReplicationPublisher publisher(primary, manager, 0, std::chrono::milliseconds(5000));
+    publisher.start();
+    
+    writeConfig(standbyConfig, {
+        {"role", "standby"},
+        {"failover_timeout_ms", 300},
+        {"primary", {{"host", "127.0.0.1"}, {"port", publisher.port()}}}
+    });
+    DataServer standby;
+    standby.loadConfig(standbyConfig);
+    standby.startPolling();
+    ASSERT_TRUE(eventually([&]() {
+        return standby.handleJsonRequest({{"action", "get_all"}}).contains("1");
+    }));
+    ASSERT_TRUE(eventually([&]() { return standby.isPolling(); }));
+    
+    // Связь восстановлена: полная синхронизация, опрос на резервном прекращается
+    std::atomic<bool> updating{true};
+    std::thread writer([&]() {
+        for (int i = 2; updating; ++i) {
+            primary.updateValue(1, "Pump.Flow", static_cast<double>(i), "good");
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    });
+    EXPECT_TRUE(eventually([&]() { return !standby.isPolling(); }));
+    updating = false;
+    writer.join();
+    EXPECT_TRUE(eventually([&]() {
+        return standby.handleJsonRequest({{"action", "get_all"}})["1"]["v"] == primary.getCurrentValue(1);
+    }));
+    
+    standby.stop();
+    publisher.stop();
+}
+
+TEST_F(ReplicationTest, GatewayIngestsRemappedAndResumes) {
+    DataCache site;
+    SubscriptionManager manager(site);
+    site.updateValue(1, "Pump.Flow", 10.0, "good");
+    site.updateValue(2, "Pump.Mode", "auto", "good");
+    site.updateValue(3, "Tank.Level", 1.5, "good");
+    ReplicationPublisher publisher(site, manager, 0, std::chrono::milliseconds(50));
+    publisher.start();
+    
+    DataCache central;
+    DataServerHandler handler(central, "site_a", {{"id_offset", 1000}, {"name_prefix", "SiteA."}});
+    handler.setConnectionParameters({{"primary", {{"host", "127.0.0.1"}, {"port", publisher.port()}}}});
+    const json variables = {
+        {"flow", {{"id", 501}, {"name", "Central.Flow"}, {"remote_id", 1}}},
+        {"mode", {{"id", 502}, {"name", "Central.Mode"}, {"remote_name", "Pump.Mode"}}}
+    };
+    
+    ASSERT_TRUE(eventually([&]() {
+        handler.readData(variables);
+        return central.idExists(1003);
+    }));
+    EXPECT_EQ(central.getCurrentValue(501), 10.0);
+    EXPECT_EQ(central.getNameById(501), "Central.Flow");
+    EXPECT_EQ(central.getCurrentValue(502), "auto");
+    EXPECT_EQ(central.getNameById(1003), "SiteA.Tank.Level");
+    EXPECT_FALSE(central.idExists(1));
+    EXPECT_EQ(handler.fullSyncCount(), 1u);
+    
+    // Обновления во время разрыва передаются после переподключения без полной синхронизации
+    ASSERT_TRUE(eventually([&]() {
+        handler.readData(variables);
+        return handler.resumePosition() > 0;
+    }));
+    handler.disconnect();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    site.updateValue(1, "Pump.Flow", 11.0, "good");
+    site.updateValue(3, "Tank.Level", 1.75, "good");
+    
+    ASSERT_TRUE(eventually([&]() {
+        handler.readData(variables);
+        return central.getCurrentValue(1003) == 1.75;
+    }));
+    EXPECT_EQ(central.getCurrentValue(501), 11.0);
+    EXPECT_EQ(central.getNameById(1003), "SiteA.Tank.Level");
+    EXPECT_EQ(handler.fullSyncCount(), 1u);
+    
+    handler.disconnect();
+    publisher.stop();
+}
+
+TEST_F(ReplicationTest, GatewayImportSkipsTakenAndOverflowingIds) {
+    DataCache site;
+    SubscriptionManager manager(site);
+    site.updateValue(1, "Pump.Flow", 10.0, "good");
+    site.updateValue(2, "Pump.Mode", "auto", "good");
+    site.updateValue(3, "Tank.Level", 1.5, "good");
+    site.updateValue(4, "Tank.Temp", 20.0, "good");
+    site.updateValue(std::numeric_limits<int64_t>::max() - 10, "Far.Tag", 7.0, "good");
+    ReplicationPublisher publisher(site, manager, 0, std::chrono::milliseconds(50));
+    publisher.start();
+    
+    // Локальная переменная 1002 и сопоставленная 1003 заняты: 2 + 1000 и 3 + 1000 не импортируются
+    DataCache central;
+    central.updateValue(1002, "Local.Valve", 1.0, "good");
+    DataServerHandler handler(central, "site_a", {{"id_offset", 1000}, {"name_prefix", "SiteA."}});
+    handler.setConnectionParameters({{"primary", {{"host", "127.0.0.1"}, {"port", publisher.port()}}}});
+    const json variables = {{"flow", {{"id", 1003}, {"name", "Central.Flow"}, {"remote_id", 1}}}};
+    
+    ASSERT_TRUE(eventually([&]() {
+        handler.readData(variables);
+        return central.idExists(1004);
+    }));
+    EXPECT_EQ(central.getCurrentValue(1003), 10.0);
+    EXPECT_EQ(central.getNameById(1003), "Central.Flow");
+    EXPECT_EQ(central.getCurrentValue(1002), 1.0);
+    EXPECT_EQ(central.getNameById(1002), "Local.Valve");
+    EXPECT_EQ(central.getNameById(1004), "SiteA.Tank.Temp");
+    EXPECT_EQ(central.getIds().size(), 3u);
+    
+    // Пересозданная связь продолжает импорт в собственные переменные
+    handler.disconnect();
+    DataServerHandler recreated(central, "site_a", {{"id_offset", 1000}, {"name_prefix", "SiteA."}});
+    recreated.setConnectionParameters({{"primary", {{"host", "127.0.0.1"}, {"port", publisher.port()}}}});
+    site.updateValue(4, "Tank.Temp", 21.0, "good");
+    ASSERT_TRUE(eventually([&]() {
+        recreated.readData(variables);
+        return central.getCurrentValue(1004) == 21.0;
+    }));
+    
+    recreated.disconnect();
+    publisher.stop();
+}
+
+TEST_F(ReplicationTest, PolledGatewayKeepsMappingAcrossLanes) {
+    DataCache site;
+    SubscriptionManager manager(site);
+    site.updateValue(1, "Pump.Flow", 10.0, "good");
+    site.updateValue(2, "Pump.Mode", "auto", "good");
+    ReplicationPublisher publisher(site, manager, 0, std::chrono::milliseconds(50));
+    publisher.start();
+    
+    // Классы обслуживания и части массовой полосы не дробят список переменных шлюза
+    DataCache central;
+    auto link = std::make_unique<DataServerHandler>(central, "site_a");
+    link->setConnectionParameters({{"primary", {{"host", "127.0.0.1"}, {"port", publisher.port()}}}});
+    DataServerHandler* handler = link.get();
+    DevicePoller poller(std::move(link), {
+        {"flow", {{"id", 501}, {"name", "Central.Flow"}, {"remote_id", 1}, {"priority", "critical"}}},
+        {"mode", {{"id", 502}, {"name", "Central.Mode"}, {"remote_id", 2}, {"priority", "bulk"}}}
+    }, 10, json::object(), {{"bulk_chunk", 1}});
+    poller.start();
+    
+    ASSERT_TRUE(eventually([&]() { return central.idExists(501) && central.idExists(502); }));
+    site.updateValue(1, "Pump.Flow", 11.0, "good");
+    ASSERT_TRUE(eventually([&]() { return central.getCurrentValue(501) == 11.0; }));
+    EXPECT_EQ(handler->fullSyncCount(), 1u);
+    
+    poller.stop();
+    publisher.stop();
 }
 
 // Тесты производительности
@@ -0,0 +1,703 @@
+// Генератор нагрузки для data_server: симуляторы Modbus TCP устройств,
+// клиенты-подписчики и клиенты-опросчики, работающие на localhost.
+//
+// Пример:
+//   data-server-loadgen --server ./data-server --devices 200 --registers 50
+//       --subscribers 20 --subs-per-client 25 --pollers 4 --duration 60 --json result.json
+
+#include <boost/asio.hpp>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+using namespace boost::asio;
+
+namespace {
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Параметры запуска
+struct Options {
+    std::string serverBinary;
+    std::string workDir = "loadgen_work";
+    unsigned short serverPort = 18080;
+    unsigned short basePort = 15020;
+    int devices = 100;
+    int registers = 50;
+    int serverPollingMs = 100;
+    int changeRateHz = 10;
+    int subscribers = 10;
+    int subsPerClient = 20;
+    int pollers = 2;
+    int pollerIntervalMs = 1000;
+    int durationSec = 30;
+    int ioThreads = 2;
+    std::string jsonOut;
+    bool noSpawn = false;
+    pid_t serverPid = 0;
+};
+
+void printUsage() {
+    std::cout <<
+        "Usage: data-server-loadgen [options]\n"
+        "  --server <path>           data-server binary to spawn\n"
+        "  --no-spawn                use an already running server (needs --port)\n"
+        "  --server-pid <pid>        server pid for CPU/memory sampling with --no-spawn\n"
+        "  --work-dir <dir>          directory for generated config.json\n"
+        "  --port <n>                server TCP port (default 18080)\n"
+        "  --base-port <n>           first simulated device port (default 15020)\n"
+        "  --devices <n>             simulated Modbus devices (default 100)\n"
+        "  --registers <n>           registers per device (default 50)\n"
+        "  --server-polling-ms <n>   polling_interval_ms in generated config (default 100)\n"
+        "  --change-rate <n>         register changes per device per second (default 10)\n"
+        "  --subscribers <n>         subscriber clients (default 10)\n"
+        "  --subs-per-client <n>     variables per subscriber client (default 20)\n"
+        "  --pollers <n>             GET_ALL poller clients (default 2)\n"
+        "  --poller-interval-ms <n>  delay between GET_ALL requests (default 1000)\n"
+        "  --duration <sec>          measurement duration (default 30)\n"
+        "  --io-threads <n>          client/simulator I/O threads (default 2)\n"
+        "  --json <file>             write machine-readable report\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--server") opts.serverBinary = next();
+        else if (arg == "--no-spawn") opts.noSpawn = true;
+        else if (arg == "--server-pid") opts.serverPid = static_cast<pid_t>(std::stoi(next()));
+        else if (arg == "--work-dir") opts.workDir = next();
+        else if (arg == "--port") opts.serverPort = static_cast<unsigned short>(std::stoi(next()));
+        else if (arg == "--base-port") opts.basePort = static_cast<unsigned short>(std::stoi(next()));
+        else if (arg == "--devices") opts.devices = std::stoi(next());
+        else if (arg == "--registers") opts.registers = std::stoi(next());
+        else if (arg == "--server-polling-ms") opts.serverPollingMs = std::stoi(next());
+        else if (arg == "--change-rate") opts.changeRateHz = std::stoi(next());
+        else if (arg == "--subscribers") opts.subscribers = std::stoi(next());
+        else if (arg == "--subs-per-client") opts.subsPerClient = std::stoi(next());
+        else if (arg == "--pollers") opts.pollers = std::stoi(next());
+        else if (arg == "--poller-interval-ms") opts.pollerIntervalMs = std::stoi(next());
+        else if (arg == "--duration") opts.durationSec = std::stoi(next());
+        else if (arg == "--io-threads") opts.ioThreads = std::stoi(next());
+        else if (arg == "--json") opts.jsonOut = next();
+        else if (arg == "--help" || arg == "-h") return false;
+        else throw std::runtime_error("Unknown option: " + arg);
+    }
+    if (opts.serverBinary.empty() && !opts.noSpawn) {
+        throw std::runtime_error("Either --server or --no-spawn is required");
+    }
+    return true;
+}
+
+// Статистика задержек в микросекундах
+class LatencyRecorder {
+private:
+    std::mutex mutex;
+    std::vector<int64_t> samples;
+
+public:
+    void record(int64_t us) {
+        std::lock_guard<std::mutex> lock(mutex);
+        samples.push_back(us);
+    }
+
+    json summary() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (samples.empty()) return {{"count", 0}};
+        std::sort(samples.begin(), samples.end());
+        auto pct = [this](double p) {
+            return samples[std::min(samples.size() - 1,
+                static_cast<size_t>(p * static_cast<double>(samples.size())))];
+        };
+        int64_t sum = 0;
+        for (auto v : samples) sum += v;
+        return {
+            {"count", samples.size()},
+            {"avg_us", sum / static_cast<int64_t>(samples.size())},
+            {"p50_us", pct(0.50)},
+            {"p90_us", pct(0.90)},
+            {"p99_us", pct(0.99)},
+            {"max_us", samples.back()}
+        };
+    }
+};
+
+// Симулятор Modbus TCP устройства (holding/input регистры, coils/discrete inputs)
+class DeviceSimulator {
+public:
+    std::vector<std::atomic<uint16_t>> registers;
+    std::vector<std::atomic<int64_t>> changedAtNs;
+    std::atomic<uint64_t> registersServed{0};
+
+private:
+    ip::tcp::acceptor acceptor;
+
+    struct Session : std::enable_shared_from_this<Session> {
+        ip::tcp::socket socket;
+        DeviceSimulator& device;
+        uint8_t header[7];
+        std::vector<uint8_t> pdu;
+        std::vector<uint8_t> response;
+
+        Session(ip::tcp::socket s, DeviceSimulator& d) : socket(std::move(s)), device(d) {}
+
+        void readHeader() {
+            auto self = shared_from_this();
+            async_read(socket, buffer(header), [self](const boost::system::error_code& ec, size_t) {
+                if (ec) return;
+                size_t length = static_cast<size_t>((self->header[4] << 8) | self->header[5]);
+                if (length < 2 || length > 254) return;
+                self->pdu.resize(length - 1);
+                self->readPdu();
+            });
+        }
+
+        void readPdu() {
+            auto self = shared_from_this();
+            async_read(socket, buffer(pdu), [self](const boost::system::error_code& ec, size_t) {
+                if (ec) return;
+                self->handle();
+            });
+        }
+
+        void handle() {
+            std::vector<uint8_t> reply;
+            uint8_t function = pdu.empty() ? 0 : pdu[0];
+            uint16_t address = pdu.size() >= 5 ? static_cast<uint16_t>((pdu[1] << 8) | pdu[2]) : 0;
+            uint16_t count = pdu.size() >= 5 ? static_cast<uint16_t>((pdu[3] << 8) | pdu[4]) : 0;
+            size_t end = static_cast<size_t>(address) + count;
+
+            if (function < 1 || function > 4) {
+                reply = {static_cast<uint8_t>(function | 0x80), 0x01};
+            } else if (count == 0 || end > device.registers.size()) {
+                reply = {static_cast<uint8_t>(function | 0x80), 0x02};
+            } else if (function <= 2) {
+                reply = {function, static_cast<uint8_t>((count + 7) / 8)};
+                reply.resize(2 + (count + 7) / 8u, 0);
+                for (uint16_t i = 0; i < count; ++i) {
+                    if (device.registers[address + i].load(std::memory_order_acquire) & 1) {
+                        reply[2 + i / 8] = static_cast<uint8_t>(reply[2 + i / 8] | (1 << (i % 8)));
+                    }
+                }
+                device.registersServed += count;
+            } else {
+                reply = {function, static_cast<uint8_t>(count * 2)};
+                for (uint16_t i = 0; i < count; ++i) {
+                    uint16_t v = device.registers[address + i].load(std::memory_order_acquire);
+                    reply.push_back(static_cast<uint8_t>(v >> 8));
+                    reply.push_back(static_cast<uint8_t>(v & 0xFF));
+                }
+                device.registersServed += count;
+            }
+
+            auto length = static_cast<uint16_t>(reply.size() + 1);
+            response.assign({header[0], header[1], 0, 0,
+                             static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length & 0xFF),
+                             header[6]});
+            response.insert(response.end(), reply.begin(), reply.end());
+
+            auto self = shared_from_this();
+            async_write(socket, buffer(response), [self](const boost::system::error_code& ec, size_t) {
+                if (!ec) self->readHeader();
+            });
+        }
+    };
+
+    void doAccept() {
+        acceptor.async_accept([this](const boost::system::error_code& ec, ip::tcp::socket socket) {
+            if (!ec) {
+                boost::system::error_code ignored;
+                socket.set_option(ip::tcp::no_delay(true), ignored);
+                std::make_shared<Session>(std::move(socket), *this)->readHeader();
+            }
+            if (acceptor.is_open()) doAccept();
+        });
+    }
+
+public:
+    DeviceSimulator(io_context& io, unsigned short port, int registerCount)
+        : registers(static_cast<size_t>(registerCount)),
+          changedAtNs(static_cast<size_t>(registerCount)),
+          acceptor(io, ip::tcp::endpoint(ip::address_v4::loopback(), port)) {
+        for (auto& r : registers) r = 0;
+        for (auto& t : changedAtNs) t = 0;
+        doAccept();
+    }
+
+    void stop() {
+        boost::system::error_code ignored;
+        acceptor.close(ignored);
+    }
+
+    // Изменение регистра: сначала метка времени, затем значение
+    void change(size_t index) {
+        changedAtNs[index].store(nowNs(), std::memory_order_relaxed);
+        uint16_t next = static_cast<uint16_t>(registers[index].load(std::memory_order_relaxed) + 1);
+        registers[index].store(next, std::memory_order_release);
+    }
+};
+
+// Общее состояние клиентов
+struct ClientStats {
+    std::atomic<uint64_t> updatesReceived{0};
+    std::atomic<uint64_t> activeSubscriptions{0};
+    std::atomic<uint64_t> subscribeRetries{0};
+    std::atomic<uint64_t> getAllRequests{0};
+    std::atomic<uint64_t> getAllBytes{0};
+    std::atomic<uint64_t> getAllErrors{0};
+    LatencyRecorder updateLatency;
+    LatencyRecorder getAllLatency;
+};
+
+// Соединение подписчика на одну переменную (протокол SUBSCRIBE <id>)
+class SubscriberConnection : public std::enable_shared_from_this<SubscriberConnection> {
+private:
+    io_context& io;
+    ip::tcp::endpoint server;
+    ip::tcp::socket socket;
+    steady_timer retryTimer;
+    streambuf input;
+    std::string request;
+    int64_t variableId;
+    DeviceSimulator& device;
+    size_t registerIndex;
+    ClientStats& stats;
+    std::atomic<bool>& running;
+    int64_t lastValue = -1;
+    bool subscribed = false;
+
+public:
+    SubscriberConnection(io_context& ctx, ip::tcp::endpoint ep, int64_t id, DeviceSimulator& dev,
+                         size_t reg, ClientStats& st, std::atomic<bool>& run)
+        : io(ctx), server(ep), socket(ctx), retryTimer(ctx), variableId(id),
+          device(dev), registerIndex(reg), stats(st), running(run) {}
+
+    void start() {
+        auto self = shared_from_this();
+        socket = ip::tcp::socket(io);
+        socket.async_connect(server, [self](const boost::system::error_code& ec) {
+            if (ec) return self->retry();
+            self->request = "SUBSCRIBE " + std::to_string(self->variableId) + "\n";
+            async_write(self->socket, buffer(self->request),
+                [self](const boost::system::error_code& wec, size_t) {
+                    if (wec) return self->retry();
+                    self->readLine();
+                });
+        });
+    }
+
+    void stop() {
+        auto self = shared_from_this();
+        post(io, [self]() {
+            boost::system::error_code ignored;
+            self->retryTimer.cancel();
+            self->socket.close(ignored);
+        });
+    }
+
+private:
+    void retry() {
+        if (subscribed) {
+            subscribed = false;
+            --stats.activeSubscriptions;
+        }
+        if (!running) return;
+        ++stats.subscribeRetries;
+        boost::system::error_code ignored;
+        socket.close(ignored);
+        input.consume(input.size());
+        auto self = shared_from_this();
+        retryTimer.expires_after(std::chrono::milliseconds(500));
+        retryTimer.async_wait([self](const boost::system::error_code& ec) {
+            if (!ec && self->running) self->start();
+        });
+    }
+
+    void readLine() {
+        auto self = shared_from_this();
+        async_read_until(socket, input, '\n', [self](const boost::system::error_code& ec, size_t n) {
+            if (ec) return self->retry();
+            std::string line(buffers_begin(self->input.data()),
+                             buffers_begin(self->input.data()) + static_cast<std::ptrdiff_t>(n));
+            self->input.consume(n);
+            self->handleLine(line);
+            self->readLine();
+        });
+    }
+
+    void handleLine(const std::string& line) {
+        int64_t receivedAt = nowNs();
+        json message = json::parse(line, nullptr, false);
+        if (message.is_discarded() || message.contains("error")) {
+            // Переменная еще не опрошена сервером: сервер закроет соединение, повторим
+            return;
+        }
+        if (!subscribed) {
+            subscribed = true;
+            ++stats.activeSubscriptions;
+        }
+        ++stats.updatesReceived;
+
+        if (!message.contains("v") || !message["v"].is_number_integer()) return;
+        int64_t value = message["v"].get<int64_t>();
+        if (value == lastValue) return;
+
+        // Задержка считается от изменения регистра в симуляторе до получения подписчиком
+        bool firstValue = (lastValue < 0);
+        lastValue = value;
+        if (firstValue) return;
+        uint16_t current = device.registers[registerIndex].load(std::memory_order_acquire);
+        if (current == static_cast<uint16_t>(value)) {
+            int64_t changedAt = device.changedAtNs[registerIndex].load(std::memory_order_relaxed);
+            if (changedAt > 0 && receivedAt >= changedAt) {
+                stats.updateLatency.record((receivedAt - changedAt) / 1000);
+            }
+        }
+    }
+};
+
+// Клиент-опросчик: периодические запросы GET_ALL
+void runPoller(ip::tcp::endpoint server, int intervalMs, ClientStats& stats, std::atomic<bool>& running) {
+    io_context io;
+    while (running) {
+        try {
+            int64_t start = nowNs();
+            ip::tcp::socket socket(io);
+            socket.connect(server);
+            write(socket, buffer(std::string("GET_ALL\n")));
+            streambuf response;
+            size_t n = read_until(socket, response, '\n');
+            stats.getAllLatency.record((nowNs() - start) / 1000);
+            stats.getAllBytes += n;
+            ++stats.getAllRequests;
+        } catch (const std::exception&) {
+            ++stats.getAllErrors;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+}
+
+// Потребление ресурсов процессом сервера через /proc
+struct ProcessSample {
+    double cpuSeconds = 0;
+    int64_t rssKb = 0;
+};
+
+bool sampleProcess(pid_t pid, ProcessSample& sample) {
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string content;
+    if (!stat.is_open() || !std::getline(stat, content)) return false;
+
+    // Поля после имени процесса (в скобках), utime и stime - 14-е и 15-е поля
+    auto pos = content.rfind(')');
+    if (pos == std::string::npos) return false;
+    std::istringstream fields(content.substr(pos + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for (int i = 3; i <= 15 && fields >> field; ++i) {
+        if (i == 14) utime = std::stoull(field);
+        if (i == 15) stime = std::stoull(field);
+    }
+    sample.cpuSeconds = static_cast<double>(utime + stime) / static_cast<double>(sysconf(_SC_CLK_TCK));
+
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) {
+            sample.rssKb = std::stoll(line.substr(6));
+            break;
+        }
+    }
+    return true;
+}
+
+// Конфигурация сервера: одна секция modbus_tcp на каждое устройство
+json buildServerConfig(const Options& opts) {
+    json config = {
+        {"server_settings", {
+            {"tcp_port", opts.serverPort},
+            {"log_level", "WARNING"},
+            {"max_history_size", 100}
+        }}
+    };
+    for (int d = 0; d < opts.devices; ++d) {
+        json variables = json::object();
+        for (int r = 0; r < opts.registers; ++r) {
+            int64_t id = 1 + static_cast<int64_t>(d) * opts.registers + r;
+            variables["reg" + std::to_string(r)] = {
+                {"id", id},
+                {"name", "dev" + std::to_string(d) + ".reg" + std::to_string(r)},
+                {"address", r},
+                {"type", "uint16"}
+            };
+        }
+        config["modbus_tcp_dev" + std::to_string(d)] = {
+            {"protocol", "modbus_tcp"},
+            {"connection_parameters", {
+                {"primary", {
+                    {"host", "127.0.0.1"},
+                    {"port", opts.basePort + d},
+                    {"unit_id", 1},
+                    {"timeout_ms", 1000}
+                }}
+            }},
+            {"variables", variables},
+            {"polling_interval_ms", opts.serverPollingMs}
+        };
+    }
+    return config;
+}
+
+pid_t spawnServer(const Options& opts) {
+    std::string binary = opts.serverBinary;
+    if (binary[0] != '/') {
+        char cwd[4096];
+        if (getcwd(cwd, sizeof(cwd))) binary = std::string(cwd) + "/" + binary;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (chdir(opts.workDir.c_str()) != 0) _exit(127);
+        execl(binary.c_str(), binary.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    return pid;
+}
+
+void stopServer(pid_t pid) {
+    kill(pid, SIGTERM);
+    for (int i = 0; i < 30; ++i) {
+        if (waitpid(pid, nullptr, WNOHANG) == pid) return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+bool waitForServer(ip::tcp::endpoint server, int timeoutSec) {
+    io_context io;
+    for (int i = 0; i < timeoutSec * 10; ++i) {
+        ip::tcp::socket socket(io);
+        boost::system::error_code ec;
+        socket.connect(server, ec);
+        if (!ec) {
+            // Пустой запрос GET_CONFIG не изменяет состояние сервера
+            write(socket, buffer(std::string("GET_CONFIG\n")), ec);
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    try {
+        if (!parseOptions(argc, argv, opts)) {
+            printUsage();
+            return 0;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        printUsage();
+        return 1;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    const size_t totalRegisters = static_cast<size_t>(opts.devices) * static_cast<size_t>(opts.registers);
+
+    // Симуляторы устройств
+    io_context simIo;
+    std::vector<std::unique_ptr<DeviceSimulator>> devices;
+    try {
+        for (int d = 0; d < opts.devices; ++d) {
+            devices.push_back(std::make_unique<DeviceSimulator>(
+                simIo, static_cast<unsigned short>(opts.basePort + d), opts.registers));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Cannot start device simulators: " << e.what() << "\n";
+        return 1;
+    }
+    auto simWork = make_work_guard(simIo);
+    std::vector<std::thread> simThreads;
+    for (int i = 0; i < opts.ioThreads; ++i) {
+        simThreads.emplace_back([&simIo]() { simIo.run(); });
+    }
+    std::cout << "Started " << opts.devices << " Modbus TCP simulators on ports "
+              << opts.basePort << "-" << (opts.basePort + opts.devices - 1)
+              << " (" << totalRegisters << " registers)\n";
+
+    // Конфигурация и запуск сервера
+    pid_t serverPid = opts.serverPid;
+    if (!opts.noSpawn) {
+        mkdir(opts.workDir.c_str(), 0755);
+        std::ofstream f(opts.workDir + "/config.json");
+        f << buildServerConfig(opts).dump(4);
+        f.close();
+        serverPid = spawnServer(opts);
+        std::cout << "Spawned data server (pid " << serverPid << ") in " << opts.workDir << "\n";
+    }
+
+    ip::tcp::endpoint serverEndpoint(ip::address_v4::loopback(), opts.serverPort);
+    if (!waitForServer(serverEndpoint, 30)) {
+        std::cerr << "Data server did not open port " << opts.serverPort << "\n";
+        if (!opts.noSpawn) stopServer(serverPid);
+        return 1;
+    }
+
+    std::atomic<bool> running{true};
+    ClientStats stats;
+
+    // Изменение регистров с заданной частотой
+    std::thread mutator([&]() {
+        auto period = std::chrono::microseconds(1000000 / std::max(1, opts.changeRateHz));
+        auto next = std::chrono::steady_clock::now();
+        size_t cursor = 0;
+        while (running) {
+            for (auto& device : devices) {
+                device->change(cursor % device->registers.size());
+            }
+            ++cursor;
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+    });
+
+    // Клиенты-подписчики
+    io_context clientIo;
+    auto clientWork = make_work_guard(clientIo);
+    std::vector<std::shared_ptr<SubscriberConnection>> subscriptions;
+    for (int c = 0; c < opts.subscribers; ++c) {
+        for (int k = 0; k < opts.subsPerClient; ++k) {
+            size_t index = (static_cast<size_t>(c) * static_cast<size_t>(opts.subsPerClient) + static_cast<size_t>(k)) % totalRegisters;
+            size_t device = index / static_cast<size_t>(opts.registers);
+            size_t reg = index % static_cast<size_t>(opts.registers);
+            auto conn = std::make_shared<SubscriberConnection>(
+                clientIo, serverEndpoint, static_cast<int64_t>(index) + 1,
+                *devices[device], reg, stats, running);
+            subscriptions.push_back(conn);
+            conn->start();
+        }
+    }
+    std::vector<std::thread> clientThreads;
+    for (int i = 0; i < opts.ioThreads; ++i) {
+        clientThreads.emplace_back([&clientIo]() { clientIo.run(); });
+    }
+
+    // Клиенты-опросчики
+    std::vector<std::thread> pollers;
+    for (int p = 0; p < opts.pollers; ++p) {
+        pollers.emplace_back(runPoller, serverEndpoint, opts.pollerIntervalMs,
+                             std::ref(stats), std::ref(running));
+    }
+
+    // Измерение
+    ProcessSample firstSample, lastSample;
+    bool haveServer = serverPid > 0 && sampleProcess(serverPid, firstSample);
+    int64_t maxRssKb = firstSample.rssKb;
+    uint64_t servedStart = 0;
+    for (auto& d : devices) servedStart += d->registersServed;
+    uint64_t updatesStart = stats.updatesReceived;
+    auto measureStart = std::chrono::steady_clock::now();
+
+    for (int sec = 1; sec <= opts.durationSec; ++sec) {
+        std::this_thread::sleep_until(measureStart + std::chrono::seconds(sec));
+        uint64_t served = 0;
+        for (auto& d : devices) served += d->registersServed;
+        ProcessSample sample;
+        if (haveServer && sampleProcess(serverPid, sample)) {
+            lastSample = sample;
+            maxRssKb = std::max(maxRssKb, sample.rssKb);
+        }
+        std::cout << "[" << std::setw(4) << sec << "s] ingest "
+                  << (served - servedStart) / static_cast<uint64_t>(sec) << " reads/s, updates "
+                  << (stats.updatesReceived - updatesStart) / static_cast<uint64_t>(sec) << " msg/s, subscriptions "
+                  << stats.activeSubscriptions << "/" << subscriptions.size();
+        if (haveServer) {
+            std::cout << ", cpu " << std::fixed << std::setprecision(1)
+                      << 100.0 * (lastSample.cpuSeconds - firstSample.cpuSeconds) / sec
+                      << "%, rss " << lastSample.rssKb / 1024 << " MB";
+        }
+        std::cout << std::endl;
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - measureStart).count();
+    uint64_t servedEnd = 0;
+    for (auto& d : devices) servedEnd += d->registersServed;
+
+    running = false;
+    mutator.join();
+    for (auto& t : pollers) t.join();
+    for (auto& conn : subscriptions) conn->stop();
+    clientWork.reset();
+    for (auto& t : clientThreads) t.join();
+
+    if (!opts.noSpawn) stopServer(serverPid);
+    for (auto& d : devices) post(simIo, [&d]() { d->stop(); });
+    simWork.reset();
+    simIo.stop();
+    for (auto& t : simThreads) t.join();
+
+    // Отчет
+    json report = {
+        {"parameters", {
+            {"devices", opts.devices},
+            {"registers_per_device", opts.registers},
+            {"server_polling_ms", opts.serverPollingMs},
+            {"change_rate_hz", opts.changeRateHz},
+            {"subscribers", opts.subscribers},
+            {"subs_per_client", opts.subsPerClient},
+            {"pollers", opts.pollers},
+            {"duration_sec", elapsed}
+        }},
+        {"ingest_reads_per_sec", static_cast<double>(servedEnd - servedStart) / elapsed},
+        {"subscriber_updates_per_sec", static_cast<double>(stats.updatesReceived - updatesStart) / elapsed},
+        {"subscribe_retries", stats.subscribeRetries.load()},
+        {"update_latency", stats.updateLatency.summary()},
+        {"get_all", {
+            {"requests", stats.getAllRequests.load()},
+            {"errors", stats.getAllErrors.load()},
+            {"bytes", stats.getAllBytes.load()},
+            {"latency", stats.getAllLatency.summary()}
+        }}
+    };
+    if (haveServer) {
+        report["server"] = {
+            {"cpu_percent", 100.0 * (lastSample.cpuSeconds - firstSample.cpuSeconds) / elapsed},
+            {"rss_kb_last", lastSample.rssKb},
+            {"rss_kb_max", maxRssKb}
+        };
+    }
+
+    std::cout << report.dump(4) << std::endl;
+    if (!opts.jsonOut.empty()) {
+        std::ofstream out(opts.jsonOut);
+        out << report.dump(4) << "\n";
+    }
+    return 0;
+}